@@ -0,0 +1,633 @@
+#include "AssetCooker.h"
+#include "Hash.h"
+#include "MemoryTracker.h"
+#include "SceneFile.h"
+#include "StartupProfiler.h"
+#include "tinyObjLoader.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+
+using namespace ExecuteIndirect;
+
+// An OBJ file and the materials of its MTL file, as tinyobj loaded them
+struct AssetCooker::ParsedFile
+{
+	std::string FileName;
+	tinyobj_opt::attrib_t Attributes;
+	std::vector<tinyobj_opt::shape_t> Shapes;
+	std::vector<tinyobj_opt::material_t> Materials;
+	bool Parsed = false;
+	TrackedMemory Memory{ Memory_Parser };		// the parsed arrays, until the render items are built
+};
+
+static double ElapsedMilliseconds(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/// <summary>
+/// Helper function - lower case path with forward slashes, so different spellings of the same file match
+/// </summary>
+static std::string NormalizePath(const std::string& path)
+{
+	std::string normalized(path);
+	for (auto& c : normalized)
+		c = (c == '\\') ? '/' : (char)tolower((unsigned char)c);
+	return normalized;
+}
+
+/// <summary>
+/// Helper function - reads a whole file
+/// </summary>
+/// <returns>False if the file can't be read</returns>
+static bool ReadFile(const std::string& fileName, std::vector<char>& data)
+{
+	std::ifstream stream(fileName, std::ios::binary | std::ios::ate);
+	if (!stream.is_open())
+		return false;
+	data.resize((size_t)stream.tellg());
+	stream.seekg(0);
+	stream.read(data.data(), data.size());
+	CountReadBytes(data.size());
+	return !stream.fail();
+}
+
+/// <summary>
+/// Helper function - the normal of a triangle, like CalculateNormal in the renderer
+/// </summary>
+static void CalculateNormal(const ScenePosition& p1, const ScenePosition& p2, const ScenePosition& p3, float normal[3])
+{
+	float v1[3] = { p2.x - p1.x, p2.y - p1.y, p2.z - p1.z };
+	float v2[3] = { p3.x - p1.x, p3.y - p1.y, p3.z - p1.z };
+	normal[0] = v1[1] * v2[2] - v1[2] * v2[1];
+	normal[1] = v1[2] * v2[0] - v1[0] * v2[2];
+	normal[2] = v1[0] * v2[1] - v1[1] * v2[0];
+	float length = sqrtf(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]);
+	if (length > 0.0f) {
+		normal[0] /= length;
+		normal[1] /= length;
+		normal[2] /= length;
+	}
+}
+
+/// <summary>
+/// Helper function - the tangent of a triangle, like CalculateTangent in the renderer
+/// </summary>
+static void CalculateTangent(const ScenePosition& p1, const ScenePosition& p2, const ScenePosition& p3,
+	const float* uv1, const float* uv2, const float* uv3, float tangent[3])
+{
+	float v1[3] = { p2.x - p1.x, p2.y - p1.y, p2.z - p1.z };
+	float v2[3] = { p3.x - p1.x, p3.y - p1.y, p3.z - p1.z };
+	float tu[2] = { uv2[0] - uv1[0], uv3[0] - uv1[0] };
+	float tv[2] = { uv2[1] - uv1[1], uv3[1] - uv1[1] };
+	float den = 1.0f / (tu[0] * tv[1] - tu[1] * tv[0]);
+	for (int a = 0; a < 3; a++)
+		tangent[a] = (tv[1] * v1[a] - tv[0] * v2[a]) * den;
+	float length = sqrtf(tangent[0] * tangent[0] + tangent[1] * tangent[1] + tangent[2] * tangent[2]);
+	//XMVector3Normalize returns zero for degenerate vectors
+	for (int a = 0; a < 3; a++)
+		tangent[a] = (length > 0.0f && std::isfinite(length)) ? tangent[a] / length : 0.0f;
+}
+
+AssetCooker::AssetCooker(const CookerOptions& options) : m_options(options), m_pool(options.ThreadCount)
+{
+}
+
+/// <summary>
+/// Reads the list of OBJ files - one path per line, empty lines and lines starting with '#' are skipped.
+/// The paths are relative to the working directory, like the ones the renderer imports.
+/// </summary>
+/// <param name="fileName">The manifest file.</param>
+/// <param name="objFiles">The OBJ files.</param>
+/// <returns>False if the manifest can't be read</returns>
+bool AssetCooker::ReadManifest(const char* fileName, std::vector<std::string>& objFiles)
+{
+	std::ifstream stream(fileName);
+	if (!stream.is_open())
+		return false;
+	std::string line;
+	while (std::getline(stream, line)) {
+		size_t first = line.find_first_not_of(" \t\r");
+		if (first == std::string::npos || line[first] == '#')
+			continue;
+		size_t last = line.find_last_not_of(" \t\r");
+		objFiles.push_back(line.substr(first, last - first + 1));
+	}
+	return true;
+}
+
+/// <summary>
+/// Imports the OBJ files and writes scene.bin and materials.bin in the output directory. The files are parsed and
+/// the render items are built in parallel, the materials are merged in the order of the files, so the result
+/// doesn't depend on the thread count.
+/// </summary>
+/// <param name="objFiles">The OBJ files.</param>
+/// <returns>False if a file can't be read or written</returns>
+bool AssetCooker::Cook(const std::vector<std::string>& objFiles)
+{
+	auto start = std::chrono::steady_clock::now();
+	m_stats.FileCount = objFiles.size();
+
+	//parse the files on the workers, tinyobj splits a file between threads too, so a single file still uses the pool's width
+	auto phase = std::chrono::steady_clock::now();
+	ProfileScope parseScope("Parse");
+	auto profileScope = StartupProfiler::GetCurrentScope();
+	std::vector<std::unique_ptr<ParsedFile>> files(objFiles.size());
+	std::vector<std::future<void>> parses;
+	int threadsPerFile = (int)std::max<size_t>(1, m_pool.GetThreadCount() / std::max<size_t>(1, objFiles.size()));
+	for (size_t i = 0; i < objFiles.size(); i++) {
+		files[i] = std::make_unique<ParsedFile>();
+		files[i]->FileName = objFiles[i];
+		ParsedFile* file = files[i].get();
+		parses.push_back(m_pool.Submit([file, threadsPerFile, profileScope]() {
+			ProfileScope scope("Parse OBJ file", profileScope);
+			std::vector<char> data;
+			if (!ReadFile(file->FileName, data))
+				return;
+			TrackedMemory fileData(Memory_Parser, data.capacity());
+			//tinyobj ignores the last byte, so a file ending with a single line break would lose its last line
+			data.push_back('\n');
+			tinyobj_opt::LoadOption option;
+			option.req_num_threads = threadsPerFile;
+			option.verbose = false;
+			file->Parsed = tinyobj_opt::parseObj(&file->Attributes, &file->Shapes, &file->Materials, data.data(), data.size(), option);
+			const tinyobj_opt::attrib_t& attributes = file->Attributes;
+			file->Memory.Resize((attributes.vertices.capacity() + attributes.normals.capacity() + attributes.texcoords.capacity()) * sizeof(float) +
+				attributes.indices.capacity() * sizeof(tinyobj_opt::index_t) + (attributes.face_num_verts.capacity() + attributes.material_ids.capacity()) * sizeof(int) +
+				file->Shapes.capacity() * sizeof(tinyobj_opt::shape_t));
+		}));
+	}
+	for (auto& parse : parses)
+		parse.get();
+	m_stats.ParseTime = ElapsedMilliseconds(phase);
+	parseScope.End();
+	for (auto& file : files) {
+		if (!file->Parsed) {
+			std::cerr << "Failed to parse " << file->FileName << std::endl;
+			return false;
+		}
+	}
+
+	//the material buffer indices depend on the order, so the materials are merged on this thread
+	phase = std::chrono::steady_clock::now();
+	ProfileScope materialScope("Materials");
+	for (auto& file : files)
+		LoadMaterials(*file);
+	m_stats.MaterialTime = ElapsedMilliseconds(phase);
+	materialScope.End();
+
+	//every shape is an independent task, the render items are inserted in file order, so later shapes replace earlier ones with the same name
+	phase = std::chrono::steady_clock::now();
+	ProfileScope geometryScope("Geometry");
+	profileScope = StartupProfiler::GetCurrentScope();
+	std::vector<std::vector<size_t>> faceIndexOffsets(files.size());
+	std::vector<std::vector<std::future<std::unique_ptr<CookedItem>>>> builds(files.size());
+	for (size_t f = 0; f < files.size(); f++) {
+		const ParsedFile* file = files[f].get();
+		std::vector<size_t>& offsets = faceIndexOffsets[f];
+		offsets.resize(file->Attributes.face_num_verts.size() + 1, 0);
+		for (size_t face = 0; face < file->Attributes.face_num_verts.size(); face++)
+			offsets[face + 1] = offsets[face] + file->Attributes.face_num_verts[face];
+		for (size_t s = 0; s < file->Shapes.size(); s++)
+			builds[f].push_back(m_pool.Submit([this, file, s, &offsets, profileScope]() {
+				ProfileScope scope("Build render item", profileScope);
+				return BuildRenderItem(*file, s, offsets);
+			}));
+	}
+	for (size_t f = 0; f < files.size(); f++) {
+		for (size_t s = 0; s < builds[f].size(); s++) {
+			std::unique_ptr<CookedItem> item = builds[f][s].get();
+			const CookedMesh& mesh = item->Mesh;
+			MemoryTracker::Get().SetOwnerName(item.get(), files[f]->Shapes[s].name);
+			MemoryTracker::Get().Set(Memory_Geometry, mesh.Positions.capacity() * sizeof(ScenePosition) +
+				mesh.Attributes.capacity() * sizeof(SceneVertexAttributes) + mesh.Indices.capacity() * sizeof(uint32_t), item.get());
+			m_renderItems[files[f]->Shapes[s].name] = std::move(item);
+		}
+	}
+	for (auto& item : m_renderItems) {
+		m_stats.ImportedVertices += item.second->ImportedVertices;
+		m_stats.CacheMissesBefore += item.second->CacheMissesBefore;
+		m_stats.CacheMissesAfter += item.second->CacheMissesAfter;
+		m_stats.CookedVertices += item.second->Mesh.Positions.size();
+		m_stats.Triangles += item.second->Mesh.Indices.size() / 3;
+	}
+	m_stats.GeometryTime = ElapsedMilliseconds(phase);
+	geometryScope.End();
+	files.clear();
+
+	std::string directory = m_options.OutputDirectory;
+	if (!directory.empty() && directory.back() != '/' && directory.back() != '\\')
+		directory += '/';
+	phase = std::chrono::steady_clock::now();
+	ProfileScope writeScope("Write scene");
+	bool written = WriteScene(directory + "scene.bin");
+	m_stats.SceneWriteTime = ElapsedMilliseconds(phase);
+	writeScope.End();
+	phase = std::chrono::steady_clock::now();
+	ProfileScope materialWriteScope("Write materials");
+	written = WriteMaterials(directory + "materials.bin") && written;
+	m_stats.MaterialWriteTime = ElapsedMilliseconds(phase);
+	materialWriteScope.End();
+
+	m_stats.RenderItemCount = m_renderItems.size();
+	m_stats.MaterialCount = m_materials.size();
+	m_stats.DiffuseMapCount = m_diffuseMaps.size();
+	m_stats.NormalMapCount = m_normalMaps.size();
+	m_stats.TotalTime = ElapsedMilliseconds(start);
+	return written;
+}
+
+/// <summary>
+/// Creates the materials and textures of a file like OBJLoader::LoadMaterials - the textures are named after
+/// the diffuse texture, materials with identical data share an entry in the material buffer.
+/// </summary>
+void AssetCooker::LoadMaterials(const ParsedFile& file)
+{
+	std::string difuseName, difuseFileName, normalName, normalFileName;
+	for (size_t i = 0; i < file.Materials.size(); i++) {
+		const tinyobj_opt::material_t& from = file.Materials[i];
+		auto mat = std::make_unique<CookedMaterial>();
+		mat->Name = m_stringPool.Intern(from.name);
+		//change the name to find .dds extention file
+		difuseName = from.diffuse_texname;
+		difuseFileName = from.diffuse_texname;
+		int t = difuseName.rfind('.');
+		int sl = difuseName.rfind('/');
+		difuseName = difuseName.substr(sl + 1, t - sl - 1);
+		difuseFileName = difuseFileName.substr(0, t);
+		difuseFileName.append(".dds");
+		//most MTL files don't contain normal maps so use the diffuse name, and append postfix _NORM
+		if (from.normal_texname.empty()) {
+			normalName = from.diffuse_texname;
+			normalFileName = from.diffuse_texname;
+			t = normalName.rfind('.');
+			sl = normalName.rfind('/');
+			normalName = normalName.substr(sl + 1, t - sl - 1);
+			normalFileName = normalFileName.substr(0, t);
+			normalFileName.append("_NORM.dds");
+		}
+		else {
+			normalName = from.normal_texname;
+			normalFileName = from.normal_texname;
+		}
+
+		MaterialFileData& data = mat->Data;
+		memset(&data, 0, sizeof(MaterialFileData));
+		data.DiffuseMapIndex = RegisterTexture(m_diffuseMaps, m_diffuseMapDedup, difuseName, difuseFileName, m_diffuseCounter);
+		data.NormalMapIndex = RegisterTexture(m_normalMaps, m_normalMapDedup, normalName, normalFileName, m_normalCounter);
+		const float albedo[4] = { 0.9f, 0.9f, 0.9f, 1.0f };
+		memcpy(data.DiffuseAlbedo, albedo, sizeof(albedo));
+		data.FresnelR0[0] = data.FresnelR0[1] = data.FresnelR0[2] = 0.5f;
+		data.Roughness = 0.5f;
+		for (int d = 0; d < 4; d++)
+			data.MatTransform[d * 5] = 1.0f;
+
+		//Materials with identical data share a single entry in the material buffer, the duplicate name becomes an alias
+		std::vector<StringRef>& sameHash = m_materialsByContent[HashBytes(&data, sizeof(MaterialFileData))];
+		StringRef canonicalName;
+		bool isDuplicate = false;
+		for (auto& candidate : sameHash) {
+			if (memcmp(&m_materials.at(candidate)->Data, &data, sizeof(MaterialFileData)) == 0) {
+				canonicalName = candidate;
+				isDuplicate = true;
+				break;
+			}
+		}
+		if (isDuplicate) {
+			if (canonicalName != mat->Name) {
+				m_materialAliases[mat->Name] = canonicalName;
+				m_stats.DedupedMaterials++;
+			}
+			continue;
+		}
+		//a material with the same name, but different data replaces the old one - in its place of the material buffer,
+		//unless other materials were merged into the old one
+		mat->MatCBIndex = (int32_t)m_materials.size();
+		auto existing = m_materials.find(mat->Name);
+		if (existing != m_materials.end())
+			mat->MatCBIndex = ReplaceMaterial(existing->second);
+		m_materialAliases.erase(mat->Name);
+		sameHash.push_back(mat->Name);
+		m_materials[mat->Name] = std::move(mat);
+	}
+}
+
+/// <summary>
+/// Takes a material, which is replaced by one with the same name, out of the content lookup. The materials, which
+/// were merged into it, keep its data - the first of them by name takes over its entry and the others become its
+/// aliases (OBJLoader::ReplaceMaterial).
+/// </summary>
+/// <param name="old">The replaced material, moved to its heir if it has one.</param>
+/// <returns>The index of the replacing material in the material buffer</returns>
+int32_t AssetCooker::ReplaceMaterial(std::unique_ptr<CookedMaterial>& old)
+{
+	StringRef name = old->Name;
+	std::vector<StringRef>& oldHash = m_materialsByContent[HashBytes(&old->Data, sizeof(MaterialFileData))];
+	oldHash.erase(std::remove(oldHash.begin(), oldHash.end(), name), oldHash.end());
+	StringRef heir;
+	for (auto& alias : m_materialAliases) {
+		if (alias.second == name && (heir.empty() || std::lexicographical_compare(alias.first.begin(), alias.first.end(), heir.begin(), heir.end())))
+			heir = alias.first;
+	}
+	if (heir.empty())
+		return old->MatCBIndex;
+	for (auto& alias : m_materialAliases) {
+		if (alias.second == name)
+			alias.second = heir;
+	}
+	m_materialAliases.erase(heir);
+	m_stats.DedupedMaterials--;
+	oldHash.push_back(heir);
+	old->Name = heir;
+	m_materials[heir] = std::move(old);
+	//the replacing material goes to the slot of the old name, after the heir
+	return (int32_t)m_materials.size() - 1;
+}
+
+/// <summary>
+/// Finds a texture, that was already imported with the same name, file path or file content, or adds a new one
+/// (OBJLoader::RegisterTexture)
+/// </summary>
+/// <returns>The index of the texture in the descriptor table</returns>
+uint32_t AssetCooker::RegisterTexture(std::unordered_map<StringRef, std::unique_ptr<CookedTexture>>& textures, TextureDedupTable& table,
+	const std::string& name, const std::string& fileName, uint32_t& counter)
+{
+	std::string path = NormalizePath(fileName);
+	auto byPath = table.ByPath.find(path);
+	if (byPath != table.ByPath.end())
+		return textures.at(byPath->second)->Index;
+	auto byName = textures.find(StringRef(name));
+	if (byName != textures.end()) {
+		table.ByPath[path] = byName->first;
+		return byName->second->Index;
+	}
+	//a copy of an already imported file, stored under another path
+	uint64_t hash = 0;
+	std::vector<char> data;
+	bool hashed = ReadFile(fileName, data);
+	if (hashed) {
+		hash = HashBytes(data.data(), data.size());
+		auto byContent = table.ByContent.find(hash);
+		if (byContent != table.ByContent.end()) {
+			table.ByPath[path] = byContent->second;
+			m_stats.DedupedTextures++;
+			return textures.at(byContent->second)->Index;
+		}
+	}
+	auto texture = std::make_unique<CookedTexture>();
+	texture->Name = m_stringPool.Intern(name);
+	texture->Filename = m_stringPool.Intern(fileName);
+	texture->Index = counter++;
+	table.ByPath[path] = texture->Name;
+	if (hashed)
+		table.ByContent[hash] = texture->Name;
+	uint32_t index = texture->Index;
+	textures[texture->Name] = std::move(texture);
+	return index;
+}
+
+/// <summary>
+/// Finds a material by name, following the aliases of the deduplicated materials
+/// </summary>
+/// <returns>nullptr if the material doesn't exist</returns>
+const AssetCooker::CookedMaterial* AssetCooker::FindMaterial(StringRef name) const
+{
+	auto alias = m_materialAliases.find(name);
+	auto material = m_materials.find(alias != m_materialAliases.end() ? alias->second : name);
+	return material != m_materials.end() ? material->second.get() : nullptr;
+}
+
+/// <summary>
+/// Builds the vertex streams of a shape like OBJLoader::LoadVertexData - a vertex per face corner with the face
+/// tangent (and the face normal, if the file has no normals) - then welds and optimizes them and computes the
+/// bounding volumes. Runs on a worker, it only reads the materials.
+/// </summary>
+/// <param name="file">The parsed file.</param>
+/// <param name="shape">The shape index.</param>
+/// <param name="faceIndexOffsets">The offset of every face in the index array of the file.</param>
+std::unique_ptr<AssetCooker::CookedItem> AssetCooker::BuildRenderItem(const ParsedFile& file, size_t shape, const std::vector<size_t>& faceIndexOffsets) const
+{
+	const tinyobj_opt::attrib_t& attributes = file.Attributes;
+	const tinyobj_opt::shape_t& from = file.Shapes[shape];
+	auto item = std::make_unique<CookedItem>();
+	CookedMesh& mesh = item->Mesh;
+	bool hasNormals = !attributes.normals.empty();
+	for (size_t face = from.face_offset; face < (size_t)from.face_offset + from.length; face++) {
+		int vCount = attributes.face_num_verts[face];
+		size_t first = mesh.Positions.size();
+		bool faceHasNormals = hasNormals;
+		for (int v = 0; v < vCount; v++) {
+			const tinyobj_opt::index_t& idx = attributes.indices[faceIndexOffsets[face] + v];
+			ScenePosition position = {};
+			SceneVertexAttributes vertex = {};
+			if (idx.vertex_index >= 0) {
+				position.x = attributes.vertices[3 * idx.vertex_index];
+				position.y = attributes.vertices[3 * idx.vertex_index + 1];
+				position.z = attributes.vertices[3 * idx.vertex_index + 2];
+			}
+			if (hasNormals && idx.normal_index >= 0) {
+				vertex.Normal[0] = attributes.normals[3 * idx.normal_index];
+				vertex.Normal[1] = attributes.normals[3 * idx.normal_index + 1];
+				vertex.Normal[2] = attributes.normals[3 * idx.normal_index + 2];
+			}
+			else {
+				faceHasNormals = false;
+			}
+			if (idx.texcoord_index >= 0) {
+				vertex.TextureCoordinates[0] = attributes.texcoords[2 * idx.texcoord_index];
+				vertex.TextureCoordinates[1] = 1.0f - attributes.texcoords[2 * idx.texcoord_index + 1];
+			}
+			else {
+				vertex.TextureCoordinates[1] = 1.0f;
+			}
+			mesh.Positions.push_back(position);
+			mesh.Attributes.push_back(vertex);
+			mesh.Indices.push_back((uint32_t)mesh.Indices.size());
+		}
+		if (vCount < 3)
+			continue;
+		size_t last = first + vCount - 1;
+		float tangent[3];
+		CalculateTangent(mesh.Positions[last], mesh.Positions[last - 1], mesh.Positions[last - 2],
+			mesh.Attributes[last].TextureCoordinates, mesh.Attributes[last - 1].TextureCoordinates, mesh.Attributes[last - 2].TextureCoordinates, tangent);
+		float normal[3];
+		if (!faceHasNormals)
+			CalculateNormal(mesh.Positions[last], mesh.Positions[last - 1], mesh.Positions[last - 2], normal);
+		for (size_t v = last - 2; v <= last; v++) {
+			memcpy(mesh.Attributes[v].Tangent, tangent, sizeof(tangent));
+			if (!faceHasNormals)
+				memcpy(mesh.Attributes[v].Normal, normal, sizeof(normal));
+		}
+	}
+
+	//get the material index from the material name
+	item->MaterialIndex = 0;
+	int matInx = from.length ? attributes.material_ids[from.face_offset] : -1;
+	if (matInx >= 0 && (size_t)matInx < file.Materials.size()) {
+		const CookedMaterial* material = FindMaterial(StringRef(file.Materials[matInx].name));
+		if (material)
+			item->MaterialIndex = material->MatCBIndex;
+	}
+
+	uint64_t importedVertices = mesh.Positions.size();
+	double missesBefore = ComputeACMR(mesh) * (mesh.Indices.size() / 3);
+	double missesAfter = missesBefore;
+	if (m_options.Optimize) {
+		WeldVertices(mesh);
+		missesBefore = ComputeACMR(mesh) * (mesh.Indices.size() / 3);
+		OptimizeVertexCache(mesh);
+		OptimizeVertexFetch(mesh);
+		missesAfter = ComputeACMR(mesh) * (mesh.Indices.size() / 3);
+	}
+	ComputeBounds(mesh, item->Bounds);
+	item->ImportedVertices = importedVertices;
+	item->CacheMissesBefore = missesBefore;
+	item->CacheMissesAfter = missesAfter;
+	return item;
+}
+
+/// <summary>
+/// Writes the render items in the layout of OBJLoader::WriteBinRenderItems, sorted by name, so equal inputs
+/// give equal files
+/// </summary>
+bool AssetCooker::WriteScene(const std::string& fileName)
+{
+	std::vector<const std::string*> names;
+	for (auto& item : m_renderItems)
+		names.push_back(&item.first);
+	std::sort(names.begin(), names.end(), [](const std::string* a, const std::string* b) { return *a < *b; });
+
+	SceneFileWriter writer;
+	uint32_t compression = m_options.Compress ? SceneCompression_LZ : SceneCompression_None;
+	std::vector<uint8_t> nameData;
+	std::vector<SceneItemRecord> records;
+	std::vector<SceneItemBounds> bounds;
+	for (auto name : names) {
+		const CookedItem& item = *m_renderItems.at(*name);
+		SceneItemRecord record = {};
+		record.NameOffset = (uint32_t)nameData.size();
+		nameData.insert(nameData.end(), name->begin(), name->end());
+		nameData.push_back('\0');
+		record.VertexCount = (uint32_t)item.Mesh.Positions.size();
+		record.IndexCount = (uint32_t)item.Mesh.Indices.size();
+		record.MaterialIndex = item.MaterialIndex;
+		record.PositionSection = writer.AddSection(SceneSection_Positions, item.Mesh.Positions.data(), item.Mesh.Positions.size() * sizeof(ScenePosition), compression);
+		record.AttributeSection = writer.AddSection(SceneSection_Attributes, item.Mesh.Attributes.data(), item.Mesh.Attributes.size() * sizeof(SceneVertexAttributes), compression);
+		record.IndexSection = writer.AddSection(SceneSection_Indices, item.Mesh.Indices.data(), item.Mesh.Indices.size() * sizeof(uint32_t), compression);
+		//the instances are generated at startup
+		record.InstanceSection = SceneInvalidSection;
+		for (int d = 0; d < 4; d++) {
+			record.World[d * 5] = 1.0f;
+			record.TexTransform[d * 5] = 1.0f;
+		}
+		records.push_back(record);
+		bounds.push_back(item.Bounds);
+	}
+	writer.AddSection(SceneSection_Names, std::move(nameData));
+	writer.AddSection(SceneSection_RenderItems, records.data(), records.size() * sizeof(SceneItemRecord));
+	writer.AddSection(SceneSection_Bounds, bounds.data(), bounds.size() * sizeof(SceneItemBounds));
+	if (!writer.Write(fileName.c_str(), (uint32_t)records.size())) {
+		std::cerr << "Failed to write " << fileName << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	m_stats.RawStreamBytes = writer.GetRawSize();
+	m_stats.CompressedStreamBytes = writer.GetCompressedSize();
+	std::ifstream written(fileName, std::ios::binary | std::ios::ate);
+	m_stats.SceneFileBytes = (uint64_t)written.tellg();
+	return true;
+}
+
+/// <summary>
+/// Writes the textures and materials in the layout of OBJLoader::WriteBinMaterialsAndTextures, sorted by their
+/// indices
+/// </summary>
+bool AssetCooker::WriteMaterials(const std::string& fileName)
+{
+	StringTableBuilder strings;
+	std::vector<TextureRecord> textureRecords;
+	auto addTextureRecords = [&strings, &textureRecords](const std::unordered_map<StringRef, std::unique_ptr<CookedTexture>>& textures) {
+		std::vector<const CookedTexture*> sorted;
+		for (auto& texture : textures)
+			sorted.push_back(texture.second.get());
+		std::sort(sorted.begin(), sorted.end(), [](const CookedTexture* a, const CookedTexture* b) { return a->Index < b->Index; });
+		for (auto texture : sorted) {
+			TextureRecord record;
+			record.NameOffset = strings.Add(texture->Name);
+			record.NameSize = texture->Name.size();
+			record.FilenameOffset = strings.Add(texture->Filename);
+			record.FilenameSize = texture->Filename.size();
+			record.Index = texture->Index;
+			textureRecords.push_back(record);
+		}
+	};
+	addTextureRecords(m_diffuseMaps);
+	addTextureRecords(m_normalMaps);
+	std::vector<const CookedMaterial*> materials;
+	for (auto& material : m_materials)
+		materials.push_back(material.second.get());
+	std::sort(materials.begin(), materials.end(), [](const CookedMaterial* a, const CookedMaterial* b) { return a->MatCBIndex < b->MatCBIndex; });
+	std::vector<MaterialRecord> materialRecords;
+	for (auto material : materials) {
+		MaterialRecord record = {};
+		record.NameOffset = strings.Add(material->Name);
+		record.NameSize = material->Name.size();
+		record.MatCBIndex = material->MatCBIndex;
+		record.Data = material->Data;
+		materialRecords.push_back(record);
+	}
+
+	MaterialFileHeader header = {};
+	header.Magic = MaterialFileMagic;
+	header.Version = MaterialFileVersion;
+	header.DiffuseMapCount = (uint32_t)m_diffuseMaps.size();
+	header.NormalMapCount = (uint32_t)m_normalMaps.size();
+	header.MaterialCount = (uint32_t)materialRecords.size();
+	header.StringTableSize = (uint32_t)strings.GetData().size();
+
+	std::ofstream stream(fileName, std::ios::trunc | std::ios::binary);
+	if (!stream.is_open()) {
+		std::cerr << "Failed to write " << fileName << ": " << strerror(errno) << std::endl;
+		return false;
+	}
+	stream.write((const char*)&header, sizeof(MaterialFileHeader));
+	stream.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+	stream.write((const char*)materialRecords.data(), materialRecords.size() * sizeof(MaterialRecord));
+	stream.write(strings.GetData().data(), strings.GetData().size());
+	m_stats.MaterialFileBytes = sizeof(MaterialFileHeader) + textureRecords.size() * sizeof(TextureRecord) +
+		materialRecords.size() * sizeof(MaterialRecord) + strings.GetData().size();
+	return !stream.fail();
+}
+
+/// <summary>
+/// Prints the phase times, the counts and the effect of the optimizations
+/// </summary>
+void AssetCooker::PrintReport(std::ostream& stream) const
+{
+	const CookerStats& s = m_stats;
+	auto acmr = [&s](double misses) { return s.Triangles ? misses / s.Triangles : 0.0; };
+	std::ios::fmtflags flags = stream.flags();
+	stream << std::fixed << std::setprecision(2);
+	stream << "Cooked " << s.FileCount << " files with " << m_pool.GetThreadCount() << " threads\n";
+	stream << "  parse            " << std::setw(10) << s.ParseTime << " ms\n";
+	stream << "  materials        " << std::setw(10) << s.MaterialTime << " ms\n";
+	stream << "  geometry         " << std::setw(10) << s.GeometryTime << " ms\n";
+	stream << "  write scene      " << std::setw(10) << s.SceneWriteTime << " ms\n";
+	stream << "  write materials  " << std::setw(10) << s.MaterialWriteTime << " ms\n";
+	stream << "  total            " << std::setw(10) << s.TotalTime << " ms\n";
+	stream << "Render items: " << s.RenderItemCount << ", triangles: " << s.Triangles << "\n";
+	stream << "Materials: " << s.MaterialCount << " (" << s.DedupedMaterials << " deduplicated), textures: "
+		<< s.DiffuseMapCount << " diffuse, " << s.NormalMapCount << " normal (" << s.DedupedTextures << " deduplicated)\n";
+	stream << "Vertices: " << s.ImportedVertices << " imported, " << s.CookedVertices << " cooked\n";
+	stream << "ACMR (" << VertexCacheSize << " entry FIFO): " << acmr(s.CacheMissesBefore) << " before, " << acmr(s.CacheMissesAfter) << " after optimization\n";
+	stream << "Written: scene.bin " << s.SceneFileBytes / (1024.0 * 1024.0) << " MB, materials.bin " << s.MaterialFileBytes / 1024.0 << " KB\n";
+	if (s.CompressedStreamBytes)
+		stream << "Stream compression: " << s.RawStreamBytes / (1024.0 * 1024.0) << " MB to " << s.CompressedStreamBytes / (1024.0 * 1024.0)
+			<< " MB (ratio " << (double)s.RawStreamBytes / s.CompressedStreamBytes << ")\n";
+	stream.flags(flags);
+}
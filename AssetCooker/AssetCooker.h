@@ -0,0 +1,123 @@
+#pragma once
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "MeshOptimizer.h"
+#include "MaterialFile.h"
+#include "MemoryTracker.h"
+#include "StringTable.h"
+#include "WorkerPool.h"
+
+namespace ExecuteIndirect {
+
+	struct CookerOptions
+	{
+		std::string OutputDirectory = "models";
+		unsigned ThreadCount = 0;			// 0 - one per hardware thread
+		bool Compress = false;				// LZ compression of the geometry streams
+		bool Optimize = true;				// weld the vertices and optimize them for the vertex cache and the vertex fetch
+	};
+
+	// Times (in milliseconds) and sizes of a cook, printed by PrintReport
+	struct CookerStats
+	{
+		double ParseTime = 0.0;
+		double MaterialTime = 0.0;
+		double GeometryTime = 0.0;
+		double SceneWriteTime = 0.0;
+		double MaterialWriteTime = 0.0;
+		double TotalTime = 0.0;
+		size_t FileCount = 0;
+		size_t RenderItemCount = 0;
+		size_t MaterialCount = 0;
+		size_t DedupedMaterials = 0;
+		size_t DiffuseMapCount = 0;
+		size_t NormalMapCount = 0;
+		size_t DedupedTextures = 0;
+		uint64_t ImportedVertices = 0;		// one per face corner, like the renderer's import
+		uint64_t CookedVertices = 0;
+		uint64_t Triangles = 0;
+		double CacheMissesBefore = 0.0;		// transformed vertices with the simulated cache, before and after the optimization
+		double CacheMissesAfter = 0.0;
+		uint64_t SceneFileBytes = 0;
+		uint64_t MaterialFileBytes = 0;
+		uint64_t RawStreamBytes = 0;		// of the compressed streams
+		uint64_t CompressedStreamBytes = 0;
+	};
+
+	// Converts OBJ/MTL files to scene.bin and materials.bin without the renderer. The import follows
+	// OBJLoader::ReadOBJFiles - the same material and texture names, deduplication and vertex layout - so the
+	// renderer reads the cooked files like the ones it writes itself.
+	class AssetCooker
+	{
+	public:
+		explicit AssetCooker(const CookerOptions& options);
+
+		static bool ReadManifest(const char* fileName, std::vector<std::string>& objFiles);
+		bool Cook(const std::vector<std::string>& objFiles);
+		const CookerStats& GetStats() const { return m_stats; }
+		void PrintReport(std::ostream& stream) const;
+
+	private:
+		struct CookedTexture
+		{
+			StringRef Name;
+			StringRef Filename;
+			uint32_t Index;
+		};
+
+		struct CookedMaterial
+		{
+			StringRef Name;
+			int32_t MatCBIndex;
+			MaterialFileData Data;
+		};
+
+		struct CookedItem
+		{
+			uint32_t MaterialIndex;
+			CookedMesh Mesh;
+			SceneItemBounds Bounds;
+			uint64_t ImportedVertices;
+			double CacheMissesBefore;
+			double CacheMissesAfter;
+
+			~CookedItem() { MemoryTracker::Get().RemoveOwner(this); }
+		};
+
+		// Lookup tables, used to find textures, that were already imported under another name
+		struct TextureDedupTable
+		{
+			std::unordered_map<std::string, StringRef> ByPath;		// normalized file path -> texture name
+			std::unordered_map<uint64_t, StringRef> ByContent;		// file content hash -> texture name
+		};
+
+		struct ParsedFile;
+
+		void LoadMaterials(const ParsedFile& file);
+		uint32_t RegisterTexture(std::unordered_map<StringRef, std::unique_ptr<CookedTexture>>& textures, TextureDedupTable& table,
+			const std::string& name, const std::string& fileName, uint32_t& counter);
+		int32_t ReplaceMaterial(std::unique_ptr<CookedMaterial>& old);
+		const CookedMaterial* FindMaterial(StringRef name) const;
+		std::unique_ptr<CookedItem> BuildRenderItem(const ParsedFile& file, size_t shape, const std::vector<size_t>& faceIndexOffsets) const;
+		bool WriteScene(const std::string& fileName);
+		bool WriteMaterials(const std::string& fileName);
+
+		CookerOptions m_options;
+		CookerStats m_stats;
+		WorkerPool m_pool;
+		StringPool m_stringPool;
+		std::unordered_map<std::string, std::unique_ptr<CookedItem>> m_renderItems;
+		std::unordered_map<StringRef, std::unique_ptr<CookedTexture>> m_diffuseMaps;
+		std::unordered_map<StringRef, std::unique_ptr<CookedTexture>> m_normalMaps;
+		std::unordered_map<StringRef, std::unique_ptr<CookedMaterial>> m_materials;
+		TextureDedupTable m_diffuseMapDedup;
+		TextureDedupTable m_normalMapDedup;
+		std::unordered_map<uint64_t, std::vector<StringRef>> m_materialsByContent;	// material data hash -> material names
+		std::unordered_map<StringRef, StringRef> m_materialAliases;				// duplicate material name -> canonical material name
+		uint32_t m_diffuseCounter = 0;
+		uint32_t m_normalCounter = 0;
+	};
+}
@@ -0,0 +1,119 @@
+// Headless test of the material deduplication of the cooker - cooks two OBJ files, whose MTL files reuse a material
+// name with other data, and checks the materials the render items of scene.bin point to in materials.bin.
+#include "AssetCooker.h"
+#include "MaterialFile.h"
+#include "SceneFile.h"
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace ExecuteIndirect;
+
+static bool WriteText(const std::string& fileName, const char* text)
+{
+	std::ofstream file(fileName, std::ios::trunc);
+	file << text;
+	return file.good();
+}
+
+/// <summary>
+/// Helper function - reads the material records of materials.bin, indexed by their place in the material buffer
+/// </summary>
+static bool ReadMaterials(const std::string& fileName, std::vector<MaterialRecord>& materials)
+{
+	std::ifstream file(fileName, std::ios::binary);
+	MaterialFileHeader header;
+	if (!file.read((char*)&header, sizeof(header)) || header.Magic != MaterialFileMagic || header.Version != MaterialFileVersion)
+		return false;
+	file.seekg((header.DiffuseMapCount + header.NormalMapCount) * sizeof(TextureRecord), std::ios::cur);
+	std::vector<MaterialRecord> records(header.MaterialCount);
+	if (!file.read((char*)records.data(), records.size() * sizeof(MaterialRecord)))
+		return false;
+	materials.assign(records.size(), MaterialRecord());
+	for (auto& record : records) {
+		if (record.MatCBIndex < 0 || (size_t)record.MatCBIndex >= records.size())
+			return false;
+		materials[record.MatCBIndex] = record;
+	}
+	return true;
+}
+
+/// <summary>
+/// Helper function - the diffuse map index of the material of a render item, -1 if the item is missing
+/// </summary>
+static int64_t GetDiffuseMap(const SceneFile& scene, const std::vector<MaterialRecord>& materials, const char* itemName)
+{
+	for (uint32_t i = 0; i < scene.GetRenderItemCount(); i++) {
+		const SceneItemRecord& record = scene.GetRenderItems()[i];
+		if (strcmp(scene.GetName(record), itemName) == 0 && record.MaterialIndex < materials.size())
+			return materials[record.MaterialIndex].Data.DiffuseMapIndex;
+	}
+	return -1;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	std::string first = directory + "/first", second = directory + "/second";
+	//B has the data of A and is merged into it, the second file replaces A. B must keep the rock texture, and C (also
+	//rock) must be merged into B, not into the data A doesn't have anymore.
+	std::string firstObj = "mtllib " + first + ".mtl\n"
+		"v 0 0 0\nv 1 0 0\nv 0 0 1\n"
+		"o itemA\nusemtl A\nf 1 2 3\n"
+		"o itemB\nusemtl B\nf 1 2 3\n";
+	std::string secondObj = "mtllib " + second + ".mtl\n"
+		"v 0 0 0\nv 1 0 0\nv 0 0 1\n"
+		"o itemA2\nusemtl A\nf 1 2 3\n"
+		"o itemC\nusemtl C\nf 1 2 3\n";
+	if (!WriteText(first + ".mtl", "newmtl A\nmap_Kd rock.png\nnewmtl B\nmap_Kd rock.png\n") ||
+		!WriteText(first + ".obj", firstObj.c_str()) ||
+		!WriteText(second + ".mtl", "newmtl A\nmap_Kd grass.png\nnewmtl C\nmap_Kd rock.png\n") ||
+		!WriteText(second + ".obj", secondObj.c_str())) {
+		std::cerr << "Failed to write the test files in " << directory << " (the directory must exist)" << std::endl;
+		return 2;
+	}
+
+	CookerOptions options;
+	options.OutputDirectory = directory;
+	options.ThreadCount = 2;
+	AssetCooker cooker(options);
+	if (!cooker.Cook({ first + ".obj", second + ".obj" })) {
+		std::cerr << "Failed to cook the test files" << std::endl;
+		return 1;
+	}
+	std::vector<MaterialRecord> materials;
+	SceneFile scene;
+	if (!ReadMaterials(directory + "/materials.bin", materials) || !scene.Open((directory + "/scene.bin").c_str())) {
+		std::cerr << "Failed to read the cooked files" << std::endl;
+		return 1;
+	}
+
+	uint32_t failures = 0;
+	int64_t rock = GetDiffuseMap(scene, materials, "itemB");
+	int64_t grass = GetDiffuseMap(scene, materials, "itemA2");
+	if (rock < 0 || grass < 0 || rock == grass) {
+		std::cerr << "B lost its data when A was replaced (rock " << rock << ", grass " << grass << ")" << std::endl;
+		failures++;
+	}
+	if (GetDiffuseMap(scene, materials, "itemA") != grass) {
+		std::cerr << "A doesn't have the data of its last definition" << std::endl;
+		failures++;
+	}
+	if (GetDiffuseMap(scene, materials, "itemC") != rock) {
+		std::cerr << "C doesn't have the rock texture" << std::endl;
+		failures++;
+	}
+	//A (grass) and B (rock, with C merged into it)
+	if (materials.size() != 2) {
+		std::cerr << materials.size() << " materials instead of 2" << std::endl;
+		failures++;
+	}
+	std::cout << materials.size() << " materials, " << scene.GetRenderItemCount() << " render items" << std::endl;
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,254 @@
+// Headless test of the generated instances:
+//  - packs random rotation, scale and translation matrices, unpacks them and checks the error against the original
+//    matrices, so a change of the packing can't lose precision unnoticed
+//  - places the instances of a spawn table on the calling thread and on a worker pool, the bytes must be the same
+#include "InstancePacking.h"
+#include "SpawnTable.h"
+#include "WorkerPool.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+using namespace ExecuteIndirect;
+
+//the largest errors of the packing, measured at about 1.1e-6 of the scale and 1.0e-6 of the radius
+static const double MaxMatrixError = 1.5e-6;		// of an element, relative to the scale
+static const double MaxPointError = 1.5e-6;			// of a transformed point, relative to the radius of the model
+static const float ModelRadius = 10.0f;
+
+/// <summary>
+/// Helper function - the rotation of the angle around the unit axis, with row vectors like the renderer's matrices
+/// </summary>
+static void AxisAngleRotation(const float axis[3], float angle, float rotation[9])
+{
+	float c = std::cos(angle), s = std::sin(angle), t = 1.0f - c;
+	float x = axis[0], y = axis[1], z = axis[2];
+	const float rows[9] = {
+		t * x * x + c, t * x * y + s * z, t * x * z - s * y,
+		t * x * y - s * z, t * y * y + c, t * y * z + s * x,
+		t * x * z + s * y, t * y * z - s * x, t * z * z + c,
+	};
+	memcpy(rotation, rows, sizeof(rows));
+}
+
+static void BuildWorld(const float rotation[9], float scale, const float translation[3], float world[16])
+{
+	memset(world, 0, 16 * sizeof(float));
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 3; column++)
+			world[4 * row + column] = rotation[3 * row + column] * scale;
+	}
+	world[12] = translation[0];
+	world[13] = translation[1];
+	world[14] = translation[2];
+	world[15] = 1.0f;
+}
+
+/// <summary>
+/// Packs and unpacks the matrix, the errors are added to the maxima
+/// </summary>
+/// <returns>False if the packed instance isn't valid (a scale, which isn't the matrix's, or a quaternion, which isn't unit)</returns>
+static bool CheckMatrix(const float world[16], float scale, const float point[3], double& maxMatrixError, double& maxPointError)
+{
+	SceneInstance instance;
+	PackInstance(world, instance);
+	const float* q = instance.Rotation;
+	double length = std::sqrt((double)q[0] * q[0] + (double)q[1] * q[1] + (double)q[2] * q[2] + (double)q[3] * q[3]);
+	if (std::fabs(length - 1.0) > 1e-6 || q[3] < 0.0f || std::fabs(instance.Scale - scale) > 1e-6 * scale)
+		return false;
+	float unpacked[16];
+	UnpackWorld(instance, unpacked);
+	for (int i = 0; i < 16; i++)
+		maxMatrixError = std::max(maxMatrixError, std::fabs((double)unpacked[i] - world[i]) / (i < 12 ? scale : 1.0f));
+	//the point is transformed in double, so the rounding of a large translation isn't counted
+	for (int column = 0; column < 3; column++) {
+		double original = world[12 + column], packed = unpacked[12 + column];
+		for (int row = 0; row < 3; row++) {
+			original += (double)point[row] * world[4 * row + column];
+			packed += (double)point[row] * unpacked[4 * row + column];
+		}
+		maxPointError = std::max(maxPointError, std::fabs(original - packed) / (ModelRadius * scale));
+	}
+	return true;
+}
+
+/// <summary>
+/// Packs the half turns around the axes and count random matrices
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestPacking(uint32_t count)
+{
+	uint32_t failures = 0;
+	double maxMatrixError = 0.0, maxPointError = 0.0;
+	const float origin[3] = { 0.0f, 0.0f, 0.0f };
+	const float point[3] = { ModelRadius, -ModelRadius, ModelRadius };
+
+	//the identity and the half turns around the axes take every branch of the quaternion extraction
+	const float axes[3][3] = { { 1.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 1.0f } };
+	for (int axis = 0; axis < 3; axis++) {
+		for (float angle : { 0.0f, 3.14159265f }) {
+			float rotation[9], world[16];
+			AxisAngleRotation(axes[axis], angle, rotation);
+			BuildWorld(rotation, 2.0f, origin, world);
+			if (!CheckMatrix(world, 2.0f, point, maxMatrixError, maxPointError)) {
+				std::cerr << "invalid instance of the half turn around axis " << axis << std::endl;
+				failures++;
+			}
+		}
+	}
+
+	std::mt19937 generator(7);
+	std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+	for (uint32_t i = 0; i < count; i++) {
+		float axis[3] = { unit(generator), unit(generator), unit(generator) };
+		float length = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+		if (length < 1e-3f)
+			continue;
+		for (float& a : axis)
+			a /= length;
+		float rotation[9], world[16];
+		AxisAngleRotation(axis, unit(generator) * 3.14159265f, rotation);
+		float scale = 0.005f + (unit(generator) + 1.0f) * 10.0f;
+		const float translation[3] = { unit(generator) * 2000.0f, unit(generator) * 200.0f, unit(generator) * 2000.0f };
+		const float modelPoint[3] = { unit(generator) * ModelRadius, unit(generator) * ModelRadius, unit(generator) * ModelRadius };
+		BuildWorld(rotation, scale, translation, world);
+		if (!CheckMatrix(world, scale, modelPoint, maxMatrixError, maxPointError)) {
+			if (failures < 10)
+				std::cerr << "invalid instance of matrix " << i << std::endl;
+			failures++;
+		}
+	}
+
+	std::cout << count << " matrices: largest element error " << maxMatrixError << " of the scale, largest point error "
+		<< maxPointError << " of the radius" << std::endl;
+	if (maxMatrixError > MaxMatrixError) {
+		std::cerr << "the element error is above " << MaxMatrixError << std::endl;
+		failures++;
+	}
+	if (maxPointError > MaxPointError) {
+		std::cerr << "the point error is above " << MaxPointError << std::endl;
+		failures++;
+	}
+	return failures;
+}
+
+/// <summary>
+/// Helper function - a round, hilly terrain, the corners of its heightfield aren't covered
+/// </summary>
+static bool BuildTerrain(Heightfield& heightfield)
+{
+	const uint32_t Rings = 40, Segments = 96;
+	const float Radius = 1000.0f;
+	std::vector<float> positions = { 0.0f, 0.0f, 0.0f };
+	std::vector<uint32_t> indices;
+	for (uint32_t ring = 1; ring <= Rings; ring++) {
+		for (uint32_t segment = 0; segment < Segments; segment++) {
+			float angle = 6.2831853f * segment / Segments;
+			float x = Radius * ring / Rings * std::cos(angle), z = Radius * ring / Rings * std::sin(angle);
+			positions.insert(positions.end(), { x, 30.0f * std::sin(x * 0.01f) * std::cos(z * 0.013f), z });
+		}
+	}
+	for (uint32_t segment = 0; segment < Segments; segment++)
+		indices.insert(indices.end(), { 0, 1 + segment, 1 + (segment + 1) % Segments });
+	for (uint32_t ring = 1; ring < Rings; ring++) {
+		uint32_t inner = 1 + (ring - 1) * Segments, outer = inner + Segments;
+		for (uint32_t segment = 0; segment < Segments; segment++) {
+			uint32_t next = (segment + 1) % Segments;
+			indices.insert(indices.end(), { inner + segment, outer + segment, outer + next, inner + segment, outer + next, inner + next });
+		}
+	}
+	return heightfield.Build(positions.data(), (uint32_t)positions.size() / 3, indices.data(), (uint32_t)indices.size());
+}
+
+/// <summary>
+/// Places a table, which needs several chunks, with the calling thread only and with the pool's threads
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestPlacement(unsigned threadCount)
+{
+	uint32_t failures = 0;
+	Heightfield heightfield;
+	if (!BuildTerrain(heightfield)) {
+		std::cerr << "the heightfield of the test terrain can't be built" << std::endl;
+		return 1;
+	}
+	SpawnTable table;
+	SpawnEntry tree;
+	tree.Model = "tree";
+	tree.Parts = { "Branches", "Trunk" };
+	tree.Count = 50000;
+	tree.MinScale = 0.5f;
+	tree.MaxScale = 2.0f;
+	table.Add(tree);
+	SpawnEntry stone;
+	stone.Model = "stone";
+	stone.Parts = { "Stone" };
+	stone.Count = 9000;
+	stone.HeightOffset = 1.0f;
+	table.Add(stone);
+	table.SetSeed(42);
+
+	//the instances of every part, placed once per run
+	auto place = [&table, &heightfield](WorkerPool* pool, std::vector<std::vector<SceneInstance>>& parts) {
+		std::vector<SpawnTarget> targets(table.GetEntries().size());
+		for (uint32_t e = 0; e < targets.size(); e++) {
+			const SpawnEntry& entry = table.GetEntries()[e];
+			targets[e].Entry = e;
+			for (size_t p = 0; p < entry.Parts.size(); p++) {
+				parts.emplace_back(table.GetCount(entry));
+				targets[e].Parts.push_back(parts.back().data());
+			}
+		}
+		table.Place(heightfield, targets, pool);
+	};
+	std::vector<std::vector<SceneInstance>> serial, parallel;
+	place(nullptr, serial);
+	WorkerPool pool(threadCount);
+	place(&pool, parallel);
+
+	for (size_t p = 0; p < serial.size(); p++) {
+		size_t bytes = serial[p].size() * sizeof(SceneInstance);
+		if (memcmp(serial[p].data(), parallel[p].data(), bytes) != 0) {
+			std::cerr << "part " << p << " differs between 1 and " << threadCount << " threads" << std::endl;
+			failures++;
+		}
+	}
+	if (memcmp(serial[0].data(), serial[1].data(), serial[0].size() * sizeof(SceneInstance)) != 0) {
+		std::cerr << "the parts of a model aren't at the same places" << std::endl;
+		failures++;
+	}
+	uint32_t empty = 0, offTerrain = 0;
+	for (auto& part : serial) {
+		for (auto& instance : part) {
+			if (instance.Scale == 0.0f)
+				empty++;
+			else if (!heightfield.IsCovered(instance.Position[0], instance.Position[2]))
+				offTerrain++;
+		}
+	}
+	if (offTerrain) {
+		std::cerr << offTerrain << " instances are off the terrain" << std::endl;
+		failures++;
+	}
+	if (empty) {
+		std::cerr << empty << " instances have no place on the terrain" << std::endl;
+		failures++;
+	}
+	std::cout << (serial[0].size() + serial[2].size()) << " instances placed on 1 and on " << threadCount << " threads" << std::endl;
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	uint32_t count = argc > 1 ? (uint32_t)atoi(argv[1]) : 1000000;
+	unsigned threadCount = argc > 2 ? (unsigned)atoi(argv[2]) : 8;
+	uint32_t failures = TestPacking(count) + TestPlacement(threadCount);
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
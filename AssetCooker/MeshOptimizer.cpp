@@ -0,0 +1,441 @@
+#include "MeshOptimizer.h"
+#include "Hash.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+
+using namespace ExecuteIndirect;
+
+static const uint32_t InvalidIndex = ~0u;
+// Size of the LRU cache, modelled by the vertex cache optimization
+static const int OptimizerCacheSize = 32;
+
+/// <summary>
+/// Merges the vertices with equal positions, normals and texture coordinates and remaps the indices to them.
+/// The import gives every face its own tangent, so the tangents of the merged vertices are averaged.
+/// </summary>
+void ExecuteIndirect::WeldVertices(CookedMesh& mesh)
+{
+	//the normal and the texture coordinates precede the tangent
+	const size_t keySize = offsetof(SceneVertexAttributes, Tangent);
+	size_t vertexCount = mesh.Positions.size();
+	size_t tableSize = 1;
+	while (tableSize < vertexCount * 2)
+		tableSize <<= 1;
+	//open addressing table of the indices of the unique vertices
+	std::vector<uint32_t> table(tableSize, InvalidIndex);
+	std::vector<uint32_t> remap(vertexCount);
+	CookedMesh welded;
+	std::vector<ScenePosition> tangentSums;
+	auto equal = [&mesh, &welded](uint32_t vertex, uint32_t unique) {
+		return memcmp(&mesh.Positions[vertex], &welded.Positions[unique], sizeof(ScenePosition)) == 0 &&
+			memcmp(&mesh.Attributes[vertex], &welded.Attributes[unique], keySize) == 0;
+	};
+	for (uint32_t v = 0; v < vertexCount; v++) {
+		uint64_t hash = HashBytes(&mesh.Positions[v], sizeof(ScenePosition));
+		hash = HashBytes(&mesh.Attributes[v], keySize, hash);
+		size_t slot = (size_t)hash & (tableSize - 1);
+		while (table[slot] != InvalidIndex && !equal(v, table[slot]))
+			slot = (slot + 1) & (tableSize - 1);
+		if (table[slot] == InvalidIndex) {
+			table[slot] = (uint32_t)welded.Positions.size();
+			welded.Positions.push_back(mesh.Positions[v]);
+			welded.Attributes.push_back(mesh.Attributes[v]);
+			tangentSums.push_back(ScenePosition{ 0.0f, 0.0f, 0.0f });
+		}
+		remap[v] = table[slot];
+		ScenePosition& sum = tangentSums[remap[v]];
+		sum.x += mesh.Attributes[v].Tangent[0];
+		sum.y += mesh.Attributes[v].Tangent[1];
+		sum.z += mesh.Attributes[v].Tangent[2];
+	}
+	for (size_t v = 0; v < welded.Attributes.size(); v++) {
+		const ScenePosition& sum = tangentSums[v];
+		float length = sqrtf(sum.x * sum.x + sum.y * sum.y + sum.z * sum.z);
+		//opposite tangents cancel out, the first one is kept
+		if (length > 1e-6f) {
+			welded.Attributes[v].Tangent[0] = sum.x / length;
+			welded.Attributes[v].Tangent[1] = sum.y / length;
+			welded.Attributes[v].Tangent[2] = sum.z / length;
+		}
+	}
+	for (auto& index : mesh.Indices)
+		index = remap[index];
+	mesh.Positions.swap(welded.Positions);
+	mesh.Attributes.swap(welded.Attributes);
+}
+
+/// <summary>
+/// Helper function - the score of a vertex in the vertex cache optimization (Forsyth). Vertices, which are in
+/// the cache, and vertices with few remaining triangles are preferred.
+/// </summary>
+static float VertexScore(int cachePosition, uint32_t remainingTriangles)
+{
+	if (remainingTriangles == 0)
+		return -1.0f;
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		//the last triangle's vertices get a fixed score, so the next triangle doesn't just reuse them
+		if (cachePosition < 3)
+			score = 0.75f;
+		else
+			score = powf(1.0f - (cachePosition - 3) / float(OptimizerCacheSize - 3), 1.5f);
+	}
+	return score + 2.0f / sqrtf((float)remainingTriangles);
+}
+
+/// <summary>
+/// Reorders the triangles, so they reuse the vertices in the post transform cache (Tom Forsyth's
+/// linear speed vertex cache optimization)
+/// </summary>
+void ExecuteIndirect::OptimizeVertexCache(CookedMesh& mesh)
+{
+	size_t vertexCount = mesh.Positions.size();
+	size_t triangleCount = mesh.Indices.size() / 3;
+	if (triangleCount == 0)
+		return;
+	const std::vector<uint32_t>& indices = mesh.Indices;
+
+	//the triangles of every vertex, the list shrinks when the triangles are added
+	std::vector<uint32_t> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		remaining[indices[i]]++;
+	std::vector<uint32_t> offsets(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; v++)
+		offsets[v + 1] = offsets[v] + remaining[v];
+	std::vector<uint32_t> adjacency(triangleCount * 3);
+	std::vector<uint32_t> fill(offsets.begin(), offsets.end() - 1);
+	for (size_t i = 0; i < triangleCount * 3; i++)
+		adjacency[fill[indices[i]]++] = (uint32_t)(i / 3);
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (size_t v = 0; v < vertexCount; v++)
+		vertexScore[v] = VertexScore(-1, remaining[v]);
+	std::vector<float> triangleScore(triangleCount);
+	std::vector<bool> added(triangleCount, false);
+	size_t bestTriangle = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+		if (triangleScore[t] > triangleScore[bestTriangle])
+			bestTriangle = t;
+	}
+
+	std::vector<uint32_t> output;
+	output.reserve(triangleCount * 3);
+	uint32_t cache[OptimizerCacheSize + 3];
+	int cacheCount = 0;
+	size_t scanCursor = 0;
+	for (size_t emitted = 0; emitted < triangleCount; emitted++) {
+		if (bestTriangle == InvalidIndex) {
+			//none of the cached vertices has a triangle left - continue with the next triangle in the old order
+			while (added[scanCursor])
+				scanCursor++;
+			bestTriangle = scanCursor;
+		}
+		size_t triangle = bestTriangle;
+		added[triangle] = true;
+		uint32_t newCache[OptimizerCacheSize + 3];
+		int newCount = 0;
+		for (int k = 0; k < 3; k++) {
+			uint32_t vertex = indices[triangle * 3 + k];
+			output.push_back(vertex);
+			uint32_t* list = &adjacency[offsets[vertex]];
+			for (uint32_t i = 0; i < remaining[vertex]; i++) {
+				if (list[i] == triangle) {
+					list[i] = list[remaining[vertex] - 1];
+					break;
+				}
+			}
+			remaining[vertex]--;
+			if (std::find(newCache, newCache + newCount, vertex) == newCache + newCount)
+				newCache[newCount++] = vertex;
+		}
+		//the triangle's vertices move to the front of the cache, the oldest ones fall out
+		for (int i = 0; i < cacheCount; i++) {
+			if (std::find(newCache, newCache + 3, cache[i]) == newCache + 3)
+				newCache[newCount++] = cache[i];
+		}
+		for (int i = 0; i < newCount; i++)
+			cachePosition[newCache[i]] = i < OptimizerCacheSize ? i : -1;
+		for (int i = 0; i < newCount; i++) {
+			uint32_t vertex = newCache[i];
+			float score = VertexScore(cachePosition[vertex], remaining[vertex]);
+			float delta = score - vertexScore[vertex];
+			vertexScore[vertex] = score;
+			for (uint32_t j = 0; j < remaining[vertex]; j++)
+				triangleScore[adjacency[offsets[vertex] + j]] += delta;
+		}
+		cacheCount = newCount < OptimizerCacheSize ? newCount : OptimizerCacheSize;
+		memcpy(cache, newCache, cacheCount * sizeof(uint32_t));
+		//the next triangle is the best one, that uses a cached vertex
+		bestTriangle = InvalidIndex;
+		float bestScore = -1.0f;
+		for (int i = 0; i < cacheCount; i++) {
+			for (uint32_t j = 0; j < remaining[cache[i]]; j++) {
+				uint32_t candidate = adjacency[offsets[cache[i]] + j];
+				if (triangleScore[candidate] > bestScore) {
+					bestScore = triangleScore[candidate];
+					bestTriangle = candidate;
+				}
+			}
+		}
+	}
+	mesh.Indices.swap(output);
+}
+
+/// <summary>
+/// Reorders the vertices in the order of their first use, so the vertex fetch reads memory linearly.
+/// Vertices, which aren't used by any triangle, are removed.
+/// </summary>
+void ExecuteIndirect::OptimizeVertexFetch(CookedMesh& mesh)
+{
+	std::vector<uint32_t> remap(mesh.Positions.size(), InvalidIndex);
+	CookedMesh ordered;
+	for (auto& index : mesh.Indices) {
+		if (remap[index] == InvalidIndex) {
+			remap[index] = (uint32_t)ordered.Positions.size();
+			ordered.Positions.push_back(mesh.Positions[index]);
+			ordered.Attributes.push_back(mesh.Attributes[index]);
+		}
+		index = remap[index];
+	}
+	mesh.Positions.swap(ordered.Positions);
+	mesh.Attributes.swap(ordered.Attributes);
+}
+
+/// <summary>
+/// Computes the average cache miss ratio - transformed vertices per triangle with a FIFO cache of VertexCacheSize entries
+/// </summary>
+double ExecuteIndirect::ComputeACMR(const CookedMesh& mesh)
+{
+	size_t triangleCount = mesh.Indices.size() / 3;
+	if (triangleCount == 0)
+		return 0.0;
+	std::vector<uint32_t> timestamps(mesh.Positions.size(), 0);
+	uint32_t time = VertexCacheSize + 1;
+	size_t misses = 0;
+	for (auto index : mesh.Indices) {
+		if (time - timestamps[index] > VertexCacheSize) {
+			timestamps[index] = time++;
+			misses++;
+		}
+	}
+	return (double)misses / triangleCount;
+}
+
+/// <summary>
+/// Helper function - eigenvectors of a symmetric 3x3 matrix (Jacobi rotations)
+/// </summary>
+/// <param name="matrix">The matrix, it is diagonalized.</param>
+/// <param name="vectors">The eigenvectors are its columns.</param>
+static void SymmetricEigenvectors(double matrix[3][3], double vectors[3][3])
+{
+	for (int i = 0; i < 3; i++)
+		for (int j = 0; j < 3; j++)
+			vectors[i][j] = (i == j) ? 1.0 : 0.0;
+	for (int sweep = 0; sweep < 32; sweep++) {
+		double offDiagonal = fabs(matrix[0][1]) + fabs(matrix[0][2]) + fabs(matrix[1][2]);
+		if (offDiagonal < 1e-12)
+			break;
+		for (int p = 0; p < 2; p++) {
+			for (int q = p + 1; q < 3; q++) {
+				if (fabs(matrix[p][q]) < 1e-15)
+					continue;
+				double theta = (matrix[q][q] - matrix[p][p]) / (2.0 * matrix[p][q]);
+				double t = (theta >= 0.0 ? 1.0 : -1.0) / (fabs(theta) + sqrt(theta * theta + 1.0));
+				double c = 1.0 / sqrt(t * t + 1.0);
+				double s = t * c;
+				for (int k = 0; k < 3; k++) {
+					double kp = matrix[k][p];
+					double kq = matrix[k][q];
+					matrix[k][p] = c * kp - s * kq;
+					matrix[k][q] = s * kp + c * kq;
+				}
+				for (int k = 0; k < 3; k++) {
+					double pk = matrix[p][k];
+					double qk = matrix[q][k];
+					matrix[p][k] = c * pk - s * qk;
+					matrix[q][k] = s * pk + c * qk;
+				}
+				for (int k = 0; k < 3; k++) {
+					double kp = vectors[k][p];
+					double kq = vectors[k][q];
+					vectors[k][p] = c * kp - s * kq;
+					vectors[k][q] = s * kp + c * kq;
+				}
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Computes the bounding volumes like RenderItem::CreateBoundingVolumes - the sphere is the smaller one of the
+/// sphere around the points and the sphere around the box center, the oriented box is the box in the principal
+/// axes of the points, if it is smaller than the axis aligned box.
+/// </summary>
+void ExecuteIndirect::ComputeBounds(const CookedMesh& mesh, SceneItemBounds& bounds)
+{
+	memset(&bounds, 0, sizeof(bounds));
+	bounds.OrientedBoxOrientation[3] = 1.0f;
+	size_t count = mesh.Positions.size();
+	if (count == 0)
+		return;
+	const ScenePosition* points = mesh.Positions.data();
+
+	float minimum[3] = { points[0].x, points[0].y, points[0].z };
+	float maximum[3] = { points[0].x, points[0].y, points[0].z };
+	for (size_t i = 1; i < count; i++) {
+		const float p[3] = { points[i].x, points[i].y, points[i].z };
+		for (int a = 0; a < 3; a++) {
+			minimum[a] = std::min(minimum[a], p[a]);
+			maximum[a] = std::max(maximum[a], p[a]);
+		}
+	}
+	for (int a = 0; a < 3; a++) {
+		bounds.BoxCenter[a] = (minimum[a] + maximum[a]) * 0.5f;
+		bounds.BoxExtents[a] = (maximum[a] - minimum[a]) * 0.5f;
+	}
+
+	auto distance = [](const ScenePosition& p, const double center[3]) {
+		double dx = p.x - center[0], dy = p.y - center[1], dz = p.z - center[2];
+		return sqrt(dx * dx + dy * dy + dz * dz);
+	};
+	//the sphere around the box center
+	double boxCenter[3] = { bounds.BoxCenter[0], bounds.BoxCenter[1], bounds.BoxCenter[2] };
+	double boxRadius = 0.0;
+	for (size_t i = 0; i < count; i++)
+		boxRadius = std::max(boxRadius, distance(points[i], boxCenter));
+	//Ritter's sphere - starts with the two farthest points on the axes and grows to include every point
+	double sphereCenter[3];
+	double sphereRadius = 0.0;
+	{
+		size_t minPoint[3] = { 0, 0, 0 };
+		size_t maxPoint[3] = { 0, 0, 0 };
+		for (size_t i = 0; i < count; i++) {
+			const float p[3] = { points[i].x, points[i].y, points[i].z };
+			for (int a = 0; a < 3; a++) {
+				const float* pMin = &points[minPoint[a]].x;
+				const float* pMax = &points[maxPoint[a]].x;
+				if (p[a] < pMin[a])
+					minPoint[a] = i;
+				if (p[a] > pMax[a])
+					maxPoint[a] = i;
+			}
+		}
+		int widest = 0;
+		double widestSpan = -1.0;
+		for (int a = 0; a < 3; a++) {
+			double start[3] = { points[minPoint[a]].x, points[minPoint[a]].y, points[minPoint[a]].z };
+			double span = distance(points[maxPoint[a]], start);
+			if (span > widestSpan) {
+				widestSpan = span;
+				widest = a;
+			}
+		}
+		const ScenePosition& a = points[minPoint[widest]];
+		const ScenePosition& b = points[maxPoint[widest]];
+		sphereCenter[0] = (a.x + b.x) * 0.5;
+		sphereCenter[1] = (a.y + b.y) * 0.5;
+		sphereCenter[2] = (a.z + b.z) * 0.5;
+		sphereRadius = widestSpan * 0.5;
+		for (size_t i = 0; i < count; i++) {
+			double d = distance(points[i], sphereCenter);
+			if (d > sphereRadius) {
+				double grownRadius = (sphereRadius + d) * 0.5;
+				double shift = (grownRadius - sphereRadius) / d;
+				sphereCenter[0] += (points[i].x - sphereCenter[0]) * shift;
+				sphereCenter[1] += (points[i].y - sphereCenter[1]) * shift;
+				sphereCenter[2] += (points[i].z - sphereCenter[2]) * shift;
+				sphereRadius = grownRadius;
+			}
+		}
+	}
+	if (boxRadius < sphereRadius) {
+		memcpy(sphereCenter, boxCenter, sizeof(boxCenter));
+		sphereRadius = boxRadius;
+	}
+	for (int a = 0; a < 3; a++)
+		bounds.SphereCenter[a] = (float)sphereCenter[a];
+	bounds.SphereRadius = (float)sphereRadius;
+
+	//the principal axes are the eigenvectors of the covariance matrix
+	double mean[3] = { 0.0, 0.0, 0.0 };
+	for (size_t i = 0; i < count; i++) {
+		mean[0] += points[i].x;
+		mean[1] += points[i].y;
+		mean[2] += points[i].z;
+	}
+	for (int a = 0; a < 3; a++)
+		mean[a] /= count;
+	double covariance[3][3] = {};
+	for (size_t i = 0; i < count; i++) {
+		double d[3] = { points[i].x - mean[0], points[i].y - mean[1], points[i].z - mean[2] };
+		for (int r = 0; r < 3; r++)
+			for (int c = 0; c < 3; c++)
+				covariance[r][c] += d[r] * d[c];
+	}
+	double axes[3][3];
+	SymmetricEigenvectors(covariance, axes);
+	//right handed axes, so they are a rotation
+	axes[0][2] = axes[1][0] * axes[2][1] - axes[2][0] * axes[1][1];
+	axes[1][2] = axes[2][0] * axes[0][1] - axes[0][0] * axes[2][1];
+	axes[2][2] = axes[0][0] * axes[1][1] - axes[1][0] * axes[0][1];
+	double low[3] = { 1e300, 1e300, 1e300 };
+	double high[3] = { -1e300, -1e300, -1e300 };
+	for (size_t i = 0; i < count; i++) {
+		for (int a = 0; a < 3; a++) {
+			double projection = points[i].x * axes[0][a] + points[i].y * axes[1][a] + points[i].z * axes[2][a];
+			low[a] = std::min(low[a], projection);
+			high[a] = std::max(high[a], projection);
+		}
+	}
+	double orientedVolume = (high[0] - low[0]) * (high[1] - low[1]) * (high[2] - low[2]);
+	double boxVolume = 8.0 * bounds.BoxExtents[0] * bounds.BoxExtents[1] * bounds.BoxExtents[2];
+	if (orientedVolume >= boxVolume) {
+		memcpy(bounds.OrientedBoxCenter, bounds.BoxCenter, sizeof(bounds.BoxCenter));
+		memcpy(bounds.OrientedBoxExtents, bounds.BoxExtents, sizeof(bounds.BoxExtents));
+		return;
+	}
+	for (int r = 0; r < 3; r++) {
+		double center = 0.0;
+		for (int a = 0; a < 3; a++)
+			center += axes[r][a] * (low[a] + high[a]) * 0.5;
+		bounds.OrientedBoxCenter[r] = (float)center;
+		bounds.OrientedBoxExtents[r] = (float)((high[r] - low[r]) * 0.5);
+	}
+	//the quaternion of the rotation, which columns are the axes
+	double trace = axes[0][0] + axes[1][1] + axes[2][2];
+	double q[4];
+	if (trace > 0.0) {
+		double s = sqrt(trace + 1.0) * 2.0;
+		q[3] = 0.25 * s;
+		q[0] = (axes[2][1] - axes[1][2]) / s;
+		q[1] = (axes[0][2] - axes[2][0]) / s;
+		q[2] = (axes[1][0] - axes[0][1]) / s;
+	}
+	else if (axes[0][0] > axes[1][1] && axes[0][0] > axes[2][2]) {
+		double s = sqrt(1.0 + axes[0][0] - axes[1][1] - axes[2][2]) * 2.0;
+		q[3] = (axes[2][1] - axes[1][2]) / s;
+		q[0] = 0.25 * s;
+		q[1] = (axes[0][1] + axes[1][0]) / s;
+		q[2] = (axes[0][2] + axes[2][0]) / s;
+	}
+	else if (axes[1][1] > axes[2][2]) {
+		double s = sqrt(1.0 + axes[1][1] - axes[0][0] - axes[2][2]) * 2.0;
+		q[3] = (axes[0][2] - axes[2][0]) / s;
+		q[0] = (axes[0][1] + axes[1][0]) / s;
+		q[1] = 0.25 * s;
+		q[2] = (axes[1][2] + axes[2][1]) / s;
+	}
+	else {
+		double s = sqrt(1.0 + axes[2][2] - axes[0][0] - axes[1][1]) * 2.0;
+		q[3] = (axes[1][0] - axes[0][1]) / s;
+		q[0] = (axes[0][2] + axes[2][0]) / s;
+		q[1] = (axes[1][2] + axes[2][1]) / s;
+		q[2] = 0.25 * s;
+	}
+	for (int a = 0; a < 4; a++)
+		bounds.OrientedBoxOrientation[a] = (float)q[a];
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include "SceneFile.h"
+
+namespace ExecuteIndirect {
+
+	// A mesh in the layout of the scene file streams
+	struct CookedMesh
+	{
+		std::vector<ScenePosition> Positions;
+		std::vector<SceneVertexAttributes> Attributes;
+		std::vector<uint32_t> Indices;
+	};
+
+	// Simulated post transform vertex cache, used to report the effect of the optimization
+	const uint32_t VertexCacheSize = 16;
+
+	void WeldVertices(CookedMesh& mesh);
+	void OptimizeVertexCache(CookedMesh& mesh);
+	void OptimizeVertexFetch(CookedMesh& mesh);
+	double ComputeACMR(const CookedMesh& mesh);
+	void ComputeBounds(const CookedMesh& mesh, SceneItemBounds& bounds);
+}
@@ -0,0 +1,148 @@
+// Headless test of the range allocator of the geometry pool and the world partition - the best fit, the coalescing
+// of the free blocks, the growth and the moves of the defragmentation
+#include "RangeAllocator.h"
+#include <iostream>
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Helper function - compares a value with the expected one and reports the difference
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t Expect(const char* what, uint64_t value, uint64_t expected)
+{
+	if (value == expected)
+		return 0;
+	std::cerr << what << ": " << value << " instead of " << expected << std::endl;
+	return 1;
+}
+
+/// <summary>
+/// Allocates from two free blocks, the smallest one, that fits, must be taken
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestBestFit()
+{
+	uint32_t failures = 0;
+	RangeAllocator allocator(100);
+	allocator.Allocate(10);
+	uint64_t large = allocator.Allocate(30);
+	allocator.Allocate(10);
+	uint64_t small = allocator.Allocate(20);
+	allocator.Allocate(30);
+	allocator.Free(large);
+	allocator.Free(small);
+	failures += Expect("best fit offset", allocator.Allocate(15), small);
+	failures += Expect("best fit rest", allocator.Allocate(5), small + 15);
+	failures += Expect("offset in the larger block", allocator.Allocate(25), large);
+	failures += Expect("offset without room", allocator.Allocate(10), RangeAllocator::InvalidOffset);
+	//the padding of an aligned range goes back to the free blocks
+	allocator.Reset(100);
+	allocator.Allocate(3);
+	failures += Expect("aligned offset", allocator.Allocate(10, 16), 16);
+	failures += Expect("offset in the padding", allocator.Allocate(13), 3);
+	return failures;
+}
+
+/// <summary>
+/// Frees ranges next to free blocks before them, after them and on both sides
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestCoalescing()
+{
+	uint32_t failures = 0;
+	RangeAllocator allocator(100);
+	uint64_t first = allocator.Allocate(10);
+	uint64_t second = allocator.Allocate(10);
+	allocator.Allocate(80);
+	allocator.Free(first);
+	//merged with the previous block
+	allocator.Free(second);
+	failures += Expect("free blocks after merging with the previous one", allocator.GetStats().FreeBlockCount, 1);
+	failures += Expect("largest block after merging with the previous one", allocator.GetStats().LargestFreeBlock, 20);
+
+	allocator.Reset(100);
+	first = allocator.Allocate(10);
+	second = allocator.Allocate(10);
+	uint64_t third = allocator.Allocate(10);
+	uint64_t fourth = allocator.Allocate(70);
+	allocator.Free(fourth);
+	//merged with the next block
+	allocator.Free(third);
+	failures += Expect("free blocks after merging with the next one", allocator.GetStats().FreeBlockCount, 1);
+	failures += Expect("largest block after merging with the next one", allocator.GetStats().LargestFreeBlock, 80);
+	allocator.Free(first);
+	//merged on both sides
+	allocator.Free(second);
+	RangeAllocatorStats stats = allocator.GetStats();
+	failures += Expect("free blocks after merging on both sides", stats.FreeBlockCount, 1);
+	failures += Expect("largest block after merging on both sides", stats.LargestFreeBlock, 100);
+	failures += Expect("used size", stats.UsedSize, 0);
+	failures += Expect("offset of the whole range", allocator.Allocate(100), 0);
+	return failures;
+}
+
+/// <summary>
+/// Grows a range, which ends with a free block, and one, which ends with an allocation
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestGrow()
+{
+	uint32_t failures = 0;
+	RangeAllocator allocator(50);
+	allocator.Allocate(40);
+	allocator.Grow(100);
+	RangeAllocatorStats stats = allocator.GetStats();
+	failures += Expect("capacity", stats.Capacity, 100);
+	failures += Expect("free blocks after growing a free end", stats.FreeBlockCount, 1);
+	failures += Expect("offset after growing a free end", allocator.Allocate(60), 40);
+	allocator.Grow(120);
+	failures += Expect("offset after growing a full range", allocator.Allocate(20), 100);
+	allocator.Grow(110);
+	failures += Expect("capacity after shrinking", allocator.GetStats().Capacity, 120);
+	return failures;
+}
+
+/// <summary>
+/// Defragments a range with gaps, the moves must keep the order and pack the ranges from the start
+/// </summary>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestDefragment()
+{
+	uint32_t failures = 0;
+	RangeAllocator allocator(100);
+	allocator.Allocate(10);
+	uint64_t first = allocator.Allocate(10);
+	uint64_t second = allocator.Allocate(20);
+	uint64_t third = allocator.Allocate(10);
+	uint64_t fourth = allocator.Allocate(20);
+	allocator.Free(first);
+	allocator.Free(third);
+	std::vector<RangeMove> moves = allocator.Defragment();
+	if (Expect("moves", moves.size(), 2))
+		return 1;
+	failures += Expect("old offset of the first move", moves[0].OldOffset, second);
+	failures += Expect("new offset of the first move", moves[0].NewOffset, 10);
+	failures += Expect("size of the first move", moves[0].Size, 20);
+	failures += Expect("old offset of the second move", moves[1].OldOffset, fourth);
+	failures += Expect("new offset of the second move", moves[1].NewOffset, 30);
+	failures += Expect("size of the second move", moves[1].Size, 20);
+	failures += Expect("moved allocation", allocator.GetAllocationSize(30), 20);
+	failures += Expect("old allocation", allocator.GetAllocationSize(fourth), 0);
+	RangeAllocatorStats stats = allocator.GetStats();
+	failures += Expect("free blocks after defragmenting", stats.FreeBlockCount, 1);
+	failures += Expect("largest block after defragmenting", stats.LargestFreeBlock, 50);
+	failures += Expect("moves of a packed range", allocator.Defragment().size(), 0);
+	return failures;
+}
+
+int main()
+{
+	uint32_t failures = TestBestFit() + TestCoalescing() + TestGrow() + TestDefragment();
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	std::cout << "range allocator checks passed" << std::endl;
+	return 0;
+}
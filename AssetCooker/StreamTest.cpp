@@ -0,0 +1,261 @@
+// Headless test of the world partition - streams the instances of a scene file along a scripted camera path
+// and checks every frame, that the budget holds and the simulated GPU copy of the instance buffers stays
+// consistent with the resident tiles.
+#include "InstancePacking.h"
+#include "SceneFile.h"
+#include "WorkerPool.h"
+#include "WorldPartition.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace ExecuteIndirect;
+
+static void PrintUsage()
+{
+	std::cerr << "Usage: eistream <scene.bin> <camera path> [--tile <size>] [--radius <load> <unload>] [--budget <MB>]\n"
+		"                [--speed <units per frame>] [--patches <instances per frame>] [--scatter <count> <extent>] [-j <threads>]\n"
+		"  camera path  waypoints, one 'x y z' per line, '#' starts a comment\n"
+		"  --scatter    for scenes without baked instances - places count instances of every item in a square of the extent\n";
+}
+
+static bool ReadCameraPath(const char* fileName, std::vector<std::vector<float>>& waypoints)
+{
+	std::ifstream file(fileName);
+	if (!file.is_open())
+		return false;
+	std::string line;
+	while (std::getline(file, line)) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		std::vector<float> point(3);
+		if (stream >> point[0] >> point[1] >> point[2])
+			waypoints.push_back(point);
+	}
+	return !waypoints.empty();
+}
+
+static bool ReadInstances(const SceneFile& scene, const SceneItemRecord& record, std::vector<SceneInstance>& instances)
+{
+	uint64_t size = scene.GetRawSize(record.InstanceSection);
+	if (size == 0 || size % sizeof(SceneInstance))
+		return false;
+	instances.resize((size_t)(size / sizeof(SceneInstance)));
+	if (!scene.IsCompressed(record.InstanceSection)) {
+		memcpy(instances.data(), scene.GetSectionData(record.InstanceSection), (size_t)size);
+		return true;
+	}
+	for (uint32_t block = 0; block < scene.GetBlockCount(record.InstanceSection); block++) {
+		if (!scene.DecompressBlock(record.InstanceSection, block, (uint8_t*)instances.data() + (size_t)block * SceneCompressionBlockSize))
+			return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Helper function - the instances, which the partition expects, are the ones with a scale
+/// </summary>
+static bool IsEmpty(const SceneInstance& instance)
+{
+	return instance.Scale == 0.0f;
+}
+
+int main(int argc, char* argv[])
+{
+	const char* sceneName = nullptr;
+	const char* pathName = nullptr;
+	WorldPartitionSettings settings;
+	float speed = 2.0f;
+	uint32_t scatterCount = 0;
+	float scatterExtent = 0.0f;
+	unsigned threads = 0;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--tile") == 0 && i + 1 < argc)
+			settings.TileSize = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--radius") == 0 && i + 2 < argc) {
+			settings.LoadRadius = (float)atof(argv[++i]);
+			settings.UnloadRadius = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "--budget") == 0 && i + 1 < argc)
+			settings.MemoryBudget = (uint64_t)(atof(argv[++i]) * 1024 * 1024);
+		else if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc)
+			speed = (float)atof(argv[++i]);
+		else if (strcmp(argv[i], "--patches") == 0 && i + 1 < argc)
+			settings.MaxPatchInstances = (uint32_t)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--scatter") == 0 && i + 2 < argc) {
+			scatterCount = (uint32_t)atoi(argv[++i]);
+			scatterExtent = (float)atof(argv[++i]);
+		}
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			threads = (unsigned)atoi(argv[++i]);
+		else if (argv[i][0] != '-' && !sceneName)
+			sceneName = argv[i];
+		else if (argv[i][0] != '-' && !pathName)
+			pathName = argv[i];
+		else {
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (!sceneName || !pathName || speed <= 0.0f) {
+		PrintUsage();
+		return 2;
+	}
+
+	SceneFile scene;
+	if (!scene.Open(sceneName)) {
+		std::cerr << "Failed to open " << sceneName << std::endl;
+		return 1;
+	}
+	std::vector<std::vector<float>> waypoints;
+	if (!ReadCameraPath(pathName, waypoints)) {
+		std::cerr << "Failed to read " << pathName << std::endl;
+		return 1;
+	}
+
+	//the items are streamed like in the renderer, the textures aren't in the scene file, so only the geometry is counted
+	std::vector<PartitionItem> items;
+	std::mt19937 generator(1);
+	std::uniform_real_distribution<float> position(-scatterExtent * 0.5f, scatterExtent * 0.5f);
+	for (uint32_t i = 0; i < scene.GetRenderItemCount(); i++) {
+		const SceneItemRecord& record = scene.GetRenderItems()[i];
+		PartitionItem item;
+		item.GeometryBytes = (uint64_t)record.VertexCount * (sizeof(ScenePosition) + sizeof(SceneVertexAttributes)) + (uint64_t)record.IndexCount * sizeof(uint32_t);
+		if (record.InstanceSection != SceneInvalidSection && (scene.GetFlags() & SceneFlag_CompactInstances)) {
+			if (!ReadInstances(scene, record, item.Instances)) {
+				std::cerr << "Failed to read the instances of " << scene.GetName(record) << std::endl;
+				return 1;
+			}
+		}
+		else {
+			item.Instances.resize(scatterCount);
+			for (auto& instance : item.Instances) {
+				PackInstance(record.World, instance);
+				instance.Position[0] = position(generator);
+				instance.Position[2] = position(generator);
+			}
+		}
+		if (item.Instances.size() > 1)
+			items.push_back(std::move(item));
+	}
+	if (items.empty()) {
+		std::cerr << "The scene has no instanced items, use --scatter" << std::endl;
+		return 1;
+	}
+	uint64_t instanceCount = 0;
+	for (auto& item : items)
+		instanceCount += item.Instances.size();
+
+	WorldPartition partition;
+	partition.Build(items, std::vector<uint64_t>(), settings);
+	std::vector<std::vector<SceneInstance>> mirrors(partition.GetItemCount());
+	std::vector<std::vector<SceneInstance>> gpu(partition.GetItemCount());
+	for (uint32_t i = 0; i < partition.GetItemCount(); i++) {
+		mirrors[i].assign(partition.GetCapacity(i), SceneInstance());
+		gpu[i] = mirrors[i];
+		partition.SetMirror(i, mirrors[i].data());
+	}
+	WorldPartitionStats stats = partition.GetStats();
+	std::cout << std::fixed << std::setprecision(2);
+	std::cout << items.size() << " streamed items, " << instanceCount << " instances in " << stats.TileCount << " tiles, "
+		<< stats.RawBytes / 1048576.0 << " MB compressed to " << stats.ColdBytes / 1048576.0 << " MB" << std::endl;
+
+	WorkerPool pool(threads);
+	std::vector<InstancePatch> patches;
+	uint64_t frames = 0, patchedInstances = 0, maxPatchFrame = 0, maxUsedBytes = 0;
+	int failures = 0;
+	auto applyPatches = [&](uint32_t maxInstances) {
+		patches.clear();
+		uint32_t count = partition.TakePatches(maxInstances, patches);
+		for (auto& patch : patches)
+			memcpy(&gpu[patch.Item][patch.Offset], &mirrors[patch.Item][patch.Offset], patch.Count * sizeof(SceneInstance));
+		return count;
+	};
+	auto check = [&](const float origin[3], const char* when) {
+		stats = partition.GetStats();
+		maxUsedBytes = std::max(maxUsedBytes, stats.UsedBytes);
+		if (stats.UsedBytes > settings.MemoryBudget) {
+			std::cerr << when << ": " << stats.UsedBytes << " bytes over the budget" << std::endl;
+			failures++;
+		}
+		for (uint32_t i = 0; i < partition.GetItemCount(); i++) {
+			uint32_t resident = 0;
+			for (auto& instance : mirrors[i]) {
+				if (IsEmpty(instance))
+					continue;
+				resident++;
+				uint32_t tile = partition.GetTile(instance.Position[0], instance.Position[2]);
+				if (!partition.IsTileResident(tile) || partition.GetTileDistance(tile, origin) > partition.GetSettings().UnloadRadius) {
+					std::cerr << when << ": item " << i << " has an instance of a tile, which isn't resident" << std::endl;
+					failures++;
+					break;
+				}
+			}
+			if (resident != partition.GetResidentInstances(i)) {
+				std::cerr << when << ": item " << i << " has " << resident << " instances, the tiles have " << partition.GetResidentInstances(i) << std::endl;
+				failures++;
+			}
+		}
+	};
+
+	//the camera moves along the path at a constant speed, one update per frame
+	float origin[3] = { waypoints[0][0], waypoints[0][1], waypoints[0][2] };
+	partition.LoadAll(origin, pool);
+	applyPatches(~0u);
+	check(origin, "start");
+	for (size_t waypoint = 1; waypoint < waypoints.size() && failures == 0; waypoint++) {
+		const std::vector<float>& from = waypoints[waypoint - 1];
+		const std::vector<float>& to = waypoints[waypoint];
+		float length = std::sqrt((to[0] - from[0]) * (to[0] - from[0]) + (to[1] - from[1]) * (to[1] - from[1]) + (to[2] - from[2]) * (to[2] - from[2]));
+		uint32_t steps = std::max((uint32_t)std::ceil(length / speed), 1u);
+		for (uint32_t step = 1; step <= steps && failures == 0; step++) {
+			float t = (float)step / steps;
+			for (int c = 0; c < 3; c++)
+				origin[c] = from[c] + (to[c] - from[c]) * t;
+			partition.Update(origin, pool);
+			uint32_t count = applyPatches(settings.MaxPatchInstances);
+			patchedInstances += count;
+			maxPatchFrame = std::max<uint64_t>(maxPatchFrame, count);
+			frames++;
+			check(origin, ("frame " + std::to_string(frames)).c_str());
+		}
+	}
+
+	//after the last waypoint every tile in range, which fits in the budget, is resident and the GPU copy has caught up
+	partition.LoadAll(origin, pool);
+	while (applyPatches(settings.MaxPatchInstances))
+		;
+	check(origin, "end");
+	for (uint32_t i = 0; i < partition.GetItemCount(); i++) {
+		if (memcmp(gpu[i].data(), mirrors[i].data(), mirrors[i].size() * sizeof(SceneInstance)) != 0) {
+			std::cerr << "end: the GPU copy of item " << i << " differs from the mirror" << std::endl;
+			failures++;
+		}
+	}
+	uint32_t missing = 0;
+	for (uint32_t tile = 0; tile < partition.GetTileCount(); tile++) {
+		if (!partition.IsTileEmpty(tile) && !partition.IsTileResident(tile) && partition.GetTileDistance(tile, origin) <= partition.GetSettings().LoadRadius)
+			missing++;
+	}
+
+	stats = partition.GetStats();
+	std::cout << frames << " frames: " << stats.Loads << " loads, " << stats.Unloads << " unloads, " << stats.Discarded << " discarded loads, "
+		<< stats.Defragmentations << " defragmentations\n"
+		<< "  patches " << patchedInstances << " instances, at most " << maxPatchFrame << " per frame\n"
+		<< "  memory at most " << maxUsedBytes / 1048576.0 << " MB of " << settings.MemoryBudget / 1048576.0 << " MB\n"
+		<< "  at the end " << stats.ResidentTiles << " resident tiles, " << stats.ResidentInstances << " instances, "
+		<< missing << " tiles in range didn't fit in the budget" << std::endl;
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
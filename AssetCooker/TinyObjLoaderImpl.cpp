@@ -0,0 +1,3 @@
+//the renderer's tinyobj implementation is compiled in its precompiled header build, the cooker compiles its own
+#define TINYOBJ_LOADER_OPT_IMPLEMENTATION
+#include "tinyObjLoader.h"
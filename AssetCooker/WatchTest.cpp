@@ -0,0 +1,78 @@
+// Headless test of the hot reload service - writes a watched file and renames a new file over it, like an editor
+// saving twice, and checks that the service reports the file once, after the changes settled
+#include "HotReloadService.h"
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+using namespace ExecuteIndirect;
+
+static bool WriteText(const std::string& fileName, const char* text)
+{
+	std::ofstream file(fileName, std::ios::trunc);
+	file << text;
+	return file.good();
+}
+
+/// <summary>
+/// Changes a watched file twice within the settle time
+/// </summary>
+/// <param name="name">The name of the watcher in the messages.</param>
+/// <returns>The number of failed checks</returns>
+static uint32_t TestWatcher(const char* name, std::unique_ptr<FileWatcher> watcher, const std::string& directory)
+{
+	const std::chrono::milliseconds PollInterval(10), SettleTime(200);
+	std::string fileName = directory + "/watched.obj";
+	std::string tempName = directory + "/watched.obj.tmp";
+	if (!WriteText(fileName, "o first\n")) {
+		std::cerr << "Failed to write " << fileName << std::endl;
+		return 1;
+	}
+
+	std::mutex mutex;
+	std::vector<std::vector<std::string>> reloads;
+	HotReloadService service(std::move(watcher));
+	service.Watch(fileName);
+	service.Start([&mutex, &reloads](const std::vector<std::string>& files) {
+		std::lock_guard<std::mutex> lock(mutex);
+		reloads.push_back(files);
+	}, PollInterval, SettleTime);
+	//the polling watcher only sees a change of the time or the size
+	std::this_thread::sleep_for(PollInterval * 3);
+	WriteText(fileName, "o second\n");
+	std::this_thread::sleep_for(PollInterval * 3);
+	WriteText(tempName, "o third, renamed\n");
+	if (std::rename(tempName.c_str(), fileName.c_str()) != 0) {
+		std::cerr << "Failed to rename " << tempName << std::endl;
+		return 1;
+	}
+	std::this_thread::sleep_for(SettleTime * 4);
+	service.Stop();
+	std::remove(fileName.c_str());
+
+	uint32_t failures = 0;
+	if (reloads.size() != 1) {
+		std::cerr << name << ": " << reloads.size() << " reloads instead of 1" << std::endl;
+		failures++;
+	}
+	else if (reloads[0].size() != 1 || reloads[0][0] != fileName) {
+		std::cerr << name << ": the reload has " << reloads[0].size() << " files instead of " << fileName << std::endl;
+		failures++;
+	}
+	std::cout << name << ": " << reloads.size() << " reloads" << std::endl;
+	return failures;
+}
+
+int main(int argc, char* argv[])
+{
+	std::string directory = argc > 1 ? argv[1] : ".";
+	uint32_t failures = TestWatcher("platform watcher", CreateFileWatcher(), directory) +
+		TestWatcher("polling watcher", std::unique_ptr<FileWatcher>(new PollingFileWatcher()), directory);
+	if (failures) {
+		std::cerr << failures << " checks failed" << std::endl;
+		return 1;
+	}
+	return 0;
+}
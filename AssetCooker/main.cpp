@@ -0,0 +1,85 @@
+#include "AssetCooker.h"
+#include "MemoryTracker.h"
+#include "StartupProfiler.h"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+using namespace ExecuteIndirect;
+
+static void PrintUsage()
+{
+	std::cerr << "Usage: eicook <manifest> [-o <output directory>] [-j <threads>] [--compress] [--no-optimize] [--profile <json file>]\n"
+		"             [--memory <json file>] [--memory-budget <MB>]\n"
+		"  manifest       list of OBJ files, one per line, '#' starts a comment\n"
+		"  -o             directory of scene.bin and materials.bin (default: models)\n"
+		"  -j             worker threads (default: one per hardware thread)\n"
+		"  --compress     LZ compression of the geometry streams\n"
+		"  --no-optimize  keep the imported vertices, don't weld or reorder them\n"
+		"  --profile      print the phase timings, bytes read and allocated, and write them as JSON\n"
+		"  --memory       print the current and peak memory of the categories and the render items, and write them as JSON\n"
+		"  --memory-budget  warn when the tracked memory goes over the budget\n";
+}
+
+int main(int argc, char* argv[])
+{
+	const char* manifest = nullptr;
+	const char* profile = nullptr;
+	const char* memory = nullptr;
+	CookerOptions options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			options.OutputDirectory = argv[++i];
+		else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+			options.ThreadCount = (unsigned)atoi(argv[++i]);
+		else if (strcmp(argv[i], "--compress") == 0)
+			options.Compress = true;
+		else if (strcmp(argv[i], "--no-optimize") == 0)
+			options.Optimize = false;
+		else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc)
+			profile = argv[++i];
+		else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc)
+			memory = argv[++i];
+		else if (strcmp(argv[i], "--memory-budget") == 0 && i + 1 < argc)
+			MemoryTracker::Get().SetTotalBudget((uint64_t)(atof(argv[++i]) * 1024 * 1024));
+		else if (argv[i][0] != '-' && !manifest)
+			manifest = argv[i];
+		else {
+			PrintUsage();
+			return 2;
+		}
+	}
+	if (!manifest) {
+		PrintUsage();
+		return 2;
+	}
+
+	//the cook is profiled like the renderer's startup, so the nightly runs can track the shared loading code
+	if (profile)
+		StartupProfiler::Get().Start("Cook");
+	std::vector<std::string> objFiles;
+	if (!AssetCooker::ReadManifest(manifest, objFiles)) {
+		std::cerr << "Failed to read " << manifest << std::endl;
+		return 1;
+	}
+	AssetCooker cooker(options);
+	if (!cooker.Cook(objFiles))
+		return 1;
+	cooker.PrintReport(std::cout);
+	if (profile) {
+		StartupProfiler::Get().Finish();
+		StartupProfiler::Get().WriteTable(std::cout);
+		if (!StartupProfiler::Get().WriteJSON(profile)) {
+			std::cerr << "Failed to write " << profile << std::endl;
+			return 1;
+		}
+	}
+	if (memory) {
+		MemoryTracker::Get().WriteTable(std::cout);
+		if (!MemoryTracker::Get().WriteJSON(memory)) {
+			std::cerr << "Failed to write " << memory << std::endl;
+			return 1;
+		}
+	}
+	return 0;
+}
@@ -1,4 +1,5 @@
 #include "Lighting.hlsli"
+#include "Instance.hlsli"
 #define threadBlockSize 64		//should be a multiple of WAPR size (32 threads for NVidia cards) 
 
 cbuffer SceneConstantBuffer : register(b0)
@@ -12,15 +13,6 @@ cbuffer SceneConstantBuffer : register(b0)
 	Light lights[MaxLights];
 };
 
-struct InstanceData
-{
-	float4x4 World;
-	float4x4 TexTransform;
-	uint materialIndex;
-	uint InstPad0;
-	uint InstPad1;
-	uint InstPad2;
-};
 
 
 cbuffer ComputeConstants : register(b1)			
@@ -28,29 +20,57 @@ cbuffer ComputeConstants : register(b1)
 	uint instanceCount;
 	float3 center;
 	float3 extents;
+	float impostorDistance;		//visible instances farther than this are drawn as impostors
+	float4 orientation;			//rotation of the oriented box, as a quaternion
+	float3 orientedCenter;
+	float sphereRadius;
+	float3 orientedExtents;
+	float CSPad0;
+	float3 sphereCenter;
+	float CSPad1;
 }
 
 Texture2D<float> HizMap										: register(t0, space1);			// HiZ MIP Map Chain
 SamplerState HizMapSampler									: register(s0);					// Sampler state for the HiZ Buffer
 StructuredBuffer<InstanceData> inputInstanceData			: register(t0);					// Instance data SRV
 AppendStructuredBuffer<InstanceData> outputInstanceData		: register(u0);					// Approved instance data UAV
+AppendStructuredBuffer<InstanceData> outputImpostorData		: register(u1);					// Approved far instance data UAV
+
 
+/// <summary>
+/// Checks if the instance's bounding sphere is inside the view frustum - a cheap test before the box corners are transformed
+/// </summary>
+/// <param name="worldMatrix">The world matrix for this instance</param>
+int sphereFrustumCull(in float4x4 worldMatrix) {
+	//the instances are scaled uniformly, so the radius is scaled by the length of one of the basis vectors
+	float radius = sphereRadius * length(worldMatrix[0].xyz);
+	float3 centerV = mul(mul(float4(sphereCenter, 1.0f), worldMatrix), viewMatrix).xyz;
+	//near plane
+	if (centerV.z + radius < -projectionMatrix[3][2] / projectionMatrix[2][2])
+		return 0;
+	//side planes - the distance of the center to the planes x * p00 = z and y * p11 = z
+	float2 scale = float2(projectionMatrix[0][0], projectionMatrix[1][1]);
+	float2 planeDistance = (abs(centerV.xy) * scale - centerV.z) / sqrt(scale * scale + 1.0f);
+	if (planeDistance.x > radius || planeDistance.y > radius)
+		return 0;
+	return 1;
+}
 
 /// <summary>
-/// Calculates the bounding box corners from its center and extents, and transforms them to homogeneous clip space
+/// Calculates the oriented bounding box corners from its center, extents and orientation, and transforms them to homogeneous clip space
 /// </summary>
 /// <param name="worldMatrix">The world matrix for this instance</param>
 /// <param name="BoundingBoxCorners">The object's bounding box corners, in local space</param>
 void transformCorners(in float4x4 worldMatrix, inout float4 BoundingBoxCorners[8]) {
 	//fill the global array with the corners
-	BoundingBoxCorners[0] = float4 (center + float3(extents.x, extents.y, extents.z), 1.0f);
-	BoundingBoxCorners[1] = float4 (center + float3(-extents.x, extents.y, extents.z), 1.0f);
-	BoundingBoxCorners[2] = float4 (center + float3(extents.x, -extents.y, extents.z), 1.0f);
-	BoundingBoxCorners[3] = float4 (center + float3(-extents.x, -extents.y, extents.z), 1.0f);
-	BoundingBoxCorners[4] = float4 (center + float3(extents.x, extents.y, -extents.z), 1.0f);
-	BoundingBoxCorners[5] = float4 (center + float3(-extents.x, extents.y, -extents.z), 1.0f);
-	BoundingBoxCorners[6] = float4 (center + float3(extents.x, -extents.y, -extents.z), 1.0f);
-	BoundingBoxCorners[7] = float4 (center + float3(-extents.x, -extents.y, -extents.z), 1.0f);
+	BoundingBoxCorners[0] = float4 (orientedCenter + rotateVector(float3(orientedExtents.x, orientedExtents.y, orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[1] = float4 (orientedCenter + rotateVector(float3(-orientedExtents.x, orientedExtents.y, orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[2] = float4 (orientedCenter + rotateVector(float3(orientedExtents.x, -orientedExtents.y, orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[3] = float4 (orientedCenter + rotateVector(float3(-orientedExtents.x, -orientedExtents.y, orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[4] = float4 (orientedCenter + rotateVector(float3(orientedExtents.x, orientedExtents.y, -orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[5] = float4 (orientedCenter + rotateVector(float3(-orientedExtents.x, orientedExtents.y, -orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[6] = float4 (orientedCenter + rotateVector(float3(orientedExtents.x, -orientedExtents.y, -orientedExtents.z), orientation), 1.0f);
+	BoundingBoxCorners[7] = float4 (orientedCenter + rotateVector(float3(-orientedExtents.x, -orientedExtents.y, -orientedExtents.z), orientation), 1.0f);
 	//multiply each of the corners by the WVP matrices
 	for (int j = 0; j < 8; j++) {
 		BoundingBoxCorners[j] = mul(BoundingBoxCorners[j], worldMatrix);
@@ -173,7 +193,14 @@ void main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
 		return;
 	
 	float4 BoundingBoxCorners[8];
-	float4x4 worldMatrix = inputInstanceData[index].World;
+	InstanceData instance = inputInstanceData[index];
+	//the slots of the streamed items, which have no resident instance, are zeroed
+	if (instance.Scale == 0.0f)
+		return;
+	float4x4 worldMatrix = instanceWorld(instance);
+	//reject the instances, which bounding sphere is outside the frustum
+	if (sphereFrustumCull(worldMatrix) == 0)
+		return;
 	//transform the current bounding box to homogenous clip space coordinates
 	transformCorners(worldMatrix, BoundingBoxCorners);
 	//execute frustum culling
@@ -183,7 +210,14 @@ void main(uint3 groupId : SV_GroupID, uint groupIndex : SV_GroupIndex)
 
 	//execute occlusion culling
 	visible = occlusionCull(BoundingBoxCorners);
-	if(visible == 1)
-		outputInstanceData.Append(inputInstanceData[index]);
+	if (visible == 0)
+		return;
+
+	//split the visible instances by distance - the far ones are drawn as impostor quads
+	float3 centerW = mul(float4(center, 1.0f), worldMatrix).xyz;
+	if (distance(centerW, eyePosW) > impostorDistance)
+		outputImpostorData.Append(instance);
+	else
+		outputInstanceData.Append(instance);
 	
 }
\ No newline at end of file
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+
+namespace ExecuteIndirect {
+
+	// SplitMix64 finalizer of a 64 bit value
+	inline uint64_t SplitMix64(uint64_t z)
+	{
+		z += 0x9e3779b97f4a7c15ull;
+		z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+		z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+		return z ^ (z >> 31);
+	}
+
+	// Counter based random number - a pure function of the seed, the stream (e.g. a spawn group) and the counter (e.g.
+	// an instance of the group), so the numbers can be generated in any order and on any thread with the same result.
+	// The counters of a stream give the sequence of a SplitMix64 generator, seeded with the hashed seed and stream.
+	inline uint64_t CounterRandom(uint64_t seed, uint64_t stream, uint64_t counter)
+	{
+		uint64_t key = SplitMix64(seed ^ SplitMix64(stream));
+		return SplitMix64(key + counter * 0x9e3779b97f4a7c15ull);
+	}
+
+	// An index in [0, count) from the high 32 bits of a random number
+	inline uint32_t RandomIndex(uint64_t random, uint32_t count)
+	{
+		return (uint32_t)(((random >> 32) * count) >> 32);
+	}
+
+	// A float in [0, 1) from the low 24 bits of a random number, so it is independent of RandomIndex
+	inline float RandomUnitFloat(uint64_t random)
+	{
+		return (float)(random & 0xffffff) * (1.0f / 16777216.0f);
+	}
+}
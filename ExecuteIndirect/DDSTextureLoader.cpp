@@ -25,6 +25,7 @@
 #include "pch.h"
 
 #include "DDSTextureLoader.h" 
+#include "StartupProfiler.h"
 
 using namespace Microsoft::WRL;
 
@@ -228,6 +229,7 @@ static HRESULT LoadTextureDataFromFile( _In_z_ const wchar_t* fileName,
     {
         return E_FAIL;
     }
+    ExecuteIndirect::CountReadBytes(BytesRead);
 
     // DDS files always start with the same magic number ("DDS ")
     uint32_t dwMagicNumber = *( const uint32_t* )( ddsData.get() );
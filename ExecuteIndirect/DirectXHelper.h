@@ -2,6 +2,8 @@
 #include "pch.h"
 #include <ppltasks.h>	// For create_task
 #include <comdef.h>
+#include "Hash.h"
+#include "StartupProfiler.h"
 
 using Microsoft::WRL::ComPtr;
 namespace DX
@@ -119,6 +121,7 @@ namespace DX
 		{
 			throw std::exception();
 		}
+		ExecuteIndirect::CountReadBytes(fileInfo.EndOfFile.LowPart);
 
 		return S_OK;
 	}
@@ -231,11 +234,69 @@ namespace DX
 		// The caller can Release the uploadBuffer after it knows the copy has been executed.
 	}
 
+	inline void CreateDefaultTexture2D(
+		ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList,
+		const void* initData,
+		UINT width,
+		UINT height,
+		DXGI_FORMAT format,
+		UINT bytesPerTexel,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer,
+		Microsoft::WRL::ComPtr<ID3D12Resource>& defaultTexture)
+	{
+		// Create the texture with a single mip level, it is created in copy destination state.
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Tex2D(format, width, height, 1, 1),
+			D3D12_RESOURCE_STATE_COPY_DEST,
+			nullptr,
+			IID_PPV_ARGS(&defaultTexture)));
+
+		// The upload heap is sized by the footprint of the texture, not by the size of the texel data
+		const UINT64 uploadBufferSize = GetRequiredIntermediateSize(defaultTexture.Get(), 0, 1);
+		ThrowIfFailed(device->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(uploadBufferSize),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&uploadBuffer)));
+
+		D3D12_SUBRESOURCE_DATA subResourceData = {};
+		subResourceData.pData = initData;
+		subResourceData.RowPitch = width * bytesPerTexel;
+		subResourceData.SlicePitch = subResourceData.RowPitch * height;
+
+		UpdateSubresources<1>(cmdList, defaultTexture.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
+		cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultTexture.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+	}
+
+	// 64 bit hash of a byte range, used for content based comparisons
+	inline UINT64 HashBytes(const void* data, size_t size, UINT64 seed = 0)
+	{
+		return ExecuteIndirect::HashBytes(data, size, seed);
+	}
+
 	inline UINT AlignForUavCounter(UINT bufferSize)
 	{
 		const UINT alignment = D3D12_UAV_COUNTER_PLACEMENT_ALIGNMENT;
 		return (bufferSize + (alignment - 1)) & ~(alignment - 1);
 	}
 
+	// The memory of a committed resource - its size, aligned like the heap, which the resource was placed in
+	inline UINT64 GetResourceSize(ID3D12Resource* resource)
+	{
+		if (!resource)
+			return 0;
+		ComPtr<ID3D12Device> device;
+		if (FAILED(resource->GetDevice(IID_PPV_ARGS(&device))))
+			return 0;
+		D3D12_RESOURCE_DESC desc = resource->GetDesc();
+		return device->GetResourceAllocationInfo(0, 1, &desc).SizeInBytes;
+	}
+
 
 }
\ No newline at end of file
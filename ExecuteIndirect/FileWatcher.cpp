@@ -0,0 +1,127 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "FileWatcher.h"
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+using namespace ExecuteIndirect;
+
+PollingFileWatcher::FileStamp PollingFileWatcher::GetStamp(const std::string& fileName)
+{
+	FileStamp stamp;
+#ifdef _WIN32
+	struct _stat64 status;
+	if (_stat64(fileName.c_str(), &status) == 0) {
+#else
+	struct stat status;
+	if (stat(fileName.c_str(), &status) == 0) {
+#endif
+#ifdef __linux__
+		//whole seconds would miss a second write of the same size
+		stamp.ModificationTime = (int64_t)status.st_mtim.tv_sec * 1000000000 + status.st_mtim.tv_nsec;
+#else
+		stamp.ModificationTime = (int64_t)status.st_mtime;
+#endif
+		stamp.Size = (int64_t)status.st_size;
+	}
+	return stamp;
+}
+
+bool PollingFileWatcher::Watch(const std::string& fileName)
+{
+	m_files[fileName] = GetStamp(fileName);
+	return true;
+}
+
+void PollingFileWatcher::Poll(std::vector<std::string>& changedFiles)
+{
+	for (auto& file : m_files) {
+		FileStamp stamp = GetStamp(file.first);
+		if (stamp.ModificationTime == file.second.ModificationTime && stamp.Size == file.second.Size)
+			continue;
+		file.second = stamp;
+		//a deleted file is reported when it is written again
+		if (stamp.ModificationTime >= 0)
+			changedFiles.push_back(file.first);
+	}
+}
+
+#ifdef __linux__
+InotifyFileWatcher::InotifyFileWatcher() :
+	m_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC))
+{
+}
+
+InotifyFileWatcher::~InotifyFileWatcher()
+{
+	if (m_fd >= 0)
+		close(m_fd);
+}
+
+bool InotifyFileWatcher::Watch(const std::string& fileName)
+{
+	if (m_fd < 0)
+		return false;
+	//the scene uses Windows paths, both separators are accepted
+	size_t separator = fileName.find_last_of("/\\");
+	std::string directory = separator == std::string::npos ? "." : fileName.substr(0, separator);
+	std::string name = separator == std::string::npos ? fileName : fileName.substr(separator + 1);
+	std::replace(directory.begin(), directory.end(), '\\', '/');
+	int wd = inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+	if (wd < 0)
+		return false;
+	Directory& watched = m_directories[wd];
+	watched.Path = directory;
+	watched.Files[name] = fileName;
+	return true;
+}
+
+void InotifyFileWatcher::Poll(std::vector<std::string>& changedFiles)
+{
+	if (m_fd < 0)
+		return;
+	alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+	for (;;) {
+		ssize_t size = read(m_fd, buffer, sizeof(buffer));
+		if (size <= 0)
+			return;
+		for (char* position = buffer; position < buffer + size;) {
+			const inotify_event* event = reinterpret_cast<const inotify_event*>(position);
+			position += sizeof(inotify_event) + event->len;
+			auto directory = m_directories.find(event->wd);
+			if (directory == m_directories.end() || event->len == 0)
+				continue;
+			auto file = directory->second.Files.find(event->name);
+			if (file == directory->second.Files.end())
+				continue;
+			//a new file is reported when it is closed, a file renamed over the watched one right away
+			if ((event->mask & IN_CREATE) && !(event->mask & IN_ISDIR))
+				continue;
+			if (std::find(changedFiles.begin(), changedFiles.end(), file->second) == changedFiles.end())
+				changedFiles.push_back(file->second);
+		}
+	}
+}
+#endif
+
+/// <summary>
+/// Creates the watcher of the platform - inotify on Linux, polling of the file times elsewhere
+/// </summary>
+std::unique_ptr<FileWatcher> ExecuteIndirect::CreateFileWatcher()
+{
+#ifdef __linux__
+	std::unique_ptr<InotifyFileWatcher> watcher(new InotifyFileWatcher());
+	if (watcher->IsValid())
+		return watcher;
+#endif
+	return std::unique_ptr<FileWatcher>(new PollingFileWatcher());
+}
@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Reports the watched files, which were written since the last poll. The hot reload service only sees this
+	// interface, CreateFileWatcher picks the best implementation of the platform.
+	class FileWatcher
+	{
+	public:
+		virtual ~FileWatcher() {}
+		// The file doesn't have to exist yet, it is reported when it is created
+		virtual bool Watch(const std::string& fileName) = 0;
+		// Appends the changed files (as they were given to Watch), it doesn't block
+		virtual void Poll(std::vector<std::string>& changedFiles) = 0;
+	};
+
+	// Compares the modification time and the size of every watched file, works on every platform
+	class PollingFileWatcher : public FileWatcher
+	{
+	public:
+		bool Watch(const std::string& fileName) override;
+		void Poll(std::vector<std::string>& changedFiles) override;
+
+	private:
+		struct FileStamp
+		{
+			int64_t ModificationTime = -1;		// -1 if the file doesn't exist
+			int64_t Size = -1;
+		};
+		static FileStamp GetStamp(const std::string& fileName);
+
+		std::unordered_map<std::string, FileStamp> m_files;
+	};
+
+#ifdef __linux__
+	// inotify watches on the directories of the files, editors often write a new file and rename it over the old one
+	class InotifyFileWatcher : public FileWatcher
+	{
+	public:
+		InotifyFileWatcher();
+		~InotifyFileWatcher() override;
+		InotifyFileWatcher(const InotifyFileWatcher&) = delete;
+		InotifyFileWatcher& operator=(const InotifyFileWatcher&) = delete;
+
+		bool IsValid() const { return m_fd >= 0; }
+		bool Watch(const std::string& fileName) override;
+		void Poll(std::vector<std::string>& changedFiles) override;
+
+	private:
+		struct Directory
+		{
+			std::string Path;
+			std::unordered_map<std::string, std::string> Files;		// name in the directory -> watched file name
+		};
+
+		int m_fd;
+		std::unordered_map<int, Directory> m_directories;			// watch descriptor -> directory
+	};
+#endif
+
+	std::unique_ptr<FileWatcher> CreateFileWatcher();
+}
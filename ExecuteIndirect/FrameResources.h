@@ -80,6 +80,10 @@ namespace ExecuteIndirect {
 		std::unique_ptr<UploadBuffer<SceneConstantBuffer>> SceneCB = nullptr;
 		std::unique_ptr<UploadBuffer<ModelConstantBuffer>> ModelCB = nullptr;
 		std::unique_ptr<UploadBuffer<MaterialData>> MaterialBuffer = nullptr;
+		// The constants of the render items, which the instances don't repeat
+		std::unique_ptr<UploadBuffer<ItemData>> ItemBuffer = nullptr;
+		// The changed instances of the streamed items, copied to their instance buffers
+		std::unique_ptr<UploadBuffer<InstanceData>> InstancePatches = nullptr;
 	};
 
 }
\ No newline at end of file
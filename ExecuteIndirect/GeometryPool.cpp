@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "GeometryPool.h"
+#include "DirectXHelper.h"
+#include "MemoryTracker.h"
+#include <sstream>
+
+using namespace ExecuteIndirect;
+using namespace Microsoft::WRL;
+
+/// <summary>
+/// Allocates the ranges of all render items, creates the pooled buffers and records the copy of the geometry
+/// </summary>
+/// <param name="device">The device.</param>
+/// <param name="cmdList">The command list, which will copy the geometry.</param>
+/// <param name="renderItems">The render items.</param>
+/// <param name="reserve">Part of the pool, left free for geometry added later.</param>
+void GeometryPool::Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, float reserve)
+{
+	UINT64 vertexCount = 0;
+	UINT64 indexCount = 0;
+	for (auto& renderItem : renderItems) {
+		vertexCount += renderItem.second->GetVertexCount();
+		indexCount += renderItem.second->GetIndexCount();
+	}
+	UINT64 vertexCapacity = vertexCount + (UINT64)(vertexCount * reserve);
+	UINT64 indexCapacity = indexCount + (UINT64)(indexCount * reserve);
+	m_vertexAllocator.Reset(vertexCapacity);
+	m_indexAllocator.Reset(indexCapacity);
+
+	CreateBuffer(device, vertexCapacity * sizeof(XMFLOAT3), m_positionBuffer, L"Pooled Position Buffer");
+	CreateBuffer(device, vertexCapacity * sizeof(VertexAttributes), m_attributeBuffer, L"Pooled Attribute Buffer");
+	CreateBuffer(device, indexCapacity * sizeof(UINT), m_indexBuffer, L"Pooled Index Buffer");
+	MemoryTracker& tracker = MemoryTracker::Get();
+	tracker.SetOwnerName(this, "Geometry pool");
+	tracker.Set(Memory_GPUGeometry, DX::GetResourceSize(m_positionBuffer.Get()) + DX::GetResourceSize(m_attributeBuffer.Get()) +
+		DX::GetResourceSize(m_indexBuffer.Get()), this);
+
+	//The allocators are empty, so the ranges are packed from the start and a single upload buffer
+	//with the three streams one after another is copied with three copies
+	const UINT64 attributesOffset = vertexCount * sizeof(XMFLOAT3);
+	const UINT64 indicesOffset = attributesOffset + vertexCount * sizeof(VertexAttributes);
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(indicesOffset + indexCount * sizeof(UINT)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_uploadBuffer)));
+	m_uploadBuffer->SetName(L"Pooled Geometry Upload Buffer");
+	tracker.Set(Memory_Uploaders, DX::GetResourceSize(m_uploadBuffer.Get()), this);
+	BYTE* mappedData = nullptr;
+	ThrowIfFailed(m_uploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+
+	m_positionView = { m_positionBuffer->GetGPUVirtualAddress(), (UINT)(vertexCapacity * sizeof(XMFLOAT3)), sizeof(XMFLOAT3) };
+	m_attributeView = { m_attributeBuffer->GetGPUVirtualAddress(), (UINT)(vertexCapacity * sizeof(VertexAttributes)), sizeof(VertexAttributes) };
+	m_indexView = { m_indexBuffer->GetGPUVirtualAddress(), (UINT)(indexCapacity * sizeof(UINT)), DXGI_FORMAT_R32_UINT };
+	for (auto& renderItem : renderItems) {
+		RenderItem* ri = renderItem.second.get();
+		UINT baseVertex = (UINT)m_vertexAllocator.Allocate(ri->GetVertexCount());
+		UINT startIndex = (UINT)m_indexAllocator.Allocate(ri->GetIndexCount());
+		memcpy(mappedData + baseVertex * sizeof(XMFLOAT3), ri->GetPositionData(), ri->GetPositionBufferByteSize());
+		memcpy(mappedData + attributesOffset + baseVertex * sizeof(VertexAttributes), ri->GetAttributeData(), ri->GetAttributeBufferByteSize());
+		memcpy(mappedData + indicesOffset + startIndex * sizeof(UINT), ri->GetIndexBufferData(), ri->GetIndexBufferByteSize());
+		ri->SetGeometry(m_positionView, m_attributeView, m_indexView, baseVertex, startIndex);
+	}
+	m_uploadBuffer->Unmap(0, nullptr);
+
+	cmdList->CopyBufferRegion(m_positionBuffer.Get(), 0, m_uploadBuffer.Get(), 0, attributesOffset);
+	cmdList->CopyBufferRegion(m_attributeBuffer.Get(), 0, m_uploadBuffer.Get(), attributesOffset, indicesOffset - attributesOffset);
+	cmdList->CopyBufferRegion(m_indexBuffer.Get(), 0, m_uploadBuffer.Get(), indicesOffset, indexCount * sizeof(UINT));
+	D3D12_RESOURCE_BARRIER barriers[3] = {
+		CD3DX12_RESOURCE_BARRIER::Transition(m_positionBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_attributeBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_indexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+/// <summary>
+/// Moves a render item to new ranges, which fit its new vertex and index count. The new ranges are allocated
+/// before the old ones are freed, so the item keeps its geometry if they can't be allocated. If no free block is big
+/// enough, the pool is compacted first - and grows, if its free space isn't enough either.
+/// </summary>
+/// <param name="device">The device.</param>
+/// <param name="cmdList">The command list, which copies the geometry of a compaction.</param>
+/// <param name="renderItems">All render items of the pool, a compaction updates their ranges and views.</param>
+/// <param name="renderItem">The render item, its ranges are updated.</param>
+/// <param name="vertexCount">The new vertex count.</param>
+/// <param name="indexCount">The new index count.</param>
+/// <returns>false if the new ranges can't be allocated</returns>
+bool GeometryPool::Reallocate(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, RenderItem* renderItem, UINT vertexCount, UINT indexCount)
+{
+	UINT64 vertexSize = DX::Max(vertexCount, 1u);
+	UINT64 indexSize = DX::Max(indexCount, 1u);
+	if (m_vertexAllocator.GetStats().LargestFreeBlock < vertexSize || m_indexAllocator.GetStats().LargestFreeBlock < indexSize)
+		Compact(device, cmdList, renderItems, vertexSize, indexSize);
+	UINT64 baseVertex = m_vertexAllocator.Allocate(vertexSize);
+	if (baseVertex == RangeAllocator::InvalidOffset)
+		return false;
+	UINT64 startIndex = m_indexAllocator.Allocate(indexSize);
+	if (startIndex == RangeAllocator::InvalidOffset) {
+		m_vertexAllocator.Free(baseVertex);
+		return false;
+	}
+	m_vertexAllocator.Free(renderItem->GetBaseVertexLocation());
+	m_indexAllocator.Free(renderItem->GetStartIndexLocation());
+	renderItem->SetGeometry(m_positionView, m_attributeView, m_indexView, (UINT)baseVertex, (UINT)startIndex);
+	return true;
+}
+
+/// <summary>
+/// Helper function - records the copy of the ranges of a defragmented allocator from the old to the new buffer
+/// </summary>
+/// <param name="stride">The size of an element of the allocator in bytes.</param>
+/// <param name="moves">The moves, returned by Defragment.</param>
+/// <param name="usedSize">The used size of the allocator.</param>
+static void CopyRanges(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* destination, ID3D12Resource* source, UINT64 stride,
+	const std::vector<RangeMove>& moves, UINT64 usedSize)
+{
+	//the ranges before the first move kept their offsets, so they are one block at the start
+	UINT64 unmoved = moves.empty() ? usedSize : moves[0].NewOffset;
+	if (unmoved)
+		cmdList->CopyBufferRegion(destination, 0, source, 0, unmoved * stride);
+	for (auto& move : moves)
+		cmdList->CopyBufferRegion(destination, move.NewOffset * stride, source, move.OldOffset * stride, move.Size * stride);
+}
+
+/// <summary>
+/// Moves all ranges to the start of new buffers, so the free space is one block at their end. If the free space is
+/// smaller than the requested sizes, the new buffers are bigger. The old buffers are released by DisposeUploader.
+/// </summary>
+/// <param name="device">The device.</param>
+/// <param name="cmdList">The command list, which copies the geometry.</param>
+/// <param name="renderItems">All render items of the pool, they get their new ranges and the views of the new buffers.</param>
+/// <param name="vertexCount">The vertex count, that must fit after the compaction.</param>
+/// <param name="indexCount">The index count, that must fit after the compaction.</param>
+void GeometryPool::Compact(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+	std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, UINT64 vertexCount, UINT64 indexCount)
+{
+	RangeAllocatorStats vertexStats = m_vertexAllocator.GetStats();
+	RangeAllocatorStats indexStats = m_indexAllocator.GetStats();
+	//a full pool grows by half, so the next reloads don't copy all geometry again
+	UINT64 vertexCapacity = vertexStats.FreeSize >= vertexCount ? vertexStats.Capacity :
+		DX::Max(vertexStats.Capacity + vertexStats.Capacity / 2, vertexStats.UsedSize + vertexCount);
+	UINT64 indexCapacity = indexStats.FreeSize >= indexCount ? indexStats.Capacity :
+		DX::Max(indexStats.Capacity + indexStats.Capacity / 2, indexStats.UsedSize + indexCount);
+	std::vector<RangeMove> vertexMoves = m_vertexAllocator.Defragment();
+	std::vector<RangeMove> indexMoves = m_indexAllocator.Defragment();
+	m_vertexAllocator.Grow(vertexCapacity);
+	m_indexAllocator.Grow(indexCapacity);
+
+	//CopyBufferRegion can't copy between overlapping regions of a buffer, so the ranges are copied to new buffers
+	ComPtr<ID3D12Resource> positionBuffer, attributeBuffer, indexBuffer;
+	CreateBuffer(device, vertexCapacity * sizeof(XMFLOAT3), positionBuffer, L"Pooled Position Buffer");
+	CreateBuffer(device, vertexCapacity * sizeof(VertexAttributes), attributeBuffer, L"Pooled Attribute Buffer");
+	CreateBuffer(device, indexCapacity * sizeof(UINT), indexBuffer, L"Pooled Index Buffer");
+	D3D12_RESOURCE_BARRIER barriers[3] = {
+		CD3DX12_RESOURCE_BARRIER::Transition(m_positionBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_attributeBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_indexBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_SOURCE)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+	CopyRanges(cmdList, positionBuffer.Get(), m_positionBuffer.Get(), sizeof(XMFLOAT3), vertexMoves, vertexStats.UsedSize);
+	CopyRanges(cmdList, attributeBuffer.Get(), m_attributeBuffer.Get(), sizeof(VertexAttributes), vertexMoves, vertexStats.UsedSize);
+	CopyRanges(cmdList, indexBuffer.Get(), m_indexBuffer.Get(), sizeof(UINT), indexMoves, indexStats.UsedSize);
+	m_retiredBuffers.push_back(m_positionBuffer);
+	m_retiredBuffers.push_back(m_attributeBuffer);
+	m_retiredBuffers.push_back(m_indexBuffer);
+	m_positionBuffer = positionBuffer;
+	m_attributeBuffer = attributeBuffer;
+	m_indexBuffer = indexBuffer;
+	barriers[0] = CD3DX12_RESOURCE_BARRIER::Transition(m_positionBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+	barriers[1] = CD3DX12_RESOURCE_BARRIER::Transition(m_attributeBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+	barriers[2] = CD3DX12_RESOURCE_BARRIER::Transition(m_indexBuffer.Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ);
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+	MemoryTracker::Get().Set(Memory_GPUGeometry, DX::GetResourceSize(m_positionBuffer.Get()) + DX::GetResourceSize(m_attributeBuffer.Get()) +
+		DX::GetResourceSize(m_indexBuffer.Get()), this);
+
+	m_positionView = { m_positionBuffer->GetGPUVirtualAddress(), (UINT)(vertexCapacity * sizeof(XMFLOAT3)), sizeof(XMFLOAT3) };
+	m_attributeView = { m_attributeBuffer->GetGPUVirtualAddress(), (UINT)(vertexCapacity * sizeof(VertexAttributes)), sizeof(VertexAttributes) };
+	m_indexView = { m_indexBuffer->GetGPUVirtualAddress(), (UINT)(indexCapacity * sizeof(UINT)), DXGI_FORMAT_R32_UINT };
+	std::unordered_map<UINT64, UINT64> vertexOffsets, indexOffsets;
+	for (auto& move : vertexMoves)
+		vertexOffsets[move.OldOffset] = move.NewOffset;
+	for (auto& move : indexMoves)
+		indexOffsets[move.OldOffset] = move.NewOffset;
+	for (auto& renderItem : renderItems) {
+		RenderItem* ri = renderItem.second.get();
+		UINT baseVertex = ri->GetBaseVertexLocation();
+		UINT startIndex = ri->GetStartIndexLocation();
+		auto vertexOffset = vertexOffsets.find(baseVertex);
+		if (vertexOffset != vertexOffsets.end())
+			baseVertex = (UINT)vertexOffset->second;
+		auto indexOffset = indexOffsets.find(startIndex);
+		if (indexOffset != indexOffsets.end())
+			startIndex = (UINT)indexOffset->second;
+		ri->SetGeometry(m_positionView, m_attributeView, m_indexView, baseVertex, startIndex);
+	}
+	std::ostringstream report;
+	report << "Geometry pool: compacted " << vertexMoves.size() << " vertex and " << indexMoves.size() << " index ranges, capacity "
+		<< vertexCapacity << " vertices and " << indexCapacity << " indices\n";
+	OutputDebugStringA(report.str().c_str());
+}
+
+/// <summary>
+/// Records the copy of the items' CPU geometry to their ranges through a new upload buffer
+/// </summary>
+/// <param name="device">The device.</param>
+/// <param name="cmdList">The command list, which will copy the geometry.</param>
+/// <param name="renderItems">The render items.</param>
+void GeometryPool::Upload(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems)
+{
+	UINT64 uploadSize = 0;
+	for (auto ri : renderItems)
+		uploadSize += ri->GetVertexBufferByteSize() + ri->GetIndexBufferByteSize();
+	if (uploadSize == 0)
+		return;
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(uploadSize),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_uploadBuffer)));
+	m_uploadBuffer->SetName(L"Pooled Geometry Upload Buffer");
+	MemoryTracker::Get().Set(Memory_Uploaders, DX::GetResourceSize(m_uploadBuffer.Get()), this);
+	BYTE* mappedData = nullptr;
+	ThrowIfFailed(m_uploadBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+
+	D3D12_RESOURCE_BARRIER barriers[3] = {
+		CD3DX12_RESOURCE_BARRIER::Transition(m_positionBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_attributeBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST),
+		CD3DX12_RESOURCE_BARRIER::Transition(m_indexBuffer.Get(), D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_COPY_DEST)
+	};
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+	//the ranges aren't contiguous any more, so every stream of every item is a copy of its own
+	UINT64 offset = 0;
+	for (auto ri : renderItems) {
+		memcpy(mappedData + offset, ri->GetPositionData(), ri->GetPositionBufferByteSize());
+		cmdList->CopyBufferRegion(m_positionBuffer.Get(), ri->GetBaseVertexLocation() * sizeof(XMFLOAT3), m_uploadBuffer.Get(), offset, ri->GetPositionBufferByteSize());
+		offset += ri->GetPositionBufferByteSize();
+		memcpy(mappedData + offset, ri->GetAttributeData(), ri->GetAttributeBufferByteSize());
+		cmdList->CopyBufferRegion(m_attributeBuffer.Get(), ri->GetBaseVertexLocation() * sizeof(VertexAttributes), m_uploadBuffer.Get(), offset, ri->GetAttributeBufferByteSize());
+		offset += ri->GetAttributeBufferByteSize();
+		memcpy(mappedData + offset, ri->GetIndexBufferData(), ri->GetIndexBufferByteSize());
+		cmdList->CopyBufferRegion(m_indexBuffer.Get(), ri->GetStartIndexLocation() * sizeof(UINT), m_uploadBuffer.Get(), offset, ri->GetIndexBufferByteSize());
+		offset += ri->GetIndexBufferByteSize();
+	}
+	m_uploadBuffer->Unmap(0, nullptr);
+	for (auto& barrier : barriers)
+		std::swap(barrier.Transition.StateBefore, barrier.Transition.StateAfter);
+	cmdList->ResourceBarrier(_countof(barriers), barriers);
+}
+
+/// <summary>
+/// Releases the upload buffer and the buffers before a compaction, after the command list, which copies from them, was executed
+/// </summary>
+void GeometryPool::DisposeUploader()
+{
+	m_uploadBuffer = nullptr;
+	m_retiredBuffers.clear();
+	MemoryTracker::Get().Set(Memory_Uploaders, 0, this);
+}
+
+GeometryPool::~GeometryPool()
+{
+	MemoryTracker::Get().RemoveOwner(this);
+}
+
+/// <summary>
+/// Creates a pooled default heap buffer, ready to be copied to
+/// </summary>
+void GeometryPool::CreateBuffer(ID3D12Device* device, UINT64 byteSize, ComPtr<ID3D12Resource>& buffer, LPCWSTR name)
+{
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+	buffer->SetName(name);
+}
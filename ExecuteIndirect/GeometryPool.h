@@ -0,0 +1,45 @@
+#pragma once
+#include <unordered_map>
+#include "RenderItem.h"
+#include "RangeAllocator.h"
+
+namespace ExecuteIndirect {
+
+	// Pooled geometry of all render items - one position, one attribute and one index buffer. Every render item
+	// gets a vertex range and an index range, which its draw commands reference with BaseVertexLocation and
+	// StartIndexLocation, so all commands bind the same views.
+	class GeometryPool
+	{
+	public:
+		~GeometryPool();
+		void Build(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+			std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, float reserve = 0.25f);
+		void DisposeUploader();
+
+		// Moves an item to ranges of its new size, the pool is compacted or grows if it has no room for them. It can move
+		// every item, their ranges and views must be read again.
+		bool Reallocate(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+			std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, RenderItem* renderItem, UINT vertexCount, UINT indexCount);
+		// Records the copy of the items' geometry to their ranges, the buffers must not be in use by the GPU
+		void Upload(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& renderItems);
+
+		RangeAllocator& GetVertexAllocator() { return m_vertexAllocator; }
+		RangeAllocator& GetIndexAllocator() { return m_indexAllocator; }
+
+	private:
+		void Compact(ID3D12Device* device, ID3D12GraphicsCommandList* cmdList,
+			std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, UINT64 vertexCount, UINT64 indexCount);
+		void CreateBuffer(ID3D12Device* device, UINT64 byteSize, Microsoft::WRL::ComPtr<ID3D12Resource>& buffer, LPCWSTR name);
+
+		RangeAllocator							m_vertexAllocator;		// in vertices, the same range is used in both vertex streams
+		RangeAllocator							m_indexAllocator;		// in indices
+		Microsoft::WRL::ComPtr<ID3D12Resource>	m_positionBuffer;
+		Microsoft::WRL::ComPtr<ID3D12Resource>	m_attributeBuffer;
+		Microsoft::WRL::ComPtr<ID3D12Resource>	m_indexBuffer;
+		Microsoft::WRL::ComPtr<ID3D12Resource>	m_uploadBuffer;
+		std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>>	m_retiredBuffers;	// the buffers before a compaction, until its copies are executed
+		D3D12_VERTEX_BUFFER_VIEW				m_positionView = {};
+		D3D12_VERTEX_BUFFER_VIEW				m_attributeView = {};
+		D3D12_INDEX_BUFFER_VIEW					m_indexView = {};
+	};
+}
@@ -0,0 +1,201 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "Heightfield.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <deque>
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Rasterizes the triangles of the mesh into the grid. A sample, covered by several triangles (e.g. an overhang), gets
+/// the highest one, samples, which no triangle covers, get the height of the nearest covered sample.
+/// </summary>
+/// <param name="positions">x, y, z of every vertex.</param>
+/// <param name="vertexCount">The number of vertices.</param>
+/// <param name="indices">The triangle list.</param>
+/// <param name="indexCount">The number of indices.</param>
+/// <param name="resolution">The number of samples along the longer side, 0 - about one sample per vertex.</param>
+/// <returns>False if the mesh has no triangle with an area on the XZ plane</returns>
+bool Heightfield::Build(const float* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, uint32_t resolution)
+{
+	const uint32_t MaxResolution = 4096;
+	m_heights.clear();
+	m_covered.clear();
+	m_width = m_depth = 0;
+	if (vertexCount < 3 || indexCount < 3)
+		return false;
+	m_maxX = m_maxZ = -FLT_MAX;
+	m_minX = m_minZ = FLT_MAX;
+	for (uint32_t i = 0; i < vertexCount; i++) {
+		m_minX = std::min(m_minX, positions[3 * i]);
+		m_maxX = std::max(m_maxX, positions[3 * i]);
+		m_minZ = std::min(m_minZ, positions[3 * i + 2]);
+		m_maxZ = std::max(m_maxZ, positions[3 * i + 2]);
+	}
+	float sizeX = m_maxX - m_minX;
+	float sizeZ = m_maxZ - m_minZ;
+	if (sizeX <= 0.0f || sizeZ <= 0.0f)
+		return false;
+	if (resolution == 0)
+		m_cellSize = std::sqrt(sizeX * sizeZ / vertexCount);
+	else
+		m_cellSize = std::max(sizeX, sizeZ) / (std::max(resolution, 2u) - 1);
+	m_cellSize = std::max(m_cellSize, std::max(sizeX, sizeZ) / (MaxResolution - 1));
+	m_width = std::min((uint32_t)std::ceil(sizeX / m_cellSize) + 1, MaxResolution);
+	m_depth = std::min((uint32_t)std::ceil(sizeZ / m_cellSize) + 1, MaxResolution);
+	m_width = std::max(m_width, 2u);
+	m_depth = std::max(m_depth, 2u);
+	m_heights.assign((size_t)m_width * m_depth, -FLT_MAX);
+	m_covered.assign((size_t)m_width * m_depth, 0);
+
+	for (uint32_t t = 0; t + 2 < indexCount; t += 3) {
+		const float* a = positions + 3 * indices[t];
+		const float* b = positions + 3 * indices[t + 1];
+		const float* c = positions + 3 * indices[t + 2];
+		float area = (b[0] - a[0]) * (c[2] - a[2]) - (c[0] - a[0]) * (b[2] - a[2]);
+		if (std::fabs(area) < 1e-12f)
+			continue;
+		//the samples in the bounding rectangle of the triangle are tested with the barycentric coordinates
+		int32_t column0 = std::max((int32_t)std::ceil((std::min({ a[0], b[0], c[0] }) - m_minX) / m_cellSize), 0);
+		int32_t column1 = std::min((int32_t)std::floor((std::max({ a[0], b[0], c[0] }) - m_minX) / m_cellSize), (int32_t)m_width - 1);
+		int32_t row0 = std::max((int32_t)std::ceil((std::min({ a[2], b[2], c[2] }) - m_minZ) / m_cellSize), 0);
+		int32_t row1 = std::min((int32_t)std::floor((std::max({ a[2], b[2], c[2] }) - m_minZ) / m_cellSize), (int32_t)m_depth - 1);
+		const float epsilon = -1e-5f;
+		for (int32_t row = row0; row <= row1; row++) {
+			float z = m_minZ + row * m_cellSize;
+			for (int32_t column = column0; column <= column1; column++) {
+				float x = m_minX + column * m_cellSize;
+				float u = ((b[0] - x) * (c[2] - z) - (c[0] - x) * (b[2] - z)) / area;
+				float v = ((c[0] - x) * (a[2] - z) - (a[0] - x) * (c[2] - z)) / area;
+				float w = 1.0f - u - v;
+				if (u < epsilon || v < epsilon || w < epsilon)
+					continue;
+				size_t sample = (size_t)row * m_width + column;
+				m_heights[sample] = std::max(m_heights[sample], u * a[1] + v * b[1] + w * c[1]);
+				m_covered[sample] = 1;
+			}
+		}
+	}
+	if (std::find(m_covered.begin(), m_covered.end(), 1) == m_covered.end()) {
+		m_heights.clear();
+		m_covered.clear();
+		m_width = m_depth = 0;
+		return false;
+	}
+	FillHoles();
+	return true;
+}
+
+/// <summary>
+/// Gives every sample, which no triangle covers, the height of the nearest covered one (a breadth first search from
+/// all covered samples), e.g. the corners of a round terrain. The coverage of the mesh is kept for IsCovered.
+/// </summary>
+void Heightfield::FillHoles()
+{
+	std::vector<uint8_t> covered = m_covered;
+	std::deque<size_t> queue;
+	for (size_t i = 0; i < covered.size(); i++) {
+		if (covered[i])
+			queue.push_back(i);
+	}
+	while (!queue.empty()) {
+		size_t sample = queue.front();
+		queue.pop_front();
+		uint32_t column = (uint32_t)(sample % m_width);
+		uint32_t row = (uint32_t)(sample / m_width);
+		size_t neighbors[4];
+		uint32_t neighborCount = 0;
+		if (column > 0)
+			neighbors[neighborCount++] = sample - 1;
+		if (column + 1 < m_width)
+			neighbors[neighborCount++] = sample + 1;
+		if (row > 0)
+			neighbors[neighborCount++] = sample - m_width;
+		if (row + 1 < m_depth)
+			neighbors[neighborCount++] = sample + m_width;
+		for (uint32_t i = 0; i < neighborCount; i++) {
+			if (covered[neighbors[i]])
+				continue;
+			covered[neighbors[i]] = 1;
+			m_heights[neighbors[i]] = m_heights[sample];
+			queue.push_back(neighbors[i]);
+		}
+	}
+}
+
+float Heightfield::GetSample(int32_t column, int32_t row) const
+{
+	column = std::min(std::max(column, 0), (int32_t)m_width - 1);
+	row = std::min(std::max(row, 0), (int32_t)m_depth - 1);
+	return m_heights[(size_t)row * m_width + column];
+}
+
+/// <summary>
+/// Gets the bilinear interpolation of the four samples around the point
+/// </summary>
+float Heightfield::GetHeight(float x, float z) const
+{
+	float column = std::min(std::max((x - m_minX) / m_cellSize, 0.0f), (float)(m_width - 1));
+	float row = std::min(std::max((z - m_minZ) / m_cellSize, 0.0f), (float)(m_depth - 1));
+	int32_t column0 = std::min((int32_t)column, (int32_t)m_width - 2);
+	int32_t row0 = std::min((int32_t)row, (int32_t)m_depth - 2);
+	float tx = column - column0;
+	float tz = row - row0;
+	float h00 = GetSample(column0, row0);
+	float h10 = GetSample(column0 + 1, row0);
+	float h01 = GetSample(column0, row0 + 1);
+	float h11 = GetSample(column0 + 1, row0 + 1);
+	return (h00 * (1.0f - tx) + h10 * tx) * (1.0f - tz) + (h01 * (1.0f - tx) + h11 * tx) * tz;
+}
+
+/// <summary>
+/// Tests the point against the bounds of the mesh and the coverage of the four samples around it, the heights of
+/// the samples off the mesh are made up
+/// </summary>
+bool Heightfield::IsCovered(float x, float z) const
+{
+	if (m_heights.empty() || x < m_minX || x > m_maxX || z < m_minZ || z > m_maxZ)
+		return false;
+	int32_t column0 = std::min((int32_t)((x - m_minX) / m_cellSize), (int32_t)m_width - 2);
+	int32_t row0 = std::min((int32_t)((z - m_minZ) / m_cellSize), (int32_t)m_depth - 2);
+	size_t sample = (size_t)row0 * m_width + column0;
+	return m_covered[sample] && m_covered[sample + 1] && m_covered[sample + m_width] && m_covered[sample + m_width + 1];
+}
+
+/// <summary>
+/// Gets the unit normal from the central differences of the heights, one cell around the point
+/// </summary>
+void Heightfield::GetNormal(float x, float z, float normal[3]) const
+{
+	float dx = GetHeight(x - m_cellSize, z) - GetHeight(x + m_cellSize, z);
+	float dz = GetHeight(x, z - m_cellSize) - GetHeight(x, z + m_cellSize);
+	float dy = 2.0f * m_cellSize;
+	float length = std::sqrt(dx * dx + dy * dy + dz * dz);
+	normal[0] = dx / length;
+	normal[1] = dy / length;
+	normal[2] = dz / length;
+}
+
+/// <summary>
+/// Gets the highest sample in the square of the radius around the point, the samples outside of the grid are its border
+/// </summary>
+float Heightfield::GetMaxHeight(float x, float z, float radius) const
+{
+	int32_t column0 = (int32_t)std::floor((x - radius - m_minX) / m_cellSize);
+	int32_t column1 = (int32_t)std::ceil((x + radius - m_minX) / m_cellSize);
+	int32_t row0 = (int32_t)std::floor((z - radius - m_minZ) / m_cellSize);
+	int32_t row1 = (int32_t)std::ceil((z + radius - m_minZ) / m_cellSize);
+	column0 = std::min(std::max(column0, 0), (int32_t)m_width - 1);
+	column1 = std::min(std::max(column1, 0), (int32_t)m_width - 1);
+	row0 = std::min(std::max(row0, 0), (int32_t)m_depth - 1);
+	row1 = std::min(std::max(row1, 0), (int32_t)m_depth - 1);
+	float height = -FLT_MAX;
+	for (int32_t row = row0; row <= row1; row++) {
+		for (int32_t column = column0; column <= column1; column++)
+			height = std::max(height, m_heights[(size_t)row * m_width + column]);
+	}
+	return height;
+}
@@ -0,0 +1,51 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Heights of a terrain mesh, sampled on a regular grid on the XZ plane. The grid is built once from the triangles,
+	// the queries at any (x, z) interpolate the four samples around it, so they don't depend on the tessellation of
+	// the mesh. Points outside of the grid get the height of its border. The samples, which no triangle covers (e.g. the
+	// corners of a round terrain), get the height of the nearest covered one, IsCovered tells them apart.
+	class Heightfield
+	{
+	public:
+		// positions - x, y, z of every vertex, the resolution is the number of samples along the longer side, 0 chooses
+		// about one sample per vertex
+		bool Build(const float* positions, uint32_t vertexCount, const uint32_t* indices, uint32_t indexCount, uint32_t resolution = 0);
+		bool IsEmpty() const { return m_heights.empty(); }
+
+		float GetHeight(float x, float z) const;
+		// The unit normal, from the slopes of the interpolated heights
+		void GetNormal(float x, float z, float normal[3]) const;
+		// The highest sample in the square of the radius around (x, z), e.g. for a horizon or visibility test
+		float GetMaxHeight(float x, float z, float radius) const;
+		// False outside of the mesh's bounds, or if any of the four samples around the point isn't on the mesh
+		bool IsCovered(float x, float z) const;
+
+		float GetMinX() const { return m_minX; }
+		float GetMinZ() const { return m_minZ; }
+		// The bounds of the mesh, the grid may reach up to a cell past them
+		float GetSizeX() const { return m_maxX - m_minX; }
+		float GetSizeZ() const { return m_maxZ - m_minZ; }
+		float GetCellSize() const { return m_cellSize; }
+		uint32_t GetWidth() const { return m_width; }
+		uint32_t GetDepth() const { return m_depth; }
+		uint64_t GetByteSize() const { return m_heights.size() * sizeof(float) + m_covered.size(); }
+
+	private:
+		float GetSample(int32_t column, int32_t row) const;
+		void FillHoles();
+
+		std::vector<float> m_heights;		// row major, m_depth rows of m_width samples
+		std::vector<uint8_t> m_covered;		// 1 for the samples on a triangle, the same layout
+		uint32_t m_width = 0;
+		uint32_t m_depth = 0;
+		float m_minX = 0.0f;
+		float m_minZ = 0.0f;
+		float m_maxX = 0.0f;
+		float m_maxZ = 0.0f;
+		float m_cellSize = 1.0f;
+	};
+}
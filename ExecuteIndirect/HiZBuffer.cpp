@@ -17,7 +17,8 @@ const float CYellow[4] = { 1.0f, 1.0f, 0.0f, 1.0f };
 const float CGray[4] = { 0.7f, 0.7f, 0.7f, 0.7f };
 
 HiZBuffer::HiZBuffer(const std::shared_ptr<DX::DeviceResources>& devResources) :
-	m_deviceResources(devResources), m_width(1024), m_height(768), m_fenceValue(0)
+	m_deviceResources(devResources), m_width(1024), m_height(768), m_fenceValue(0),
+	m_CulledOccluderIndices(nullptr), m_CulledOccluderCommands(nullptr), m_culledOccluderCommandCount(0), m_enableTrianglePreCulling(true)
 {
 	CreateResources();
 }
@@ -63,7 +64,11 @@ void HiZBuffer::RenderOccluders(FrameResources* currFrameResource, UINT occluder
 	//Execute indirectly the commands which will render the occluder
 	PIXBeginEvent(m_HiZDepthCommandList.Get(), 0, L"Draw potential occluders");
 	{
-		m_HiZDepthCommandList->ExecuteIndirect(m_HiZDepthCommandSignature.Get(), occluderCount, OccluderCommandBuffer.Get(), 0, nullptr, 0);
+		//With pre-culling the occluders are drawn with the compacted index buffer, one command per occluder instance
+		if (m_enableTrianglePreCulling && m_CulledOccluderCommandBuffer)
+			m_HiZDepthCommandList->ExecuteIndirect(m_HiZDepthCommandSignature.Get(), m_culledOccluderCommandCount, m_CulledOccluderCommandBuffer.Get(), 0, nullptr, 0);
+		else
+			m_HiZDepthCommandList->ExecuteIndirect(m_HiZDepthCommandSignature.Get(), occluderCount, OccluderCommandBuffer.Get(), 0, nullptr, 0);
 	}
 	PIXEndEvent(m_HiZDepthCommandList.Get());
 
@@ -111,6 +116,89 @@ void HiZBuffer::RenderOccluders(FrameResources* currFrameResource, UINT occluder
 	//m_deviceResources->ReadTimestamps(false);
 }
 
+/// <summary>
+/// Creates the upload buffers for the triangle pre-culling of the occluders. Their CPU vertex and index buffers must stay alive.
+/// </summary>
+/// <param name="occluders">The occluder render items.</param>
+void HiZBuffer::SetOccluders(std::vector<RenderItem*>& occluders)
+{
+	auto d3dDevice = m_deviceResources->GetD3DDevice();
+	m_occluders = occluders;
+	//the worst case is that no triangle of any instance is culled
+	UINT indexCount = 0;
+	UINT commandCount = 0;
+	for (auto ri : m_occluders) {
+		indexCount += ri->GetIndexCount() * ri->GetInstanceCount();
+		commandCount += ri->GetInstanceCount();
+	}
+	if (commandCount == 0)
+		return;
+
+	//Both buffers stay in the upload heap and are mapped for the whole run. RenderOccluders waits for the GPU,
+	//so a single copy is enough and the CPU never writes them while they are in use.
+	ThrowIfFailed(d3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(indexCount * sizeof(UINT)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_PotentialOccludersIndexBuffer)));
+	m_PotentialOccludersIndexBuffer->SetName(L"Culled Occluder Index Buffer");
+	ThrowIfFailed(m_PotentialOccludersIndexBuffer->Map(0, nullptr, reinterpret_cast<void**>(&m_CulledOccluderIndices)));
+	m_PotentialOccludersIndexBufferView.BufferLocation = m_PotentialOccludersIndexBuffer->GetGPUVirtualAddress();
+	m_PotentialOccludersIndexBufferView.Format = DXGI_FORMAT_R32_UINT;
+	m_PotentialOccludersIndexBufferView.SizeInBytes = indexCount * sizeof(UINT);
+
+	ThrowIfFailed(d3dDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(commandCount * sizeof(OccluderIndirectCommand)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&m_CulledOccluderCommandBuffer)));
+	m_CulledOccluderCommandBuffer->SetName(L"Culled Occluder Command Buffer");
+	ThrowIfFailed(m_CulledOccluderCommandBuffer->Map(0, nullptr, reinterpret_cast<void**>(&m_CulledOccluderCommands)));
+}
+
+/// <summary>
+/// Removes the occluder triangles, which can't write depth for the current camera, and writes the 
+/// compacted index buffer and the occluder commands for this frame
+/// </summary>
+/// <param name="view">The camera view matrix.</param>
+/// <param name="proj">The camera projection matrix.</param>
+void HiZBuffer::CullOccluderTriangles(XMFLOAT4X4& view, XMFLOAT4X4& proj)
+{
+	if (!m_enableTrianglePreCulling || !m_CulledOccluderCommandBuffer)
+		return;
+	XMMATRIX viewProj = XMMatrixMultiply(XMLoadFloat4x4(&view), XMLoadFloat4x4(&proj));
+	//the occluders are rendered in the HiZ buffer, so its size decides which triangles are sub-pixel
+	m_TriangleCuller.BeginFrame(viewProj, (float)m_width, (float)m_height);
+	UINT indexOffset = 0;
+	m_culledOccluderCommandCount = 0;
+	for (auto ri : m_occluders) {
+		std::vector<InstanceData>& instances = ri->GetInstances();
+		for (UINT i = 0; i < instances.size(); i++) {
+			XMMATRIX world = GetInstanceWorldMatrix(instances[i]);
+			UINT indexCount = m_TriangleCuller.Cull(ri, world, m_CulledOccluderIndices + indexOffset);
+			if (indexCount == 0)
+				continue;
+			OccluderIndirectCommand& command = m_CulledOccluderCommands[m_culledOccluderCommandCount++];
+			command.positionBufferView = ri->PositionBufferView();
+			command.indexBufferView = m_PotentialOccludersIndexBufferView;
+			//the vertex shader indexes the instance data with SV_InstanceID, so the view starts at this instance
+			command.instancesShaderView = ri->GetInstanceBufferGPU()->GetGPUVirtualAddress() + i * sizeof(InstanceData);
+			command.drawArguments.IndexCountPerInstance = indexCount;
+			command.drawArguments.InstanceCount = 1;
+			command.drawArguments.StartIndexLocation = indexOffset;
+			//the compacted indices are local to the render item, its vertices start at its range in the pooled buffer
+			command.drawArguments.BaseVertexLocation = ri->GetBaseVertexLocation();
+			command.drawArguments.StartInstanceLocation = 0;
+			indexOffset += indexCount;
+		}
+	}
+	m_TriangleCuller.EndFrame();
+}
+
 void HiZBuffer::RenderMIPMap()
 {
 	//describe a viewport with the HiZ buffer's width and height
@@ -207,10 +295,8 @@ void HiZBuffer::InitDepth() {
 	//Describe the input layout (the structure of the vertices feeded to the vertex shader)
 	const D3D12_INPUT_ELEMENT_DESC inputLayout[] =
 	{
-		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+		//the occluders are drawn only from the position stream
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
 	};
 	//Read the compiled shaders
 	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"HiZDepthVS.cso").c_str(), m_HiZDepthVS));
@@ -244,7 +330,7 @@ void HiZBuffer::InitDepth() {
 	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
 	commandSignatureDesc.pArgumentDescs = argumentDescs;
 	commandSignatureDesc.NumArgumentDescs = _countof(argumentDescs);
-	commandSignatureDesc.ByteStride = sizeof(IndirectCommand);
+	commandSignatureDesc.ByteStride = sizeof(OccluderIndirectCommand);
 	//Create the command signature
 	ThrowIfFailed(d3dDevice->CreateCommandSignature(&commandSignatureDesc, m_HiZDepthRootSignature.Get(), IID_PPV_ARGS(&m_HiZDepthCommandSignature)));
 	// Describe a rasterizer state with no back-face culling and solid rendering mode (opposed to wireframe)
@@ -2,6 +2,7 @@
 #include <d3d12.h>
 #include "DeviceResources.h"
 #include "ShaderStructures.h"
+#include "OccluderTriangleCuller.h"
 
 using namespace Microsoft::WRL;
 namespace ExecuteIndirect
@@ -15,7 +16,11 @@ namespace ExecuteIndirect
 		HiZBuffer(const std::shared_ptr<DX::DeviceResources>& deviceResources);
 		void InitMIPMap();
 		void InitDepth();
+		void SetOccluders(std::vector<RenderItem*>& occluders);
+		void CullOccluderTriangles(XMFLOAT4X4& view, XMFLOAT4X4& proj);
 		void RenderOccluders(FrameResources* currFrameResource, UINT occluderCount);
+		void ChangeTrianglePreCulling() { m_enableTrianglePreCulling = !m_enableTrianglePreCulling; }
+		OccluderCullingStats& GetOccluderCullingStats() { return m_TriangleCuller.GetStats(); }
 		void RenderMIPMap();
 		UINT GetHIZBufferHeight() { return m_height; }
 		UINT GetHIZBufferWidth() { return m_width; }
@@ -41,6 +46,7 @@ namespace ExecuteIndirect
 		ComPtr<ID3D12Resource>				m_pTempBuffer;
 		ComPtr<ID3D12Resource>				OccluderCommandBuffer;
 		ComPtr<ID3D12Resource>				OccluderCommandBufferUploader;
+		ComPtr<ID3D12Resource>				m_CulledOccluderCommandBuffer;		//rewritten every frame by the triangle pre-culling
 		
 		ComPtr<ID3D12Resource>				m_pHizDepthBuffer;
 		ComPtr<ID3D12Resource>				m_pMIPMapVertexBuffer;
@@ -71,6 +77,13 @@ namespace ExecuteIndirect
 		UINT m_MIPMapRTVDescriptorSize;
 		UINT m_fenceValue;
 		HANDLE m_fenceEvent;
+
+		OccluderTriangleCuller				m_TriangleCuller;
+		std::vector<RenderItem*>			m_occluders;
+		UINT*								m_CulledOccluderIndices;
+		OccluderIndirectCommand*			m_CulledOccluderCommands;
+		UINT								m_culledOccluderCommandCount;
+		bool								m_enableTrianglePreCulling;
 		void CreateResources();
 	};
 }
\ No newline at end of file
@@ -1,4 +1,5 @@
 #include "Lighting.hlsli"
+#include "Instance.hlsli"
 cbuffer SceneConstantBuffer : register(b0)
 {
 	float4x4 viewMatrix;
@@ -10,24 +11,12 @@ cbuffer SceneConstantBuffer : register(b0)
 	Light lights[MaxLights];
 };
 
-struct InstanceData
-{
-	float4x4 World;
-	float4x4 TexTransform;
-	uint materialIndex;
-	uint InstPad0;
-	uint InstPad1;
-	uint InstPad2;
-};
 
 StructuredBuffer<InstanceData> instanceData : register(t0);
 // Per-vertex data used as input to the vertex shader.
 struct VS_IN
 {
-	float3 PosL    : POSITION;			//Vertex position in local space
-	float3 NormalL : NORMAL;			//Normal in local space
-	float2 TexC    : TEXCOORD;			//Texture coordinates
-	float3 TangentU : TANGENT;			//Tangent in local space
+	float3 PosL    : POSITION;			//Vertex position in local space (the position stream only)
 };
 
 // Per-pixel color data passed through the pixel shader.
@@ -48,7 +37,7 @@ PS_IN main(VS_IN input, uint instanceID : SV_InstanceID)
 	PS_IN output;
 	//Load the instance data
 	InstanceData instData = instanceData[instanceID];
-	float4x4 worldMatrix = instData.World;
+	float4x4 worldMatrix = instanceWorld(instData);
 
 	float4 pos = float4(input.PosL, 1.0f);
 	// Transform the position to world space.
@@ -0,0 +1,81 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "HotReloadService.h"
+#include <algorithm>
+
+using namespace ExecuteIndirect;
+
+HotReloadService::HotReloadService(std::unique_ptr<FileWatcher> watcher) :
+	m_watcher(std::move(watcher))
+{
+}
+
+HotReloadService::~HotReloadService()
+{
+	Stop();
+}
+
+/// <summary>
+/// Adds a file to the watcher, can be called while the service runs
+/// </summary>
+bool HotReloadService::Watch(const std::string& fileName)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_watcher->Watch(fileName);
+}
+
+/// <summary>
+/// Starts the service thread
+/// </summary>
+/// <param name="reload">Called on the service thread with the changed files, one call at a time.</param>
+/// <param name="pollInterval">Time between two polls of the watcher.</param>
+/// <param name="settleTime">Time without changes, after which the collected changes are reloaded.</param>
+void HotReloadService::Start(ReloadFunction reload, std::chrono::milliseconds pollInterval, std::chrono::milliseconds settleTime)
+{
+	Stop();
+	m_reload = reload;
+	m_stopping = false;
+	m_thread = std::thread(&HotReloadService::ServiceLoop, this, pollInterval, settleTime);
+}
+
+/// <summary>
+/// Stops the thread, a reload in progress is finished first
+/// </summary>
+void HotReloadService::Stop()
+{
+	if (!m_thread.joinable())
+		return;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+	m_thread.join();
+}
+
+void HotReloadService::ServiceLoop(std::chrono::milliseconds pollInterval, std::chrono::milliseconds settleTime)
+{
+	std::vector<std::string> changed;
+	std::vector<std::string> polled;
+	auto lastChange = std::chrono::steady_clock::now();
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			if (m_condition.wait_for(lock, pollInterval, [this]() { return m_stopping; }))
+				return;
+			polled.clear();
+			m_watcher->Poll(polled);
+		}
+		auto now = std::chrono::steady_clock::now();
+		for (auto& fileName : polled) {
+			if (std::find(changed.begin(), changed.end(), fileName) == changed.end())
+				changed.push_back(fileName);
+			lastChange = now;
+		}
+		if (!changed.empty() && now - lastChange >= settleTime) {
+			m_reload(changed);
+			changed.clear();
+		}
+	}
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "FileWatcher.h"
+
+namespace ExecuteIndirect {
+
+	// Watches files on its own thread and calls the reload function on that thread with the files, which changed.
+	// The changes are collected until no file changed for the settle time, so a tool writing several files (an OBJ
+	// and its MTL) or writing a file in parts causes one reload.
+	class HotReloadService
+	{
+	public:
+		typedef std::function<void(const std::vector<std::string>&)> ReloadFunction;
+
+		explicit HotReloadService(std::unique_ptr<FileWatcher> watcher = CreateFileWatcher());
+		HotReloadService(const HotReloadService&) = delete;
+		HotReloadService& operator=(const HotReloadService&) = delete;
+		~HotReloadService();
+
+		bool Watch(const std::string& fileName);
+		void Start(ReloadFunction reload,
+			std::chrono::milliseconds pollInterval = std::chrono::milliseconds(50),
+			std::chrono::milliseconds settleTime = std::chrono::milliseconds(250));
+		void Stop();
+		bool IsRunning() const { return m_thread.joinable(); }
+
+	private:
+		void ServiceLoop(std::chrono::milliseconds pollInterval, std::chrono::milliseconds settleTime);
+
+		std::unique_ptr<FileWatcher>	m_watcher;
+		ReloadFunction					m_reload;
+		std::thread						m_thread;
+		std::mutex						m_mutex;			// the watcher and the stop flag
+		std::condition_variable			m_condition;
+		bool							m_stopping = false;
+	};
+}
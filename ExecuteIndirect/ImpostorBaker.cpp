@@ -0,0 +1,269 @@
+#include "pch.h"
+#include "ImpostorBaker.h"
+#include "DirectXHelper.h"
+#include "Hash.h"
+#include "StartupProfiler.h"
+
+using namespace DirectX;
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Packs a normalized vector in a R8G8B8A8_UNORM texel, alpha is always 1 (covered)
+/// </summary>
+static UINT PackNormal(XMFLOAT3& n)
+{
+	UINT r = static_cast<UINT>((n.x * 0.5f + 0.5f) * 255.0f + 0.5f);
+	UINT g = static_cast<UINT>((n.y * 0.5f + 0.5f) * 255.0f + 0.5f);
+	UINT b = static_cast<UINT>((n.z * 0.5f + 0.5f) * 255.0f + 0.5f);
+	return r | (g << 8) | (b << 16) | (255u << 24);
+}
+
+/// <summary>
+/// Packs texture coordinates in a R16G16_UNORM texel. Only the fractional part is kept,
+/// which is enough as the diffuse maps are sampled with a wrap sampler
+/// </summary>
+static UINT PackTexCoord(float u, float v)
+{
+	u -= floorf(u);
+	v -= floorf(v);
+	UINT x = static_cast<UINT>(u * 65535.0f + 0.5f);
+	UINT y = static_cast<UINT>(v * 65535.0f + 0.5f);
+	return x | (y << 16);
+}
+
+ImpostorBaker::ImpostorBaker(UINT viewCount, UINT tileSize) :
+	m_viewCount(viewCount),
+	m_tileSize(tileSize)
+{
+}
+
+/// <summary>
+/// Bakes the impostor atlas of a render item
+/// </summary>
+/// <param name="name">The render item name.</param>
+/// <param name="ri">The render item, its CPU vertex and index buffers must still be alive.</param>
+/// <returns>The baked atlas</returns>
+std::unique_ptr<ImpostorAtlas> ImpostorBaker::Bake(const std::string& name, RenderItem* ri)
+{
+	auto atlas = std::make_unique<ImpostorAtlas>();
+	atlas->Name = name;
+	atlas->ViewCount = m_viewCount;
+	atlas->TileSize = m_tileSize;
+	atlas->SourceHash = HashSource(ri);
+	//the bounding sphere of the bounding box contains the mesh from every direction
+	BoundingBox box;
+	BoundingBox::CreateFromPoints(box, ri->GetVertexCount(), ri->GetPositionData(), sizeof(XMFLOAT3));
+	atlas->Center = box.Center;
+	atlas->Radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&box.Extents)));
+
+	UINT texelCount = atlas->GetWidth() * atlas->GetHeight();
+	atlas->TexCoords.assign(texelCount, 0);
+	atlas->Normals.assign(texelCount, 0);
+	atlas->Depths.assign(texelCount, 1.0f);
+
+	for (UINT view = 0; view < m_viewCount; view++)
+		RasterizeView(ri, atlas.get(), view);
+
+	return atlas;
+}
+
+/// <summary>
+/// Hashes the mesh data the atlas is baked from - the positions, the vertex attributes and the indices
+/// </summary>
+/// <param name="ri">The render item, its CPU vertex and index buffers must still be alive.</param>
+/// <returns>The hash, stored with the atlas</returns>
+uint64_t ImpostorBaker::HashSource(RenderItem* ri)
+{
+	uint64_t hash = HashBytes(ri->GetPositionData(), ri->GetVertexCount() * sizeof(XMFLOAT3));
+	hash = HashBytes(ri->GetAttributeData(), ri->GetVertexCount() * sizeof(VertexAttributes), hash);
+	return HashBytes(ri->GetIndexBufferData(), ri->GetIndexCount() * sizeof(UINT), hash);
+}
+
+/// <summary>
+/// Rasterizes the render item in a single tile of the atlas, using orthographic projection.
+/// View k looks at the center from direction (sin(2*PI*k/N), 0, cos(2*PI*k/N)) - must match ImpostorVS.hlsl
+/// </summary>
+/// <param name="ri">The render item.</param>
+/// <param name="atlas">The atlas.</param>
+/// <param name="view">The view (tile) index.</param>
+void ImpostorBaker::RasterizeView(RenderItem* ri, ImpostorAtlas* atlas, UINT view)
+{
+	const float angle = XM_2PI * view / atlas->ViewCount;
+	//direction from the center to the baking camera, and the camera basis
+	const XMFLOAT3 toCamera(sinf(angle), 0.0f, cosf(angle));
+	const XMFLOAT3 right(-toCamera.z, 0.0f, toCamera.x);
+	const float size = static_cast<float>(atlas->TileSize);
+	const float radius = atlas->Radius;
+	const UINT atlasWidth = atlas->GetWidth();
+	const UINT tileOffset = view * atlas->TileSize;
+
+	XMFLOAT3* positions = ri->GetPositionData();
+	VertexAttributes* attributes = ri->GetAttributeData();
+	UINT* indices = ri->GetIndexBufferData();
+
+	for (UINT t = 0; t + 2 < ri->GetIndexCount(); t += 3) {
+		//transform the triangle corners to tile space - x and y in pixels, z is normalized depth
+		XMFLOAT3 screen[3];
+		for (int c = 0; c < 3; c++) {
+			XMFLOAT3& p = positions[indices[t + c]];
+			float x = p.x - atlas->Center.x;
+			float y = p.y - atlas->Center.y;
+			float z = p.z - atlas->Center.z;
+			float rx = x * right.x + z * right.z;
+			float depth = -(x * toCamera.x + z * toCamera.z);
+			screen[c].x = (rx / radius * 0.5f + 0.5f) * size;
+			screen[c].y = (0.5f - y / radius * 0.5f) * size;
+			screen[c].z = (depth + radius) / (2.0f * radius);
+		}
+		//twice the signed area, skip degenerate triangles
+		float area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[1].y - screen[0].y) * (screen[2].x - screen[0].x);
+		if (fabsf(area) < 1e-8f)
+			continue;
+		//pixel bounding rectangle of the triangle, clamped to the tile
+		int minX = DX::Max(0, static_cast<int>(floorf(DX::Min(DX::Min(screen[0].x, screen[1].x), screen[2].x))));
+		int minY = DX::Max(0, static_cast<int>(floorf(DX::Min(DX::Min(screen[0].y, screen[1].y), screen[2].y))));
+		int maxX = DX::Min(static_cast<int>(atlas->TileSize) - 1, static_cast<int>(ceilf(DX::Max(DX::Max(screen[0].x, screen[1].x), screen[2].x))));
+		int maxY = DX::Min(static_cast<int>(atlas->TileSize) - 1, static_cast<int>(ceilf(DX::Max(DX::Max(screen[0].y, screen[1].y), screen[2].y))));
+
+		VertexAttributes& v0 = attributes[indices[t]];
+		VertexAttributes& v1 = attributes[indices[t + 1]];
+		VertexAttributes& v2 = attributes[indices[t + 2]];
+		for (int py = minY; py <= maxY; py++) {
+			for (int px = minX; px <= maxX; px++) {
+				//evaluate the edge functions at the pixel center
+				float sx = px + 0.5f;
+				float sy = py + 0.5f;
+				float w0 = ((screen[2].x - screen[1].x) * (sy - screen[1].y) - (screen[2].y - screen[1].y) * (sx - screen[1].x)) / area;
+				float w1 = ((screen[0].x - screen[2].x) * (sy - screen[2].y) - (screen[0].y - screen[2].y) * (sx - screen[2].x)) / area;
+				float w2 = 1.0f - w0 - w1;
+				//vegetation is double sided, so both windings are accepted
+				if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f)
+					continue;
+				float depth = w0 * screen[0].z + w1 * screen[1].z + w2 * screen[2].z;
+				UINT texel = py * atlasWidth + tileOffset + px;
+				if (depth >= atlas->Depths[texel])
+					continue;
+
+				XMFLOAT3 normal;
+				normal.x = w0 * v0.normal.x + w1 * v1.normal.x + w2 * v2.normal.x;
+				normal.y = w0 * v0.normal.y + w1 * v1.normal.y + w2 * v2.normal.y;
+				normal.z = w0 * v0.normal.z + w1 * v1.normal.z + w2 * v2.normal.z;
+				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&normal));
+				//flip back facing normals towards the baking camera
+				if (XMVectorGetX(XMVector3Dot(n, XMLoadFloat3(&toCamera))) < 0.0f)
+					n = XMVectorNegate(n);
+				XMStoreFloat3(&normal, n);
+
+				atlas->Depths[texel] = depth;
+				atlas->Normals[texel] = PackNormal(normal);
+				atlas->TexCoords[texel] = PackTexCoord(
+					w0 * v0.textureCoordinates.x + w1 * v1.textureCoordinates.x + w2 * v2.textureCoordinates.x,
+					w0 * v0.textureCoordinates.y + w1 * v1.textureCoordinates.y + w2 * v2.textureCoordinates.y);
+			}
+		}
+	}
+}
+
+/// <summary>
+/// Writes the baked impostors in a binary file, so they are baked only once
+/// </summary>
+/// <param name="impostors">The impostor map.</param>
+/// <param name="binFileName">Name of the binary file.</param>
+void ImpostorBaker::WriteBinImpostors(std::unordered_map<std::string, std::unique_ptr<ImpostorAtlas>>& impostors, const char* binFileName)
+{
+	std::ofstream stream;
+	stream.open(binFileName, std::ios::trunc | std::ios::binary);
+	if (stream.is_open()) {
+		UINT version = ImpostorFileVersion;
+		stream.write((const char*)&version, sizeof(UINT));
+		UINT impostorCount = impostors.size();
+		stream.write((const char*)&impostorCount, sizeof(UINT));
+		for (auto& impostor : impostors) {
+			ImpostorAtlas* atlas = impostor.second.get();
+			UINT nameSize = atlas->Name.size() + 1;
+			stream.write((const char*)&nameSize, sizeof(UINT));
+			stream.write(atlas->Name.c_str(), nameSize);
+			stream.write((const char*)&atlas->SourceHash, sizeof(uint64_t));
+			stream.write((const char*)&atlas->ViewCount, sizeof(UINT));
+			stream.write((const char*)&atlas->TileSize, sizeof(UINT));
+			stream.write((const char*)&atlas->Center, sizeof(XMFLOAT3));
+			stream.write((const char*)&atlas->Radius, sizeof(float));
+
+			UINT texelCount = atlas->GetWidth() * atlas->GetHeight();
+			stream.write((const char*)atlas->TexCoords.data(), texelCount * sizeof(UINT));
+			stream.write((const char*)atlas->Normals.data(), texelCount * sizeof(UINT));
+			stream.write((const char*)atlas->Depths.data(), texelCount * sizeof(float));
+		}
+		stream.close();
+	}
+	else {
+		char errorStr[100];
+		strerror_s(errorStr, 100, errno);
+	}
+}
+
+/// <summary>
+/// Reads the baked impostors from a binary file
+/// </summary>
+/// <param name="impostors">The impostor map.</param>
+/// <param name="binFileName">Name of the binary file.</param>
+/// <returns>False if the file doesn't exist, is truncated or corrupt, or was baked by another version or with different settings, and the impostors must be baked</returns>
+bool ImpostorBaker::ReadBinImpostors(std::unordered_map<std::string, std::unique_ptr<ImpostorAtlas>>& impostors, const char* binFileName)
+{
+	//the names are render item names and there is an atlas per vegetation model, anything bigger is a corrupt file
+	const UINT MaxNameSize = 256;
+	const UINT MaxImpostorCount = 1024;
+	std::ifstream stream;
+	stream.open(binFileName, std::ios::binary);
+	if (!stream.is_open())
+		return false;
+
+	UINT version = 0;
+	UINT impostorCount = 0;
+	stream.read((char*)&version, sizeof(UINT));
+	stream.read((char*)&impostorCount, sizeof(UINT));
+	if (!stream || version != ImpostorFileVersion || impostorCount > MaxImpostorCount)
+		return false;
+	while (impostorCount--) {
+		auto atlas = std::make_unique<ImpostorAtlas>();
+		UINT nameSize = 0;
+		stream.read((char*)&nameSize, sizeof(UINT));
+		if (!stream || nameSize == 0 || nameSize > MaxNameSize) {
+			impostors.clear();
+			return false;
+		}
+		atlas->Name.resize(nameSize);
+		stream.read(&atlas->Name[0], nameSize);
+		if (!stream || atlas->Name.back() != '\0') {
+			impostors.clear();
+			return false;
+		}
+		atlas->Name.resize(nameSize - 1);
+		stream.read((char*)&atlas->SourceHash, sizeof(uint64_t));
+		stream.read((char*)&atlas->ViewCount, sizeof(UINT));
+		stream.read((char*)&atlas->TileSize, sizeof(UINT));
+		stream.read((char*)&atlas->Center, sizeof(XMFLOAT3));
+		stream.read((char*)&atlas->Radius, sizeof(float));
+		//the view count and the tile size are the baker's, so the texel count is bounded by them
+		if (!stream || atlas->ViewCount != m_viewCount || atlas->TileSize != m_tileSize) {
+			impostors.clear();
+			return false;
+		}
+
+		UINT texelCount = atlas->GetWidth() * atlas->GetHeight();
+		atlas->TexCoords.resize(texelCount);
+		atlas->Normals.resize(texelCount);
+		atlas->Depths.resize(texelCount);
+		stream.read((char*)atlas->TexCoords.data(), texelCount * sizeof(UINT));
+		stream.read((char*)atlas->Normals.data(), texelCount * sizeof(UINT));
+		stream.read((char*)atlas->Depths.data(), texelCount * sizeof(float));
+		if (!stream) {
+			impostors.clear();
+			return false;
+		}
+		impostors[atlas->Name] = std::move(atlas);
+	}
+	CountReadBytes((uint64_t)stream.tellg());
+	stream.close();
+	return true;
+}
@@ -0,0 +1,64 @@
+#pragma once
+#include <fstream>
+#include <unordered_map>
+#include "ShaderStructures.h"
+#include "RenderItem.h"
+
+using namespace DirectX;
+
+namespace ExecuteIndirect {
+
+	// Atlas indices - each impostor owns three textures, placed one after another in the texture heap
+	enum ImpostorAtlasType
+	{
+		Impostor_TexCoordAtlas,		// R16G16_UNORM - the mesh texture coordinates, used to fetch the albedo from the diffuse map
+		Impostor_NormalAtlas,		// R8G8B8A8_UNORM - the object space normal, alpha is coverage
+		Impostor_DepthAtlas,		// R32_FLOAT - the normalized depth, 1.0 where nothing was rasterized
+		Impostor_AtlasCount
+	};
+
+	// Version of models\impostors.bin, a file of another version is baked again
+	const UINT ImpostorFileVersion = 2;
+
+	// The baked views of a single render item. Every view is a square tile and the tiles are
+	// laid out horizontally, so the atlas is (ViewCount * TileSize) x TileSize texels.
+	struct ImpostorAtlas
+	{
+		std::string Name;
+		UINT index;
+		UINT ViewCount;
+		UINT TileSize;
+		XMFLOAT3 Center;
+		float Radius;
+		uint64_t SourceHash;		// of the baked mesh, the atlas is baked again when the mesh changes
+
+		std::vector<UINT> TexCoords;
+		std::vector<UINT> Normals;
+		std::vector<float> Depths;
+
+		Microsoft::WRL::ComPtr<ID3D12Resource> Resource[Impostor_AtlasCount];
+		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap[Impostor_AtlasCount];
+
+		UINT GetWidth() { return ViewCount * TileSize; }
+		UINT GetHeight() { return TileSize; }
+	};
+
+	// Offline baker - renders a render item from ViewCount directions around the vertical axis
+	// with a CPU software rasterizer
+	class ImpostorBaker
+	{
+	public:
+		ImpostorBaker(UINT viewCount = 8, UINT tileSize = 128);
+		std::unique_ptr<ImpostorAtlas> Bake(const std::string& name, RenderItem* ri);
+		static uint64_t HashSource(RenderItem* ri);
+
+		bool ReadBinImpostors(std::unordered_map<std::string, std::unique_ptr<ImpostorAtlas>>& impostors, const char* fileName);
+		void WriteBinImpostors(std::unordered_map<std::string, std::unique_ptr<ImpostorAtlas>>& impostors, const char* fileName);
+
+	private:
+		void RasterizeView(RenderItem* ri, ImpostorAtlas* atlas, UINT view);
+
+		UINT m_viewCount;
+		UINT m_tileSize;
+	};
+}
@@ -0,0 +1,128 @@
+// Defaults for number of lights.
+#ifndef NUM_DIR_LIGHTS
+#define NUM_DIR_LIGHTS 3
+#endif
+
+#ifndef NUM_POINT_LIGHTS
+#define NUM_POINT_LIGHTS 0
+#endif
+
+#ifndef NUM_SPOT_LIGHTS
+#define NUM_SPOT_LIGHTS 0
+#endif
+
+#include "Lighting.hlsli"
+#include "Instance.hlsli"
+
+#define MaxImpostors 8
+
+//static samplers
+SamplerState gsamPointWrap        : register(s0);
+SamplerState gsamPointClamp       : register(s1);
+SamplerState gsamLinearWrap       : register(s2);
+SamplerState gsamLinearClamp      : register(s3);
+SamplerState gsamAnisotropicWrap  : register(s4);
+SamplerState gsamAnisotropicClamp : register(s5);
+
+cbuffer SceneConstantBuffer : register(b0)
+{
+	float4x4 viewMatrix;
+	float4x4 projectionMatrix;
+	float4 viewportSize;
+	float3 eyePosW;
+	float sCBPadding1;
+	float4 ambientLight;
+
+	Light lights[MaxLights];
+};
+
+cbuffer ImpostorConstants : register(b1)
+{
+	float3 impostorCenter;
+	float impostorRadius;
+	uint atlasIndex;
+	uint viewCount;
+	uint itemIndex;
+	uint ImpPad0;
+};
+
+struct MaterialData
+{
+	float4   DiffuseAlbedo;
+	float3   FresnelR0;
+	float    Roughness;
+	float4x4 MatTransform;
+	uint     DiffuseMapIndex;
+	uint     NormalMapIndex;
+	uint     MatPad1;
+	uint     MatPad2;
+};
+
+
+//unbounded, the same declaration as in PixelShader.hlsl
+Texture2D diffuseMaps[] : register(t0, space1);
+//Every impostor has three atlases - texture coordinates, normals and depth
+Texture2D impostorAtlases[3 * MaxImpostors] : register(t0, space3);
+StructuredBuffer<MaterialData> materials : register(t0);
+StructuredBuffer<ItemData> items : register(t2);
+
+struct PixelShaderInput
+{
+	float4 PosH    : SV_POSITION;
+	float3 PosW    : POSITION;
+	float2 AtlasC  : TEXCOORD;
+	nointerpolation float4 Rotation : ROTATION;
+	nointerpolation float3 ViewDirW : VIEWDIR;
+	nointerpolation float RadiusW : RADIUS;
+};
+
+struct PixelShaderOutput
+{
+	float4 Color : SV_TARGET;
+	float Depth  : SV_DEPTH;
+};
+
+/// <summary>
+/// Impostor Pixel Shader main function
+/// </summary>
+/// <returns>Pixel Color and the depth of the baked surface</returns>
+/// <param name="input">The Pixel Shader Input</param>
+PixelShaderOutput main(PixelShaderInput input)
+{
+	//discard the texels where the baker didn't rasterize anything
+	float depth = impostorAtlases[atlasIndex * 3 + 2].Sample(gsamPointClamp, input.AtlasC).r;
+	clip(0.999f - depth);
+
+	//the quad passes through the center, the baked depth moves the pixel to the surface of the mesh - otherwise
+	//the quads of the parts of a model (trunk and branches) would be at the same depth and z-fight
+	float3 posW = input.PosW + input.ViewDirW * ((depth * 2.0f - 1.0f) * input.RadiusW);
+	float4 posH = mul(mul(float4(posW, 1.0f), viewMatrix), projectionMatrix);
+
+	ItemData item = items[itemIndex];
+	MaterialData matData = materials[item.materialIndex];
+	//the atlas stores the mesh texture coordinates, transform them the same way the vertex shader does
+	float2 meshTexC = impostorAtlases[atlasIndex * 3].Sample(gsamPointClamp, input.AtlasC).rg;
+	float4 texC = mul(float4(meshTexC, 0.0f, 1.0f), item.TexTransform);
+	texC = mul(texC, matData.MatTransform);
+
+	float4 diffuseColor = diffuseMaps[matData.DiffuseMapIndex].Sample(gsamAnisotropicWrap, texC.xy);
+	clip(diffuseColor.a - 0.1f);
+	float4 diffuseAlbedo = matData.DiffuseAlbedo * diffuseColor;
+
+	//the atlas stores the object space normal
+	float3 normalL = impostorAtlases[atlasIndex * 3 + 1].Sample(gsamPointClamp, input.AtlasC).xyz * 2.0f - 1.0f;
+	float3 normalW = normalize(rotateVector(normalL, input.Rotation));
+	float3 toEyeW = normalize(eyePosW - posW);
+
+	float4 ambient = ambientLight * diffuseAlbedo;
+	const float shininess = 1.0f - matData.Roughness;
+	Material mat = { diffuseAlbedo, matData.FresnelR0, shininess };
+	float3 shadowFactor = 1.0f;
+	float4 directLight = ComputeLighting(lights, mat, posW, normalW, toEyeW, shadowFactor);
+
+	PixelShaderOutput output;
+	output.Color = ambient + directLight;
+	output.Color.a = diffuseAlbedo.a;
+	output.Depth = posH.z / posH.w;
+	return output;
+}
@@ -0,0 +1,81 @@
+#include "Lighting.hlsli"
+#include "Instance.hlsli"
+
+cbuffer SceneConstantBuffer : register(b0)
+{
+	float4x4 viewMatrix;
+	float4x4 projectionMatrix;
+	float4 viewportSize;
+	float3 eyePosW;
+	float sCBPadding1;
+	float4 ambientLight;
+	Light lights[MaxLights];
+};
+
+cbuffer ImpostorConstants : register(b1)
+{
+	float3 impostorCenter;		//Center of the baked mesh, in local space
+	float impostorRadius;		//Radius of the baked mesh, in local space
+	uint atlasIndex;
+	uint viewCount;
+	uint itemIndex;				//in the render item table
+	uint ImpPad0;
+};
+
+
+StructuredBuffer<InstanceData> instanceData : register(t1);			//Instance Data SRV (the far instances)
+
+struct PixelShaderInput
+{
+	float4 PosH    : SV_POSITION;
+	float3 PosW    : POSITION;
+	float2 AtlasC  : TEXCOORD;		//Texture coordinates in the impostor atlas
+	nointerpolation float4 Rotation : ROTATION;		//of the instance, the atlas normals are in local space
+	nointerpolation float3 ViewDirW : VIEWDIR;		//the direction the chosen view was baked along, towards the mesh
+	nointerpolation float RadiusW : RADIUS;
+};
+
+static const float2 quadCorners[6] =
+{
+	float2(0.0f, 0.0f), float2(1.0f, 0.0f), float2(0.0f, 1.0f),
+	float2(0.0f, 1.0f), float2(1.0f, 0.0f), float2(1.0f, 1.0f)
+};
+
+/// <summary>
+/// Impostor Vertex Shader main function - expands every instance to a camera facing quad
+/// </summary>
+/// <returns>Pixel Shader Input</returns>
+/// <param name="vertexID">System value - the quad corner index</param>
+/// <param name="instanceID">System value - the current instance index</param>
+PixelShaderInput main(uint vertexID : SV_VertexID, uint instanceID : SV_InstanceID)
+{
+	PixelShaderInput output;
+	InstanceData instData = instanceData[instanceID];
+	float4x4 worldMatrix = instanceWorld(instData);
+	float scale = instData.Scale;
+	float3 centerW = mul(float4(impostorCenter, 1.0f), worldMatrix).xyz;
+	float radiusW = impostorRadius * scale;
+
+	//the quad rotates around the vertical axis to face the camera
+	float3 toEye = eyePosW - centerW;
+	toEye.y = 0.0f;
+	toEye = length(toEye) > 0.0f ? normalize(toEye) : float3(0.0f, 0.0f, 1.0f);
+	float3 right = float3(-toEye.z, 0.0f, toEye.x);
+
+	//view k of the atlas was baked from local direction (sin(2*PI*k/N), 0, cos(2*PI*k/N)), pick the closest one
+	float4 inverseRotation = float4(-instData.Rotation.xyz, instData.Rotation.w);
+	float3 toEyeL = rotateVector(toEye, inverseRotation);
+	float azimuth = atan2(toEyeL.x, toEyeL.z);
+	uint view = ((int)round(azimuth / 6.28318530718f * viewCount) + viewCount) % viewCount;
+	float viewAngle = 6.28318530718f * view / viewCount;
+	output.ViewDirW = -rotateVector(float3(sin(viewAngle), 0.0f, cos(viewAngle)), instData.Rotation);
+	output.Rotation = instData.Rotation;
+	output.RadiusW = radiusW;
+
+	float2 corner = quadCorners[vertexID];
+	float3 posW = centerW + right * (corner.x * 2.0f - 1.0f) * radiusW + float3(0.0f, 1.0f, 0.0f) * (1.0f - corner.y * 2.0f) * radiusW;
+	output.PosW = posW;
+	output.PosH = mul(mul(float4(posW, 1.0f), viewMatrix), projectionMatrix);
+	output.AtlasC = float2((view + corner.x) / viewCount, corner.y);
+	return output;
+}
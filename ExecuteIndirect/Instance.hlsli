@@ -0,0 +1,44 @@
+// Compact instance - the layout of InstanceData in ShaderStructures.h
+struct InstanceData
+{
+	float3 Position;
+	float Scale;				//uniform, 0 for an empty slot
+	float4 Rotation;			//unit quaternion
+};
+
+// Constants of a render item, which all of its instances share - ItemData in ShaderStructures.h
+struct ItemData
+{
+	float4x4 TexTransform;
+	uint materialIndex;
+	uint ItemPad0;
+	uint ItemPad1;
+	uint ItemPad2;
+};
+
+/// <summary>
+/// Builds the world matrix of an instance - the scaled rotation in the first three rows, the translation in the last
+/// </summary>
+float4x4 instanceWorld(in InstanceData instance)
+{
+	float4 q = instance.Rotation;
+	float3x3 rotation = float3x3(
+		1.0f - 2.0f * (q.y * q.y + q.z * q.z), 2.0f * (q.x * q.y + q.z * q.w), 2.0f * (q.x * q.z - q.y * q.w),
+		2.0f * (q.x * q.y - q.z * q.w), 1.0f - 2.0f * (q.x * q.x + q.z * q.z), 2.0f * (q.y * q.z + q.x * q.w),
+		2.0f * (q.x * q.z + q.y * q.w), 2.0f * (q.y * q.z - q.x * q.w), 1.0f - 2.0f * (q.x * q.x + q.y * q.y));
+	rotation *= instance.Scale;
+	return float4x4(
+		float4(rotation[0], 0.0f),
+		float4(rotation[1], 0.0f),
+		float4(rotation[2], 0.0f),
+		float4(instance.Position, 1.0f));
+}
+
+/// <summary>
+/// Rotates a vector by a unit quaternion, the same rotation as the one of instanceWorld
+/// </summary>
+float3 rotateVector(float3 v, float4 q)
+{
+	return v + 2.0f * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+
@@ -0,0 +1,97 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "InstancePacking.h"
+#include <cmath>
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Packs an instance, its world matrix must have no shear and the same scale on every axis
+/// </summary>
+/// <param name="world">The world matrix.</param>
+/// <param name="instance">The packed instance.</param>
+void ExecuteIndirect::PackInstance(const float world[16], SceneInstance& instance)
+{
+	instance.Position[0] = world[12];
+	instance.Position[1] = world[13];
+	instance.Position[2] = world[14];
+	instance.Scale = std::sqrt(world[0] * world[0] + world[1] * world[1] + world[2] * world[2]);
+	PackRotation(world, instance.Rotation);
+}
+
+/// <summary>
+/// Gets the quaternion from the largest of its components, which is the most accurate one
+/// </summary>
+void ExecuteIndirect::PackRotation(const float world[16], float quaternion[4])
+{
+	float r[3][3];
+	for (int row = 0; row < 3; row++) {
+		const float* basis = world + 4 * row;
+		float length = std::sqrt(basis[0] * basis[0] + basis[1] * basis[1] + basis[2] * basis[2]);
+		float inverse = length > 0.0f ? 1.0f / length : 0.0f;
+		for (int column = 0; column < 3; column++)
+			r[row][column] = basis[column] * inverse;
+	}
+	float& x = quaternion[0];
+	float& y = quaternion[1];
+	float& z = quaternion[2];
+	float& w = quaternion[3];
+	float trace = r[0][0] + r[1][1] + r[2][2];
+	if (trace > 0.0f) {
+		float s = 2.0f * std::sqrt(trace + 1.0f);
+		w = 0.25f * s;
+		x = (r[1][2] - r[2][1]) / s;
+		y = (r[2][0] - r[0][2]) / s;
+		z = (r[0][1] - r[1][0]) / s;
+	}
+	else if (r[0][0] > r[1][1] && r[0][0] > r[2][2]) {
+		float s = 2.0f * std::sqrt(1.0f + r[0][0] - r[1][1] - r[2][2]);
+		x = 0.25f * s;
+		w = (r[1][2] - r[2][1]) / s;
+		y = (r[0][1] + r[1][0]) / s;
+		z = (r[2][0] + r[0][2]) / s;
+	}
+	else if (r[1][1] > r[2][2]) {
+		float s = 2.0f * std::sqrt(1.0f + r[1][1] - r[0][0] - r[2][2]);
+		y = 0.25f * s;
+		w = (r[2][0] - r[0][2]) / s;
+		x = (r[0][1] + r[1][0]) / s;
+		z = (r[1][2] + r[2][1]) / s;
+	}
+	else {
+		float s = 2.0f * std::sqrt(1.0f + r[2][2] - r[0][0] - r[1][1]);
+		z = 0.25f * s;
+		w = (r[0][1] - r[1][0]) / s;
+		x = (r[2][0] + r[0][2]) / s;
+		y = (r[1][2] + r[2][1]) / s;
+	}
+	//q and -q are the same rotation, w is kept positive
+	float length = std::sqrt(x * x + y * y + z * z + w * w);
+	float inverse = (w < 0.0f ? -1.0f : 1.0f) / length;
+	for (int i = 0; i < 4; i++)
+		quaternion[i] *= inverse;
+}
+
+/// <summary>
+/// Builds the world matrix of a packed instance, an empty slot gives a matrix without the rotation and the scale
+/// </summary>
+void ExecuteIndirect::UnpackWorld(const SceneInstance& instance, float world[16])
+{
+	float x = instance.Rotation[0], y = instance.Rotation[1], z = instance.Rotation[2], w = instance.Rotation[3];
+	float s = instance.Scale;
+	const float rows[3][3] = {
+		{ 1.0f - 2.0f * (y * y + z * z), 2.0f * (x * y + z * w), 2.0f * (x * z - y * w) },
+		{ 2.0f * (x * y - z * w), 1.0f - 2.0f * (x * x + z * z), 2.0f * (y * z + x * w) },
+		{ 2.0f * (x * z + y * w), 2.0f * (y * z - x * w), 1.0f - 2.0f * (x * x + y * y) },
+	};
+	for (int row = 0; row < 3; row++) {
+		for (int column = 0; column < 3; column++)
+			world[4 * row + column] = rows[row][column] * s;
+		world[4 * row + 3] = 0.0f;
+	}
+	world[12] = instance.Position[0];
+	world[13] = instance.Position[1];
+	world[14] = instance.Position[2];
+	world[15] = 1.0f;
+}
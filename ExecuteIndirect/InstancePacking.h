@@ -0,0 +1,17 @@
+#pragma once
+#include "SceneFile.h"
+#include <cstdint>
+
+namespace ExecuteIndirect {
+
+	// Conversions between the compact instances and the world matrices of the renderer. The matrices are the XMFLOAT4X4
+	// of an XMMATRIX - row vectors, the translation in the last row. The culling and the vertex shaders decode the same
+	// layout in Instance.hlsli.
+
+	// The world matrix must be a rotation, a uniform scale and a translation - the scale is the length of the first row
+	void PackInstance(const float world[16], SceneInstance& instance);
+	// Unit quaternion (x, y, z, w) of a rotation matrix with row vectors, the rows are normalized first
+	void PackRotation(const float world[16], float quaternion[4]);
+
+	void UnpackWorld(const SceneInstance& instance, float world[16]);
+}
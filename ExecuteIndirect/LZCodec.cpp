@@ -0,0 +1,175 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "LZCodec.h"
+#include <cstring>
+
+using namespace ExecuteIndirect;
+
+static const int LZHashBits = 14;
+
+static uint32_t Read32(const uint8_t* p)
+{
+	uint32_t value;
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static uint32_t Hash32(uint32_t value)
+{
+	return (value * 2654435761u) >> (32 - LZHashBits);
+}
+
+/// <summary>
+/// Helper function - writes a length, which doesn't fit in the token nibble, as a run of 255 bytes and the rest
+/// </summary>
+static uint8_t* WriteLength(uint8_t* out, size_t length)
+{
+	while (length >= 255) {
+		*out++ = 255;
+		length -= 255;
+	}
+	*out++ = (uint8_t)length;
+	return out;
+}
+
+/// <summary>
+/// Helper function - writes a sequence
+/// </summary>
+/// <returns>The end of the sequence or nullptr if it doesn't fit in the destination</returns>
+static uint8_t* WriteSequence(uint8_t* out, uint8_t* outEnd, const uint8_t* literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+	size_t worstCase = 1 + literalCount / 255 + 1 + literalCount + 2 + matchLength / 255 + 1;
+	if ((size_t)(outEnd - out) < worstCase)
+		return nullptr;
+	uint8_t* token = out++;
+	*token = (uint8_t)((literalCount < 15 ? literalCount : 15) << 4);
+	if (literalCount >= 15)
+		out = WriteLength(out, literalCount - 15);
+	memcpy(out, literals, literalCount);
+	out += literalCount;
+	//the last sequence ends after the literals
+	if (matchLength == 0)
+		return out;
+	*out++ = (uint8_t)(offset & 0xFF);
+	*out++ = (uint8_t)(offset >> 8);
+	matchLength -= LZMinMatch;
+	*token |= (uint8_t)(matchLength < 15 ? matchLength : 15);
+	if (matchLength >= 15)
+		out = WriteLength(out, matchLength - 15);
+	return out;
+}
+
+/// <summary>
+/// Compresses a block with a single pass greedy match finder
+/// </summary>
+/// <param name="source">The data.</param>
+/// <param name="sourceSize">The size of the data.</param>
+/// <param name="destination">The compressed data.</param>
+/// <param name="destinationCapacity">The size of the destination, LZCompressBound always fits.</param>
+/// <returns>The size of the compressed data, 0 if it doesn't fit in the destination</returns>
+size_t ExecuteIndirect::LZCompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationCapacity)
+{
+	uint32_t table[1 << LZHashBits];
+	memset(table, 0, sizeof(table));
+	const uint8_t* in = source;
+	const uint8_t* anchor = source;
+	const uint8_t* inEnd = source + sourceSize;
+	uint8_t* out = destination;
+	uint8_t* outEnd = destination + destinationCapacity;
+	size_t misses = 0;
+
+	while (sourceSize >= LZMinMatch && in <= inEnd - LZMinMatch) {
+		uint32_t hash = Hash32(Read32(in));
+		const uint8_t* candidate = source + table[hash];
+		table[hash] = (uint32_t)(in - source);
+		if (candidate < in && (size_t)(in - candidate) <= LZMaxOffset && Read32(candidate) == Read32(in)) {
+			size_t matchLength = LZMinMatch;
+			while (in + matchLength < inEnd && candidate[matchLength] == in[matchLength])
+				matchLength++;
+			out = WriteSequence(out, outEnd, anchor, in - anchor, in - candidate, matchLength);
+			if (!out)
+				return 0;
+			in += matchLength;
+			anchor = in;
+			misses = 0;
+		}
+		else {
+			//incompressible data is skipped faster and faster
+			in += 1 + (misses++ >> 6);
+		}
+	}
+	out = WriteSequence(out, outEnd, anchor, inEnd - anchor, 0, 0);
+	if (!out)
+		return 0;
+	return out - destination;
+}
+
+/// <summary>
+/// Decompresses a block. Every length and offset is checked, so corrupted data can't write outside the destination.
+/// </summary>
+/// <param name="source">The compressed data.</param>
+/// <param name="sourceSize">The size of the compressed data.</param>
+/// <param name="destination">The decompressed data.</param>
+/// <param name="destinationSize">The size of the decompressed data.</param>
+/// <returns>False if the compressed data is corrupted or doesn't decompress to exactly destinationSize bytes</returns>
+bool ExecuteIndirect::LZDecompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationSize)
+{
+	const uint8_t* in = source;
+	const uint8_t* inEnd = source + sourceSize;
+	uint8_t* out = destination;
+	uint8_t* outEnd = destination + destinationSize;
+
+	while (in < inEnd) {
+		uint8_t token = *in++;
+		size_t literalCount = token >> 4;
+		if (literalCount == 15) {
+			uint8_t extra;
+			do {
+				if (in == inEnd)
+					return false;
+				extra = *in++;
+				literalCount += extra;
+			} while (extra == 255);
+		}
+		if ((size_t)(inEnd - in) < literalCount || (size_t)(outEnd - out) < literalCount)
+			return false;
+		memcpy(out, in, literalCount);
+		in += literalCount;
+		out += literalCount;
+		//the last sequence has no match
+		if (in == inEnd)
+			break;
+
+		if (inEnd - in < 2)
+			return false;
+		size_t offset = in[0] | (in[1] << 8);
+		in += 2;
+		if (offset == 0 || offset > (size_t)(out - destination))
+			return false;
+		size_t matchLength = token & 15;
+		if (matchLength == 15) {
+			uint8_t extra;
+			do {
+				if (in == inEnd)
+					return false;
+				extra = *in++;
+				matchLength += extra;
+			} while (extra == 255);
+		}
+		matchLength += LZMinMatch;
+		if ((size_t)(outEnd - out) < matchLength)
+			return false;
+		const uint8_t* match = out - offset;
+		if (offset >= matchLength) {
+			memcpy(out, match, matchLength);
+			out += matchLength;
+		}
+		else {
+			//overlapping match - repeats the last offset bytes
+			for (size_t i = 0; i < matchLength; i++)
+				*out++ = match[i];
+		}
+	}
+	return out == outEnd;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace ExecuteIndirect {
+
+	// Byte oriented LZ77 codec in the LZ4 style: every sequence is a token (literal length | match length - 4),
+	// the literals, a 16 bit match offset and the match. The last sequence has only literals.
+	// It has no dependencies, so the scene files don't need an external library.
+	const size_t LZMinMatch = 4;
+	const size_t LZMaxOffset = 65535;
+
+	// The worst case size of the compressed data - the literals and their length bytes
+	inline size_t LZCompressBound(size_t size) { return size + size / 255 + 16; }
+
+	size_t LZCompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationCapacity);
+	bool LZDecompress(const uint8_t* source, size_t sourceSize, uint8_t* destination, size_t destinationSize);
+}
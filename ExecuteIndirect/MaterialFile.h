@@ -0,0 +1,55 @@
+#pragma once
+#include <cstdint>
+
+namespace ExecuteIndirect {
+
+	// materials.bin v2 layout:
+	//   MaterialFileHeader | TextureRecord[DiffuseMapCount] | TextureRecord[NormalMapCount] | MaterialRecord[MaterialCount] | string table
+	// The names are offsets in the deduplicated string table of '\0' terminated strings, the loaded
+	// textures and materials reference them in the mapped file. Like the scene file, the structures don't
+	// use DirectXMath, so the asset cooker writes them without the renderer.
+	const uint32_t MaterialFileMagic = 0x544D4945;		// "EIMT"
+	const uint32_t MaterialFileVersion = 2;
+
+	struct MaterialFileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t DiffuseMapCount;
+		uint32_t NormalMapCount;
+		uint32_t MaterialCount;
+		uint32_t StringTableSize;
+		uint32_t Reserved[2];
+	};
+
+	struct TextureRecord
+	{
+		uint32_t NameOffset;
+		uint32_t NameSize;
+		uint32_t FilenameOffset;
+		uint32_t FilenameSize;
+		uint32_t Index;
+	};
+
+	// Layout of MaterialData
+	struct MaterialFileData
+	{
+		float DiffuseAlbedo[4];
+		float FresnelR0[3];
+		float Roughness;
+		float MatTransform[16];
+		uint32_t DiffuseMapIndex;
+		uint32_t NormalMapIndex;
+		uint32_t MaterialPad1;
+		uint32_t MaterialPad2;
+	};
+
+	struct MaterialRecord
+	{
+		uint32_t NameOffset;
+		uint32_t NameSize;
+		int32_t MatCBIndex;
+		uint32_t Pad;
+		MaterialFileData Data;
+	};
+}
@@ -0,0 +1,352 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "MemoryTracker.h"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace ExecuteIndirect;
+
+static const char* categoryNames[Memory_CategoryCount] = {
+	"Geometry",
+	"Instances",
+	"GPU geometry",
+	"GPU instances",
+	"Uploaders",
+	"Frame resources",
+	"Textures",
+	"Parser",
+	"Streaming"
+};
+
+const char* ExecuteIndirect::GetMemoryCategoryName(MemoryCategory category)
+{
+	return category < Memory_CategoryCount ? categoryNames[category] : "Unknown";
+}
+
+MemoryTracker& MemoryTracker::Get()
+{
+	static MemoryTracker tracker;
+	return tracker;
+}
+
+/// <summary>
+/// Helper function - formats bytes as MB for the warnings and the table
+/// </summary>
+static std::string FormatMB(uint64_t bytes)
+{
+	std::ostringstream stream;
+	stream << std::fixed << std::setprecision(2) << bytes / (1024.0 * 1024.0) << " MB";
+	return stream.str();
+}
+
+/// <summary>
+/// Changes the bytes of a category and the total, a warning is added if the category or the total crosses its budget
+/// </summary>
+void MemoryTracker::ChangeLocked(MemoryCategory category, uint64_t oldBytes, uint64_t newBytes, std::string& warnings)
+{
+	Counter& counter = m_categories[category];
+	//the bytes are never removed twice, but a wrong caller mustn't wrap the counters around
+	uint64_t removed = std::min(oldBytes, counter.Current);
+	uint64_t current = counter.Current - removed + newBytes;
+	uint64_t total = m_total.Current - std::min(removed, m_total.Current) + newBytes;
+	if (counter.Budget && counter.Current <= counter.Budget && current > counter.Budget) {
+		warnings += std::string("Memory: ") + categoryNames[category] + " is over its budget, " + FormatMB(current) + " of " + FormatMB(counter.Budget) + "\n";
+		m_warnings++;
+	}
+	if (m_total.Budget && m_total.Current <= m_total.Budget && total > m_total.Budget) {
+		warnings += "Memory: the total is over its budget, " + FormatMB(total) + " of " + FormatMB(m_total.Budget) + "\n";
+		m_warnings++;
+	}
+	counter.Current = current;
+	counter.Peak = std::max(counter.Peak, current);
+	m_total.Current = total;
+	m_total.Peak = std::max(m_total.Peak, total);
+}
+
+/// <summary>
+/// Adds or removes bytes of an owner in a category
+/// </summary>
+void MemoryTracker::ChangeOwnerLocked(MemoryCategory category, const void* owner, uint64_t bytes, bool add, std::string& warnings)
+{
+	if (!owner) {
+		ChangeLocked(category, add ? 0 : bytes, add ? bytes : 0, warnings);
+		return;
+	}
+	Owner& entry = m_owners[owner];
+	uint64_t oldBytes = entry.Bytes[category];
+	uint64_t newBytes = add ? oldBytes + bytes : oldBytes - std::min(bytes, oldBytes);
+	entry.Bytes[category] = newBytes;
+	entry.Total = entry.Total - oldBytes + newBytes;
+	entry.Peak = std::max(entry.Peak, entry.Total);
+	ChangeLocked(category, oldBytes, newBytes, warnings);
+}
+
+void MemoryTracker::Add(MemoryCategory category, uint64_t bytes, const void* owner)
+{
+	if (category >= Memory_CategoryCount || bytes == 0)
+		return;
+	std::string warnings;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ChangeOwnerLocked(category, owner, bytes, true, warnings);
+	}
+	Warn(warnings);
+}
+
+void MemoryTracker::Remove(MemoryCategory category, uint64_t bytes, const void* owner)
+{
+	if (category >= Memory_CategoryCount || bytes == 0)
+		return;
+	std::string warnings;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		ChangeOwnerLocked(category, owner, bytes, false, warnings);
+	}
+	Warn(warnings);
+}
+
+/// <summary>
+/// Replaces the bytes of an owner in a category - used for the resources, which are recreated or resized as a whole
+/// </summary>
+/// <param name="category">The category.</param>
+/// <param name="bytes">The new size, 0 if the owner released its memory of the category.</param>
+/// <param name="owner">The owner, required.</param>
+void MemoryTracker::Set(MemoryCategory category, uint64_t bytes, const void* owner)
+{
+	if (category >= Memory_CategoryCount || !owner)
+		return;
+	std::string warnings;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		auto found = m_owners.find(owner);
+		if (found == m_owners.end() && bytes == 0)
+			return;
+		uint64_t oldBytes = found == m_owners.end() ? 0 : found->second.Bytes[category];
+		if (bytes > oldBytes)
+			ChangeOwnerLocked(category, owner, bytes - oldBytes, true, warnings);
+		else if (bytes < oldBytes)
+			ChangeOwnerLocked(category, owner, oldBytes - bytes, false, warnings);
+	}
+	Warn(warnings);
+}
+
+void MemoryTracker::SetOwnerName(const void* owner, const std::string& name)
+{
+	if (!owner)
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_owners[owner].Name = name;
+}
+
+void MemoryTracker::RemoveOwner(const void* owner)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	auto found = m_owners.find(owner);
+	if (found == m_owners.end())
+		return;
+	//going down never crosses a budget
+	std::string warnings;
+	for (uint32_t category = 0; category < Memory_CategoryCount; category++)
+		ChangeLocked((MemoryCategory)category, found->second.Bytes[category], 0, warnings);
+	m_owners.erase(found);
+}
+
+void MemoryTracker::SetBudget(MemoryCategory category, uint64_t bytes)
+{
+	if (category >= Memory_CategoryCount)
+		return;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_categories[category].Budget = bytes;
+}
+
+void MemoryTracker::SetTotalBudget(uint64_t bytes)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_total.Budget = bytes;
+}
+
+void MemoryTracker::SetWarningFunction(WarningFunction warning)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	m_warning = warning;
+}
+
+void MemoryTracker::Warn(const std::string& warnings) const
+{
+	if (warnings.empty())
+		return;
+	WarningFunction warning;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		warning = m_warning;
+	}
+	if (warning)
+		warning(warnings);
+	else
+		std::cerr << warnings;
+}
+
+uint64_t MemoryTracker::GetCurrent(MemoryCategory category) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return category < Memory_CategoryCount ? m_categories[category].Current : 0;
+}
+
+uint64_t MemoryTracker::GetPeak(MemoryCategory category) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return category < Memory_CategoryCount ? m_categories[category].Peak : 0;
+}
+
+uint64_t MemoryTracker::GetTotal() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total.Current;
+}
+
+uint64_t MemoryTracker::GetTotalPeak() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_total.Peak;
+}
+
+uint32_t MemoryTracker::GetWarningCount() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return m_warnings;
+}
+
+void MemoryTracker::ResetPeaks()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& counter : m_categories)
+		counter.Peak = counter.Current;
+	m_total.Peak = m_total.Current;
+	for (auto& owner : m_owners)
+		owner.second.Peak = owner.second.Total;
+}
+
+/// <summary>
+/// Copies the owners, the ones with the most bytes first. The ones with the same bytes are ordered by the name,
+/// so two reports of the same scene list them in the same order.
+/// </summary>
+std::vector<std::pair<const void*, MemoryTracker::Owner>> MemoryTracker::SortOwners() const
+{
+	std::vector<std::pair<const void*, Owner>> owners(m_owners.begin(), m_owners.end());
+	std::sort(owners.begin(), owners.end(), [](const std::pair<const void*, Owner>& a, const std::pair<const void*, Owner>& b) {
+		if (a.second.Total != b.second.Total)
+			return a.second.Total > b.second.Total;
+		return a.second.Name < b.second.Name;
+	});
+	for (auto& owner : owners) {
+		if (owner.second.Name.empty()) {
+			std::ostringstream name;
+			name << "unnamed " << owner.first;
+			owner.second.Name = name.str();
+		}
+	}
+	return owners;
+}
+
+/// <summary>
+/// Writes the categories with their current, peak and budget bytes, and the owners with the most bytes
+/// </summary>
+void MemoryTracker::WriteTable(std::ostream& stream, size_t maxOwners) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	const double MB = 1024.0 * 1024.0;
+	stream << std::fixed << std::setprecision(2);
+	stream << "Memory (" << m_warnings << " budget warnings)\n";
+	stream << std::left << std::setw(24) << "Category" << std::right << std::setw(12) << "Current MB" << std::setw(12) << "Peak MB"
+		<< std::setw(12) << "Budget MB" << "\n";
+	for (uint32_t category = 0; category < Memory_CategoryCount; category++) {
+		const Counter& counter = m_categories[category];
+		stream << std::left << std::setw(24) << categoryNames[category] << std::right << std::setw(12) << counter.Current / MB
+			<< std::setw(12) << counter.Peak / MB;
+		if (counter.Budget)
+			stream << std::setw(12) << counter.Budget / MB << (counter.Current > counter.Budget ? " over" : "");
+		stream << "\n";
+	}
+	stream << std::left << std::setw(24) << "Total" << std::right << std::setw(12) << m_total.Current / MB << std::setw(12) << m_total.Peak / MB;
+	if (m_total.Budget)
+		stream << std::setw(12) << m_total.Budget / MB << (m_total.Current > m_total.Budget ? " over" : "");
+	stream << "\n";
+
+	std::vector<std::pair<const void*, Owner>> owners = SortOwners();
+	if (owners.empty())
+		return;
+	stream << std::left << std::setw(48) << "Owner" << std::right << std::setw(12) << "Current MB" << std::setw(12) << "Peak MB" << "\n";
+	for (size_t i = 0; i < owners.size() && i < maxOwners; i++) {
+		const Owner& owner = owners[i].second;
+		stream << std::left << std::setw(48) << owner.Name.substr(0, 47) << std::right << std::setw(12) << owner.Total / MB
+			<< std::setw(12) << owner.Peak / MB << "\n";
+	}
+	if (owners.size() > maxOwners)
+		stream << (owners.size() - maxOwners) << " more owners\n";
+}
+
+/// <summary>
+/// Helper function - writes a JSON string
+/// </summary>
+static void WriteJSONString(std::ostream& stream, const std::string& text)
+{
+	stream << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			stream << '\\' << c;
+		else if ((unsigned char)c < 0x20)
+			stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else
+			stream << c;
+	}
+	stream << '"';
+}
+
+/// <summary>
+/// Writes the categories and all owners as JSON, in bytes. An owner lists only the categories it has bytes in.
+/// </summary>
+void MemoryTracker::WriteJSON(std::ostream& stream) const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	stream << "{\n\t\"totalBytes\": " << m_total.Current << ",\n\t\"peakBytes\": " << m_total.Peak << ",\n\t\"budgetBytes\": " << m_total.Budget
+		<< ",\n\t\"warnings\": " << m_warnings << ",\n\t\"categories\": [";
+	for (uint32_t category = 0; category < Memory_CategoryCount; category++) {
+		const Counter& counter = m_categories[category];
+		stream << (category ? ",\n\t\t{ " : "\n\t\t{ ") << "\"name\": ";
+		WriteJSONString(stream, categoryNames[category]);
+		stream << ", \"bytes\": " << counter.Current << ", \"peakBytes\": " << counter.Peak << ", \"budgetBytes\": " << counter.Budget << " }";
+	}
+	stream << "\n\t],\n\t\"owners\": [";
+	std::vector<std::pair<const void*, Owner>> owners = SortOwners();
+	for (size_t i = 0; i < owners.size(); i++) {
+		const Owner& owner = owners[i].second;
+		stream << (i ? ",\n\t\t{ " : "\n\t\t{ ") << "\"name\": ";
+		WriteJSONString(stream, owner.Name);
+		stream << ", \"bytes\": " << owner.Total << ", \"peakBytes\": " << owner.Peak << ", \"categories\": {";
+		bool first = true;
+		for (uint32_t category = 0; category < Memory_CategoryCount; category++) {
+			if (!owner.Bytes[category])
+				continue;
+			stream << (first ? " " : ", ");
+			WriteJSONString(stream, categoryNames[category]);
+			stream << ": " << owner.Bytes[category];
+			first = false;
+		}
+		stream << (first ? "} }" : " } }");
+	}
+	stream << "\n\t]\n}\n";
+}
+
+/// <returns>False if the file can't be written</returns>
+bool MemoryTracker::WriteJSON(const char* fileName) const
+{
+	std::ofstream stream(fileName);
+	if (!stream.is_open())
+		return false;
+	WriteJSON(stream);
+	return stream.good();
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	enum MemoryCategory : uint32_t
+	{
+		Memory_Geometry = 0,		// CPU vertex and index streams of the render items
+		Memory_Instances,			// CPU instances of the render items
+		Memory_GPUGeometry,			// pooled vertex and index buffers
+		Memory_GPUInstances,		// instance, processed instance and impostor instance buffers
+		Memory_Uploaders,			// upload heaps, which are kept after their copy
+		Memory_FrameResources,		// upload buffers of the frames in flight
+		Memory_Textures,			// diffuse and normal maps, impostor atlases
+		Memory_Parser,				// temporary arrays of the importers
+		Memory_Streaming,			// compressed instance tiles of the world partition
+		Memory_CategoryCount
+	};
+
+	const char* GetMemoryCategoryName(MemoryCategory category);
+
+	// Current and peak bytes of the memory categories and of their owners (a render item, a texture, the geometry pool).
+	// The buffers are reported where they are created and released, not every allocation, so the tracker is cheap enough
+	// to stay on in release builds. A category or the total over its budget is reported once, when it crosses the budget.
+	class MemoryTracker
+	{
+	public:
+		typedef std::function<void(const std::string&)> WarningFunction;
+
+		static MemoryTracker& Get();
+
+		// The owner is optional, its bytes are listed per owner too
+		void Add(MemoryCategory category, uint64_t bytes, const void* owner = nullptr);
+		void Remove(MemoryCategory category, uint64_t bytes, const void* owner = nullptr);
+		// Replaces the bytes, which the owner has in the category
+		void Set(MemoryCategory category, uint64_t bytes, const void* owner);
+		void SetOwnerName(const void* owner, const std::string& name);
+		// Removes the owner and all bytes it still has, called when it is destroyed
+		void RemoveOwner(const void* owner);
+
+		// 0 - no budget
+		void SetBudget(MemoryCategory category, uint64_t bytes);
+		void SetTotalBudget(uint64_t bytes);
+		// Called outside of the tracker's lock, the default writes to stderr
+		void SetWarningFunction(WarningFunction warning);
+
+		uint64_t GetCurrent(MemoryCategory category) const;
+		uint64_t GetPeak(MemoryCategory category) const;
+		uint64_t GetTotal() const;
+		uint64_t GetTotalPeak() const;
+		uint32_t GetWarningCount() const;
+		// The peaks start again from the current bytes, e.g. after the startup
+		void ResetPeaks();
+
+		// The categories, followed by the owners with the most bytes
+		void WriteTable(std::ostream& stream, size_t maxOwners = 20) const;
+		void WriteJSON(std::ostream& stream) const;
+		bool WriteJSON(const char* fileName) const;
+
+	private:
+		struct Counter
+		{
+			uint64_t Current = 0;
+			uint64_t Peak = 0;
+			uint64_t Budget = 0;
+		};
+
+		struct Owner
+		{
+			std::string Name;
+			uint64_t Bytes[Memory_CategoryCount] = {};
+			uint64_t Total = 0;
+			uint64_t Peak = 0;
+		};
+
+		MemoryTracker() = default;
+		void ChangeLocked(MemoryCategory category, uint64_t oldBytes, uint64_t newBytes, std::string& warnings);
+		void ChangeOwnerLocked(MemoryCategory category, const void* owner, uint64_t bytes, bool add, std::string& warnings);
+		std::vector<std::pair<const void*, Owner>> SortOwners() const;
+		void Warn(const std::string& warnings) const;
+
+		mutable std::mutex m_mutex;
+		Counter m_categories[Memory_CategoryCount];
+		Counter m_total;
+		uint32_t m_warnings = 0;
+		std::unordered_map<const void*, Owner> m_owners;
+		WarningFunction m_warning;
+	};
+
+	// Temporary memory, which is in a category for the lifetime of the object, e.g. the arrays of a parsed file
+	class TrackedMemory
+	{
+	public:
+		explicit TrackedMemory(MemoryCategory category, uint64_t bytes = 0) : m_category(category) { Resize(bytes); }
+		TrackedMemory(const TrackedMemory&) = delete;
+		TrackedMemory& operator=(const TrackedMemory&) = delete;
+		~TrackedMemory() { Resize(0); }
+
+		void Resize(uint64_t bytes)
+		{
+			if (bytes > m_bytes)
+				MemoryTracker::Get().Add(m_category, bytes - m_bytes);
+			else if (bytes < m_bytes)
+				MemoryTracker::Get().Remove(m_category, m_bytes - bytes);
+			m_bytes = bytes;
+		}
+
+	private:
+		MemoryCategory m_category;
+		uint64_t m_bytes = 0;
+	};
+}
@@ -2,7 +2,12 @@
 #include "OBJLoader.h"
 #include "ShaderStructures.h"
 #include <string>
+#include <algorithm>
+#include <atomic>
+#include <stdexcept>
 #include "DirectXHelper.h"
+#include "StartupProfiler.h"
+#include "MemoryTracker.h"
 #include <stdio.h>
 #include <errno.h>
 
@@ -12,6 +17,13 @@
 using namespace DirectX;
 using namespace ExecuteIndirect;
 
+//the binary files are also written by the asset cooker, which has its own copies of the layouts
+static_assert(sizeof(ScenePosition) == sizeof(XMFLOAT3), "The position stream layout doesn't match the scene file");
+static_assert(sizeof(SceneVertexAttributes) == sizeof(VertexAttributes), "The attribute stream layout doesn't match the scene file");
+static_assert(sizeof(SceneInstance) == sizeof(InstanceData) && offsetof(SceneInstance, Rotation) == offsetof(InstanceData, Rotation),
+	"The instance layout doesn't match the scene file");
+static_assert(sizeof(MaterialFileData) == sizeof(MaterialData), "MaterialData doesn't match the materials file");
+
 /// <summary>
 /// Calculates the normal.
 /// </summary>
@@ -75,8 +87,35 @@ void CalculateTangent(Vertex& vertex1, Vertex& vertex2, Vertex& vertex3, XMFLOAT
 	XMStoreFloat3(&tangent, XMVector3Normalize(XMLoadFloat3(&tangent)));
 }
 
-OBJLoader::OBJLoader() : textureCounter(0), materialCounter(0), normalCounter(0)
+OBJLoader::OBJLoader() : textureCounter(0), materialCounter(0), normalCounter(0), m_dedupedTextures(0), m_dedupedMaterials(0)
+{
+}
+
+/// <summary>
+/// Helper function - lower case path with forward slashes, so different spellings of the same file match
+/// </summary>
+static std::string NormalizePath(const std::string& path)
+{
+	std::string normalized(path);
+	for (auto& c : normalized)
+		c = (c == '\\') ? '/' : (char)tolower((unsigned char)c);
+	return normalized;
+}
+
+/// <summary>
+/// Helper function - hashes the content of a file
+/// </summary>
+/// <returns>False if the file can't be read</returns>
+static bool HashFile(const std::string& fileName, UINT64& hash)
 {
+	std::ifstream stream(fileName, std::ios::binary | std::ios::ate);
+	if (!stream.is_open())
+		return false;
+	std::vector<char> data((size_t)stream.tellg());
+	stream.seekg(0);
+	stream.read(data.data(), data.size());
+	hash = DX::HashBytes(data.data(), data.size());
+	return true;
 }
 
 
@@ -117,99 +156,540 @@ const char* OBJLoader::MapFile(size_t *len, const char* filename)
 /// <param name="normalMaps">The normal maps.</param>
 /// <param name="materials">The materials.</param>
 void OBJLoader::ReadBinFiles(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-							std::unordered_map<std::string, std::unique_ptr<Material>>& materials)
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials)
 {
+	CommitPendingSceneFile("models\\scene.bin");
 	ReadBinRenderItems(rItems, "models\\scene.bin");
 	ReadBinMaterialsAndTextures(diffuseMaps, normalMaps, materials, "models\\materials.bin");
 }
 
+/// <summary>
+/// Helper function - milliseconds since a point in time
+/// </summary>
+static double ElapsedMilliseconds(std::chrono::steady_clock::time_point since)
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - since).count();
+}
+
+/// <summary>
+/// Helper function - reads a byte of every page, so the page faults happen on the calling thread
+/// </summary>
+static void TouchPages(const void* data, size_t size)
+{
+	const volatile BYTE* bytes = static_cast<const volatile BYTE*>(data);
+	for (size_t offset = 0; offset < size; offset += 4096)
+		(void)bytes[offset];
+}
+
+/// <summary>
+/// Starts reading the binary files on the worker pool. materials.bin is read by one task, the render items
+/// of a v2 scene file are decoded by a task each, so the caller can start the work which needs only one of them.
+/// </summary>
+/// <param name="pool">The worker pool.</param>
+/// <param name="rItems">The render items map.</param>
+/// <param name="diffuseMaps">The diffuse maps.</param>
+/// <param name="normalMaps">The normal maps.</param>
+/// <param name="materials">The materials.</param>
+/// <param name="onItemLoaded">Optional callback, called for every decoded render item.</param>
+/// <returns>The futures of the load</returns>
+SceneLoadRequest OBJLoader::ReadBinFilesAsync(WorkerPool& pool,
+							std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials,
+							RenderItemLoadedCallback onItemLoaded)
+{
+	SceneLoadRequest request;
+	request.Start = std::chrono::steady_clock::now();
+	request.Timings = std::make_shared<SceneLoadTimings>();
+	request.Timings->WorkerCount = pool.GetThreadCount();
+	auto start = request.Start;
+	auto timings = request.Timings;
+	//the tasks are nested in the caller's scope of the startup profile
+	auto profileScope = StartupProfiler::GetCurrentScope();
+
+	request.MaterialsReady = pool.Submit([this, &diffuseMaps, &normalMaps, &materials, start, timings, profileScope]() {
+		ProfileScope scope("Read materials file", profileScope);
+		ReadBinMaterialsAndTextures(diffuseMaps, normalMaps, materials, "models\\materials.bin");
+		timings->MaterialsReady = ElapsedMilliseconds(start);
+	}).share();
+
+	//the old format is a stream, so it is read by a single task
+	CommitPendingSceneFile("models\\scene.bin");
+	if (!OpenSceneFile("models\\scene.bin")) {
+		request.RenderItemsReady = pool.Submit([this, &rItems, start, timings, profileScope]() {
+			ProfileScope scope("Read scene file", profileScope);
+			ReadBinRenderItemsV1(rItems, "models\\scene.bin");
+			timings->RenderItemCount = rItems.size();
+			timings->ItemDecodeTime = ElapsedMilliseconds(start);
+			timings->RenderItemsReady = timings->ItemDecodeTime;
+		}).share();
+		return request;
+	}
+
+	//state shared by the decode tasks, the last one to finish completes the load
+	struct DecodeState
+	{
+		std::mutex MapMutex;
+		SceneStreamStats Streams;				// guarded by the map mutex
+		std::atomic<UINT> Remaining;
+		std::atomic<long long> DecodeMicroseconds;
+		std::promise<void> Done;
+	};
+	auto state = std::make_shared<DecodeState>();
+	//in the strict mode every section is verified before the decoding, the other modes verify the sections
+	//of a render item, when it is decoded
+	if (m_sceneFile.GetVerifyMode() == SceneVerify_Strict)
+		VerifySceneFile(&pool, "models\\scene.bin");
+	UINT renderItemCount = m_sceneFile.IsOpen() ? m_sceneFile.GetRenderItemCount() : 0;
+	state->Remaining = renderItemCount;
+	state->DecodeMicroseconds = 0;
+	request.RenderItemsReady = state->Done.get_future().share();
+	timings->RenderItemCount = renderItemCount;
+	if (renderItemCount == 0) {
+		state->Done.set_value();
+		return request;
+	}
+	WorkerPool* workers = &pool;
+	for (UINT i = 0; i < renderItemCount; i++) {
+		request.RenderItems.push_back(pool.Submit([this, i, workers, &rItems, onItemLoaded, state, start, timings, profileScope]() -> RenderItem* {
+			ProfileScope scope("Decode render item", profileScope);
+			auto decodeStart = std::chrono::steady_clock::now();
+			const SceneItemRecord& record = m_sceneFile.GetRenderItems()[i];
+			std::string name(m_sceneFile.GetName(record));
+			SceneStreamStats streams;
+			auto ri = CreateMappedRenderItem(i, workers, &streams);
+			RenderItem* result = ri.get();
+			if (ri) {
+				//files without bounds need all positions for the bounding volumes, the mapped streams are faulted in here,
+				//so the copy to the upload heap doesn't stall on them
+				if (!ri->HasBoundingVolumes())
+					ri->CreateBoundingVolumes();
+				if (streams.MappedBytes) {
+					auto touchStart = std::chrono::steady_clock::now();
+					TouchPages(ri->GetPositionData(), ri->GetPositionBufferByteSize());
+					TouchPages(ri->GetAttributeData(), ri->GetAttributeBufferByteSize());
+					TouchPages(ri->GetIndexBufferData(), ri->GetIndexBufferByteSize());
+					streams.MappedTime = ElapsedMilliseconds(touchStart);
+				}
+				CountReadBytes(streams.MappedBytes + streams.CompressedBytes);
+				{
+					std::lock_guard<std::mutex> lock(state->MapMutex);
+					rItems[name] = std::move(ri);
+					state->Streams.MappedBytes += streams.MappedBytes;
+					state->Streams.MappedTime += streams.MappedTime;
+					state->Streams.CompressedBytes += streams.CompressedBytes;
+					state->Streams.DecompressedBytes += streams.DecompressedBytes;
+					state->Streams.DecompressTime += streams.DecompressTime;
+				}
+				if (onItemLoaded)
+					onItemLoaded(name, result);
+			}
+			state->DecodeMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - decodeStart).count();
+			if (--state->Remaining == 0) {
+				timings->ItemDecodeTime = state->DecodeMicroseconds / 1000.0;
+				timings->Streams = state->Streams;
+				timings->RenderItemsReady = ElapsedMilliseconds(start);
+				state->Done.set_value();
+			}
+			return result;
+		}).share());
+	}
+	return request;
+}
+
 void OBJLoader::ReadOBJFiles(const char* fileNames[], UINT numFiles, 
 							std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-							std::unordered_map<std::string, std::unique_ptr<Material>>& materials)
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials)
 {
 	
 	for (UINT i = 0; i < numFiles; i++) {
-		tinyobj_opt::attrib_t attrib;
-		std::vector<tinyobj_opt::shape_t> shapes;
-		std::vector<tinyobj_opt::material_t> materialz;
-		std::string err;
-		const char* fileName = fileNames[i];
-		size_t data_len = 0;
-		const char* data;
-		data = MapFile(&data_len, fileName);
-
-		tinyobj_opt::LoadOption option;
-		option.req_num_threads = 8;
-		option.verbose = false;
-		bool ret = parseObj(&attrib, &shapes, &materialz, data, data_len, option);
-
-		if (!ret) {
+		if (!ImportOBJFile(fileNames[i], rItems, diffuseMaps, normalMaps, materials))
 			std::cerr << "Failed to parse .obj" << std::endl;
-
-		}
-		else {
-			LoadMaterials(materialz, diffuseMaps, normalMaps, materials);
-			LoadVertexData(attrib, shapes, materialz, materials, rItems);
-				
-		}
 	}
+	std::string dedupReport = "Deduplicated " + std::to_string(m_dedupedMaterials) + " materials and " + std::to_string(m_dedupedTextures) + " textures\n";
+	OutputDebugStringA(dedupReport.c_str());
 	WriteBinRenderItems(rItems, "models\\scene.bin");
 	WriteBinMaterialsAndTextures(diffuseMaps, normalMaps, materials, "models\\materials.bin");
 }
 
+/// <summary>
+/// Imports the shapes of an OBJ file and the materials of its MTL file, without writing the binary files. The
+/// file is unmapped before returning, so it can be written again while the application runs (hot reload).
+/// </summary>
+/// <param name="fileName">Name of the OBJ file.</param>
+/// <returns>false if the file can't be read or parsed</returns>
+bool OBJLoader::ImportOBJFile(const char* fileName,
+							std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials)
+{
+	MappedFile file;
+	if (!file.Open(fileName))
+		return false;
+	tinyobj_opt::attrib_t attrib;
+	std::vector<tinyobj_opt::shape_t> shapes;
+	std::vector<tinyobj_opt::material_t> materialz;
+
+	tinyobj_opt::LoadOption option;
+	option.req_num_threads = 8;
+	option.verbose = false;
+	if (!parseObj(&attrib, &shapes, &materialz, reinterpret_cast<const char*>(file.GetData()), (size_t)file.GetSize(), option))
+		return false;
+	//the parsed arrays live until the render items are built
+	TrackedMemory parsed(Memory_Parser, (attrib.vertices.capacity() + attrib.normals.capacity() + attrib.texcoords.capacity()) * sizeof(float) +
+		attrib.indices.capacity() * sizeof(tinyobj_opt::index_t) + (attrib.face_num_verts.capacity() + attrib.material_ids.capacity()) * sizeof(int) +
+		shapes.capacity() * sizeof(tinyobj_opt::shape_t));
+	LoadMaterials(materialz, diffuseMaps, normalMaps, materials);
+	LoadVertexData(attrib, shapes, materialz, materials, rItems);
+	return true;
+}
+
+static SceneItemBounds GetSceneItemBounds(RenderItem* ri)
+{
+	SceneItemBounds itemBounds;
+	memcpy(itemBounds.BoxCenter, &ri->GetBoundingBoxData().Center, sizeof(XMFLOAT3));
+	memcpy(itemBounds.BoxExtents, &ri->GetBoundingBoxData().Extents, sizeof(XMFLOAT3));
+	memcpy(itemBounds.SphereCenter, &ri->GetBoundingSphereData().Center, sizeof(XMFLOAT3));
+	itemBounds.SphereRadius = ri->GetBoundingSphereData().Radius;
+	memcpy(itemBounds.OrientedBoxCenter, &ri->GetOrientedBoxData().Center, sizeof(XMFLOAT3));
+	memcpy(itemBounds.OrientedBoxExtents, &ri->GetOrientedBoxData().Extents, sizeof(XMFLOAT3));
+	memcpy(itemBounds.OrientedBoxOrientation, &ri->GetOrientedBoxData().Orientation, sizeof(XMFLOAT4));
+	return itemBounds;
+}
+
 /// <summary>
 /// Write the application's render item structures in a binary file for faster loading
 /// </summary>
 /// <param name="rItems">The render items map.</param>
 /// <param name="binFileName">Name of the bin file.</param>
-void OBJLoader::WriteBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char* binFileName) {
-	std::ofstream stream;
-	stream.open(binFileName, std::ios::trunc | std::ios::binary);
-	if (stream.is_open()) {
-		UINT riSize = rItems.size();
-		stream.write((const char*)&riSize, sizeof(UINT));
-		for (std::unordered_map<std::string, std::unique_ptr<RenderItem>>::iterator iter = rItems.begin(); iter != rItems.end(); iter++) {
-			std::string riName = iter->first;
-			UINT riNameSize = riName.size() + 1;
-			stream.write((const char*)&riNameSize, sizeof(UINT));
-			stream.write((const char*)riName.data(), riNameSize);
-
-			UINT vByteSize = iter->second->GetVertexBufferByteSize();
-			UINT iByteSize = iter->second->GetIndexBufferByteSize();
-
-			stream.write((const char*)&vByteSize, sizeof(UINT));
-			stream.write((const char*)&iByteSize, sizeof(UINT));
-
-			stream.write((const char*)iter->second->GetVertexBufferData(), vByteSize);
-			stream.write((const char*)iter->second->GetIndexBufferData(), iByteSize);
-			UINT materialIndex = iter->second->GetMaterialIndex();
-
-			stream.write((const char*)&materialIndex, sizeof(UINT));
-			XMFLOAT4X4 WorldMatrix(iter->second->GetWorldMatrix());
-			XMFLOAT4X4 TextTransformMatrix(iter->second->GetTexTransformMatrix());
-			stream.write((const char*)&WorldMatrix, sizeof(XMFLOAT4X4));
-			stream.write((const char*)&TextTransformMatrix, sizeof(XMFLOAT4X4));
+/// <param name="bakeInstances">Store the generated instances, so they aren't generated at startup.</param>
+/// <param name="compress">Compress the geometry and instance streams.</param>
+void OBJLoader::WriteBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char* binFileName, bool bakeInstances, bool compress) {
+	SceneFileWriter writer;
+	uint32_t compression = compress ? SceneCompression_LZ : SceneCompression_None;
+	std::vector<uint8_t> names;
+	std::vector<SceneItemRecord> records;
+	std::vector<SceneItemBounds> bounds;
+	records.reserve(rItems.size());
+	bounds.reserve(rItems.size());
+	for (std::unordered_map<std::string, std::unique_ptr<RenderItem>>::iterator iter = rItems.begin(); iter != rItems.end(); iter++) {
+		RenderItem* ri = iter->second.get();
+		SceneItemRecord record = {};
+		record.NameOffset = names.size();
+		names.insert(names.end(), iter->first.begin(), iter->first.end());
+		names.push_back('\0');
+		record.VertexCount = ri->GetVertexCount();
+		record.IndexCount = ri->GetIndexCount();
+		record.MaterialIndex = ri->GetMaterialIndex();
+		//every stream is a separate aligned blob, which the loader uses in place (or decompresses)
+		record.PositionSection = writer.AddSection(SceneSection_Positions, ri->GetPositionData(), ri->GetPositionBufferByteSize(), compression);
+		record.AttributeSection = writer.AddSection(SceneSection_Attributes, ri->GetAttributeData(), ri->GetAttributeBufferByteSize(), compression);
+		record.IndexSection = writer.AddSection(SceneSection_Indices, ri->GetIndexBufferData(), ri->GetIndexBufferByteSize(), compression);
+		//the instances are uploaded as they are
+		record.InstanceSection = (bakeInstances && ri->GetInstanceCount()) ?
+			writer.AddSection(SceneSection_Instances, ri->GetInstances().data(), ri->GetInstancesByteSize(), compression) : SceneInvalidSection;
+		memcpy(record.World, &ri->GetWorldMatrix(), sizeof(XMFLOAT4X4));
+		memcpy(record.TexTransform, &ri->GetTexTransformMatrix(), sizeof(XMFLOAT4X4));
+		records.push_back(record);
 
-		}
-		stream.close();
+		//the bounding volumes are computed here, so the startup doesn't have to read the vertices
+		if (!ri->HasBoundingVolumes())
+			ri->CreateBoundingVolumes();
+		bounds.push_back(GetSceneItemBounds(ri));
 	}
-	else {
+	writer.AddSection(SceneSection_Names, std::move(names));
+	writer.AddSection(SceneSection_RenderItems, records.data(), records.size() * sizeof(SceneItemRecord));
+	writer.AddSection(SceneSection_Bounds, bounds.data(), bounds.size() * sizeof(SceneItemBounds));
+	if (!writer.Write(binFileName, records.size(), bakeInstances ? SceneFlag_BakedInstances | SceneFlag_CompactInstances : 0)) {
 		char errorStr[100];
 		strerror_s(errorStr, 100,  errno);
 	}
-	
+	else if (compress && writer.GetCompressedSize()) {
+		std::ostringstream report;
+		report.precision(2);
+		report << std::fixed << "Scene compression: " << writer.GetRawSize() / (1024.0 * 1024.0) << " MB of streams compressed to "
+			<< writer.GetCompressedSize() / (1024.0 * 1024.0) << " MB (ratio " << (double)writer.GetRawSize() / writer.GetCompressedSize() << ")\n";
+		OutputDebugStringA(report.str().c_str());
+	}
+}
+
+/// <summary>
+/// Saves changed render items as a journal entry of the scene file - their streams, the records and the bounds are
+/// appended, the rest of the file isn't rewritten. The streams keep the compression of the ones they replace.
+/// </summary>
+/// <param name="changedItems">The names and the render items, which geometry or material changed.</param>
+/// <param name="binFileName">Name of the scene file.</param>
+/// <param name="shouldCompact">Set if the file has grown enough to be compacted.</param>
+/// <returns>False if the file can't be appended to or doesn't have one of the render items, it has to be rewritten</returns>
+bool OBJLoader::AppendBinRenderItems(const std::vector<std::pair<std::string, RenderItem*>>& changedItems, const char* binFileName, bool& shouldCompact) {
+	SceneJournalWriter journal;
+	if (!journal.Open(binFileName))
+		return false;
+	const SceneFile& file = journal.GetFile();
+	uint32_t itemsSection = file.FindSection(SceneSection_RenderItems);
+	uint32_t boundsSection = file.FindSection(SceneSection_Bounds);
+	if (!file.GetBounds() || boundsSection == SceneInvalidSection)
+		return false;
+	std::vector<SceneItemRecord> records(file.GetRenderItems(), file.GetRenderItems() + file.GetRenderItemCount());
+	std::vector<SceneItemBounds> bounds(file.GetBounds(), file.GetBounds() + file.GetRenderItemCount());
+	for (auto& changed : changedItems) {
+		auto record = std::find_if(records.begin(), records.end(),
+			[&file, &changed](const SceneItemRecord& other) { return changed.first == file.GetName(other); });
+		if (record == records.end())
+			return false;
+		RenderItem* ri = changed.second;
+		auto compression = [&file](uint32_t section) { return file.IsCompressed(section) ? SceneCompression_LZ : SceneCompression_None; };
+		journal.ReplaceSection(record->PositionSection, ri->GetPositionData(), ri->GetPositionBufferByteSize(), compression(record->PositionSection));
+		journal.ReplaceSection(record->AttributeSection, ri->GetAttributeData(), ri->GetAttributeBufferByteSize(), compression(record->AttributeSection));
+		journal.ReplaceSection(record->IndexSection, ri->GetIndexBufferData(), ri->GetIndexBufferByteSize(), compression(record->IndexSection));
+		record->VertexCount = ri->GetVertexCount();
+		record->IndexCount = ri->GetIndexCount();
+		record->MaterialIndex = ri->GetMaterialIndex();
+		if (!ri->HasBoundingVolumes())
+			ri->CreateBoundingVolumes();
+		bounds[record - records.begin()] = GetSceneItemBounds(ri);
+	}
+	journal.ReplaceSection(itemsSection, records.data(), records.size() * sizeof(SceneItemRecord));
+	journal.ReplaceSection(boundsSection, bounds.data(), bounds.size() * sizeof(SceneItemBounds));
+	if (!journal.Commit((uint32_t)records.size(), file.GetFlags()))
+		return false;
+	shouldCompact = journal.ShouldCompact();
+	std::ostringstream report;
+	report << "Scene file: " << changedItems.size() << " render items appended to " << binFileName << ", "
+		<< journal.GetAppendedBytes() / 1024 << " KB\n";
+	OutputDebugStringA(report.str().c_str());
+	return true;
+}
+
+/// <summary>
+/// Maps the scene file and creates render items, which use the geometry in the mapping without copying it.
+/// Files in the old format are read with the stream reader.
+/// </summary>
+/// <param name="rItems">The render items map.</param>
+/// <param name="binFileName">Name of the binary file.</param>
+void OBJLoader::ReadBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char* binFileName) {
+	if (!OpenSceneFile(binFileName)) {
+		ReadBinRenderItemsV1(rItems, binFileName);
+		return;
+	}
+	if (!m_sceneFile.IsOpen())
+		return;
+	if (m_sceneFile.GetVerifyMode() == SceneVerify_Strict)
+		VerifySceneFile(nullptr, binFileName);
+	const SceneItemRecord* records = m_sceneFile.GetRenderItems();
+	for (UINT i = 0; i < m_sceneFile.GetRenderItemCount(); i++) {
+		auto ri = CreateMappedRenderItem(i);
+		if (ri)
+			rItems[m_sceneFile.GetName(records[i])] = std::move(ri);
+	}
+}
+
+/// <summary>
+/// Maps the scene file. A corrupted scene file isn't read as the old format - it is reported and no render items are
+/// loaded from it, in the strict verify mode the load fails.
+/// </summary>
+/// <param name="fileName">Name of the scene file.</param>
+/// <returns>False if the file should be read with the old format reader</returns>
+bool OBJLoader::OpenSceneFile(const char* fileName)
+{
+	if (m_sceneFile.Open(fileName) || !SceneFile::IsSceneFile(fileName))
+		return m_sceneFile.IsOpen();
+	std::string error = std::string(fileName) + " is corrupted or truncated";
+	if (m_sceneFile.GetVerifyMode() == SceneVerify_Strict)
+		throw std::runtime_error(error);
+	OutputDebugStringA((error + ", the render items aren't loaded\n").c_str());
+	return true;
+}
+
+/// <summary>
+/// Verifies every section of the scene file against its hash, in parallel on the pool
+/// </summary>
+/// <param name="pool">Optional worker pool.</param>
+/// <param name="fileName">Name of the scene file, for the error.</param>
+void OBJLoader::VerifySceneFile(WorkerPool* pool, const char* fileName)
+{
+	std::vector<std::future<bool>> results;
+	bool valid = true;
+	for (uint32_t i = 0; i < m_sceneFile.GetSectionCount(); i++) {
+		if (pool)
+			results.push_back(pool->Submit([this, i]() { return m_sceneFile.VerifySection(i); }));
+		else
+			valid = m_sceneFile.VerifySection(i) && valid;
+	}
+	for (auto& result : results)
+		valid = result.get() && valid;
+	if (!valid)
+		throw std::runtime_error(std::string(fileName) + " doesn't match its hashes");
+}
+
+/// <summary>
+/// Creates a render item, which streams point into the mapped scene file. Compressed streams are decompressed
+/// into buffers, owned by the render item.
+/// </summary>
+/// <param name="recordIndex">The index of the render item's record.</param>
+/// <param name="pool">Optional worker pool, which helps with the decompression of the blocks.</param>
+/// <param name="stats">Optional, the sizes and times of the streams are added to it.</param>
+/// <returns>The render item or nullptr if the blobs don't match the counts in the record or are corrupted</returns>
+std::unique_ptr<RenderItem> OBJLoader::CreateMappedRenderItem(UINT recordIndex, WorkerPool* pool, SceneStreamStats* stats)
+{
+	const SceneItemRecord& record = m_sceneFile.GetRenderItems()[recordIndex];
+	//the sections are verified the first time they are touched (unless the verification is off)
+	if (!m_sceneFile.VerifySection(record.PositionSection) || !m_sceneFile.VerifySection(record.AttributeSection) ||
+		!m_sceneFile.VerifySection(record.IndexSection) ||
+		(record.InstanceSection != SceneInvalidSection && !m_sceneFile.VerifySection(record.InstanceSection))) {
+		std::string error = std::string("Scene file: render item ") + m_sceneFile.GetName(record) + " is corrupted and isn't loaded\n";
+		OutputDebugStringA(error.c_str());
+		return nullptr;
+	}
+	if (m_sceneFile.GetRawSize(record.PositionSection) != record.VertexCount * sizeof(XMFLOAT3) ||
+		m_sceneFile.GetRawSize(record.AttributeSection) != record.VertexCount * sizeof(VertexAttributes) ||
+		m_sceneFile.GetRawSize(record.IndexSection) != record.IndexCount * sizeof(UINT))
+		return nullptr;
+	uint32_t sections[4];
+	void* destinations[4];
+	UINT sectionCount = 0;
+	std::unique_ptr<RenderItem> ri;
+	if (!m_sceneFile.IsCompressed(record.PositionSection) && !m_sceneFile.IsCompressed(record.AttributeSection) &&
+		!m_sceneFile.IsCompressed(record.IndexSection)) {
+		ri = std::make_unique<RenderItem>(record.VertexCount, record.IndexCount,
+			static_cast<const XMFLOAT3*>(m_sceneFile.GetSectionData(record.PositionSection)),
+			static_cast<const VertexAttributes*>(m_sceneFile.GetSectionData(record.AttributeSection)),
+			static_cast<const UINT*>(m_sceneFile.GetSectionData(record.IndexSection)));
+		if (stats)
+			stats->MappedBytes += ri->GetVertexBufferByteSize() + ri->GetIndexBufferByteSize();
+	}
+	else {
+		//the streams are decompressed straight into the buffers of the render item
+		ri = std::make_unique<RenderItem>((int)record.VertexCount, (int)record.IndexCount);
+		sections[0] = record.PositionSection;
+		sections[1] = record.AttributeSection;
+		sections[2] = record.IndexSection;
+		destinations[0] = ri->GetPositionData();
+		destinations[1] = ri->GetAttributeData();
+		destinations[2] = ri->GetIndexBufferData();
+		sectionCount = 3;
+	}
+	ri->SetMaterialIndex(record.MaterialIndex);
+	XMFLOAT4X4 WorldMatrix;
+	XMFLOAT4X4 TextTransformMatrix;
+	memcpy(&WorldMatrix, record.World, sizeof(XMFLOAT4X4));
+	memcpy(&TextTransformMatrix, record.TexTransform, sizeof(XMFLOAT4X4));
+	ri->SetWorldMatrix(WorldMatrix);
+	ri->SetTextureTransformMatrix(TextTransformMatrix);
+	if (record.InstanceSection != SceneInvalidSection && HasBakedInstances()) {
+		uint64_t instancesSize = m_sceneFile.GetRawSize(record.InstanceSection);
+		if (instancesSize == 0 || instancesSize % sizeof(InstanceData))
+			return nullptr;
+		ri->GetInstances().resize((size_t)(instancesSize / sizeof(InstanceData)));
+		sections[sectionCount] = record.InstanceSection;
+		destinations[sectionCount] = ri->GetInstances().data();
+		sectionCount++;
+	}
+	if (!DecompressSections(sections, destinations, sectionCount, pool, stats))
+		return nullptr;
+	ri->TrackMemory();
+	if (m_sceneFile.GetBounds()) {
+		const SceneItemBounds& bounds = m_sceneFile.GetBounds()[recordIndex];
+		BoundingBox box(XMFLOAT3(bounds.BoxCenter), XMFLOAT3(bounds.BoxExtents));
+		BoundingSphere sphere(XMFLOAT3(bounds.SphereCenter), bounds.SphereRadius);
+		BoundingOrientedBox oriented(XMFLOAT3(bounds.OrientedBoxCenter), XMFLOAT3(bounds.OrientedBoxExtents), XMFLOAT4(bounds.OrientedBoxOrientation));
+		ri->SetBoundingVolumes(box, sphere, oriented);
+	}
+	return ri;
+}
+
+/// <summary>
+/// Decompresses sections of the scene file into the given buffers, the uncompressed ones are copied. The blocks
+/// are shared with helper tasks on the pool. The calling task takes blocks as well and waits only for the blocks,
+/// which are already running, so it doesn't deadlock when all workers are decoding render items.
+/// </summary>
+/// <param name="sections">The indices of the sections.</param>
+/// <param name="destinations">The buffers for the sections, big enough for their raw sizes.</param>
+/// <param name="sectionCount">The number of sections.</param>
+/// <param name="pool">Optional worker pool.</param>
+/// <param name="stats">Optional, the sizes and the time of the decompression are added to it.</param>
+/// <returns>False if a block is corrupted</returns>
+bool OBJLoader::DecompressSections(const uint32_t* sections, void* const* destinations, UINT sectionCount, WorkerPool* pool, SceneStreamStats* stats)
+{
+	struct BlockJob
+	{
+		uint32_t Section;
+		uint32_t Block;
+		void* Destination;
+	};
+	struct BlockWork
+	{
+		std::vector<BlockJob> Jobs;
+		std::atomic<size_t> Next;
+		std::atomic<size_t> Done;
+		std::atomic<bool> Failed;
+		std::atomic<long long> DecompressMicroseconds;
+		std::mutex Mutex;
+		std::condition_variable Finished;
+	};
+	auto work = std::make_shared<BlockWork>();
+	work->Next = 0;
+	work->Done = 0;
+	work->Failed = false;
+	work->DecompressMicroseconds = 0;
+	UINT64 compressedBytes = 0;
+	UINT64 decompressedBytes = 0;
+	for (UINT i = 0; i < sectionCount; i++) {
+		if (!m_sceneFile.IsCompressed(sections[i])) {
+			memcpy(destinations[i], m_sceneFile.GetSectionData(sections[i]), (size_t)m_sceneFile.GetSection(sections[i]).Size);
+			continue;
+		}
+		compressedBytes += m_sceneFile.GetSection(sections[i]).Size;
+		decompressedBytes += m_sceneFile.GetRawSize(sections[i]);
+		for (uint32_t block = 0; block < m_sceneFile.GetBlockCount(sections[i]); block++)
+			work->Jobs.push_back({ sections[i], block, destinations[i] });
+	}
+	if (work->Jobs.empty())
+		return true;
+
+	const SceneFile* sceneFile = &m_sceneFile;
+	auto runJobs = [sceneFile, work]() {
+		for (size_t job = work->Next++; job < work->Jobs.size(); job = work->Next++) {
+			auto blockStart = std::chrono::steady_clock::now();
+			if (!sceneFile->DecompressBlock(work->Jobs[job].Section, work->Jobs[job].Block, work->Jobs[job].Destination))
+				work->Failed = true;
+			work->DecompressMicroseconds += std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - blockStart).count();
+			if (++work->Done == work->Jobs.size()) {
+				std::lock_guard<std::mutex> lock(work->Mutex);
+				work->Finished.notify_all();
+			}
+		}
+	};
+	if (pool) {
+		size_t helpers = DX::Min<size_t>(pool->GetThreadCount(), work->Jobs.size() - 1);
+		for (size_t i = 0; i < helpers; i++)
+			pool->Submit(runJobs);
+	}
+	runJobs();
+	{
+		std::unique_lock<std::mutex> lock(work->Mutex);
+		work->Finished.wait(lock, [&work]() { return work->Done == work->Jobs.size(); });
+	}
+	if (stats) {
+		stats->CompressedBytes += compressedBytes;
+		stats->DecompressedBytes += decompressedBytes;
+		stats->DecompressTime += work->DecompressMicroseconds / 1000.0;
+	}
+	return !work->Failed;
 }
 
 /// <summary>
-/// Read the application's structures from a binary file for faster loading
+/// Read the application's structures from a binary file in the first (stream) format
 /// </summary>
 /// <param name="rItems">The render items map.</param>
 /// <param name="origFileName">Name of the binary file.</param>
-void OBJLoader::ReadBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char* origFileName) {
+void OBJLoader::ReadBinRenderItemsV1(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char* origFileName) {
 	std::wstring binFileName(DX::convertCharArrayToLPCWSTR(origFileName));
 	binFileName = binFileName.substr(0, binFileName.find_last_of('.'));
 	binFileName.append(L".bin");
@@ -219,19 +699,20 @@ void OBJLoader::ReadBinRenderItems(std::unordered_map<std::string, std::unique_p
 	if (stream.is_open()) {
 		stream.read((char*)&riSize, sizeof(UINT));
 		while(riSize--) {
-			UINT vByteSize;
+			UINT vertexCount;
 			UINT iByteSize;
 			UINT materialIndex;
 			UINT modelCBIndex;
 			UINT riNameSize;
 	
 			stream.read((char*)&riNameSize, sizeof(UINT));
-			char* riName = new char[riNameSize];
-			stream.read(riName, riNameSize);
-			stream.read((char*)&vByteSize, sizeof(UINT));
+			std::string riName(riNameSize, '\0');
+			stream.read(&riName[0], riNameSize);
+			riName.resize(riNameSize - 1);
+			stream.read((char*)&vertexCount, sizeof(UINT));
 			stream.read((char*)&iByteSize, sizeof(UINT));			
-			auto ri = std::make_unique<RenderItem>(vByteSize/sizeof(Vertex), iByteSize/sizeof(UINT));
-			stream.read((char*)ri->GetVertexBufferData(), vByteSize);
+			auto ri = std::make_unique<RenderItem>(vertexCount, iByteSize/sizeof(UINT));
+			stream.read((char*)ri->GetVertexBufferData(), ri->GetVertexBufferByteSize());
 			stream.read((char*)ri->GetIndexBufferData(), iByteSize);
 			stream.read((char*)&materialIndex, sizeof(UINT));
 			ri->SetMaterialIndex(materialIndex);
@@ -243,6 +724,7 @@ void OBJLoader::ReadBinRenderItems(std::unordered_map<std::string, std::unique_p
 			ri->SetTextureTransformMatrix(TextTransformMatrix);
 			rItems[riName] = std::move(ri);
 		}
+		CountReadBytes((uint64_t)stream.tellg());
 		stream.close();
 	}
 	else {
@@ -260,48 +742,49 @@ void OBJLoader::ReadBinRenderItems(std::unordered_map<std::string, std::unique_p
 /// <param name="normalMaps">The normal maps.</param>
 /// <param name="to">The material map</param>
 /// <param name="binFileName">Name of the binary file.</param>
-void OBJLoader::WriteBinMaterialsAndTextures(std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-											 std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-											 std::unordered_map<std::string, std::unique_ptr<Material>>& to, const char* binFileName) {
+void OBJLoader::WriteBinMaterialsAndTextures(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+											 std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+											 std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char* binFileName) {
+	StringTableBuilder strings;
+	auto makeTextureRecord = [&strings](Texture& texture) {
+		TextureRecord record;
+		record.NameOffset = strings.Add(texture.Name);
+		record.NameSize = texture.Name.size();
+		record.FilenameOffset = strings.Add(texture.Filename);
+		record.FilenameSize = texture.Filename.size();
+		record.Index = texture.index;
+		return record;
+	};
+	std::vector<TextureRecord> textureRecords;
+	for (auto& map : diffuseMaps)
+		textureRecords.push_back(makeTextureRecord(*map.second));
+	for (auto& map : normalMaps)
+		textureRecords.push_back(makeTextureRecord(*map.second));
+	std::vector<MaterialRecord> materialRecords;
+	for (auto& material : to) {
+		MaterialRecord record = {};
+		record.NameOffset = strings.Add(material.second->Name);
+		record.NameSize = material.second->Name.size();
+		record.MatCBIndex = material.second->MatCBIndex;
+		memcpy(&record.Data, &material.second->data, sizeof(MaterialData));
+		materialRecords.push_back(record);
+	}
+
+	MaterialFileHeader header = {};
+	header.Magic = MaterialFileMagic;
+	header.Version = MaterialFileVersion;
+	header.DiffuseMapCount = diffuseMaps.size();
+	header.NormalMapCount = normalMaps.size();
+	header.MaterialCount = materialRecords.size();
+	header.StringTableSize = strings.GetData().size();
+
 	std::ofstream stream;
 	stream.open(binFileName, std::ios::trunc | std::ios::binary);
 	if (stream.is_open()) {
-		UINT diffuseMapsSize = diffuseMaps.size();
-		UINT normalMapsSize = normalMaps.size();
-		UINT materialSize = to.size();
-		UINT fileNameSize;
-		UINT nameSize;
-		stream.write((const char*)&diffuseMapsSize, sizeof(UINT));
-		for (auto& map : diffuseMaps) {
-			fileNameSize = map.second->Filename.size() + 1;
-			stream.write((const char*)&fileNameSize, sizeof(UINT));
-			stream.write(map.second->Filename.c_str(), fileNameSize);
-
-			nameSize = map.second->Name.size() + 1;
-			stream.write((const char*)&nameSize, sizeof(UINT));
-			stream.write(map.second->Name.c_str(), nameSize);
-			stream.write((const char*)&map.second->index, sizeof(UINT));
-		}		
-		stream.write((const char*)&normalMapsSize, sizeof(UINT));
-		for (auto& map : normalMaps) {
-			fileNameSize = map.second->Filename.size() + 1;
-			stream.write((const char*)&fileNameSize, sizeof(UINT));
-			stream.write(map.second->Filename.data(), fileNameSize);
-
-			nameSize = map.second->Name.size() + 1;
-			stream.write((const char*)&nameSize, sizeof(UINT));
-			stream.write(map.second->Name.data(), nameSize);
-			stream.write((const char*)&map.second->index, sizeof(UINT));
-		}	
-		stream.write((const char*)&materialSize, sizeof(UINT));
-		for (auto& material : to) {
-			stream.write((const char*)&material.second->data, sizeof(MaterialData));
-			stream.write((const char*)&material.second->MatCBIndex, sizeof(UINT));
-			nameSize = material.second->Name.size() + 1;
-			stream.write((const char*)&nameSize, sizeof(UINT));
-			stream.write(material.second->Name.data(), nameSize);
-		}
-
+		stream.write((const char*)&header, sizeof(MaterialFileHeader));
+		stream.write((const char*)textureRecords.data(), textureRecords.size() * sizeof(TextureRecord));
+		stream.write((const char*)materialRecords.data(), materialRecords.size() * sizeof(MaterialRecord));
+		stream.write(strings.GetData().data(), strings.GetData().size());
 		stream.close();
 	}
 	else {
@@ -312,15 +795,86 @@ void OBJLoader::WriteBinMaterialsAndTextures(std::unordered_map<std::string, std
 }
 
 /// <summary>
-/// Read the application's material structures from a binary file for faster loading
+/// Read the application's material structures from a binary file. The names reference the string
+/// table of the mapped file, files in the old format are read with the stream reader.
 /// </summary>
 /// <param name="diffuseMaps">The diffuse maps.</param>
 /// <param name="normalMaps">The normal maps.</param>
 /// <param name="to">The material map</param>
 /// <param name="binFileName">Name of the binary file.</param>
-void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-									std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-									std::unordered_map<std::string, std::unique_ptr<Material>>& to, const char* binFileName){
+void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char* binFileName) {
+	if (!ReadBinMaterialsAndTexturesV2(diffuseMaps, normalMaps, to, binFileName))
+		ReadBinMaterialsAndTexturesV1(diffuseMaps, normalMaps, to, binFileName);
+}
+
+/// <summary>
+/// Maps a v2 materials file and creates the textures and materials, without copying their names
+/// </summary>
+/// <returns>False if the file is missing, isn't a v2 file or is corrupted</returns>
+bool OBJLoader::ReadBinMaterialsAndTexturesV2(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char* binFileName) {
+	if (!m_materialsFile.Open(binFileName))
+		return false;
+	const BYTE* data = m_materialsFile.GetData();
+	auto header = reinterpret_cast<const MaterialFileHeader*>(data);
+	if (m_materialsFile.GetSize() < sizeof(MaterialFileHeader) || header->Magic != MaterialFileMagic || header->Version != MaterialFileVersion) {
+		m_materialsFile.Close();
+		return false;
+	}
+	UINT textureCount = header->DiffuseMapCount + header->NormalMapCount;
+	UINT64 stringsOffset = sizeof(MaterialFileHeader) + (UINT64)textureCount * sizeof(TextureRecord) + (UINT64)header->MaterialCount * sizeof(MaterialRecord);
+	if (stringsOffset + header->StringTableSize > m_materialsFile.GetSize()) {
+		m_materialsFile.Close();
+		return false;
+	}
+	auto textureRecords = reinterpret_cast<const TextureRecord*>(data + sizeof(MaterialFileHeader));
+	auto materialRecords = reinterpret_cast<const MaterialRecord*>(textureRecords + textureCount);
+	const char* strings = reinterpret_cast<const char*>(data + stringsOffset);
+	auto isValid = [strings, header](UINT offset, UINT size) {
+		return (UINT64)offset + size < header->StringTableSize && strings[offset + size] == '\0';
+	};
+	bool valid = true;
+	for (UINT i = 0; valid && i < textureCount; i++)
+		valid = isValid(textureRecords[i].NameOffset, textureRecords[i].NameSize) && isValid(textureRecords[i].FilenameOffset, textureRecords[i].FilenameSize);
+	for (UINT i = 0; valid && i < header->MaterialCount; i++)
+		valid = isValid(materialRecords[i].NameOffset, materialRecords[i].NameSize);
+	if (!valid) {
+		m_materialsFile.Close();
+		return false;
+	}
+
+	for (UINT i = 0; i < textureCount; i++) {
+		auto map = std::make_unique<Texture>();
+		map->Name = StringRef(strings + textureRecords[i].NameOffset, textureRecords[i].NameSize);
+		map->Filename = StringRef(strings + textureRecords[i].FilenameOffset, textureRecords[i].FilenameSize);
+		map->index = textureRecords[i].Index;
+		auto& maps = (i < header->DiffuseMapCount) ? diffuseMaps : normalMaps;
+		maps[map->Name] = std::move(map);
+	}
+	for (UINT i = 0; i < header->MaterialCount; i++) {
+		auto mat = std::make_unique<Material>();
+		mat->Name = StringRef(strings + materialRecords[i].NameOffset, materialRecords[i].NameSize);
+		mat->MatCBIndex = materialRecords[i].MatCBIndex;
+		memcpy(&mat->data, &materialRecords[i].Data, sizeof(MaterialData));
+		to[mat->Name] = std::move(mat);
+	}
+	CountReadBytes(m_materialsFile.GetSize());
+	return true;
+}
+
+/// <summary>
+/// Read the application's material structures from a binary file in the first (stream) format
+/// </summary>
+/// <param name="diffuseMaps">The diffuse maps.</param>
+/// <param name="normalMaps">The normal maps.</param>
+/// <param name="to">The material map</param>
+/// <param name="binFileName">Name of the binary file.</param>
+void OBJLoader::ReadBinMaterialsAndTexturesV1(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+									std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char* binFileName){
 
 	std::ifstream stream;
 	stream.open(binFileName, std::ios::binary);
@@ -336,13 +890,13 @@ void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<std::string, std:
 			stream.read((char*)&fileNameSize, sizeof(UINT));
 			fileName = new char[fileNameSize];
 			stream.read(fileName, fileNameSize);
-			map->Filename = std::string(fileName);
+			map->Filename = m_stringPool.Intern(std::string(fileName));
 			delete[] fileName;
 
 			stream.read((char*)&nameSize, sizeof(UINT));
 			name = new char[nameSize];
 			stream.read(name, nameSize);
-			map->Name = std::string(name);
+			map->Name = m_stringPool.Intern(std::string(name));
 			delete[] name;
 
 			stream.read((char*)&map->index, sizeof(UINT));
@@ -354,13 +908,13 @@ void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<std::string, std:
 			stream.read((char*)&fileNameSize, sizeof(UINT));
 			fileName = new char[fileNameSize];
 			stream.read(fileName, fileNameSize);
-			map->Filename = std::string(fileName);
+			map->Filename = m_stringPool.Intern(std::string(fileName));
 			delete[] fileName;
 
 			stream.read((char*)&nameSize, sizeof(UINT));
 			name = new char[nameSize];
 			stream.read(name, nameSize);
-			map->Name = std::string(name);
+			map->Name = m_stringPool.Intern(std::string(name));
 			delete[] name;
 
 			stream.read((char*)&map->index, sizeof(UINT));
@@ -376,10 +930,11 @@ void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<std::string, std:
 			stream.read((char*)&nameSize, sizeof(UINT));
 			name = new char[nameSize];
 			stream.read(name, nameSize);
-			mat->Name = std::string(name);
+			mat->Name = m_stringPool.Intern(std::string(name));
 			delete[] name;
 			to[mat->Name] = std::move(mat);
 		}
+		CountReadBytes((uint64_t)stream.tellg());
 		stream.close();
 	}
 	else {
@@ -397,13 +952,13 @@ void OBJLoader::ReadBinMaterialsAndTextures(std::unordered_map<std::string, std:
 /// <param name="diffuseMaps">The diffuse maps.</param>
 /// <param name="normalMaps">The normal maps.</param>
 /// <param name="to">Application's material map</param>
-void OBJLoader::LoadMaterials(std::vector<tinyobj_opt::material_t>& from, std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<std::string, std::unique_ptr<Material>>& to)
+void OBJLoader::LoadMaterials(std::vector<tinyobj_opt::material_t>& from, std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<StringRef, std::unique_ptr<Material>>& to)
 {
 	std::string difuseName, difuseFileName, normalName, normalFileName;
 	for (int i = 0; i < from.size(); i++) {
 		auto mat = std::make_unique<Material>();
-		mat->Name = from[i].name;
+		mat->Name = m_stringPool.Intern(from[i].name);
 		//Load texture name and filename 
 		difuseName = from[i].diffuse_texname;
 		difuseFileName = from[i].diffuse_texname;
@@ -428,35 +983,135 @@ void OBJLoader::LoadMaterials(std::vector<tinyobj_opt::material_t>& from, std::u
 			normalFileName = from[i].normal_texname;
 		}
 		
-		//Check if diffuse map already exists in the unordered_map
-		if (diffuseMaps.find(difuseName) == diffuseMaps.end()) {
-			auto texture = std::make_unique<Texture>();
-			texture->Name = difuseName;
-			texture->Filename = difuseFileName;
-			texture->index = textureCounter++;
-			diffuseMaps[texture->Name] = std::move(texture);
-		}
-		//Check if normal map already exists in the unordered_map
-		if (normalMaps.find(normalName) == normalMaps.end()) {
-			auto normalMap = std::make_unique<Texture>();
-			normalMap->Name = normalName;
-			normalMap->Filename = normalFileName;
-			normalMap->index = normalCounter++;
-			normalMaps[normalMap->Name] = std::move(normalMap);
-		}
+		//Register the maps, textures that were already imported (by name, path or content) are reused
 		//Initialize the material object with the indices and default values for fresnel, albedo and roughness
-		mat->data.DiffuseMapIndex = diffuseMaps[difuseName]->index;
-		mat->data.NormalMapIndex = normalMaps[normalName]->index;
+		mat->data.DiffuseMapIndex = RegisterTexture(diffuseMaps, m_diffuseMapDedup, difuseName, difuseFileName, textureCounter);
+		mat->data.NormalMapIndex = RegisterTexture(normalMaps, m_normalMapDedup, normalName, normalFileName, normalCounter);
 		mat->data.DiffuseAlbedo = XMFLOAT4(0.9f, 0.9f, 0.9f, 1.0f);
 		mat->data.FresnelR0 = XMFLOAT3(0.5f, 0.5f, 0.5f);
 		mat->data.Roughness = 0.5f;
 		XMStoreFloat4x4(&mat->data.MatTransform, XMMatrixIdentity());
+		mat->data.MaterialPad1 = 0;
+		mat->data.MaterialPad2 = 0;
+
+		//Materials with identical data share a single entry in the material buffer, the duplicate name becomes an alias
+		std::vector<StringRef>& sameHash = m_materialsByContent[DX::HashBytes(&mat->data, sizeof(MaterialData))];
+		StringRef canonicalName;
+		bool isDuplicate = false;
+		for (auto& candidate : sameHash) {
+			if (memcmp(&to.at(candidate)->data, &mat->data, sizeof(MaterialData)) == 0) {
+				canonicalName = candidate;
+				isDuplicate = true;
+				break;
+			}
+		}
+		if (isDuplicate) {
+			if (canonicalName != mat->Name) {
+				m_materialAliases[mat->Name] = canonicalName;
+				m_dedupedMaterials++;
+			}
+			continue;
+		}
+		//a material with the same name, but different data replaces the old one - in its place of the material buffer,
+		//unless other materials were merged into the old one
 		mat->MatCBIndex = to.size();
+		auto existing = to.find(mat->Name);
+		if (existing != to.end())
+			mat->MatCBIndex = ReplaceMaterial(to, existing->second);
+		m_materialAliases.erase(mat->Name);
+		sameHash.push_back(mat->Name);
 		//store the object in the material map
 		to[mat->Name] = std::move(mat);
 	}
 }
 
+/// <summary>
+/// Takes a material, which is replaced by one with the same name, out of the content lookup. The materials, which
+/// were merged into it, keep its data - the first of them by name takes over its entry and the others become its
+/// aliases.
+/// </summary>
+/// <param name="materials">The material map.</param>
+/// <param name="old">The replaced material, moved to its heir if it has one.</param>
+/// <returns>The index of the replacing material in the material buffer</returns>
+int OBJLoader::ReplaceMaterial(std::unordered_map<StringRef, std::unique_ptr<Material>>& materials, std::unique_ptr<Material>& old)
+{
+	StringRef name = old->Name;
+	std::vector<StringRef>& oldHash = m_materialsByContent[DX::HashBytes(&old->data, sizeof(MaterialData))];
+	oldHash.erase(std::remove(oldHash.begin(), oldHash.end(), name), oldHash.end());
+	StringRef heir;
+	for (auto& alias : m_materialAliases) {
+		if (alias.second == name && (heir.empty() || std::lexicographical_compare(alias.first.begin(), alias.first.end(), heir.begin(), heir.end())))
+			heir = alias.first;
+	}
+	if (heir.empty())
+		return old->MatCBIndex;
+	for (auto& alias : m_materialAliases) {
+		if (alias.second == name)
+			alias.second = heir;
+	}
+	m_materialAliases.erase(heir);
+	m_dedupedMaterials--;
+	oldHash.push_back(heir);
+	old->Name = heir;
+	materials[heir] = std::move(old);
+	//the replacing material goes to the slot of the old name, after the heir
+	return (int)materials.size() - 1;
+}
+
+/// <summary>
+/// Finds a texture, that was already imported with the same name, file path or file content, or adds a new one
+/// </summary>
+/// <param name="textures">The texture map.</param>
+/// <param name="table">The lookup tables of the texture map.</param>
+/// <param name="name">The texture name.</param>
+/// <param name="fileName">The texture file name.</param>
+/// <param name="counter">The index counter of the texture map.</param>
+/// <returns>The index of the texture in the descriptor table</returns>
+UINT OBJLoader::RegisterTexture(std::unordered_map<StringRef, std::unique_ptr<Texture>>& textures, TextureDedupTable& table,
+	const std::string& name, const std::string& fileName, UINT& counter)
+{
+	std::string path = NormalizePath(fileName);
+	auto byPath = table.ByPath.find(path);
+	if (byPath != table.ByPath.end())
+		return textures.at(byPath->second)->index;
+	auto byName = textures.find(StringRef(name));
+	if (byName != textures.end()) {
+		table.ByPath[path] = byName->first;
+		return byName->second->index;
+	}
+	//a copy of an already imported file, stored under another path
+	UINT64 hash = 0;
+	bool hashed = HashFile(fileName, hash);
+	if (hashed) {
+		auto byContent = table.ByContent.find(hash);
+		if (byContent != table.ByContent.end()) {
+			table.ByPath[path] = byContent->second;
+			m_dedupedTextures++;
+			return textures.at(byContent->second)->index;
+		}
+	}
+	auto texture = std::make_unique<Texture>();
+	texture->Name = m_stringPool.Intern(name);
+	texture->Filename = m_stringPool.Intern(fileName);
+	texture->index = counter++;
+	texture->ContentHash = hash;
+	table.ByPath[path] = texture->Name;
+	if (hashed)
+		table.ByContent[hash] = texture->Name;
+	UINT index = texture->index;
+	textures[texture->Name] = std::move(texture);
+	return index;
+}
+
+/// <summary>
+/// Finds a material by name, following the aliases of the deduplicated materials
+/// </summary>
+Material* OBJLoader::FindMaterial(std::unordered_map<StringRef, std::unique_ptr<Material>>& materials, StringRef name)
+{
+	auto alias = m_materialAliases.find(name);
+	return materials.at(alias != m_materialAliases.end() ? alias->second : name).get();
+}
+
 /// <summary>
 /// Loads the vertex data from the tinyobj loader structures to the structures used by the application.
 /// </summary>
@@ -468,7 +1123,7 @@ void OBJLoader::LoadMaterials(std::vector<tinyobj_opt::material_t>& from, std::u
 void OBJLoader::LoadVertexData(tinyobj_opt::attrib_t & attributes,
 								std::vector<tinyobj_opt::shape_t>& shapes, 
 								std::vector<tinyobj_opt::material_t>& from,
-								std::unordered_map<std::string, std::unique_ptr<Material>>& to,
+								std::unordered_map<StringRef, std::unique_ptr<Material>>& to,
 								std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems)
 {
 	
@@ -525,16 +1180,24 @@ void OBJLoader::LoadVertexData(tinyobj_opt::attrib_t & attributes,
 			}
 			index_offset += vCount;
 		}
+		TrackedMemory vertices(Memory_Parser, vertexBuffer.capacity() * sizeof(Vertex) + indexBuffer.capacity() * sizeof(UINT));
 		//get the material index and material name
 		int matInx = attributes.material_ids[faceOffset];
 		std::string matName = from[matInx].name;
 		//create the render item
 		auto ri = std::make_unique<RenderItem>(vertexBuffer.size(), indexBuffer.size());
-		//copy the vertex and index data
-		memcpy(ri->GetVertexBufferData(), vertexBuffer.data(), vertexBuffer.size() * sizeof(Vertex));
+		//split the interleaved vertices in the position and the attribute streams, copy the index data
+		XMFLOAT3* positions = ri->GetPositionData();
+		VertexAttributes* vertexAttributes = ri->GetAttributeData();
+		for (size_t v = 0; v < vertexBuffer.size(); v++) {
+			positions[v] = vertexBuffer[v].pos;
+			vertexAttributes[v].normal = vertexBuffer[v].normal;
+			vertexAttributes[v].textureCoordinates = vertexBuffer[v].textureCoordinates;
+			vertexAttributes[v].tangent = vertexBuffer[v].tangent;
+		}
 		memcpy(ri->GetIndexBufferData(), indexBuffer.data(), indexBuffer.size() * sizeof(UINT));
 		//save the material index for accessing the material buffer
-		ri->SetMaterialIndex(to[matName]->MatCBIndex);
+		ri->SetMaterialIndex(FindMaterial(to, StringRef(matName))->MatCBIndex);
 		//Initialize the world and texture transformation matrices to identity matrix
 		XMStoreFloat4x4(&ri->GetWorldMatrix(), XMMatrixIdentity());
 		XMStoreFloat4x4(&ri->GetTexTransformMatrix(), XMMatrixIdentity());
@@ -1,36 +1,103 @@
 #pragma once
+#include <chrono>
 #include <fstream>
+#include <functional>
+#include <future>
 #include <unordered_map>
 #include "d3dx12.h"
 #include <sstream>
 #include "RenderItem.h"
+#include "SceneFile.h"
+#include "MaterialFile.h"
+#include "WorkerPool.h"
 #include "tinyObjLoader.h"
 
 using namespace DirectX;
 
 namespace ExecuteIndirect {
-	
+
+	// Lookup tables, used to find textures, that were already imported under another name
+	struct TextureDedupTable
+	{
+		std::unordered_map<std::string, StringRef> ByPath;		// normalized file path -> texture name
+		std::unordered_map<UINT64, StringRef> ByContent;		// file content hash -> texture name
+	};
+
+	// Sizes and times of the geometry streams of the decoded render items. The times are summed over the workers,
+	// so the throughputs are per core.
+	struct SceneStreamStats
+	{
+		UINT64 MappedBytes = 0;				// streams, used in place in the mapping
+		double MappedTime = 0.0;			// of the page faults of the mapped streams, in milliseconds
+		UINT64 CompressedBytes = 0;			// compressed streams, in the file
+		UINT64 DecompressedBytes = 0;
+		double DecompressTime = 0.0;		// in milliseconds
+	};
+
+	// Timings of an asynchronous load, in milliseconds from the start of the load
+	struct SceneLoadTimings
+	{
+		double RenderItemsReady = 0.0;		// all render items are decoded
+		double MaterialsReady = 0.0;		// materials.bin is read
+		double ItemDecodeTime = 0.0;		// sum of the decode times of the render items over all workers
+		UINT RenderItemCount = 0;
+		UINT WorkerCount = 0;
+		SceneStreamStats Streams;
+	};
+
+	// Handle of an asynchronous load of the binary files. The maps, given to ReadBinFilesAsync, must not be
+	// touched before the future, which fills them, is ready.
+	struct SceneLoadRequest
+	{
+		std::vector<std::shared_future<RenderItem*>> RenderItems;		// one per render item (v2 scene files only)
+		std::shared_future<void> RenderItemsReady;
+		std::shared_future<void> MaterialsReady;
+		std::shared_ptr<SceneLoadTimings> Timings;						// complete when both futures are ready
+		std::chrono::steady_clock::time_point Start;
+	};
+
+	// Called on a worker thread after a render item is decoded and inserted in the map
+	typedef std::function<void(const std::string& name, RenderItem* renderItem)> RenderItemLoadedCallback;
+
 	class OBJLoader
 	{
 	public:
 		OBJLoader();
 		const char * MapFile(size_t * len, const char * filename);
 		void ReadBinFiles(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-							std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-							std::unordered_map<std::string, std::unique_ptr<Material>>& materials);
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials);
+
+		SceneLoadRequest ReadBinFilesAsync(WorkerPool& pool,
+							std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+							std::unordered_map<StringRef, std::unique_ptr<Material>>& materials,
+							RenderItemLoadedCallback onItemLoaded = nullptr);
 
 		void ReadOBJFiles(const char* fileNames[], UINT numFiles, 
 						std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
-						std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-						std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-						std::unordered_map<std::string, std::unique_ptr<Material>>& materials);
+						std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+						std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+						std::unordered_map<StringRef, std::unique_ptr<Material>>& materials);
 
-		void WriteBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char * fileName);
+		bool ImportOBJFile(const char* fileName,
+						std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems,
+						std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+						std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+						std::unordered_map<StringRef, std::unique_ptr<Material>>& materials);
 
-		void WriteBinMaterialsAndTextures(std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<std::string, std::unique_ptr<Material>>& to, const char * fileName);
+		void WriteBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char * fileName, bool bakeInstances = false, bool compress = false);
+		bool AppendBinRenderItems(const std::vector<std::pair<std::string, RenderItem*>>& changedItems, const char* fileName, bool& shouldCompact);
+		// The baked instances of older files (without the compact layout) are ignored, they are generated again
+		bool HasBakedInstances() const { return IsTerrainScaled() && (m_sceneFile.GetFlags() & SceneFlag_CompactInstances); }
+		bool IsTerrainScaled() const { return m_sceneFile.IsOpen() && (m_sceneFile.GetFlags() & SceneFlag_BakedInstances); }
+		void SetSceneVerifyMode(uint32_t mode) { m_sceneFile.SetVerifyMode(mode); }		// SceneVerifyMode, before the scene is read
 
-		void ReadBinMaterialsAndTextures(std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<std::string, std::unique_ptr<Material>>& to, const char * fileName);
+		void WriteBinMaterialsAndTextures(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char * fileName);
+
+		void ReadBinMaterialsAndTextures(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char * fileName);
 
 		void ReadBinRenderItems(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char * fileName);
 
@@ -42,16 +109,40 @@ namespace ExecuteIndirect {
 
 		*/
 		void LoadMaterials(std::vector<tinyobj_opt::material_t>& from, 
-			std::unordered_map<std::string, std::unique_ptr<Texture>>& diffuseMaps,
-			std::unordered_map<std::string, std::unique_ptr<Texture>>& normalMaps,
-			std::unordered_map<std::string, std::unique_ptr<Material>>& to);
+			std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps,
+			std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps,
+			std::unordered_map<StringRef, std::unique_ptr<Material>>& to);
 
 		void LoadVertexData(tinyobj_opt::attrib_t& attributes, 
 			std::vector<tinyobj_opt::shape_t>& shapes, 
 			std::vector<tinyobj_opt::material_t>& from,
-			std::unordered_map<std::string, std::unique_ptr<Material>>& to,
+			std::unordered_map<StringRef, std::unique_ptr<Material>>& to,
 			std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems);
 
+		bool OpenSceneFile(const char* fileName);
+		void VerifySceneFile(WorkerPool* pool, const char* fileName);
+		std::unique_ptr<RenderItem> CreateMappedRenderItem(UINT recordIndex, WorkerPool* pool = nullptr, SceneStreamStats* stats = nullptr);
+		bool DecompressSections(const uint32_t* sections, void* const* destinations, UINT sectionCount, WorkerPool* pool, SceneStreamStats* stats);
+		void ReadBinRenderItemsV1(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& rItems, const char * fileName);
+		bool ReadBinMaterialsAndTexturesV2(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char * fileName);
+		void ReadBinMaterialsAndTexturesV1(std::unordered_map<StringRef, std::unique_ptr<Texture>>& diffuseMaps, std::unordered_map<StringRef, std::unique_ptr<Texture>>& normalMaps, std::unordered_map<StringRef, std::unique_ptr<Material>>& to, const char * fileName);
+
+		UINT RegisterTexture(std::unordered_map<StringRef, std::unique_ptr<Texture>>& textures, TextureDedupTable& table,
+			const std::string& name, const std::string& fileName, UINT& counter);
+		int ReplaceMaterial(std::unordered_map<StringRef, std::unique_ptr<Material>>& materials, std::unique_ptr<Material>& old);
+		Material* FindMaterial(std::unordered_map<StringRef, std::unique_ptr<Material>>& materials, StringRef name);
+
+		TextureDedupTable m_diffuseMapDedup;
+		TextureDedupTable m_normalMapDedup;
+		std::unordered_map<UINT64, std::vector<StringRef>> m_materialsByContent;	// material data hash -> material names
+		std::unordered_map<StringRef, StringRef> m_materialAliases;				// duplicate material name -> canonical material name
+		UINT m_dedupedTextures;
+		UINT m_dedupedMaterials;
+
+		SceneFile m_sceneFile;					// the render items point into this mapping, so it lives as long as the loader
+		MappedFile m_materialsFile;				// the texture and material names point into this mapping
+		StringPool m_stringPool;				// names of imported and old format textures and materials
+
 		std::ifstream m_fileReader;
 		std::ifstream m_mtlReader;
 		std::stringstream m_memoryReader;
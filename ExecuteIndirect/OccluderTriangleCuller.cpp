@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "OccluderTriangleCuller.h"
+#include "DirectXHelper.h"
+
+using namespace DirectX;
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Resets the counters and stores the camera for the following Cull calls
+/// </summary>
+/// <param name="viewProj">The view projection matrix of the camera.</param>
+/// <param name="viewportWidth">Width of the viewport, the occluders are rendered in.</param>
+/// <param name="viewportHeight">Height of the viewport, the occluders are rendered in.</param>
+void OccluderTriangleCuller::BeginFrame(FXMMATRIX viewProj, float viewportWidth, float viewportHeight)
+{
+	XMStoreFloat4x4(&m_viewProj, viewProj);
+	m_viewportWidth = viewportWidth;
+	m_viewportHeight = viewportHeight;
+	m_stats = OccluderCullingStats();
+	QueryPerformanceCounter((LARGE_INTEGER*)&m_startTime);
+}
+
+/// <summary>
+/// Stops the timer of the pass
+/// </summary>
+void OccluderTriangleCuller::EndFrame()
+{
+	__int64 endTime, frequency;
+	QueryPerformanceCounter((LARGE_INTEGER*)&endTime);
+	QueryPerformanceFrequency((LARGE_INTEGER*)&frequency);
+	m_stats.CullingTime = (endTime - m_startTime) * 1000.0 / frequency;
+}
+
+/// <summary>
+/// Culls the triangles of a single occluder instance and writes the indices of the remaining ones
+/// </summary>
+/// <param name="ri">The occluder render item, its CPU vertex and index buffers must be alive.</param>
+/// <param name="world">The world matrix of the instance (not transposed).</param>
+/// <param name="outIndices">The output indices, must have place for all indices of the render item.</param>
+/// <returns>Number of written indices</returns>
+UINT OccluderTriangleCuller::Cull(RenderItem* ri, CXMMATRIX world, UINT* outIndices)
+{
+	//transform all vertices once, the triangles share them
+	XMMATRIX worldViewProj = XMMatrixMultiply(world, XMLoadFloat4x4(&m_viewProj));
+	m_clipPositions.resize(ri->GetVertexCount());
+	XMVector3TransformStream(m_clipPositions.data(), sizeof(XMFLOAT4), ri->GetPositionData(), sizeof(XMFLOAT3), ri->GetVertexCount(), worldViewProj);
+
+	const UINT* indices = ri->GetIndexBufferData();
+	const UINT triangleCount = ri->GetIndexCount() / 3;
+	const XMVECTOR zero = XMVectorZero();
+	const XMVECTOR trueMask = XMVectorTrueInt();
+	const XMVECTOR areaEpsilon = XMVectorReplicate(1.0e-6f);
+	const XMVECTOR wEpsilon = XMVectorReplicate(1.0e-5f);
+	const XMVECTOR halfWidth = XMVectorReplicate(0.5f * m_viewportWidth);
+	const XMVECTOR halfHeight = XMVectorReplicate(0.5f * m_viewportHeight);
+	UINT writtenIndices = 0;
+
+	for (UINT t = 0; t < triangleCount; t += 4) {
+		const UINT lanes = DX::Min(4u, triangleCount - t);
+		//load the corners of four triangles and transpose them, so every vector holds one component of four corners
+		XMVECTOR x[3], y[3], z[3], w[3];
+		for (UINT c = 0; c < 3; c++) {
+			XMMATRIX corners;
+			for (UINT l = 0; l < 4; l++) {
+				//the missing triangles of the last group repeat the last one, their lanes are ignored
+				UINT triangle = t + DX::Min(l, lanes - 1);
+				corners.r[l] = XMLoadFloat4(&m_clipPositions[indices[triangle * 3 + c]]);
+			}
+			corners = XMMatrixTranspose(corners);
+			x[c] = corners.r[0];
+			y[c] = corners.r[1];
+			z[c] = corners.r[2];
+			w[c] = corners.r[3];
+		}
+
+		//frustum test - the triangle is outside if all of its corners are outside the same plane
+		XMVECTOR left = trueMask, right = trueMask, bottom = trueMask, top = trueMask, nearPlane = trueMask, farPlane = trueMask;
+		//the screen space tests are valid only if the whole triangle is in front of the camera
+		XMVECTOR inFront = trueMask;
+		for (UINT c = 0; c < 3; c++) {
+			XMVECTOR negW = XMVectorNegate(w[c]);
+			left = XMVectorAndInt(left, XMVectorLess(x[c], negW));
+			right = XMVectorAndInt(right, XMVectorGreater(x[c], w[c]));
+			bottom = XMVectorAndInt(bottom, XMVectorLess(y[c], negW));
+			top = XMVectorAndInt(top, XMVectorGreater(y[c], w[c]));
+			nearPlane = XMVectorAndInt(nearPlane, XMVectorLess(z[c], zero));
+			farPlane = XMVectorAndInt(farPlane, XMVectorGreater(z[c], w[c]));
+			inFront = XMVectorAndInt(inFront, XMVectorGreater(w[c], wEpsilon));
+		}
+		XMVECTOR frustumCulled = XMVectorOrInt(XMVectorOrInt(XMVectorOrInt(left, right), XMVectorOrInt(bottom, top)), XMVectorOrInt(nearPlane, farPlane));
+
+		//project to pixels, y goes down as in the render target
+		XMVECTOR sx[3], sy[3];
+		for (UINT c = 0; c < 3; c++) {
+			XMVECTOR invW = XMVectorReciprocal(w[c]);
+			sx[c] = XMVectorMultiplyAdd(XMVectorMultiply(x[c], invW), halfWidth, halfWidth);
+			sy[c] = XMVectorNegativeMultiplySubtract(XMVectorMultiply(y[c], invW), halfHeight, halfHeight);
+		}
+		//twice the signed area - front faces are clockwise on screen, which gives positive area
+		XMVECTOR area = XMVectorSubtract(
+			XMVectorMultiply(XMVectorSubtract(sx[1], sx[0]), XMVectorSubtract(sy[2], sy[0])),
+			XMVectorMultiply(XMVectorSubtract(sy[1], sy[0]), XMVectorSubtract(sx[2], sx[0])));
+		XMVECTOR zeroArea = XMVectorAndInt(inFront, XMVectorLessOrEqual(XMVectorAbs(area), areaEpsilon));
+		XMVECTOR backface = XMVectorAndInt(inFront, XMVectorLess(area, zero));
+		//a triangle, whose bounding rectangle doesn't contain a pixel center, can't be rasterized
+		XMVECTOR minX = XMVectorMin(XMVectorMin(sx[0], sx[1]), sx[2]);
+		XMVECTOR maxX = XMVectorMax(XMVectorMax(sx[0], sx[1]), sx[2]);
+		XMVECTOR minY = XMVectorMin(XMVectorMin(sy[0], sy[1]), sy[2]);
+		XMVECTOR maxY = XMVectorMax(XMVectorMax(sy[0], sy[1]), sy[2]);
+		XMVECTOR subPixel = XMVectorAndInt(inFront, XMVectorOrInt(
+			XMVectorEqual(XMVectorRound(minX), XMVectorRound(maxX)),
+			XMVectorEqual(XMVectorRound(minY), XMVectorRound(maxY))));
+
+		//compact the indices of the remaining triangles
+		uint32_t frustumLanes[4], zeroAreaLanes[4], backfaceLanes[4], subPixelLanes[4];
+		XMStoreInt4(frustumLanes, frustumCulled);
+		XMStoreInt4(zeroAreaLanes, zeroArea);
+		XMStoreInt4(backfaceLanes, backface);
+		XMStoreInt4(subPixelLanes, subPixel);
+		for (UINT l = 0; l < lanes; l++) {
+			if (frustumLanes[l])
+				m_stats.FrustumRejected++;
+			else if (zeroAreaLanes[l])
+				m_stats.ZeroAreaRejected++;
+			else if (backfaceLanes[l])
+				m_stats.BackfaceRejected++;
+			else if (subPixelLanes[l])
+				m_stats.SubPixelRejected++;
+			else {
+				const UINT* triangleIndices = &indices[(t + l) * 3];
+				outIndices[writtenIndices++] = triangleIndices[0];
+				outIndices[writtenIndices++] = triangleIndices[1];
+				outIndices[writtenIndices++] = triangleIndices[2];
+				m_stats.AcceptedTriangles++;
+			}
+		}
+	}
+	m_stats.TotalTriangles += triangleCount;
+	return writtenIndices;
+}
@@ -0,0 +1,44 @@
+#pragma once
+#include <vector>
+#include "ShaderStructures.h"
+#include "RenderItem.h"
+
+using namespace DirectX;
+
+namespace ExecuteIndirect {
+
+	// Counters of the last pre-culling pass, every triangle is counted by the first test that rejects it
+	struct OccluderCullingStats
+	{
+		UINT TotalTriangles = 0;
+		UINT FrustumRejected = 0;		// all three corners outside the same frustum plane
+		UINT BackfaceRejected = 0;		// counter clockwise on screen
+		UINT ZeroAreaRejected = 0;		// degenerate on screen
+		UINT SubPixelRejected = 0;		// bounding rectangle doesn't contain a pixel center
+		UINT AcceptedTriangles = 0;
+		double CullingTime = 0.0;		// in milliseconds
+
+		float GetRejectionRate() { return TotalTriangles ? 1.0f - (float)AcceptedTriangles / TotalTriangles : 0.0f; }
+	};
+
+	// CPU pass, that removes the occluder triangles, which can't write depth for the current camera.
+	// Four triangles are tested at a time with DirectXMath vectors, the surviving indices are compacted.
+	class OccluderTriangleCuller
+	{
+	public:
+		void BeginFrame(FXMMATRIX viewProj, float viewportWidth, float viewportHeight);
+		UINT Cull(RenderItem* ri, CXMMATRIX world, UINT* outIndices);
+		void EndFrame();
+
+		OccluderCullingStats& GetStats() { return m_stats; }
+
+	private:
+		XMFLOAT4X4 m_viewProj;
+		float m_viewportWidth;
+		float m_viewportHeight;
+		__int64 m_startTime;
+
+		std::vector<XMFLOAT4> m_clipPositions;		// the occluder vertices in homogeneous clip space
+		OccluderCullingStats m_stats;
+	};
+}
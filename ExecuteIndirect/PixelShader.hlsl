@@ -48,8 +48,9 @@ struct MaterialData
 	uint     MatPad2;
 };
 
-Texture2D diffuseMaps[15] : register(t0, space1);
-Texture2D normalMaps[15] : register(t0, space2);
+//unbounded - the texture table has as many maps as the scene, after the duplicates were merged
+Texture2D diffuseMaps[] : register(t0, space1);
+Texture2D normalMaps[] : register(t0, space2);
 StructuredBuffer<MaterialData> materials : register(t0);
 
 // Per-pixel color data passed through the pixel shader.
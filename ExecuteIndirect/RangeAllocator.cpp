@@ -0,0 +1,180 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "RangeAllocator.h"
+#include <algorithm>
+
+using namespace ExecuteIndirect;
+
+RangeAllocator::RangeAllocator(uint64_t capacity)
+{
+	Reset(capacity);
+}
+
+/// <summary>
+/// Frees all allocations and sets a new capacity
+/// </summary>
+/// <param name="capacity">The capacity.</param>
+void RangeAllocator::Reset(uint64_t capacity)
+{
+	m_capacity = capacity;
+	m_usedSize = 0;
+	m_freeByOffset.clear();
+	m_freeBySize.clear();
+	m_allocations.clear();
+	if (capacity)
+		InsertFreeBlock(0, capacity);
+}
+
+/// <summary>
+/// Extends the range, the new space is merged with the last free block
+/// </summary>
+/// <param name="newCapacity">The new capacity, smaller values are ignored.</param>
+void RangeAllocator::Grow(uint64_t newCapacity)
+{
+	if (newCapacity <= m_capacity)
+		return;
+	uint64_t offset = m_capacity;
+	uint64_t size = newCapacity - m_capacity;
+	m_capacity = newCapacity;
+	//merge with the free block at the end of the old range
+	if (!m_freeByOffset.empty()) {
+		auto last = std::prev(m_freeByOffset.end());
+		if (last->first + last->second == offset) {
+			offset = last->first;
+			size += last->second;
+			EraseFreeBlock(last);
+		}
+	}
+	InsertFreeBlock(offset, size);
+}
+
+/// <summary>
+/// Allocates a range, using the smallest free block that fits
+/// </summary>
+/// <param name="size">The size.</param>
+/// <param name="alignment">The alignment of the offset.</param>
+/// <returns>The offset of the range or InvalidOffset if there is no block big enough</returns>
+uint64_t RangeAllocator::Allocate(uint64_t size, uint64_t alignment)
+{
+	if (size == 0)
+		return InvalidOffset;
+	//the padding is at most alignment - 1, so blocks of at least this size always fit
+	for (auto iter = m_freeBySize.lower_bound(size); iter != m_freeBySize.end(); iter++) {
+		uint64_t blockOffset = iter->second;
+		uint64_t blockSize = iter->first;
+		uint64_t offset = (blockOffset + alignment - 1) / alignment * alignment;
+		uint64_t padding = offset - blockOffset;
+		if (padding + size > blockSize)
+			continue;
+
+		EraseFreeBlock(m_freeByOffset.find(blockOffset));
+		//return the padding and the rest of the block to the free list
+		if (padding)
+			InsertFreeBlock(blockOffset, padding);
+		if (padding + size < blockSize)
+			InsertFreeBlock(offset + size, blockSize - padding - size);
+
+		m_allocations[offset] = size;
+		m_usedSize += size;
+		return offset;
+	}
+	return InvalidOffset;
+}
+
+/// <summary>
+/// Frees a range and merges it with the neighbouring free blocks
+/// </summary>
+/// <param name="offset">The offset, returned by Allocate.</param>
+void RangeAllocator::Free(uint64_t offset)
+{
+	auto allocation = m_allocations.find(offset);
+	if (allocation == m_allocations.end())
+		return;
+	uint64_t size = allocation->second;
+	m_allocations.erase(allocation);
+	m_usedSize -= size;
+
+	auto next = m_freeByOffset.lower_bound(offset);
+	if (next != m_freeByOffset.end() && offset + size == next->first) {
+		size += next->second;
+		next = std::next(next);
+		EraseFreeBlock(std::prev(next));
+	}
+	if (next != m_freeByOffset.begin()) {
+		auto previous = std::prev(next);
+		if (previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			EraseFreeBlock(previous);
+		}
+	}
+	InsertFreeBlock(offset, size);
+}
+
+/// <summary>
+/// Moves all allocations to the beginning of the range, keeping their order. The caller must move
+/// the data, the moves are sorted by offset, so they can be done one after another in place.
+/// </summary>
+/// <returns>The moved ranges</returns>
+std::vector<RangeMove> RangeAllocator::Defragment()
+{
+	std::vector<std::pair<uint64_t, uint64_t>> allocations(m_allocations.begin(), m_allocations.end());
+	std::sort(allocations.begin(), allocations.end());
+
+	std::vector<RangeMove> moves;
+	m_allocations.clear();
+	uint64_t offset = 0;
+	for (auto& allocation : allocations) {
+		if (allocation.first != offset)
+			moves.push_back({ allocation.first, offset, allocation.second });
+		m_allocations[offset] = allocation.second;
+		offset += allocation.second;
+	}
+	m_freeByOffset.clear();
+	m_freeBySize.clear();
+	if (offset < m_capacity)
+		InsertFreeBlock(offset, m_capacity - offset);
+	return moves;
+}
+
+/// <summary>
+/// Gets the size of an allocation
+/// </summary>
+/// <param name="offset">The offset, returned by Allocate.</param>
+/// <returns>The size or 0 if there is no allocation at this offset</returns>
+uint64_t RangeAllocator::GetAllocationSize(uint64_t offset) const
+{
+	auto allocation = m_allocations.find(offset);
+	return allocation == m_allocations.end() ? 0 : allocation->second;
+}
+
+RangeAllocatorStats RangeAllocator::GetStats() const
+{
+	RangeAllocatorStats stats;
+	stats.Capacity = m_capacity;
+	stats.UsedSize = m_usedSize;
+	stats.FreeSize = m_capacity - m_usedSize;
+	stats.LargestFreeBlock = m_freeBySize.empty() ? 0 : std::prev(m_freeBySize.end())->first;
+	stats.AllocationCount = (uint32_t)m_allocations.size();
+	stats.FreeBlockCount = (uint32_t)m_freeByOffset.size();
+	return stats;
+}
+
+void RangeAllocator::InsertFreeBlock(uint64_t offset, uint64_t size)
+{
+	m_freeByOffset[offset] = size;
+	m_freeBySize.insert(std::make_pair(size, offset));
+}
+
+void RangeAllocator::EraseFreeBlock(std::map<uint64_t, uint64_t>::iterator block)
+{
+	auto range = m_freeBySize.equal_range(block->second);
+	for (auto iter = range.first; iter != range.second; iter++) {
+		if (iter->second == block->first) {
+			m_freeBySize.erase(iter);
+			break;
+		}
+	}
+	m_freeByOffset.erase(block);
+}
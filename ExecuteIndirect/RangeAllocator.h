@@ -0,0 +1,59 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <unordered_map>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Statistics of a range allocator, all sizes are in the allocator's units
+	struct RangeAllocatorStats
+	{
+		uint64_t Capacity = 0;
+		uint64_t UsedSize = 0;
+		uint64_t FreeSize = 0;
+		uint64_t LargestFreeBlock = 0;
+		uint32_t AllocationCount = 0;
+		uint32_t FreeBlockCount = 0;
+
+		// 0 when all free space is one block, close to 1 when it is split in many small blocks
+		float GetFragmentation() const { return FreeSize ? 1.0f - (float)LargestFreeBlock / FreeSize : 0.0f; }
+	};
+
+	// A range, that changed its place during defragmentation
+	struct RangeMove
+	{
+		uint64_t OldOffset;
+		uint64_t NewOffset;
+		uint64_t Size;
+	};
+
+	// CPU suballocator of a linear range [0, capacity). It doesn't know what it allocates (bytes, vertices, indices),
+	// so it has no dependency on the device. Free blocks are kept sorted by offset for coalescing and by size for best fit.
+	class RangeAllocator
+	{
+	public:
+		static const uint64_t InvalidOffset = ~0ull;
+
+		explicit RangeAllocator(uint64_t capacity = 0);
+		void Reset(uint64_t capacity);
+		void Grow(uint64_t newCapacity);
+
+		uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+		void Free(uint64_t offset);
+		std::vector<RangeMove> Defragment();
+
+		uint64_t GetAllocationSize(uint64_t offset) const;
+		RangeAllocatorStats GetStats() const;
+
+	private:
+		void InsertFreeBlock(uint64_t offset, uint64_t size);
+		void EraseFreeBlock(std::map<uint64_t, uint64_t>::iterator block);
+
+		uint64_t m_capacity;
+		uint64_t m_usedSize;
+		std::map<uint64_t, uint64_t>			m_freeByOffset;		// offset -> size
+		std::multimap<uint64_t, uint64_t>		m_freeBySize;		// size -> offset
+		std::unordered_map<uint64_t, uint64_t>	m_allocations;		// offset -> size
+	};
+}
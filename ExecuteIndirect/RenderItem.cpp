@@ -1,6 +1,7 @@
 #include "pch.h"
 #include "RenderItem.h"
 #include "DirectXHelper.h"
+#include "MemoryTracker.h"
 
 using namespace ExecuteIndirect;
 
@@ -8,13 +9,39 @@ RenderItem::RenderItem(int vertexCount , int indexCount) :
 	VertexCount(vertexCount), 
 	IndexCount(indexCount)
 {
-	VertexBufferCPU = new Vertex[VertexCount];
+	PositionBufferByteSize = vertexCount*sizeof(XMFLOAT3);
+	AttributeBufferByteSize = vertexCount*sizeof(VertexAttributes);
+	IndexBufferByteSize = indexCount*sizeof(UINT);
+
+	//a single allocation holds both vertex streams, so they are uploaded to a single GPU buffer
+	VertexBufferCPU = new BYTE[PositionBufferByteSize + AttributeBufferByteSize];
+	PositionBufferCPU = reinterpret_cast<XMFLOAT3*>(VertexBufferCPU);
+	AttributeBufferCPU = reinterpret_cast<VertexAttributes*>(VertexBufferCPU + PositionBufferByteSize);
 	IndexBufferCPU = new UINT[IndexCount];
 
-	VertexByteStride = sizeof(Vertex);
-	VertexBufferByteSize = vertexCount*sizeof(Vertex);
+	TriangleCount = indexCount / 3;
+	TrackMemory();
+}
+
+/// <summary>
+/// Creates a render item, which uses geometry owned by someone else (the mapped scene file). The memory
+/// must outlive the render item and is read only.
+/// </summary>
+RenderItem::RenderItem(UINT vertexCount, UINT indexCount, const XMFLOAT3* positions, const VertexAttributes* attributes, const UINT* indices) :
+	VertexCount(vertexCount),
+	IndexCount(indexCount),
+	OwnsCPUBuffers(false)
+{
+	PositionBufferByteSize = vertexCount*sizeof(XMFLOAT3);
+	AttributeBufferByteSize = vertexCount*sizeof(VertexAttributes);
 	IndexBufferByteSize = indexCount*sizeof(UINT);
 
+	//the streams aren't in a single allocation
+	VertexBufferCPU = nullptr;
+	PositionBufferCPU = const_cast<XMFLOAT3*>(positions);
+	AttributeBufferCPU = const_cast<VertexAttributes*>(attributes);
+	IndexBufferCPU = const_cast<UINT*>(indices);
+
 	TriangleCount = indexCount / 3;
 }
 
@@ -28,7 +55,18 @@ void RenderItem::CreateCounterOffset() {
 
 RenderItem::~RenderItem() {
 	ReleaseCPUBuffers();
+	//the instances and the GPU buffers are released with the item
+	MemoryTracker::Get().RemoveOwner(this);
+}
 
+/// <summary>
+/// Reports the CPU streams and the instances to the memory tracker, called when they are allocated, resized or freed.
+/// The streams in a mapped scene file aren't counted, the mapping is the file cache's memory.
+/// </summary>
+void RenderItem::TrackMemory() {
+	MemoryTracker& tracker = MemoryTracker::Get();
+	tracker.Set(Memory_Geometry, OwnsCPUBuffers && PositionBufferCPU ? (uint64_t)PositionBufferByteSize + AttributeBufferByteSize + IndexBufferByteSize : 0, this);
+	tracker.Set(Memory_Instances, (uint64_t)Instances.capacity() * sizeof(InstanceData), this);
 }
 
 /// <summary>
@@ -36,17 +74,79 @@ RenderItem::~RenderItem() {
 /// if the GPU resource is in a default buffer
 /// </summary>
 void RenderItem::ReleaseCPUBuffers() {
-	if (VertexBufferCPU)
-		delete[] VertexBufferCPU;
-	if (IndexBufferCPU)
-		delete[] IndexBufferCPU;
+	if (OwnsCPUBuffers) {
+		if (VertexBufferCPU)
+			delete[] VertexBufferCPU;
+		if (IndexBufferCPU)
+			delete[] IndexBufferCPU;
+	}
+	VertexBufferCPU = nullptr;
+	PositionBufferCPU = nullptr;
+	AttributeBufferCPU = nullptr;
+	IndexBufferCPU = nullptr;
+	TrackMemory();
+}
+
+/// <summary>
+/// Copies streams, which point into a mapped scene file, to owned memory, so they can be modified
+/// </summary>
+void RenderItem::DetachCPUBuffers() {
+	if (OwnsCPUBuffers)
+		return;
+	BYTE* vertexBuffer = new BYTE[PositionBufferByteSize + AttributeBufferByteSize];
+	memcpy(vertexBuffer, PositionBufferCPU, PositionBufferByteSize);
+	memcpy(vertexBuffer + PositionBufferByteSize, AttributeBufferCPU, AttributeBufferByteSize);
+	UINT* indexBuffer = new UINT[IndexCount];
+	memcpy(indexBuffer, IndexBufferCPU, IndexBufferByteSize);
+
+	VertexBufferCPU = vertexBuffer;
+	PositionBufferCPU = reinterpret_cast<XMFLOAT3*>(VertexBufferCPU);
+	AttributeBufferCPU = reinterpret_cast<VertexAttributes*>(VertexBufferCPU + PositionBufferByteSize);
+	IndexBufferCPU = indexBuffer;
+	OwnsCPUBuffers = true;
+	TrackMemory();
+}
 
+/// <summary>
+/// Takes the CPU streams and the bounding volumes of a reimported item. The instances, the GPU buffers and the
+/// flags of this item stay, its old streams go to the other item and are freed with it.
+/// </summary>
+void RenderItem::ReplaceGeometry(RenderItem& from) {
+	std::swap(VertexBufferCPU, from.VertexBufferCPU);
+	std::swap(PositionBufferCPU, from.PositionBufferCPU);
+	std::swap(AttributeBufferCPU, from.AttributeBufferCPU);
+	std::swap(IndexBufferCPU, from.IndexBufferCPU);
+	std::swap(OwnsCPUBuffers, from.OwnsCPUBuffers);
+	std::swap(PositionBufferByteSize, from.PositionBufferByteSize);
+	std::swap(AttributeBufferByteSize, from.AttributeBufferByteSize);
+	std::swap(IndexBufferByteSize, from.IndexBufferByteSize);
+	std::swap(VertexCount, from.VertexCount);
+	std::swap(IndexCount, from.IndexCount);
+	std::swap(TriangleCount, from.TriangleCount);
+	if (from.hasBoundingVolumes)
+		SetBoundingVolumes(from.boundingBox, from.boundingSphere, from.orientedBox);
+	else
+		CreateBoundingVolumes();
+	TrackMemory();
+	from.TrackMemory();
 }
 
 /// <summary>
-/// Creates the render item bounding box.
+/// Creates the render item bounding box, sphere and oriented box.
 /// </summary>
-void RenderItem::CreateBoundingBox()
+void RenderItem::CreateBoundingVolumes()
 {
-	BoundingBox::CreateFromPoints(boundingBox, VertexCount, &VertexBufferCPU[0].pos, sizeof(Vertex));
+	BoundingBox::CreateFromPoints(boundingBox, VertexCount, PositionBufferCPU, sizeof(XMFLOAT3));
+	//the sphere and the oriented box from the points aren't always tighter than the ones built from the box
+	BoundingSphere::CreateFromPoints(boundingSphere, VertexCount, PositionBufferCPU, sizeof(XMFLOAT3));
+	BoundingSphere boxSphere;
+	BoundingSphere::CreateFromBoundingBox(boxSphere, boundingBox);
+	if (boxSphere.Radius < boundingSphere.Radius)
+		boundingSphere = boxSphere;
+	BoundingOrientedBox::CreateFromPoints(orientedBox, VertexCount, PositionBufferCPU, sizeof(XMFLOAT3));
+	float orientedVolume = orientedBox.Extents.x * orientedBox.Extents.y * orientedBox.Extents.z;
+	float boxVolume = boundingBox.Extents.x * boundingBox.Extents.y * boundingBox.Extents.z;
+	if (orientedVolume >= boxVolume)
+		BoundingOrientedBox::CreateFromBoundingBox(orientedBox, boundingBox);
+	hasBoundingVolumes = true;
 }
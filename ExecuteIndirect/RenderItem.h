@@ -10,31 +10,39 @@ namespace ExecuteIndirect {
 	{
 	public:
 		RenderItem(int vertexCount, int indexCount);
+		RenderItem(UINT vertexCount, UINT indexCount, const XMFLOAT3* positions, const VertexAttributes* attributes, const UINT* indices);
 		void CreateCounterOffset();
 		~RenderItem();
 		void ReleaseCPUBuffers();
+		void DetachCPUBuffers();
+		void ReplaceGeometry(RenderItem& from);
+		void TrackMemory();
 
 	private:
-		Vertex* VertexBufferCPU;
+		BYTE* VertexBufferCPU;					// the position stream, followed by the attribute stream
+		XMFLOAT3* PositionBufferCPU;
+		VertexAttributes* AttributeBufferCPU;
 		UINT* IndexBufferCPU;
+		bool OwnsCPUBuffers = true;				// false if the streams point into a mapped scene file
 
-		Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
-		Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> Texture = nullptr;
-
-		Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
-		Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> TextureUploader = nullptr;
 
 		Microsoft::WRL::ComPtr<ID3D12Resource> InstanceBufferGPU = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> ProcessedInstanceBufferGPU = nullptr;
+		Microsoft::WRL::ComPtr<ID3D12Resource> ImpostorInstanceBufferGPU = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> InstanceBufferUploader = nullptr;
 
 		// Data about the buffers.
-		UINT VertexByteStride = 0;
-		UINT VertexBufferByteSize = 0;
-		DXGI_FORMAT IndexFormat = DXGI_FORMAT_R32_UINT;
+		UINT PositionBufferByteSize = 0;
+		UINT AttributeBufferByteSize = 0;
 		UINT IndexBufferByteSize = 0;
+		// Views of the pooled geometry buffers and the ranges of this item in them
+		D3D12_VERTEX_BUFFER_VIEW PositionView = {};
+		D3D12_VERTEX_BUFFER_VIEW AttributeView = {};
+		D3D12_INDEX_BUFFER_VIEW IndexView = {};
+		UINT BaseVertexLocation = 0;
+		UINT StartIndexLocation = 0;
 		UINT InstanceBufferCounterOffset = 0;
 
 		UINT VertexCount;
@@ -48,7 +56,11 @@ namespace ExecuteIndirect {
 
 		std::vector<InstanceData> Instances;
 		BoundingBox boundingBox;
+		BoundingSphere boundingSphere;
+		BoundingOrientedBox orientedBox;
+		bool hasBoundingVolumes = false;
 		bool isItemOccluder = false;
+		int impostorInx = -1;
 
 	public:
 		UINT GetVertexCount() { return VertexCount; }
@@ -56,19 +68,18 @@ namespace ExecuteIndirect {
 		UINT GetCommandCount() { return CommandCount; }
 		UINT GetTriangleCount() { return TriangleCount; }
 
-		Microsoft::WRL::ComPtr<ID3D12Resource>& GetVertexBufferGPU() { return VertexBufferGPU; }
-		Microsoft::WRL::ComPtr<ID3D12Resource>& GetIndexBufferGPU()  { return IndexBufferGPU; }
-
-		Microsoft::WRL::ComPtr<ID3D12Resource>& GetVertexBufferUploader() { return VertexBufferUploader; }
-		Microsoft::WRL::ComPtr<ID3D12Resource>& GetIndexBufferUploader() { return IndexBufferUploader; }
-
 		Microsoft::WRL::ComPtr<ID3D12Resource>& GetInstanceBufferGPU() { return InstanceBufferGPU; }
 		Microsoft::WRL::ComPtr<ID3D12Resource>& GetInstanceBufferUploader() { return InstanceBufferUploader; }
 		Microsoft::WRL::ComPtr<ID3D12Resource>& GetProcessedInstanceBufferGPU() { return ProcessedInstanceBufferGPU; }
+		Microsoft::WRL::ComPtr<ID3D12Resource>& GetImpostorInstanceBufferGPU() { return ImpostorInstanceBufferGPU; }
 
-		Vertex* GetVertexBufferData() { return VertexBufferCPU; }
+		BYTE* GetVertexBufferData() { return VertexBufferCPU; }		// nullptr for render items in a mapped scene file
+		XMFLOAT3* GetPositionData() { return PositionBufferCPU; }
+		VertexAttributes* GetAttributeData() { return AttributeBufferCPU; }
 		UINT* GetIndexBufferData() { return IndexBufferCPU; }
 		DirectX::BoundingBox& GetBoundingBoxData() { return boundingBox; }
+		DirectX::BoundingSphere& GetBoundingSphereData() { return boundingSphere; }
+		DirectX::BoundingOrientedBox& GetOrientedBoxData() { return orientedBox; }
 		UINT GetInstanceBufferCounterOffset() { return InstanceBufferCounterOffset; }
 		UINT GetNumFramesDirty() { return NumFramesDirty; }
 		XMFLOAT4X4& GetWorldMatrix() { return World; }
@@ -76,50 +87,47 @@ namespace ExecuteIndirect {
 		std::vector<InstanceData>& GetInstances() { return Instances; }
 
 		bool isOccluder() { return isItemOccluder; }
+		bool hasImpostor() { return impostorInx >= 0; }
+		int GetImpostorIndex() { return impostorInx; }
 
 		UINT GetMaterialIndex() { return materialInx; }
-		UINT GetVertexByteStride() { return VertexByteStride; }
-		UINT GetVertexBufferByteSize() { return VertexBufferByteSize; }
+		UINT GetPositionBufferByteSize() { return PositionBufferByteSize; }
+		UINT GetAttributeBufferByteSize() { return AttributeBufferByteSize; }
+		UINT GetVertexBufferByteSize() { return PositionBufferByteSize + AttributeBufferByteSize; }
 		UINT GetIndexBufferByteSize() { return IndexBufferByteSize; }
+		UINT GetBaseVertexLocation() { return BaseVertexLocation; }
+		UINT GetStartIndexLocation() { return StartIndexLocation; }
 		UINT GetInstancesByteSize() { return Instances.size() * sizeof(InstanceData); }
 		UINT GetInstanceCount() { return Instances.size(); }
 
-		void SetVertexByteStride(UINT byteStride) { VertexByteStride = byteStride; }
-		void SetVertexBufferByteSize(UINT byteSize) { VertexBufferByteSize = byteSize; }
 		void SetIndexBufferByteSize(UINT byteSize) { IndexBufferByteSize = byteSize; }
 		void SetMaterialIndex(UINT m) { materialInx = m; }
 		void SetNumFramesDirty(UINT n) { NumFramesDirty = n; }
 		void SetWorldMatrix(XMFLOAT4X4& m) { World = m; }
 		void SetTextureTransformMatrix(XMFLOAT4X4& m) { TexTransformMatrix = m; }
 		void SetOccluder(bool state) { isItemOccluder = state; }
-		void CreateBoundingBox();
-
-		D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
-		{
-			D3D12_VERTEX_BUFFER_VIEW vbv;
-			vbv.BufferLocation = VertexBufferGPU->GetGPUVirtualAddress();
-			vbv.StrideInBytes = VertexByteStride;
-			vbv.SizeInBytes = VertexBufferByteSize;
-
-			return vbv;
+		void SetImpostorIndex(int inx) { impostorInx = inx; }
+		void SetGeometry(D3D12_VERTEX_BUFFER_VIEW& positionView, D3D12_VERTEX_BUFFER_VIEW& attributeView, D3D12_INDEX_BUFFER_VIEW& indexView,
+			UINT baseVertex, UINT startIndex) {
+			PositionView = positionView;
+			AttributeView = attributeView;
+			IndexView = indexView;
+			BaseVertexLocation = baseVertex;
+			StartIndexLocation = startIndex;
 		}
-
-		D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
-		{
-			D3D12_INDEX_BUFFER_VIEW ibv;
-			ibv.BufferLocation = IndexBufferGPU->GetGPUVirtualAddress();
-			ibv.Format = IndexFormat;
-			ibv.SizeInBytes = IndexBufferByteSize;
-
-			return ibv;
+		void CreateBoundingVolumes();
+		void SetBoundingVolumes(const BoundingBox& box, const BoundingSphere& sphere, const BoundingOrientedBox& oriented) {
+			boundingBox = box;
+			boundingSphere = sphere;
+			orientedBox = oriented;
+			hasBoundingVolumes = true;
 		}
+		bool HasBoundingVolumes() { return hasBoundingVolumes; }
 
-		// We can free this memory after we finish upload to the GPU.
-		void DisposeUploaders()
-		{
-			VertexBufferUploader = nullptr;
-			IndexBufferUploader = nullptr;
-		}
+		// The geometry is in the pooled buffers, shared by all render items
+		D3D12_VERTEX_BUFFER_VIEW PositionBufferView()const { return PositionView; }
+		D3D12_VERTEX_BUFFER_VIEW AttributeBufferView()const { return AttributeView; }
+		D3D12_INDEX_BUFFER_VIEW IndexBufferView()const { return IndexView; }
 	};
 }
 
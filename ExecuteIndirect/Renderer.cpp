@@ -4,8 +4,11 @@
 #include "DirectXHelper.h"
 #include "d3dx12.h"
 #include "DDSTextureLoader.h"
+#include "TaskGraph.h"
+#include "MemoryTracker.h"
 #include <ppltasks.h>
 #include <synchapi.h>
+#include <algorithm>
 #include <array>
 #include <sstream>
 
@@ -35,10 +38,45 @@ Renderer::Renderer(const std::shared_ptr<DX::DeviceResources>& deviceResources,
 	m_Camera(camera),
 	m_cullingScissorRect(),
 	m_enableCulling(false),
-	m_HizBuffer(deviceResources)
+	m_enableImpostors(true),
+	m_regenerateInstances(false),
+	m_compressScene(false),
+	m_enableStreaming(true),
+	m_enableHotReload(true),
+	m_lazyTextures(true),
+	m_impostorDistance(400.0f),
+	m_HizBuffer(deviceResources),
+	m_TextureIO(1)
 {
 	//m_Loader.ReadOBJFiles(fileNames, _countof(fileNames), m_renderItems, m_DiffuseMaps, m_NormalMaps, m_Materials);
-	m_Loader.ReadBinFiles(m_renderItems, m_DiffuseMaps, m_NormalMaps, m_Materials);
+#if defined(_DEBUG)
+	//release builds trust the scene file, debug builds check every section the first time it's read (CI uses SceneVerify_Strict)
+	m_Loader.SetSceneVerifyMode(SceneVerify_Lazy);
+#endif
+	//the loaded tiles reach past the impostor distance, so the far vegetation is still drawn as impostors
+	m_WorldPartitionSettings.TileSize = 256.0f;
+	m_WorldPartitionSettings.LoadRadius = 3.0f * m_impostorDistance;
+	m_WorldPartitionSettings.UnloadRadius = 3.0f * m_impostorDistance + 256.0f;
+	m_WorldPartitionSettings.MemoryBudget = 256ull * 1024 * 1024;
+	//the generated models and their counts come from models\spawn.txt, if there is one, e.g. a scaled up table for a load test
+	SpawnTable spawnTable;
+	std::string spawnError;
+	if (spawnTable.Load("models\\spawn.txt", spawnError))
+		m_Scene.SetSpawnTable(spawnTable);
+	else if (!spawnError.empty())
+		OutputDebugStringA(("Spawn table: " + spawnError + ", the default table is used\n").c_str());
+	//the budgets of a production node, a category, which goes over its budget, is reported in the debug output
+	MemoryTracker& memory = MemoryTracker::Get();
+	memory.SetWarningFunction([](const std::string& warning) { OutputDebugStringA(warning.c_str()); });
+	memory.SetBudget(Memory_Geometry, 256ull * 1024 * 1024);
+	memory.SetBudget(Memory_Instances, 256ull * 1024 * 1024);
+	memory.SetBudget(Memory_GPUGeometry, 512ull * 1024 * 1024);
+	memory.SetBudget(Memory_GPUInstances, 512ull * 1024 * 1024);
+	memory.SetBudget(Memory_Uploaders, 128ull * 1024 * 1024);
+	memory.SetBudget(Memory_Textures, 1024ull * 1024 * 1024);
+	memory.SetBudget(Memory_Streaming, m_WorldPartitionSettings.MemoryBudget);
+	memory.SetTotalBudget(3072ull * 1024 * 1024);
+	m_SceneLoad = m_Loader.ReadBinFilesAsync(m_WorkerPool, m_renderItems, m_DiffuseMaps, m_NormalMaps, m_Materials);
 	m_cullingScissorRect.bottom = static_cast<LONG>(deviceResources->GetRenderTargetHeight());
 	m_cullingScissorRect.right = static_cast<LONG>(deviceResources->GetRenderTargetWidth());
 	CreateDeviceDependentResources();
@@ -47,34 +85,142 @@ Renderer::Renderer(const std::shared_ptr<DX::DeviceResources>& deviceResources,
 
 Renderer::~Renderer()
 {
-	
+	m_HotReload.Stop();
 	m_commandList->Close();
 	m_deviceResources->WaitForGpu();
+	//the render items and the geometry pool remove themselves, the rest are owned by the renderer
+	MemoryTracker& memory = MemoryTracker::Get();
+	for (auto& texture : m_DiffuseMaps)
+		memory.RemoveOwner(texture.second.get());
+	for (auto& normalMap : m_NormalMaps)
+		memory.RemoveOwner(normalMap.second.get());
+	for (auto& impostor : m_Impostors)
+		memory.RemoveOwner(impostor.second.get());
+	for (auto& frameResource : mFrameResources)
+		memory.RemoveOwner(frameResource.get());
+	memory.RemoveOwner(&m_indirectCommandData);
+	memory.RemoveOwner(&m_WorldPartition);
 }
 
+/// <summary>
+/// Creates the resources as a task graph. The device is free threaded, so the root signatures, the pipelines,
+/// the upload buffers, the instances and the HiZ buffer are created on the workers. The steps, which record the
+/// command list, and the waits for the scene load run on this thread.
+/// </summary>
 void Renderer::CreateDeviceDependentResources()
 {
-	CreateRootSignatures();
-	BuildPSOAndCommandLists();
-	LoadTextures();
-	
-	CreateCommandSignature();
-	BuildFrameResources();
-	
-	m_Scene.BuildInstanceData(m_renderItems);
-	m_Scene.SetOccluders(m_renderItems);
-	BuildRenderItems();	
-	BuildIndirectCommands();
-	BuildDescriptorHeaps();
-	InitializeHiZBuffer();
+	TaskGraph startup;
+	auto commandLists = startup.AddTask("Command lists", [this]() { CreateCommandLists(); }, {}, Task_MainThread);
+	auto materials = startup.AddTask("Wait for materials", [this]() { WaitForSceneLoad(m_SceneLoad.MaterialsReady); }, {}, Task_MainThread);
+	auto textures = startup.AddTask("Textures", [this]() { LoadTextures(); }, { commandLists, materials }, Task_MainThread);
+	auto renderItems = startup.AddTask("Wait for render items", [this]() {
+		WaitForSceneLoad(m_SceneLoad.RenderItemsReady);
+		ReportSceneLoadTimings();
+		m_renderItemsSize = (UINT)m_renderItems.size();
+		for (auto& renderItem : m_renderItems)
+			MemoryTracker::Get().SetOwnerName(renderItem.second.get(), renderItem.first);
+	}, {}, Task_MainThread);
+	auto hiZBuffer = startup.AddTask("HiZ buffer", [this]() { InitializeHiZBuffer(); });
+	//the texture tables of the root signature are sized by the materials file, the compute one uses the HiZ sampler
+	auto rootSignatures = startup.AddTask("Root signatures", [this]() { CreateRootSignatures(); }, { materials, hiZBuffer });
+	auto pipelineState = startup.AddTask("Pipeline state", [this]() { BuildPipelineState(); }, { rootSignatures });
+	auto impostorPipelineState = startup.AddTask("Impostor pipeline state", [this]() { BuildImpostorPipelineState(); }, { rootSignatures });
+	auto computePipelineState = startup.AddTask("Compute pipeline state", [this]() { BuildComputePipelineState(); }, { rootSignatures });
+	auto commandSignature = startup.AddTask("Command signatures", [this]() { CreateCommandSignature(); }, { rootSignatures });
+	auto frameResources = startup.AddTask("Frame resources", [this]() { BuildFrameResources(); }, { materials, renderItems });
+
+	//The instances are generated only if the scene file has no baked ones. The generated instances are baked
+	//in a pending scene file, which replaces the mapped one at the next start.
+	bool generateInstances = m_regenerateInstances || !m_Loader.HasBakedInstances();
+	auto instances = startup.AddTask("Instances", [this, generateInstances]() {
+		if (generateInstances) {
+			ProfileScope scope("Generate instances");
+			m_Scene.BuildInstanceData(m_renderItems, !m_Loader.IsTerrainScaled(), &m_WorkerPool);
+		}
+		ProfileScope scope("Occluders and bounds");
+		m_Scene.SetOccluders(m_renderItems);
+		//the bounding volumes are stored in the scene file or created by the asynchronous loader, old files get them here,
+		//before the buffers and the baked scene file read the render items
+		for (auto& renderItem : m_renderItems) {
+			if (!renderItem.second->HasBoundingVolumes())
+				renderItem.second->CreateBoundingVolumes();
+			renderItem.second->TrackMemory();
+		}
+	}, { renderItems });
+	//the file is only read at the next start, so the writing overlaps with the rest of the startup
+	TaskGraph::TaskId bakeScene = 0;
+	if (generateInstances) {
+		bakeScene = startup.AddTask("Bake scene file", [this]() {
+			std::string pendingScene = std::string("models\\scene.bin") + ScenePendingSuffix;
+			m_Loader.WriteBinRenderItems(m_renderItems, pendingScene.c_str(), true, m_compressScene);
+		}, { instances });
+	}
+	auto impostorAtlases = startup.AddTask("Impostor atlases", [this]() { BuildImpostorAtlases(); }, { instances });
+	auto impostors = startup.AddTask("Impostor textures", [this]() { BuildImpostors(); }, { commandLists, impostorAtlases }, Task_MainThread);
+	//the streamed instances are taken out of the render items, so the baked scene file must have them already. It waits
+	//for the first tiles on the workers, so it doesn't run on one of them.
+	auto worldPartition = startup.AddTask("World partition", [this]() { BuildWorldPartition(); }, { materials, instances }, Task_MainThread);
+	if (generateInstances)
+		startup.AddDependency(worldPartition, bakeScene);
+	auto buffers = startup.AddTask("Render item buffers", [this]() { BuildRenderItems(); }, { impostors, worldPartition }, Task_MainThread);
+	auto indirectCommands = startup.AddTask("Indirect commands", [this]() { BuildIndirectCommands(); }, { buffers }, Task_MainThread);
+	auto descriptorHeaps = startup.AddTask("Descriptor heaps", [this]() { BuildDescriptorHeaps(); }, { textures, indirectCommands }, Task_MainThread);
 	// Close the command list and execute it to begin the vertex buffer copy into
 	// the default heap.
-	ThrowIfFailed(m_commandList->Close());
-	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
-	m_deviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
-	m_deviceResources->WaitForGpu();
+	auto upload = startup.AddTask("Upload", [this]() {
+		ThrowIfFailed(m_commandList->Close());
+		ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+		m_deviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+		m_deviceResources->WaitForGpu();
+		//the pooled geometry was copied, the other upload buffers are reused
+		m_GeometryPool.DisposeUploader();
+	}, { descriptorHeaps, pipelineState, impostorPipelineState, computePipelineState, commandSignature, frameResources }, Task_MainThread);
+	if (generateInstances)
+		startup.AddDependency(upload, bakeScene);
+	startup.Run(m_WorkerPool);
+	OutputDebugStringA(startup.GetReport().c_str());
+	StartHotReload();
 	m_loadingComplete = true;
-	
+}
+
+/// <summary>
+/// Waits for a part of the asynchronous scene load and adds the time to the waiting time
+/// </summary>
+/// <param name="ready">The future of the part.</param>
+void Renderer::WaitForSceneLoad(std::shared_future<void>& ready)
+{
+	auto waitStart = std::chrono::steady_clock::now();
+	//get rethrows the exceptions of the load
+	ready.get();
+	m_SceneLoadWaitTime += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - waitStart).count();
+}
+
+/// <summary>
+/// Prints when the parts of the scene were ready and how much of the load was hidden behind the pipeline creation
+/// </summary>
+void Renderer::ReportSceneLoadTimings()
+{
+	SceneLoadTimings& timings = *m_SceneLoad.Timings;
+	double loadTime = DX::Max(timings.RenderItemsReady, timings.MaterialsReady);
+	std::ostringstream report;
+	report.precision(2);
+	report << std::fixed
+		<< "Scene load: " << timings.RenderItemCount << " render items ready at " << timings.RenderItemsReady << " ms ("
+		<< timings.ItemDecodeTime << " ms of decoding on " << timings.WorkerCount << " workers), materials ready at "
+		<< timings.MaterialsReady << " ms\n"
+		<< "Scene load: main thread waited " << m_SceneLoadWaitTime << " ms, "
+		<< DX::Max(0.0, loadTime - m_SceneLoadWaitTime) << " ms of the load overlapped with pipeline creation\n";
+	//the throughputs are per core - the times are summed over the workers
+	SceneStreamStats& streams = timings.Streams;
+	const double MB = 1024.0 * 1024.0;
+	if (streams.MappedBytes)
+		report << "Scene load: " << streams.MappedBytes / MB << " MB of mapped streams faulted in at "
+			<< streams.MappedBytes / DX::Max(streams.MappedTime, 0.001) / 1.0e6 << " GB/s\n";
+	if (streams.CompressedBytes)
+		report << "Scene load: " << streams.CompressedBytes / MB << " MB of compressed streams decompressed to "
+			<< streams.DecompressedBytes / MB << " MB (ratio " << (double)streams.DecompressedBytes / streams.CompressedBytes << ") at "
+			<< streams.DecompressedBytes / DX::Max(streams.DecompressTime, 0.001) / 1.0e6 << " GB/s\n";
+	OutputDebugStringA(report.str().c_str());
 }
 
 // Initializes view parameters when the window size changes.
@@ -103,7 +249,7 @@ void Renderer::CreateWindowSizeDependentResources()
 void Renderer::UpdateMaterialBuffer()
 {
 	auto currMaterialBuffer = mCurrFrameResource->MaterialBuffer.get();
-	for (std::unordered_map<std::string, std::unique_ptr<Material>>::iterator iter = m_Materials.begin(); iter != m_Materials.end(); iter++)
+	for (std::unordered_map<StringRef, std::unique_ptr<Material>>::iterator iter = m_Materials.begin(); iter != m_Materials.end(); iter++)
 	{
 		// Only update the cbuffer data if the constants have changed.  If the cbuffer
 		// data changes, it needs to be updated for each FrameResource.
@@ -127,6 +273,25 @@ void Renderer::UpdateMaterialBuffer()
 	}
 }
 
+/// <summary>
+/// Updates the table of the render item constants, in the order of the indirect commands
+/// </summary>
+void Renderer::UpdateItemBuffer()
+{
+	//the constants change only with a hot reload, then every frame resource gets the new table
+	if (m_itemsFramesDirty == 0)
+		return;
+	auto currItemBuffer = mCurrFrameResource->ItemBuffer.get();
+	int itemIndex = 0;
+	for (auto& renderItem : m_renderItems) {
+		ItemData itemData = {};
+		XMStoreFloat4x4(&itemData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItem.second->GetTexTransformMatrix())));
+		itemData.MaterialIndex = renderItem.second->GetMaterialIndex();
+		currItemBuffer->CopyData(itemIndex++, itemData);
+	}
+	m_itemsFramesDirty--;
+}
+
 /// <summary>
 /// Updates the scene constant buffer.
 /// </summary>
@@ -138,6 +303,7 @@ void Renderer::UpdateSceneCB()
 	//Store the matricies in upload buffers
 	XMStoreFloat4x4(&m_SceneBufferData.viewMatrix, XMMatrixTranspose(XMLoadFloat4x4(&view)));
 	XMStoreFloat4x4(&m_SceneBufferData.projectionMatrix, XMMatrixTranspose(XMLoadFloat4x4(&proj)));
+	m_SceneBufferData.eyePosW = m_Camera->GetMatrixOrigin();
 	m_SceneBufferData.ambientLight = { 0.25f, 0.25f, 0.35f, 1.0f };
 	//direction lights
 	m_SceneBufferData.Lights[0].Direction = { 0.57735f, -0.57735f, 0.57735f };
@@ -158,12 +324,19 @@ void Renderer::UpdateSceneCB()
 void Renderer::Update()
 {
 	if (m_loadingComplete) {
+		//the reimported items are swapped in before anything of this frame is recorded
+		ApplyHotReload();
+		RequestVisibleTextures();
 		// Cycle through the circular frame resource array.
 		mCurrFrameResourceIndex = (mCurrFrameResourceIndex + 1) % DX::c_frameCount;
 		mCurrFrameResource = mFrameResources[mCurrFrameResourceIndex].get();
 
 		UpdateSceneCB();
 		UpdateMaterialBuffer();
+		UpdateItemBuffer();
+		//the loads, which finished since the last frame, are copied to the mirrors here and patched in PopulateCommandLists
+		if (!m_streamedItems.empty())
+			m_WorldPartition.Update(&m_Camera->GetMatrixOrigin().x, m_WorkerPool);
 	}
 }
 
@@ -176,6 +349,23 @@ void Renderer::ChangeCulling()
 	m_justChangedCulling = true;
 }
 
+/// <summary>
+/// Enables and disables the CPU triangle pre-culling of the occluders
+/// </summary>
+void Renderer::ChangeTrianglePreCulling()
+{
+	m_HizBuffer.ChangeTrianglePreCulling();
+}
+
+/// <summary>
+/// Enables and disables drawing the far vegetation as impostors (works together with the culling, as the 
+/// compute shader is the one that separates the far instances)
+/// </summary>
+void Renderer::ChangeImpostors()
+{
+	m_enableImpostors = !m_enableImpostors;
+}
+
 
 /// <summary>
 /// Renders one frame from the scene.
@@ -191,8 +381,11 @@ bool Renderer::Render()
 		// Record all the commands we need to render the scene into the command lists.
 		PopulateCommandLists();
 		// Execute the compute work.
-		if (m_enableCulling)
+		if (m_enableCulling || m_patchesRecorded)
 		{
+			// The patches overwrite the instance buffers, which the previous frame may still draw.
+			if (m_patchesRecorded)
+				m_deviceResources->GetComputeCommandQueue()->Wait(m_deviceResources->GetFence(), m_deviceResources->GetFenceValue() - 1);
  			PIXBeginEvent(m_deviceResources->GetCommandQueue(), 0, L"Cull invisible triangles");
 
 			ID3D12CommandList* ppComputeCommandLists[] = { m_computeCommandList.Get() };
@@ -250,7 +443,17 @@ void Renderer::BuildFrameResources()
 	for (int i = 0; i < DX::c_frameCount; ++i)
 	{
 		mFrameResources.push_back(std::make_unique<FrameResources>(d3Device,
-			1, (UINT)m_renderItems.size(), (UINT)m_Materials.size()));
+			1, m_renderItemsSize, (UINT)m_Materials.size()));
+		mFrameResources.back()->ItemBuffer = std::make_unique<UploadBuffer<ItemData>>(d3Device, DX::Max(m_renderItemsSize, 1u), false);
+		if (m_enableStreaming)
+			mFrameResources.back()->InstancePatches = std::make_unique<UploadBuffer<InstanceData>>(d3Device, m_WorldPartitionSettings.MaxPatchInstances, false);
+		FrameResources* frameResource = mFrameResources.back().get();
+		UINT64 bytes = DX::GetResourceSize(frameResource->SceneCB->Resource()) + DX::GetResourceSize(frameResource->ModelCB->Resource()) +
+			DX::GetResourceSize(frameResource->MaterialBuffer->Resource()) + DX::GetResourceSize(frameResource->ItemBuffer->Resource());
+		if (frameResource->InstancePatches)
+			bytes += DX::GetResourceSize(frameResource->InstancePatches->Resource());
+		MemoryTracker::Get().SetOwnerName(frameResource, "Frame resources " + std::to_string(i));
+		MemoryTracker::Get().Set(Memory_FrameResources, bytes, frameResource);
 	}
 
 }
@@ -268,10 +471,16 @@ void Renderer::PopulateCommandLists()
 		//Reset the graphics and compute command lists with their pipeline states
 		ThrowIfFailed(m_computeCommandList->Reset(m_deviceResources->GetComputeCommandAllocator(), m_computePipelineState.Get()));
 		ThrowIfFailed(m_commandList->Reset(m_deviceResources->GetCommandAllocator(), m_pipelineState.Get()));
+		//The streamed instances are patched before the culling reads them
+		RecordInstancePatches();
+		//The textures, which were read since the last frame, are uploaded before anything is drawn
+		UpdateLazyTextures(currentFrameIndex);
 
 		// Record the compute commands that will cull instances and prevent them from being processed by the graphics pipeline.
 		if (m_enableCulling)
 		{ 
+			//Remove the occluder triangles, that can't write depth from this camera
+			m_HizBuffer.CullOccluderTriangles(m_Camera->GetViewMatrix(), m_Camera->GetProjectionMatrix());
 			//Render the occluders in the HiZ buffer and generate mip maps of the rendered occluders
 			m_HizBuffer.RenderOccluders( mCurrFrameResource, m_occluderIndirectCommandData.size());
 			m_HizBuffer.RenderMIPMap();
@@ -298,7 +507,7 @@ void Renderer::PopulateCommandLists()
 					continue; 
 				//Set the instance data descriptor table using the instance data heap with the necessary offset
 				m_computeCommandList->SetComputeRootDescriptorTable(Compute_InstanceDataTable, 
-					CD3DX12_GPU_DESCRIPTOR_HANDLE(m_InstanceDataHeap->GetGPUDescriptorHandleForHeapStart(), 2*i, m_SrvCbvUavDescriptorSize));
+					CD3DX12_GPU_DESCRIPTOR_HANDLE(m_InstanceDataHeap->GetGPUDescriptorHandleForHeapStart(), 3*i, m_SrvCbvUavDescriptorSize));
 				//Set the processed instance UAV buffer state to "copy destination"
 				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(iter->second->GetProcessedInstanceBufferGPU().Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
 				m_computeCommandList->ResourceBarrier(1, &barrier);
@@ -307,13 +516,29 @@ void Renderer::PopulateCommandLists()
 				//Set the processed instance UAV buffer state to unordered access which will allow the compute shader to add the approved instance data
 				barrier = CD3DX12_RESOURCE_BARRIER::Transition(iter->second->GetProcessedInstanceBufferGPU().Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
 				m_computeCommandList->ResourceBarrier(1, &barrier);
+				//Reset the impostor UAV counter the same way
+				if (iter->second->hasImpostor()) {
+					barrier = CD3DX12_RESOURCE_BARRIER::Transition(iter->second->GetImpostorInstanceBufferGPU().Get(), D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COPY_DEST);
+					m_computeCommandList->ResourceBarrier(1, &barrier);
+					m_computeCommandList->CopyBufferRegion(iter->second->GetImpostorInstanceBufferGPU().Get(), iter->second->GetInstanceBufferCounterOffset(), m_processedInstancesCounterReset->Resource(), 0, sizeof(UINT));
+					barrier = CD3DX12_RESOURCE_BARRIER::Transition(iter->second->GetImpostorInstanceBufferGPU().Get(), D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+					m_computeCommandList->ResourceBarrier(1, &barrier);
+				}
 				//Set the compute shader constants 
 				ComputeShaderConstants csConstants;
 				csConstants.instanceCount = iter->second->GetInstanceCount();
 				csConstants.boundingBoxCenter = iter->second->GetBoundingBoxData().Center;
 				csConstants.boundingBoxExtents = iter->second->GetBoundingBoxData().Extents;
+				//the tighter volumes - the corners of the oriented box are culled and the sphere is tested first
+				csConstants.orientedBoxCenter = iter->second->GetOrientedBoxData().Center;
+				csConstants.orientedBoxExtents = iter->second->GetOrientedBoxData().Extents;
+				csConstants.orientedBoxOrientation = iter->second->GetOrientedBoxData().Orientation;
+				csConstants.boundingSphereCenter = iter->second->GetBoundingSphereData().Center;
+				csConstants.boundingSphereRadius = iter->second->GetBoundingSphereData().Radius;
+				//Items without impostor never append to the impostor buffer
+				csConstants.impostorDistance = (m_enableImpostors && iter->second->hasImpostor()) ? m_impostorDistance : FLT_MAX;
 				
-				m_computeCommandList->SetComputeRoot32BitConstants(Compute_Constants, 7, reinterpret_cast<void*>(&csConstants), 0);
+				m_computeCommandList->SetComputeRoot32BitConstants(Compute_Constants, sizeof(ComputeShaderConstants) / sizeof(UINT), reinterpret_cast<void*>(&csConstants), 0);
 				//Start the compute shader execution with thread block count equal to instance count divided by thread count per block
 				m_computeCommandList->Dispatch(static_cast<UINT>(ceil(iter->second->GetInstanceCount() / float(ComputeThreadBlockSize))), 1, 1);
 			}
@@ -340,8 +565,11 @@ void Renderer::PopulateCommandLists()
 			m_commandList->SetGraphicsRootConstantBufferView(Graphics_SceneCBV, mCurrFrameResource->SceneCB->Resource()->GetGPUVirtualAddress());
 			//Set the material SRV (as it is structured buffer in the shader we can do it without using heap)
 			m_commandList->SetGraphicsRootShaderResourceView(Graphics_MaterialsSRV, mCurrFrameResource->MaterialBuffer->Resource()->GetGPUVirtualAddress());
-			//Set the texture descriptor table using the texture SRV descriptor heap 
-			m_commandList->SetGraphicsRootDescriptorTable(Graphics_TextureTable, m_srvTextureHeap->GetGPUDescriptorHandleForHeapStart());
+			//the render item table, the indirect commands set the index of their item
+			m_commandList->SetGraphicsRootShaderResourceView(Graphics_ItemsSRV, mCurrFrameResource->ItemBuffer->Resource()->GetGPUVirtualAddress());
+			//Set the texture descriptor table using this frame's copy of the table in the texture SRV descriptor heap
+			m_commandList->SetGraphicsRootDescriptorTable(Graphics_TextureTable,
+				CD3DX12_GPU_DESCRIPTOR_HANDLE(m_srvTextureHeap->GetGPUDescriptorHandleForHeapStart(), currentFrameIndex * m_textureDescriptorCount, m_SrvCbvUavDescriptorSize));
 			//Calculate the byte offset of the instance count member of the indirect command structure
 			IndirectCommand c;
 			UINT commandOffset = (char*)&c.drawArguments.InstanceCount - (char*)&c;
@@ -432,6 +660,62 @@ void Renderer::PopulateCommandLists()
 				nullptr,
 				0);
 			PIXEndEvent(m_commandList.Get());
+			//Draw the far vegetation instances, separated by the compute shader, as impostor quads
+			if (m_enableCulling && m_enableImpostors && !m_impostorIndirectCommandData.empty()) {
+				ImpostorIndirectCommand ic;
+				UINT impostorCommandOffset = (char*)&ic.drawArguments.InstanceCount - (char*)&ic;
+				D3D12_RESOURCE_BARRIER barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+					ImpostorCommandBuffer.Get(),
+					D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+					D3D12_RESOURCE_STATE_COPY_DEST);
+				m_commandList->ResourceBarrier(1, &barrier);
+				//Copy the impostor UAV counters in the instance count field of the impostor commands
+				for (UINT i = 0; i < m_impostorItems.size(); i++) {
+					barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+						m_impostorItems[i]->GetImpostorInstanceBufferGPU().Get(),
+						D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
+						D3D12_RESOURCE_STATE_COPY_SOURCE);
+					m_commandList->ResourceBarrier(1, &barrier);
+					m_commandList->CopyBufferRegion(ImpostorCommandBuffer.Get(), i*sizeof(ImpostorIndirectCommand) + impostorCommandOffset,
+						m_impostorItems[i]->GetImpostorInstanceBufferGPU().Get(), m_impostorItems[i]->GetInstanceBufferCounterOffset(), sizeof(UINT));
+					barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+						m_impostorItems[i]->GetImpostorInstanceBufferGPU().Get(),
+						D3D12_RESOURCE_STATE_COPY_SOURCE,
+						D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+					m_commandList->ResourceBarrier(1, &barrier);
+				}
+				barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+					ImpostorCommandBuffer.Get(),
+					D3D12_RESOURCE_STATE_COPY_DEST,
+					D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+				m_commandList->ResourceBarrier(1, &barrier);
+
+				m_commandList->SetPipelineState(m_impostorPipelineState.Get());
+				PIXBeginEvent(m_commandList.Get(), 0, L"Draw impostors");
+				m_commandList->ExecuteIndirect(
+					m_impostorCommandSignature.Get(),
+					m_impostorIndirectCommandData.size(),
+					ImpostorCommandBuffer.Get(),
+					0,
+					nullptr,
+					0);
+				PIXEndEvent(m_commandList.Get());
+				//Copy the impostor instance counts after the main counts, an item drawn only as impostors needs its textures too
+				barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+					ImpostorCommandBuffer.Get(),
+					D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT,
+					D3D12_RESOURCE_STATE_COPY_SOURCE);
+				m_commandList->ResourceBarrier(1, &barrier);
+				for (UINT i = 0; i < m_impostorIndirectCommandData.size(); i++) {
+					m_commandList->CopyBufferRegion(DrawnInstancesReadbackBuffer.Get(), (m_indirectCommandData.size() + i) * sizeof(UINT),
+						ImpostorCommandBuffer.Get(), i*sizeof(ImpostorIndirectCommand) + impostorCommandOffset, sizeof(UINT));
+				}
+				barrier = CD3DX12_RESOURCE_BARRIER::Transition(
+					ImpostorCommandBuffer.Get(),
+					D3D12_RESOURCE_STATE_COPY_SOURCE,
+					D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT);
+				m_commandList->ResourceBarrier(1, &barrier);
+			}
 			//Change the render target state back to presenting 
 			barriers[0].Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
 			barriers[0].Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
@@ -456,7 +740,11 @@ void Renderer::PopulateCommandLists()
 
 void Renderer::InitializeHiZBuffer()
 {
-	m_HizBuffer.InitMIPMap();
+	{
+		ProfileScope scope("MIP map chain");
+		m_HizBuffer.InitMIPMap();
+	}
+	ProfileScope scope("Depth pass");
 	m_HizBuffer.InitDepth();
 }
 
@@ -471,22 +759,33 @@ void Renderer::BuildIndirectCommands() {
 		//Every drawing command consists of vertex buffer view, index buffer view, shader resource view
 		//and the arguments for the DrawIndexedInstanced call
 		IndirectCommand command;
-		command.drawArguments.BaseVertexLocation = 0;
+		command.drawArguments.BaseVertexLocation = iter->second->GetBaseVertexLocation();
 		command.drawArguments.IndexCountPerInstance = iter->second->GetIndexCount();
 		command.drawArguments.InstanceCount = iter->second->GetInstanceCount();
-		command.drawArguments.StartIndexLocation = 0;
+		command.drawArguments.StartIndexLocation = iter->second->GetStartIndexLocation();
 		command.drawArguments.StartInstanceLocation = 0;
 
-		command.vertexBufferView = iter->second->VertexBufferView();
+		command.positionBufferView = iter->second->PositionBufferView();
+		command.attributeBufferView = iter->second->AttributeBufferView();
 		command.indexBufferView = iter->second->IndexBufferView();
 		command.instancesShaderView = iter->second->GetInstanceBufferGPU()->GetGPUVirtualAddress();
+		command.itemIndex = (UINT)m_indirectCommandData.size();
 
 		//push back the command in the vector
 		m_indirectCommandData.push_back(command);
-		//if the item is occluder, than push it in the occluder's commands also
-		if (iter->second->isOccluder())
-			m_occluderIndirectCommandData.push_back(command);
+		//if the item is occluder, than push it in the occluder's commands also - they need only the positions
+		if (iter->second->isOccluder()) {
+			OccluderIndirectCommand occluderCommand;
+			occluderCommand.positionBufferView = command.positionBufferView;
+			occluderCommand.indexBufferView = command.indexBufferView;
+			occluderCommand.instancesShaderView = command.instancesShaderView;
+			occluderCommand.drawArguments = command.drawArguments;
+			m_occluderIndirectCommandData.push_back(occluderCommand);
+			m_potentialOccluders.push_back(iter->second.get());
+		}
 	}
+	//The HiZ buffer draws the pre-culled occluder triangles from its own per frame buffers
+	m_HizBuffer.SetOccluders(m_potentialOccluders);
 	//Create GPU resource - command buffer
 	DX::CreateDefaultBuffer(d3Device, m_commandList.Get(), m_indirectCommandData.data(),
 		m_indirectCommandData.size()*sizeof(IndirectCommand), CommandBufferUploader, CommandBuffer);
@@ -495,11 +794,47 @@ void Renderer::BuildIndirectCommands() {
 	ComPtr<ID3D12Resource>& OccluderCommandBuffer = m_HizBuffer.GetOccluderCommandBuffer();
 	ComPtr<ID3D12Resource>& OccluderCommandBufferUploader = m_HizBuffer.GetOccluderCommandBufferUploader();
 
-	DX::CreateDefaultBuffer(d3Device, m_commandList.Get(), m_occluderIndirectCommandData.data(), m_occluderIndirectCommandData.size()*sizeof(IndirectCommand),
+	DX::CreateDefaultBuffer(d3Device, m_commandList.Get(), m_occluderIndirectCommandData.data(), m_occluderIndirectCommandData.size()*sizeof(OccluderIndirectCommand),
 		OccluderCommandBuffer, OccluderCommandBufferUploader);
 
 	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CommandBuffer.Get(),
 		D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT));
+
+	//Every render item with impostor gets an impostor command - draw a quad for each far instance
+	UINT itemIndex = 0;
+	for (auto& renderItem : m_renderItems) {
+		RenderItem* ri = renderItem.second.get();
+		if (!ri->hasImpostor()) {
+			itemIndex++;
+			continue;
+		}
+		ImpostorAtlas* atlas = m_Impostors[renderItem.first].get();
+		ImpostorIndirectCommand command;
+		command.instancesShaderView = ri->GetImpostorInstanceBufferGPU()->GetGPUVirtualAddress();
+		command.constants.center = atlas->Center;
+		command.constants.radius = atlas->Radius;
+		command.constants.atlasIndex = atlas->index;
+		command.constants.viewCount = atlas->ViewCount;
+		command.constants.itemIndex = itemIndex++;
+		command.constants.ImpostorPad0 = 0;
+		command.drawArguments.VertexCountPerInstance = 6;
+		command.drawArguments.InstanceCount = 0;		//filled with the UAV counter every frame
+		command.drawArguments.StartVertexLocation = 0;
+		command.drawArguments.StartInstanceLocation = 0;
+		m_impostorIndirectCommandData.push_back(command);
+		m_impostorItems.push_back(ri);
+	}
+	if (!m_impostorIndirectCommandData.empty()) {
+		DX::CreateDefaultBuffer(d3Device, m_commandList.Get(), m_impostorIndirectCommandData.data(),
+			m_impostorIndirectCommandData.size()*sizeof(ImpostorIndirectCommand), ImpostorCommandBufferUploader, ImpostorCommandBuffer);
+		ImpostorCommandBuffer->SetName(L"Impostor Command Buffer");
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(ImpostorCommandBuffer.Get(),
+			D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT));
+	}
+	//the uploaders are kept, the command buffer is uploaded again when the culling is switched
+	MemoryTracker::Get().SetOwnerName(&m_indirectCommandData, "Indirect commands");
+	MemoryTracker::Get().Set(Memory_Uploaders, DX::GetResourceSize(CommandBufferUploader.Get()) + DX::GetResourceSize(OccluderCommandBuffer.Get()) +
+		DX::GetResourceSize(OccluderCommandBufferUploader.Get()) + DX::GetResourceSize(ImpostorCommandBufferUploader.Get()), &m_indirectCommandData);
 }
 
 /// <summary>
@@ -530,32 +865,682 @@ void Renderer::UpdateIndirectCommands()
 }
 
 /// <summary>
-/// Loads the diffuse and normal maps.
+/// Loads the diffuse and normal maps. With lazy textures only the placeholders are created, the maps are loaded
+/// when they are drawn for the first time.
 /// </summary>
 void Renderer::LoadTextures() {
 	auto d3Device = m_deviceResources->GetD3DDevice();
-	std::string texturePath;
+	if (m_lazyTextures) {
+		//a mid grey diffuse map and a flat normal map (R8G8B8A8, red in the low byte)
+		CreatePlaceholderTexture(0xFF808080, m_placeholderTextures[0], m_placeholderUploaders[0]);
+		CreatePlaceholderTexture(0xFFFF8080, m_placeholderTextures[1], m_placeholderUploaders[1]);
+		return;
+	}
 	for (auto& texture : m_DiffuseMaps) {
-		texturePath = texture.second->Filename;
+		StringRef texturePath = texture.second->Filename;
 		ThrowIfFailed(CreateDDSTextureFromFile12(d3Device, m_commandList.Get(), std::wstring(texturePath.begin(), texturePath.end()).c_str(),
 													texture.second->Resource, texture.second->UploadHeap));
 		//Change the state to add the non pixel shader resource state
 		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.second->Resource.Get(),
 			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
-		
+		TrackTextureMemory(texture.second.get());
 	}
 	for (auto& normalMap : m_NormalMaps) {
-		texturePath = normalMap.second->Filename;
+		StringRef texturePath = normalMap.second->Filename;
 		ThrowIfFailed(CreateDDSTextureFromFile12(d3Device, m_commandList.Get(), std::wstring(texturePath.begin(), texturePath.end()).c_str(),
 			normalMap.second->Resource, normalMap.second->UploadHeap));
 		//Change the state to add the non pixel shader resource state
 		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(normalMap.second->Resource.Get(),
 			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
-
+		TrackTextureMemory(normalMap.second.get());
 	}
 	
 }
 
+/// <summary>
+/// Reports the resource and the upload heap of a diffuse or normal map to the memory tracker
+/// </summary>
+void Renderer::TrackTextureMemory(Texture* texture)
+{
+	MemoryTracker& memory = MemoryTracker::Get();
+	memory.SetOwnerName(texture, texture->Filename.str());
+	memory.Set(Memory_Textures, DX::GetResourceSize(texture->Resource.Get()), texture);
+	memory.Set(Memory_Uploaders, DX::GetResourceSize(texture->UploadHeap.Get()), texture);
+}
+
+/// <summary>
+/// Creates a 1x1 texture, which is bound instead of the textures, which aren't loaded yet
+/// </summary>
+/// <param name="color">The texel.</param>
+/// <param name="texture">The texture.</param>
+/// <param name="uploadHeap">The upload heap, must live until the command list is executed.</param>
+void Renderer::CreatePlaceholderTexture(UINT color, ComPtr<ID3D12Resource>& texture, ComPtr<ID3D12Resource>& uploadHeap)
+{
+	auto d3Device = m_deviceResources->GetD3DDevice();
+	ThrowIfFailed(d3Device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Tex2D(DXGI_FORMAT_R8G8B8A8_UNORM, 1, 1, 1, 1),
+		D3D12_RESOURCE_STATE_COPY_DEST,
+		nullptr,
+		IID_PPV_ARGS(&texture)));
+	texture->SetName(L"Placeholder Texture");
+	ThrowIfFailed(d3Device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(GetRequiredIntermediateSize(texture.Get(), 0, 1)),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&uploadHeap)));
+	D3D12_SUBRESOURCE_DATA texel = {};
+	texel.pData = &color;
+	texel.RowPitch = sizeof(UINT);
+	texel.SlicePitch = sizeof(UINT);
+	UpdateSubresources<1>(m_commandList.Get(), texture.Get(), uploadHeap.Get(), 0, 0, 1, &texel);
+	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+}
+
+/// <summary>
+/// Numbers the diffuse and normal maps like the texture table and finds the texture slots of every indirect command
+/// </summary>
+void Renderer::BuildTextureSlots()
+{
+	UINT diffuseCount = (UINT)m_DiffuseMaps.size();
+	m_textureSlots.assign(m_DiffuseMaps.size() + m_NormalMaps.size(), nullptr);
+	for (auto& texture : m_DiffuseMaps) {
+		if (texture.second->index < diffuseCount)
+			m_textureSlots[texture.second->index] = texture.second.get();
+	}
+	for (auto& normalMap : m_NormalMaps) {
+		if (diffuseCount + normalMap.second->index < m_textureSlots.size())
+			m_textureSlots[diffuseCount + normalMap.second->index] = normalMap.second.get();
+	}
+	m_textureStates.assign(m_textureSlots.size(), Texture_Unloaded);
+	for (UINT slot = 0; slot < m_textureSlots.size(); slot++) {
+		if (!m_textureSlots[slot])
+			m_textureStates[slot] = Texture_Failed;
+		else if (m_textureSlots[slot]->Resource)
+			m_textureStates[slot] = Texture_Resident;
+	}
+
+	std::unordered_map<int, Material*> materials;
+	for (auto& material : m_Materials)
+		materials[material.second->MatCBIndex] = material.second.get();
+	m_commandTextures.clear();
+	for (auto& renderItem : m_renderItems) {
+		std::vector<UINT> slots;
+		auto material = materials.find((int)renderItem.second->GetMaterialIndex());
+		if (material != materials.end()) {
+			if (material->second->data.DiffuseMapIndex < diffuseCount)
+				slots.push_back(material->second->data.DiffuseMapIndex);
+			if (diffuseCount + material->second->data.NormalMapIndex < m_textureSlots.size())
+				slots.push_back(diffuseCount + material->second->data.NormalMapIndex);
+		}
+		m_commandTextures.push_back(slots);
+	}
+}
+
+/// <summary>
+/// Queues the textures of the items, which were drawn, on the I/O thread. The drawn instance counts are the ones
+/// the culling wrote to the command buffer and the impostor command buffer, so an item is found a frame or two after
+/// it becomes visible - also if all of its visible instances are impostors, which sample its diffuse map.
+/// </summary>
+void Renderer::RequestVisibleTextures()
+{
+	if (!m_lazyTextures)
+		return;
+	UINT* drawnCounts = nullptr;
+	UINT commandCount = (UINT)m_indirectCommandData.size();
+	CD3DX12_RANGE range(0, (commandCount + m_impostorIndirectCommandData.size()) * sizeof(UINT));
+	ThrowIfFailed(DrawnInstancesReadbackBuffer->Map(0, &range, reinterpret_cast<void**>(&drawnCounts)));
+	//the impostor commands are added to the counts of their items' commands
+	std::vector<UINT> visibleCounts(drawnCounts, drawnCounts + commandCount);
+	if (m_enableCulling && m_enableImpostors) {
+		for (UINT i = 0; i < m_impostorIndirectCommandData.size(); i++)
+			visibleCounts[m_impostorIndirectCommandData[i].constants.itemIndex] += drawnCounts[commandCount + i];
+	}
+	for (UINT i = 0; i < m_commandTextures.size(); i++) {
+		if (visibleCounts[i] == 0)
+			continue;
+		for (UINT slot : m_commandTextures[i]) {
+			if (m_textureStates[slot] != Texture_Unloaded)
+				continue;
+			m_textureStates[slot] = Texture_Loading;
+			StringRef texturePath = m_textureSlots[slot]->Filename;
+			std::wstring fileName(texturePath.begin(), texturePath.end());
+			m_textureLoads.push_back(std::make_pair(slot, m_TextureIO.Submit([fileName]() {
+				std::vector<byte> data;
+				DX::ReadDataFromFile(fileName.c_str(), data);
+				return data;
+			})));
+		}
+	}
+	DrawnInstancesReadbackBuffer->Unmap(0, nullptr);
+}
+
+/// <summary>
+/// Creates the textures, whose files were read since the last frame, and records their upload at the start of the
+/// graphics command list. Every frame has its own copy of the texture table, so a changed SRV is written to the copy
+/// of the frame being recorded and the copies of the frames in flight are updated when their frame comes again.
+/// </summary>
+/// <param name="frame">The index of the frame being recorded.</param>
+void Renderer::UpdateLazyTextures(UINT frame)
+{
+	for (size_t i = 0; i < m_textureLoads.size();) {
+		if (m_textureLoads[i].second.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			i++;
+			continue;
+		}
+		UINT slot = m_textureLoads[i].first;
+		Texture* texture = m_textureSlots[slot];
+		std::vector<byte> data;
+		try {
+			data = m_textureLoads[i].second.get();
+		}
+		catch (...) {
+		}
+		m_textureLoads.erase(m_textureLoads.begin() + i);
+		ComPtr<ID3D12Resource> resource;
+		ComPtr<ID3D12Resource> uploadHeap;
+		if (data.empty() || FAILED(CreateDDSTextureFromMemory12(m_deviceResources->GetD3DDevice(), m_commandList.Get(),
+			data.data(), data.size(), resource, uploadHeap))) {
+			OutputDebugStringA(("Failed to load " + texture->Filename.str() + ", the placeholder stays\n").c_str());
+			m_textureStates[slot] = Texture_Failed;
+			continue;
+		}
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(),
+			D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+		texture->Resource = resource;
+		texture->UploadHeap = uploadHeap;
+		TrackTextureMemory(texture);
+		m_textureStates[slot] = Texture_Resident;
+		m_dirtyTextureDescriptors.push_back({ slot, DX::c_frameCount });
+	}
+	for (size_t i = 0; i < m_dirtyTextureDescriptors.size();) {
+		DirtyTextureDescriptor& dirty = m_dirtyTextureDescriptors[i];
+		CreateTextureSRV(m_textureSlots[dirty.Slot], dirty.Slot, (int)frame);
+		if (--dirty.NumFramesDirty == 0)
+			m_dirtyTextureDescriptors.erase(m_dirtyTextureDescriptors.begin() + i);
+		else
+			i++;
+	}
+}
+
+/// <summary>
+/// Loads the impostor atlases of the vegetation, the atlases which were never baked or whose mesh changed since
+/// they were baked are baked again. Runs on a worker.
+/// </summary>
+void Renderer::BuildImpostorAtlases()
+{
+	std::vector<std::string>& impostorNames = m_Scene.GetImpostorModelNames();
+	//Baking needs the CPU vertex data, so it is done once and saved next to the scene
+	m_ImpostorBaker.ReadBinImpostors(m_Impostors, "models\\impostors.bin");
+	bool baked = false;
+	for (auto& name : impostorNames) {
+		auto renderItem = m_renderItems.find(name);
+		if (renderItem == m_renderItems.end())
+			continue;
+		auto impostor = m_Impostors.find(name);
+		if (impostor != m_Impostors.end() && impostor->second->SourceHash == ImpostorBaker::HashSource(renderItem->second.get()))
+			continue;
+		m_Impostors[name] = m_ImpostorBaker.Bake(name, renderItem->second.get());
+		baked = true;
+	}
+	if (baked)
+		m_ImpostorBaker.WriteBinImpostors(m_Impostors, "models\\impostors.bin");
+}
+
+/// <summary>
+/// Creates the textures of the impostor atlases.
+/// </summary>
+void Renderer::BuildImpostors()
+{
+	auto d3Device = m_deviceResources->GetD3DDevice();
+	std::vector<std::string>& impostorNames = m_Scene.GetImpostorModelNames();
+	UINT atlasIndex = 0;
+	for (auto& name : impostorNames) {
+		auto renderItem = m_renderItems.find(name);
+		if (m_Impostors.find(name) == m_Impostors.end() || renderItem == m_renderItems.end())
+			continue;
+		//The texture table has place for a limited number of impostors
+		if (atlasIndex == MaxImpostors)
+			break;
+		ImpostorAtlas* atlas = m_Impostors[name].get();
+		atlas->index = atlasIndex++;
+		renderItem->second->SetImpostorIndex(atlas->index);
+
+		DX::CreateDefaultTexture2D(d3Device, m_commandList.Get(), atlas->TexCoords.data(), atlas->GetWidth(), atlas->GetHeight(),
+			DXGI_FORMAT_R16G16_UNORM, sizeof(UINT), atlas->UploadHeap[Impostor_TexCoordAtlas], atlas->Resource[Impostor_TexCoordAtlas]);
+		DX::CreateDefaultTexture2D(d3Device, m_commandList.Get(), atlas->Normals.data(), atlas->GetWidth(), atlas->GetHeight(),
+			DXGI_FORMAT_R8G8B8A8_UNORM, sizeof(UINT), atlas->UploadHeap[Impostor_NormalAtlas], atlas->Resource[Impostor_NormalAtlas]);
+		DX::CreateDefaultTexture2D(d3Device, m_commandList.Get(), atlas->Depths.data(), atlas->GetWidth(), atlas->GetHeight(),
+			DXGI_FORMAT_R32_FLOAT, sizeof(float), atlas->UploadHeap[Impostor_DepthAtlas], atlas->Resource[Impostor_DepthAtlas]);
+		UINT64 textureBytes = 0;
+		UINT64 uploadBytes = 0;
+		for (UINT i = 0; i < Impostor_AtlasCount; i++) {
+			textureBytes += DX::GetResourceSize(atlas->Resource[i].Get());
+			uploadBytes += DX::GetResourceSize(atlas->UploadHeap[i].Get());
+		}
+		MemoryTracker::Get().SetOwnerName(atlas, "Impostor " + name);
+		MemoryTracker::Get().Set(Memory_Textures, textureBytes, atlas);
+		MemoryTracker::Get().Set(Memory_Uploaders, uploadBytes, atlas);
+	}
+}
+
+/// <summary>
+/// Helper function - the size of a texture file, the memory of the texture is about the same
+/// </summary>
+static uint64_t GetTextureFileSize(StringRef fileName)
+{
+	WIN32_FILE_ATTRIBUTE_DATA attributes;
+	if (!GetFileAttributesExA(std::string(fileName.begin(), fileName.end()).c_str(), GetFileExInfoStandard, &attributes))
+		return 0;
+	return ((uint64_t)attributes.nFileSizeHigh << 32) | attributes.nFileSizeLow;
+}
+
+/// <summary>
+/// Splits the instances of the small, instanced render items in world tiles. Their instance buffers become the mirrors
+/// of the partition - a slot without a resident instance is zeroed and the compute shader skips it. The tiles around the
+/// camera are loaded before the buffers are created. The occluders and the items bigger than a tile stay resident.
+/// </summary>
+void Renderer::BuildWorldPartition()
+{
+	if (!m_enableStreaming)
+		return;
+	//the textures of the partition are the diffuse maps, followed by the normal maps
+	UINT diffuseCount = (UINT)m_DiffuseMaps.size();
+	std::vector<uint64_t> textureBytes(m_DiffuseMaps.size() + m_NormalMaps.size(), 0);
+	for (auto& texture : m_DiffuseMaps) {
+		if (texture.second->index < diffuseCount)
+			textureBytes[texture.second->index] = GetTextureFileSize(texture.second->Filename);
+	}
+	for (auto& normalMap : m_NormalMaps) {
+		if (diffuseCount + normalMap.second->index < textureBytes.size())
+			textureBytes[diffuseCount + normalMap.second->index] = GetTextureFileSize(normalMap.second->Filename);
+	}
+
+	std::vector<PartitionItem> items;
+	for (auto& renderItem : m_renderItems) {
+		RenderItem* ri = renderItem.second.get();
+		if (ri->isOccluder() || ri->GetInstanceCount() < 2)
+			continue;
+		//the largest instance decides, an empty slot has scale 0
+		float maxScale = 0.0f;
+		for (auto& instance : ri->GetInstances())
+			maxScale = DX::Max(maxScale, instance.Scale);
+		float radius = ri->GetBoundingSphereData().Radius * maxScale;
+		if (2.0f * radius > m_WorldPartitionSettings.TileSize)
+			continue;
+		PartitionItem item;
+		item.GeometryBytes = (uint64_t)ri->GetVertexCount() * (sizeof(XMFLOAT3) + sizeof(VertexAttributes)) + (uint64_t)ri->GetIndexCount() * sizeof(UINT);
+		for (auto& material : m_Materials) {
+			if (material.second->MatCBIndex != (int)ri->GetMaterialIndex())
+				continue;
+			if (material.second->data.DiffuseMapIndex < diffuseCount)
+				item.Textures.push_back(material.second->data.DiffuseMapIndex);
+			if (diffuseCount + material.second->data.NormalMapIndex < textureBytes.size())
+				item.Textures.push_back(diffuseCount + material.second->data.NormalMapIndex);
+		}
+		item.Instances.resize(ri->GetInstanceCount());
+		memcpy(item.Instances.data(), ri->GetInstances().data(), ri->GetInstancesByteSize());
+		items.push_back(std::move(item));
+		m_streamedItems.push_back(ri);
+	}
+	if (items.empty())
+		return;
+
+	m_WorldPartition.Build(items, textureBytes, m_WorldPartitionSettings);
+	for (UINT i = 0; i < m_streamedItems.size(); i++) {
+		//an empty buffer can't be created, a single empty slot is enough
+		std::vector<InstanceData>& instances = m_streamedItems[i]->GetInstances();
+		instances.assign(DX::Max(m_WorldPartition.GetCapacity(i), 1u), InstanceData());
+		m_WorldPartition.SetMirror(i, reinterpret_cast<SceneInstance*>(instances.data()));
+		m_streamedItems[i]->TrackMemory();
+	}
+	m_WorldPartition.LoadAll(&m_Camera->GetMatrixOrigin().x, m_WorkerPool);
+	//the buffers are created from the mirrors, so there is nothing to patch yet
+	m_WorldPartition.ClearPatches();
+	WorldPartitionStats stats = m_WorldPartition.GetStats();
+	MemoryTracker::Get().SetOwnerName(&m_WorldPartition, "World partition");
+	MemoryTracker::Get().Set(Memory_Streaming, stats.ColdBytes, &m_WorldPartition);
+	std::ostringstream report;
+	report << "World partition: " << m_streamedItems.size() << " streamed items in " << stats.TileCount << " tiles, "
+		<< stats.RawBytes / 1048576.0 << " MB of instances compressed to " << stats.ColdBytes / 1048576.0 << " MB, "
+		<< stats.ResidentTiles << " tiles resident at the start (" << stats.UsedBytes / 1048576.0 << " MB)\n";
+	OutputDebugStringA(report.str().c_str());
+}
+
+/// <summary>
+/// Copies the changed ranges of the streamed instance buffers with the compute command list. The patches of a
+/// frame are limited, the rest is copied in the next frames.
+/// </summary>
+void Renderer::RecordInstancePatches()
+{
+	m_patchesRecorded = false;
+	if (m_streamedItems.empty())
+		return;
+	UploadBuffer<InstanceData>* patchBuffer = mCurrFrameResource->InstancePatches.get();
+	m_instancePatches.clear();
+	if (m_WorldPartition.TakePatches(patchBuffer->ElementCount(), m_instancePatches) == 0)
+		return;
+	//the patches of an item are taken together, so every buffer is transitioned once
+	std::vector<D3D12_RESOURCE_BARRIER> toCopy;
+	std::vector<D3D12_RESOURCE_BARRIER> toRead;
+	for (size_t i = 0; i < m_instancePatches.size(); i++) {
+		if (i > 0 && m_instancePatches[i].Item == m_instancePatches[i - 1].Item)
+			continue;
+		ID3D12Resource* buffer = m_streamedItems[m_instancePatches[i].Item]->GetInstanceBufferGPU().Get();
+		toCopy.push_back(CD3DX12_RESOURCE_BARRIER::Transition(buffer, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_COPY_DEST));
+		toRead.push_back(CD3DX12_RESOURCE_BARRIER::Transition(buffer, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+	}
+	m_computeCommandList->ResourceBarrier((UINT)toCopy.size(), toCopy.data());
+	UINT uploadOffset = 0;
+	for (auto& patch : m_instancePatches) {
+		RenderItem* ri = m_streamedItems[patch.Item];
+		memcpy(patchBuffer->GetData(uploadOffset), &ri->GetInstances()[patch.Offset], patch.Count * sizeof(InstanceData));
+		m_computeCommandList->CopyBufferRegion(ri->GetInstanceBufferGPU().Get(), patch.Offset * sizeof(InstanceData),
+			patchBuffer->Resource(), uploadOffset * sizeof(InstanceData), patch.Count * sizeof(InstanceData));
+		uploadOffset += patch.Count;
+	}
+	m_computeCommandList->ResourceBarrier((UINT)toRead.size(), toRead.data());
+	m_patchesRecorded = true;
+}
+
+/// <summary>
+/// Watches the OBJ files of the scene, their MTL files and the textures. The changed files are reimported on the
+/// service thread and swapped in by ApplyHotReload at the start of a frame.
+/// </summary>
+void Renderer::StartHotReload()
+{
+	if (!m_enableHotReload)
+		return;
+	for (auto fileName : fileNames) {
+		std::string objFile(fileName);
+		m_hotReloadModels[objFile] = objFile;
+		m_hotReloadModels[objFile.substr(0, objFile.rfind('.')) + ".mtl"] = objFile;
+	}
+	for (auto& model : m_hotReloadModels)
+		m_HotReload.Watch(model.first);
+	for (auto& texture : m_DiffuseMaps)
+		m_HotReload.Watch(texture.second->Filename.str());
+	for (auto& normalMap : m_NormalMaps)
+		m_HotReload.Watch(normalMap.second->Filename.str());
+	m_HotReload.Start([this](const std::vector<std::string>& changedFiles) { ReimportFiles(changedFiles); });
+}
+
+/// <summary>
+/// Reimports the changed OBJ files on the service thread. Every file is imported with a loader of its own, only
+/// the shapes, which are render items of the scene, are kept. The render item map isn't changed after the
+/// startup, so it is only read here.
+/// </summary>
+/// <param name="fileNames">The changed files.</param>
+void Renderer::ReimportFiles(const std::vector<std::string>& fileNames)
+{
+	std::unique_ptr<HotReloadBatch> batch(new HotReloadBatch());
+	std::vector<std::string> objFiles;
+	for (auto& fileName : fileNames) {
+		auto model = m_hotReloadModels.find(fileName);
+		if (model == m_hotReloadModels.end())
+			batch->Textures.push_back(fileName);
+		else if (std::find(objFiles.begin(), objFiles.end(), model->second) == objFiles.end())
+			objFiles.push_back(model->second);
+	}
+	for (auto& objFile : objFiles) {
+		OBJLoader loader;
+		std::unordered_map<std::string, std::unique_ptr<RenderItem>> items;
+		std::unordered_map<StringRef, std::unique_ptr<Texture>> diffuseMaps;
+		std::unordered_map<StringRef, std::unique_ptr<Texture>> normalMaps;
+		std::unordered_map<StringRef, std::unique_ptr<Material>> materials;
+		if (!loader.ImportOBJFile(objFile.c_str(), items, diffuseMaps, normalMaps, materials)) {
+			OutputDebugStringA(("Hot reload: failed to import " + objFile + "\n").c_str());
+			continue;
+		}
+		for (auto& item : items) {
+			if (m_renderItems.find(item.first) == m_renderItems.end())
+				continue;
+			HotReloadItem reloaded;
+			reloaded.Name = item.first;
+			for (auto& material : materials) {
+				if (material.second->MatCBIndex == (int)item.second->GetMaterialIndex())
+					reloaded.MaterialName = material.first.str();
+			}
+			//the bounding volumes are created here, so the frame, which swaps the item in, doesn't read the vertices
+			item.second->CreateBoundingVolumes();
+			MemoryTracker::Get().SetOwnerName(item.second.get(), "Reimported " + item.first);
+			reloaded.Item = std::move(item.second);
+			batch->Items.push_back(std::move(reloaded));
+		}
+	}
+	if (batch->Items.empty() && batch->Textures.empty())
+		return;
+
+	//the batch, which wasn't applied yet, gets the new changes, a newer item replaces the older one
+	std::lock_guard<std::mutex> lock(m_hotReloadMutex);
+	if (!m_pendingReload) {
+		m_pendingReload = std::move(batch);
+		return;
+	}
+	for (auto& item : batch->Items) {
+		auto pending = std::find_if(m_pendingReload->Items.begin(), m_pendingReload->Items.end(),
+			[&item](const HotReloadItem& other) { return other.Name == item.Name; });
+		if (pending != m_pendingReload->Items.end())
+			*pending = std::move(item);
+		else
+			m_pendingReload->Items.push_back(std::move(item));
+	}
+	for (auto& texture : batch->Textures) {
+		if (std::find(m_pendingReload->Textures.begin(), m_pendingReload->Textures.end(), texture) == m_pendingReload->Textures.end())
+			m_pendingReload->Textures.push_back(texture);
+	}
+}
+
+/// <summary>
+/// Swaps the reimported geometry and textures in. The reimported items get new ranges in the geometry pool and
+/// their draw commands are patched, every other item keeps its buffers. It is a development feature, so it waits
+/// for the GPU instead of keeping the old geometry alive for the frames in flight.
+/// </summary>
+void Renderer::ApplyHotReload()
+{
+	std::unique_ptr<HotReloadBatch> batch;
+	{
+		std::lock_guard<std::mutex> lock(m_hotReloadMutex);
+		batch = std::move(m_pendingReload);
+	}
+	if (!batch)
+		return;
+	auto d3dDevice = m_deviceResources->GetD3DDevice();
+	m_deviceResources->WaitForGpu();
+	ThrowIfFailed(m_deviceResources->GetCommandAllocator()->Reset());
+	ThrowIfFailed(m_commandList->Reset(m_deviceResources->GetCommandAllocator(), nullptr));
+
+	//the commands are in the iteration order of the render items, the occluder commands in the order of the occluders
+	std::unordered_map<RenderItem*, UINT> commandIndices;
+	std::unordered_map<RenderItem*, UINT> occluderIndices;
+	for (auto& renderItem : m_renderItems) {
+		UINT commandIndex = (UINT)commandIndices.size();
+		commandIndices[renderItem.second.get()] = commandIndex;
+		if (renderItem.second->isOccluder()) {
+			UINT occluderIndex = (UINT)occluderIndices.size();
+			occluderIndices[renderItem.second.get()] = occluderIndex;
+		}
+	}
+	std::vector<RenderItem*> reloaded;
+	std::vector<std::pair<std::string, RenderItem*>> saved;
+	bool occludersChanged = false;
+	for (auto& item : batch->Items) {
+		RenderItem* ri = m_renderItems.at(item.Name).get();
+		if (!m_GeometryPool.Reallocate(d3dDevice, m_commandList.Get(), m_renderItems, ri, item.Item->GetVertexCount(), item.Item->GetIndexCount())) {
+			OutputDebugStringA(("Hot reload: no room for " + item.Name + " in the geometry pool, it is reloaded at the next start\n").c_str());
+			continue;
+		}
+		ri->ReplaceGeometry(*item.Item);
+		reloaded.push_back(ri);
+		//the atlas keeps the old mesh until the next start, which finds the changed hash and bakes it again
+		if (ri->hasImpostor())
+			OutputDebugStringA(("Hot reload: the impostor of " + item.Name + " is baked again at the next start\n").c_str());
+		saved.push_back(std::make_pair(item.Name, ri));
+
+		//the material index is in the item table, the instances don't change
+		auto material = m_Materials.find(StringRef(item.MaterialName));
+		if (material == m_Materials.end() || material->second->MatCBIndex == (int)ri->GetMaterialIndex())
+			continue;
+		ri->SetMaterialIndex(material->second->MatCBIndex);
+		m_itemsFramesDirty = DX::c_frameCount;
+	}
+	if (!reloaded.empty()) {
+		//a compaction of the pool moves every item to new buffers, so all commands get the ranges and views of their items
+		for (auto& renderItem : m_renderItems) {
+			RenderItem* ri = renderItem.second.get();
+			IndirectCommand& command = m_indirectCommandData[commandIndices[ri]];
+			command.drawArguments.IndexCountPerInstance = ri->GetIndexCount();
+			command.drawArguments.BaseVertexLocation = ri->GetBaseVertexLocation();
+			command.drawArguments.StartIndexLocation = ri->GetStartIndexLocation();
+			command.positionBufferView = ri->PositionBufferView();
+			command.attributeBufferView = ri->AttributeBufferView();
+			command.indexBufferView = ri->IndexBufferView();
+			if (ri->isOccluder()) {
+				OccluderIndirectCommand& occluderCommand = m_occluderIndirectCommandData[occluderIndices[ri]];
+				occluderCommand.positionBufferView = command.positionBufferView;
+				occluderCommand.indexBufferView = command.indexBufferView;
+				occluderCommand.drawArguments.IndexCountPerInstance = command.drawArguments.IndexCountPerInstance;
+				occluderCommand.drawArguments.BaseVertexLocation = command.drawArguments.BaseVertexLocation;
+				occluderCommand.drawArguments.StartIndexLocation = command.drawArguments.StartIndexLocation;
+				occludersChanged = true;
+			}
+		}
+		m_GeometryPool.Upload(d3dDevice, m_commandList.Get(), reloaded);
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CommandBuffer.Get(),
+			D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT, D3D12_RESOURCE_STATE_COPY_DEST));
+		UpdateIndirectCommands();
+		m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CommandBuffer.Get(),
+			D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT));
+	}
+	if (occludersChanged) {
+		//the occluder commands are read from an upload heap buffer, the triangle pre-culling buffers are sized by the occluder indices
+		BYTE* mappedData = nullptr;
+		ComPtr<ID3D12Resource>& occluderCommandBuffer = m_HizBuffer.GetOccluderCommandBuffer();
+		ThrowIfFailed(occluderCommandBuffer->Map(0, nullptr, reinterpret_cast<void**>(&mappedData)));
+		memcpy(mappedData, m_occluderIndirectCommandData.data(), m_occluderIndirectCommandData.size() * sizeof(OccluderIndirectCommand));
+		occluderCommandBuffer->Unmap(0, nullptr);
+		m_HizBuffer.SetOccluders(m_potentialOccluders);
+	}
+
+	UINT reloadedTextures = 0;
+	UINT diffuseCount = (UINT)m_DiffuseMaps.size();
+	for (auto& fileName : batch->Textures) {
+		for (auto& texture : m_DiffuseMaps) {
+			if (texture.second->Filename == StringRef(fileName) && ReloadTexture(texture.second.get(), texture.second->index))
+				reloadedTextures++;
+		}
+		for (auto& normalMap : m_NormalMaps) {
+			if (normalMap.second->Filename == StringRef(fileName) && ReloadTexture(normalMap.second.get(), diffuseCount + normalMap.second->index))
+				reloadedTextures++;
+		}
+	}
+
+	ThrowIfFailed(m_commandList->Close());
+	ID3D12CommandList* ppCommandLists[] = { m_commandList.Get() };
+	m_deviceResources->GetCommandQueue()->ExecuteCommandLists(_countof(ppCommandLists), ppCommandLists);
+	m_deviceResources->WaitForGpu();
+	m_GeometryPool.DisposeUploader();
+	std::ostringstream report;
+	report << "Hot reload: " << reloaded.size() << " render items, " << reloadedTextures << " textures\n";
+	OutputDebugStringA(report.str().c_str());
+	if (!saved.empty())
+		SaveHotReload(saved);
+}
+
+/// <summary>
+/// Saves the reimported render items as a journal entry of the scene file, so the next start has them without
+/// importing the OBJ files. When the journal has grown enough, the file is compacted on the worker pool into its
+/// pending version, which replaces it at the next start.
+/// </summary>
+/// <param name="items">The names and the render items, which were reimported.</param>
+void Renderer::SaveHotReload(const std::vector<std::pair<std::string, RenderItem*>>& items)
+{
+	if (m_sceneCompaction.valid())
+		m_sceneCompaction.wait();
+	//a baked or compacted file, which isn't committed yet, is the one the next start reads
+	std::string sceneFile = "models\\scene.bin";
+	std::string pendingFile = sceneFile + ScenePendingSuffix;
+	if (std::ifstream(pendingFile, std::ios::binary).is_open())
+		sceneFile = pendingFile;
+	bool compact = false;
+	if (!m_Loader.AppendBinRenderItems(items, sceneFile.c_str(), compact)) {
+		OutputDebugStringA(("Hot reload: the render items can't be saved to " + sceneFile + ", they are reimported at the next start\n").c_str());
+		return;
+	}
+	if (!compact)
+		return;
+	m_sceneCompaction = m_WorkerPool.Submit([sceneFile, pendingFile]() {
+		//the mapped scene file is replaced at the next start, the pending file isn't mapped and is replaced right away
+		std::string compactedFile = sceneFile + ScenePendingSuffix;
+		if (!CompactSceneFile(sceneFile.c_str(), compactedFile.c_str()))
+			OutputDebugStringA(("Scene file: compaction of " + sceneFile + " failed\n").c_str());
+		else if (sceneFile == pendingFile)
+			CommitPendingSceneFile(sceneFile.c_str());
+	});
+}
+
+/// <summary>
+/// Loads a changed diffuse or normal map and points its SRV to the new resource. The old resource is kept,
+/// if the file can't be loaded (e.g. it is still being written).
+/// </summary>
+/// <param name="texture">The texture.</param>
+/// <param name="descriptorIndex">Index of its SRV in the texture heap.</param>
+bool Renderer::ReloadTexture(Texture* texture, UINT descriptorIndex)
+{
+	//a texture, which isn't loaded yet, is read from the new file when it is drawn, a failed one gets another try
+	if (m_textureStates[descriptorIndex] == Texture_Failed && m_textureSlots[descriptorIndex])
+		m_textureStates[descriptorIndex] = Texture_Unloaded;
+	if (m_textureStates[descriptorIndex] != Texture_Resident)
+		return false;
+	ComPtr<ID3D12Resource> resource;
+	ComPtr<ID3D12Resource> uploadHeap;
+	StringRef texturePath = texture->Filename;
+	if (FAILED(CreateDDSTextureFromFile12(m_deviceResources->GetD3DDevice(), m_commandList.Get(),
+		std::wstring(texturePath.begin(), texturePath.end()).c_str(), resource, uploadHeap))) {
+		OutputDebugStringA(("Hot reload: failed to load " + texturePath.str() + "\n").c_str());
+		return false;
+	}
+	m_commandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(resource.Get(),
+		D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE | D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE));
+	texture->Resource = resource;
+	texture->UploadHeap = uploadHeap;
+	TrackTextureMemory(texture);
+	CreateTextureSRV(texture, descriptorIndex);
+	return true;
+}
+
+
+/// <summary>
+/// Creates the SRV of a diffuse or normal map in the texture heap, a texture, which isn't loaded, gets the placeholder
+/// </summary>
+/// <param name="texture">The texture.</param>
+/// <param name="descriptorIndex">Index in the texture table - the normal maps follow the diffuse maps.</param>
+/// <param name="frame">The frame copy of the texture table, -1 writes all copies.</param>
+void Renderer::CreateTextureSRV(Texture* texture, UINT descriptorIndex, int frame)
+{
+	ID3D12Resource* resource = texture->Resource ? texture->Resource.Get() :
+		m_placeholderTextures[descriptorIndex < m_DiffuseMaps.size() ? 0 : 1].Get();
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MostDetailedMip = 0;
+	srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+	//Set the needed format and mip levels of the texture
+	srvDesc.Format = resource->GetDesc().Format;
+	srvDesc.Texture2D.MipLevels = resource->GetDesc().MipLevels;
+	//place in the descriptor heap and create the shader resource view
+	for (UINT copy = 0; copy < DX::c_frameCount; copy++) {
+		if (frame >= 0 && copy != (UINT)frame)
+			continue;
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(m_srvTextureHeap->GetCPUDescriptorHandleForHeapStart(),
+			copy * m_textureDescriptorCount + descriptorIndex, m_SrvCbvUavDescriptorSize);
+		m_deviceResources->GetD3DDevice()->CreateShaderResourceView(resource, &srvDesc, hDescriptor);
+	}
+}
 
 /// <summary>
 /// Builds the descriptor heaps.
@@ -564,17 +1549,19 @@ void Renderer::BuildDescriptorHeaps() {
 	auto d3dDevice = m_deviceResources->GetD3DDevice();
 
 	{
-		//Describe the descriptor heap for the diffuse and normal maps
+		//Describe the descriptor heap for the diffuse and normal maps and the impostor atlases. Every frame has a copy of
+		//the texture table, so a lazily loaded texture can change its SRV while the other frames are in flight.
 		D3D12_DESCRIPTOR_HEAP_DESC SrvHeapDesc = {};
-		SrvHeapDesc.NumDescriptors = m_DiffuseMaps.size() + m_NormalMaps.size();		
+		m_textureDescriptorCount = m_DiffuseMaps.size() + m_NormalMaps.size() + Impostor_AtlasCount * MaxImpostors;
+		SrvHeapDesc.NumDescriptors = DX::c_frameCount * m_textureDescriptorCount;
 		SrvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 		SrvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 		//Create the descriptor heap
 		ThrowIfFailed(d3dDevice->CreateDescriptorHeap(&SrvHeapDesc, IID_PPV_ARGS(&m_srvTextureHeap)));
 		m_srvTextureHeap->SetName(L"Texture SRV Heap");
 		
-		//Describe the descriptor heap for the instance data (both processed and non-processed)
-		SrvHeapDesc.NumDescriptors = 2 * m_renderItems.size();
+		//Describe the descriptor heap for the instance data (non-processed, processed and processed far instances)
+		SrvHeapDesc.NumDescriptors = 3 * m_renderItems.size();
 		SrvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 		SrvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 		//Create the descriptor heap
@@ -594,35 +1581,42 @@ void Renderer::BuildDescriptorHeaps() {
 	}
 	//fill texture heap
 	{
-		//Describe the diffuse and normal SRV
-		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
-		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
-		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-		srvDesc.Texture2D.MostDetailedMip = 0;
-		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
-
+		BuildTextureSlots();
 		//For each diffuse map create SRV at the needed offset
 		for (auto& texture : m_DiffuseMaps)
-		{
-			//place in the descriptor heap
-			CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(m_srvTextureHeap->GetCPUDescriptorHandleForHeapStart(), texture.second->index, m_SrvCbvUavDescriptorSize);
-			//Set the needed format and mip levels of the texture
-			srvDesc.Format = texture.second->Resource->GetDesc().Format;
-			srvDesc.Texture2D.MipLevels = texture.second->Resource->GetDesc().MipLevels;
-			//Create the shader resource view
-			d3dDevice->CreateShaderResourceView(texture.second->Resource.Get(), &srvDesc, hDescriptor);
-		}
+			CreateTextureSRV(texture.second.get(), texture.second->index);
 		//For each normal map create SRV at the needed offset
 		int offset = m_DiffuseMaps.size();
 		for (auto& normalMap : m_NormalMaps)
-		{
-			//place in the descriptor heap
-			CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(m_srvTextureHeap->GetCPUDescriptorHandleForHeapStart(), normalMap.second->index + offset, m_SrvCbvUavDescriptorSize);
-			//Set the needed format and mip levels of the texture
-			srvDesc.Format = normalMap.second->Resource->GetDesc().Format;
-			srvDesc.Texture2D.MipLevels = normalMap.second->Resource->GetDesc().MipLevels;
-			//Create the shader resource view
-			d3dDevice->CreateShaderResourceView(normalMap.second->Resource.Get(), &srvDesc, hDescriptor);
+			CreateTextureSRV(normalMap.second.get(), normalMap.second->index + offset);
+
+		//Describe the impostor atlas SRV
+		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+		srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+		srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+		srvDesc.Texture2D.MostDetailedMip = 0;
+		srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+		//Impostor atlases follow the normal maps, unused slots get null descriptors
+		offset += m_NormalMaps.size();
+		srvDesc.Texture2D.MipLevels = 1;
+		const DXGI_FORMAT atlasFormats[Impostor_AtlasCount] = { DXGI_FORMAT_R16G16_UNORM, DXGI_FORMAT_R8G8B8A8_UNORM, DXGI_FORMAT_R32_FLOAT };
+		for (UINT frame = 0; frame < DX::c_frameCount; frame++) {
+			UINT frameOffset = frame * m_textureDescriptorCount + offset;
+			for (UINT i = 0; i < Impostor_AtlasCount * MaxImpostors; i++) {
+				CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(m_srvTextureHeap->GetCPUDescriptorHandleForHeapStart(), frameOffset + i, m_SrvCbvUavDescriptorSize);
+				srvDesc.Format = atlasFormats[i % Impostor_AtlasCount];
+				d3dDevice->CreateShaderResourceView(nullptr, &srvDesc, hDescriptor);
+			}
+			for (auto& impostor : m_Impostors) {
+				if (!impostor.second->Resource[0])
+					continue;
+				for (UINT a = 0; a < Impostor_AtlasCount; a++) {
+					CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(m_srvTextureHeap->GetCPUDescriptorHandleForHeapStart(),
+						frameOffset + impostor.second->index * Impostor_AtlasCount + a, m_SrvCbvUavDescriptorSize);
+					srvDesc.Format = atlasFormats[a];
+					d3dDevice->CreateShaderResourceView(impostor.second->Resource[a].Get(), &srvDesc, hDescriptor);
+				}
+			}
 		}
 	}
 	//Create the UAV counter reset 
@@ -632,7 +1626,8 @@ void Renderer::BuildDescriptorHeaps() {
 	}
 	//Create a readback buffer to store the UAV counter for each render item
 	{
-		DX::CreateReadbackBuffer(d3dDevice, m_commandList.Get(), m_indirectCommandData.size()*sizeof(UINT), DrawnInstancesReadbackBuffer);
+		//the counts of the indirect commands, followed by the counts of the impostor commands (at most one per atlas)
+		DX::CreateReadbackBuffer(d3dDevice, m_commandList.Get(), (m_indirectCommandData.size() + MaxImpostors)*sizeof(UINT), DrawnInstancesReadbackBuffer);
 	}
 	
 	{
@@ -672,6 +1667,10 @@ void Renderer::BuildDescriptorHeaps() {
 			d3dDevice->CreateUnorderedAccessView(iter->second->GetProcessedInstanceBufferGPU().Get(), iter->second->GetProcessedInstanceBufferGPU().Get(), &uavDesc, hDescriptor);
 			//Offset the descriptor in the descriptor table
 			hDescriptor.Offset(1, m_SrvCbvUavDescriptorSize);
+			//Create the far instances UAV - items without impostor never append to it, so they reuse the processed buffer
+			ID3D12Resource* impostorBuffer = iter->second->hasImpostor() ? iter->second->GetImpostorInstanceBufferGPU().Get() : iter->second->GetProcessedInstanceBufferGPU().Get();
+			d3dDevice->CreateUnorderedAccessView(impostorBuffer, impostorBuffer, &uavDesc, hDescriptor);
+			hDescriptor.Offset(1, m_SrvCbvUavDescriptorSize);
 		}
 	}
 	//Create SRV for the HiZ Buffer
@@ -685,32 +1684,20 @@ void Renderer::BuildDescriptorHeaps() {
 
 
 /// <summary>
-/// Builds the vertex, index and instance buffers,
-/// also creates the bounding box of the object
+/// Builds the pooled vertex and index buffers and the instance buffers
 /// </summary>
 void Renderer::BuildRenderItems()
 {
 	auto d3Device = m_deviceResources->GetD3DDevice();
 	std::string name;
+	//Pack the geometry of all render items in the pooled vertex and index buffers
+	ProfileScope geometryScope("Geometry pool");
+	m_GeometryPool.Build(d3Device, m_commandList.Get(), m_renderItems);
+	geometryScope.End();
+	ProfileScope instanceScope("Instance buffers");
 	//Iterate over the render items
 	std::unordered_map<std::string, std::unique_ptr<RenderItem>>::iterator iter;
 	for (iter = m_renderItems.begin(); iter != m_renderItems.end(); iter++) {
-		//Create GPU vertex buffer
-		DX::CreateDefaultBuffer(d3Device, m_commandList.Get(),
-			iter->second->GetVertexBufferData(),
-			iter->second->GetVertexCount() * sizeof(Vertex),
-			iter->second->GetVertexBufferUploader(),
-			iter->second->GetVertexBufferGPU());
-		name = "Vertex Buffer for render item " + iter->first;
-		iter->second->GetVertexBufferGPU()->SetName(DX::convertCharArrayToLPCWSTR(name.c_str()).c_str());
-		//Create GPU index buffer
-		DX::CreateDefaultBuffer(d3Device, m_commandList.Get(),
-			iter->second->GetIndexBufferData(),
-			iter->second->GetIndexCount() * sizeof(UINT),
-			iter->second->GetIndexBufferUploader(),
-			iter->second->GetIndexBufferGPU());
-		name = "Index Buffer for render item " + iter->first;
-		iter->second->GetIndexBufferGPU()->SetName(DX::convertCharArrayToLPCWSTR(name.c_str()).c_str());
 		//Create GPU instance data buffer
 		DX::CreateDefaultBuffer(d3Device, m_commandList.Get(),
 			iter->second->GetInstances().data(),
@@ -729,77 +1716,122 @@ void Renderer::BuildRenderItems()
 			iter->second->GetProcessedInstanceBufferGPU());
 		name = "Processed Instance Data Buffer for render item " + iter->first;
 		iter->second->GetProcessedInstanceBufferGPU()->SetName(DX::convertCharArrayToLPCWSTR(name.c_str()).c_str());
-		//Create the item's bounding box
-		iter->second->CreateBoundingBox();
+		//Create GPU UAV buffer for storing the far instances, drawn as impostors
+		if (iter->second->hasImpostor()) {
+			DX::CreateUAVBuffer(d3Device, m_commandList.Get(),
+				iter->second->GetInstanceBufferCounterOffset() + sizeof(UINT),
+				iter->second->GetImpostorInstanceBufferGPU());
+			name = "Impostor Instance Data Buffer for render item " + iter->first;
+			iter->second->GetImpostorInstanceBufferGPU()->SetName(DX::convertCharArrayToLPCWSTR(name.c_str()).c_str());
+		}
+		//the uploader is kept, the hot reload copies changed instances through it
+		MemoryTracker::Get().Set(Memory_GPUInstances, DX::GetResourceSize(iter->second->GetInstanceBufferGPU().Get()) +
+			DX::GetResourceSize(iter->second->GetProcessedInstanceBufferGPU().Get()) + DX::GetResourceSize(iter->second->GetImpostorInstanceBufferGPU().Get()), iter->second.get());
+		MemoryTracker::Get().Set(Memory_Uploaders, DX::GetResourceSize(iter->second->GetInstanceBufferUploader().Get()), iter->second.get());
 	}
 
 }
 
 /// <summary>
-/// Builds the Pipeline State Objects and command lists.
+/// Creates the graphics and compute command lists. The pipeline states are set when the lists are reset.
 /// </summary>
-void Renderer::BuildPSOAndCommandLists() {
+void Renderer::CreateCommandLists() {
 	auto d3dDevice = m_deviceResources->GetD3DDevice();
-	//Read the compiled shaders 
-	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"VertexShader.cso").c_str(), m_vertexShader));
-	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"PixelShader.cso").c_str(), m_pixelShader));
-	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"ComputeShader.cso").c_str(), m_computeShader));
-
-	// Create the pipeline state once the shaders are loaded.
-	{
-		//Describe the shader input layout
-		static const D3D12_INPUT_ELEMENT_DESC inputLayout[] =
-		{
-			{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-			{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
-		};
-		//Describe default rasterizer with solid mode and no back-face cull
-		CD3DX12_RASTERIZER_DESC rsDesc(D3D12_DEFAULT);
-		rsDesc.FillMode = D3D12_FILL_MODE_SOLID;
-		rsDesc.CullMode = D3D12_CULL_MODE_NONE;
-		//Describe the graphics pipeline state object (PSO).
-		D3D12_GRAPHICS_PIPELINE_STATE_DESC state = {};
-		state.InputLayout = { inputLayout, _countof(inputLayout) };
-		state.pRootSignature = m_rootSignature.Get();
-		state.VS = { &m_vertexShader[0], m_vertexShader.size() };
-		state.PS = { &m_pixelShader[0], m_pixelShader.size() };
-		state.RasterizerState = rsDesc;
-		state.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
-		state.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
-		state.SampleMask = UINT_MAX;
-		state.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
-		state.NumRenderTargets = 1;
-		state.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
-		state.DSVFormat = DXGI_FORMAT_D32_FLOAT;
-		state.SampleDesc.Count = 1;
-		//Create the graphics pipeline state object (PSO).
-		ThrowIfFailed(d3dDevice->CreateGraphicsPipelineState(&state, IID_PPV_ARGS(&m_pipelineState)));
-		m_pipelineState->SetName(L"Pipeline State");
-
-		// Shader data can be deleted once the pipeline state is created.
-		m_vertexShader.clear();
-		m_pixelShader.clear();
-
-		// Describe and create the compute pipeline state object (PSO).
-		D3D12_COMPUTE_PIPELINE_STATE_DESC computePsoDesc = {};
-		computePsoDesc.pRootSignature = m_computeRootSignature.Get();
-		computePsoDesc.CS = { &m_computeShader[0], m_computeShader.size() };
-
-		ThrowIfFailed(d3dDevice->CreateComputePipelineState(&computePsoDesc, IID_PPV_ARGS(&m_computePipelineState)));
-		m_computePipelineState->SetName(L"Compute Pipeline State");
-		m_computeShader.clear();
-	}
-	// Create the graphic and compute command list.
-	ThrowIfFailed(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_deviceResources->GetCommandAllocator(), m_pipelineState.Get(), IID_PPV_ARGS(&m_commandList)));
-	ThrowIfFailed(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_deviceResources->GetComputeCommandAllocator(), m_computePipelineState.Get(), IID_PPV_ARGS(&m_computeCommandList)));
+	ThrowIfFailed(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_DIRECT, m_deviceResources->GetCommandAllocator(), nullptr, IID_PPV_ARGS(&m_commandList)));
+	ThrowIfFailed(d3dDevice->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COMPUTE, m_deviceResources->GetComputeCommandAllocator(), nullptr, IID_PPV_ARGS(&m_computeCommandList)));
 	m_commandList->SetName(L"Command List");
 	m_computeCommandList->SetName(L"Compute Command List");
 	//Close the compute command list, as the rest of the initialization will be handled by the graphics command list
 	ThrowIfFailed(m_computeCommandList->Close());
 }
 
+/// <summary>
+/// Describes the graphics pipeline state, shared by the scene and the impostor pipeline states.
+/// </summary>
+D3D12_GRAPHICS_PIPELINE_STATE_DESC Renderer::GetGraphicsPipelineStateDesc()
+{
+	//Describe default rasterizer with solid mode and no back-face cull
+	CD3DX12_RASTERIZER_DESC rsDesc(D3D12_DEFAULT);
+	rsDesc.FillMode = D3D12_FILL_MODE_SOLID;
+	rsDesc.CullMode = D3D12_CULL_MODE_NONE;
+	//Describe the graphics pipeline state object (PSO).
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC state = {};
+	state.pRootSignature = m_rootSignature.Get();
+	state.RasterizerState = rsDesc;
+	state.BlendState = CD3DX12_BLEND_DESC(D3D12_DEFAULT);
+	state.DepthStencilState = CD3DX12_DEPTH_STENCIL_DESC(D3D12_DEFAULT);
+	state.SampleMask = UINT_MAX;
+	state.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE;
+	state.NumRenderTargets = 1;
+	state.RTVFormats[0] = DXGI_FORMAT_B8G8R8A8_UNORM;
+	state.DSVFormat = DXGI_FORMAT_D32_FLOAT;
+	state.SampleDesc.Count = 1;
+	return state;
+}
+
+/// <summary>
+/// Builds the Pipeline State Object of the scene.
+/// </summary>
+void Renderer::BuildPipelineState() {
+	auto d3dDevice = m_deviceResources->GetD3DDevice();
+	//Read the compiled shaders 
+	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"VertexShader.cso").c_str(), m_vertexShader));
+	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"PixelShader.cso").c_str(), m_pixelShader));
+	//Describe the shader input layout
+	static const D3D12_INPUT_ELEMENT_DESC inputLayout[] =
+	{
+		//positions come from slot 0, the rest of the attributes from slot 1
+		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 1, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 1, 20, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 }
+	};
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC state = GetGraphicsPipelineStateDesc();
+	state.InputLayout = { inputLayout, _countof(inputLayout) };
+	state.VS = { &m_vertexShader[0], m_vertexShader.size() };
+	state.PS = { &m_pixelShader[0], m_pixelShader.size() };
+	//Create the graphics pipeline state object (PSO).
+	ThrowIfFailed(d3dDevice->CreateGraphicsPipelineState(&state, IID_PPV_ARGS(&m_pipelineState)));
+	m_pipelineState->SetName(L"Pipeline State");
+	// Shader data can be deleted once the pipeline state is created.
+	m_vertexShader.clear();
+	m_pixelShader.clear();
+}
+
+/// <summary>
+/// Builds the Pipeline State Object of the impostors.
+/// </summary>
+void Renderer::BuildImpostorPipelineState() {
+	auto d3dDevice = m_deviceResources->GetD3DDevice();
+	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"ImpostorVS.cso").c_str(), m_impostorVertexShader));
+	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"ImpostorPS.cso").c_str(), m_impostorPixelShader));
+	//The impostor quads are generated in the vertex shader, so there is no input layout
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC state = GetGraphicsPipelineStateDesc();
+	state.InputLayout = { nullptr, 0 };
+	state.VS = { &m_impostorVertexShader[0], m_impostorVertexShader.size() };
+	state.PS = { &m_impostorPixelShader[0], m_impostorPixelShader.size() };
+	ThrowIfFailed(d3dDevice->CreateGraphicsPipelineState(&state, IID_PPV_ARGS(&m_impostorPipelineState)));
+	m_impostorPipelineState->SetName(L"Impostor Pipeline State");
+	m_impostorVertexShader.clear();
+	m_impostorPixelShader.clear();
+}
+
+/// <summary>
+/// Builds the Pipeline State Object of the culling compute shader.
+/// </summary>
+void Renderer::BuildComputePipelineState() {
+	auto d3dDevice = m_deviceResources->GetD3DDevice();
+	ThrowIfFailed(DX::ReadDataFromFile(DX::GetAssetFullPath(L"ComputeShader.cso").c_str(), m_computeShader));
+	// Describe and create the compute pipeline state object (PSO).
+	D3D12_COMPUTE_PIPELINE_STATE_DESC computePsoDesc = {};
+	computePsoDesc.pRootSignature = m_computeRootSignature.Get();
+	computePsoDesc.CS = { &m_computeShader[0], m_computeShader.size() };
+
+	ThrowIfFailed(d3dDevice->CreateComputePipelineState(&computePsoDesc, IID_PPV_ARGS(&m_computePipelineState)));
+	m_computePipelineState->SetName(L"Compute Pipeline State");
+	m_computeShader.clear();
+}
+
 /// <summary>
 /// Creates the root signatures.
 /// </summary>
@@ -815,14 +1847,19 @@ void Renderer::CreateRootSignatures()
 	}
 	//Describe root parameters 
 	CD3DX12_ROOT_PARAMETER1 rootParameters[Graphics_RootParametersCount];
-	CD3DX12_DESCRIPTOR_RANGE1 textureTable[2];
+	//the shaders declare unbounded texture arrays, so the ranges can have any number of maps
+	CD3DX12_DESCRIPTOR_RANGE1 textureTable[3];
 	textureTable[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, m_DiffuseMaps.size(), 0, 1, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
 	textureTable[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, m_NormalMaps.size(), 0, 2, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
+	textureTable[2].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, Impostor_AtlasCount * MaxImpostors, 0, 3, D3D12_DESCRIPTOR_RANGE_FLAG_NONE);
 	//Root parameters can be root descriptors, root constants or root descriptor tables
 	rootParameters[Graphics_SceneCBV].InitAsConstantBufferView(0);
 	rootParameters[Graphics_MaterialsSRV].InitAsShaderResourceView(0);
 	rootParameters[Graphics_InstanceData].InitAsShaderResourceView(1);
-	rootParameters[Graphics_TextureTable].InitAsDescriptorTable(2, textureTable);
+	rootParameters[Graphics_TextureTable].InitAsDescriptorTable(3, textureTable);
+	rootParameters[Graphics_ImpostorConstants].InitAsConstants(sizeof(ImpostorConstants) / sizeof(UINT), 1);
+	rootParameters[Graphics_ItemsSRV].InitAsShaderResourceView(2);
+	rootParameters[Graphics_ItemConstants].InitAsConstants(1, 2);
 
 	// A root signature is an array of root parameters.
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC rootSignatureDesc;
@@ -837,7 +1874,7 @@ void Renderer::CreateRootSignatures()
 	//describe the compute root signature
 	CD3DX12_DESCRIPTOR_RANGE1 instanceData[2];
 	instanceData[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
-	instanceData[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 1, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
+	instanceData[1].Init(D3D12_DESCRIPTOR_RANGE_TYPE_UAV, 2, 0, 0, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE);
 
 	CD3DX12_DESCRIPTOR_RANGE1 HizBufferTable[1];
 	HizBufferTable[0].Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 0, 1, D3D12_DESCRIPTOR_RANGE_FLAG_DATA_STATIC);
@@ -847,7 +1884,7 @@ void Renderer::CreateRootSignatures()
 	computeRootParameters[Compute_SceneCBV].InitAsConstantBufferView(0);
 	computeRootParameters[Compute_HiZBufferSRV].InitAsDescriptorTable(1, HizBufferTable);
 	computeRootParameters[Compute_InstanceDataTable].InitAsDescriptorTable(2, instanceData);
-	computeRootParameters[Compute_Constants].InitAsConstants(7, 1);
+	computeRootParameters[Compute_Constants].InitAsConstants(sizeof(ComputeShaderConstants) / sizeof(UINT), 1);
 
 	CD3DX12_VERSIONED_ROOT_SIGNATURE_DESC computeRootSignatureDesc;
 	computeRootSignatureDesc.Init_1_1(Compute_RootParametersCount, computeRootParameters, 1, m_HizBuffer.GetSamplerDesc());
@@ -864,13 +1901,20 @@ void Renderer::CreateCommandSignature()
 {
 	auto d3dDevice = m_deviceResources->GetD3DDevice();
 	//Describe the indirect arguments
-	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[4] = {};
+	D3D12_INDIRECT_ARGUMENT_DESC argumentDescs[6] = {};
 	argumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
 	argumentDescs[0].VertexBuffer.Slot = 0;
-	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
-	argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
-	argumentDescs[2].ShaderResourceView.RootParameterIndex = Graphics_InstanceData;
-	argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+	argumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_VERTEX_BUFFER_VIEW;
+	argumentDescs[1].VertexBuffer.Slot = 1;
+	argumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW;
+	argumentDescs[3].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+	argumentDescs[3].ShaderResourceView.RootParameterIndex = Graphics_InstanceData;
+	//the index of the render item in the item table
+	argumentDescs[4].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	argumentDescs[4].Constant.RootParameterIndex = Graphics_ItemConstants;
+	argumentDescs[4].Constant.DestOffsetIn32BitValues = 0;
+	argumentDescs[4].Constant.Num32BitValuesToSet = 1;
+	argumentDescs[5].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
 	//Describe the command signature
 	D3D12_COMMAND_SIGNATURE_DESC commandSignatureDesc = {};
 	commandSignatureDesc.pArgumentDescs = argumentDescs;
@@ -879,6 +1923,21 @@ void Renderer::CreateCommandSignature()
 	//Create the command signature
 	ThrowIfFailed(d3dDevice->CreateCommandSignature(&commandSignatureDesc, m_rootSignature.Get(), IID_PPV_ARGS(&m_commandSignature)));
 	m_commandSignature->SetName(L"Command Signature");
+
+	//Describe the impostor indirect arguments - instance data, impostor constants and a non-indexed draw of the quads
+	D3D12_INDIRECT_ARGUMENT_DESC impostorArgumentDescs[3] = {};
+	impostorArgumentDescs[0].Type = D3D12_INDIRECT_ARGUMENT_TYPE_SHADER_RESOURCE_VIEW;
+	impostorArgumentDescs[0].ShaderResourceView.RootParameterIndex = Graphics_InstanceData;
+	impostorArgumentDescs[1].Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT;
+	impostorArgumentDescs[1].Constant.RootParameterIndex = Graphics_ImpostorConstants;
+	impostorArgumentDescs[1].Constant.DestOffsetIn32BitValues = 0;
+	impostorArgumentDescs[1].Constant.Num32BitValuesToSet = sizeof(ImpostorConstants) / sizeof(UINT);
+	impostorArgumentDescs[2].Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW;
+	commandSignatureDesc.pArgumentDescs = impostorArgumentDescs;
+	commandSignatureDesc.NumArgumentDescs = _countof(impostorArgumentDescs);
+	commandSignatureDesc.ByteStride = sizeof(ImpostorIndirectCommand);
+	ThrowIfFailed(d3dDevice->CreateCommandSignature(&commandSignatureDesc, m_rootSignature.Get(), IID_PPV_ARGS(&m_impostorCommandSignature)));
+	m_impostorCommandSignature->SetName(L"Impostor Command Signature");
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> Renderer::GetStaticSamplers()
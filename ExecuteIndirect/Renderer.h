@@ -7,6 +7,11 @@
 #include "OBJLoader.h"
 #include "FrameResources.h"
 #include "Scene.h"
+#include "ImpostorBaker.h"
+#include "GeometryPool.h"
+#include "WorldPartition.h"
+#include "HotReloadService.h"
+#include <mutex>
 
 using namespace Microsoft::WRL;
 
@@ -22,11 +27,16 @@ namespace ExecuteIndirect
 		void CreateDeviceDependentResources();
 		void CreateWindowSizeDependentResources();
 		void UpdateMaterialBuffer();
+		void UpdateItemBuffer();
 		void UpdateSceneCB();
 		void Update();
 		void ChangeCulling();
+		void ChangeImpostors();
+		void ChangeTrianglePreCulling();
 		bool Render();
 		UINT GetTotalDrawnInstances();
+		OccluderCullingStats& GetOccluderCullingStats() { return m_HizBuffer.GetOccluderCullingStats(); }
+		WorldPartitionStats GetStreamingStats() const { return m_WorldPartition.GetStats(); }
 
 	private:
 		void PopulateCommandLists(); 
@@ -36,15 +46,44 @@ namespace ExecuteIndirect
 		void LoadTextures();
 		void BuildDescriptorHeaps();
 		void BuildRenderItems();
-		void BuildPSOAndCommandLists();
+		void BuildImpostorAtlases();
+		void BuildImpostors();
+		void BuildWorldPartition();
+		void RecordInstancePatches();
+		void StartHotReload();
+		void ReimportFiles(const std::vector<std::string>& fileNames);
+		void ApplyHotReload();
+		void SaveHotReload(const std::vector<std::pair<std::string, RenderItem*>>& items);
+		bool ReloadTexture(Texture* texture, UINT descriptorIndex);
+		void CreateTextureSRV(Texture* texture, UINT descriptorIndex, int frame = -1);
+		void TrackTextureMemory(Texture* texture);
+		void CreatePlaceholderTexture(UINT color, ComPtr<ID3D12Resource>& texture, ComPtr<ID3D12Resource>& uploadHeap);
+		void BuildTextureSlots();
+		void RequestVisibleTextures();
+		void UpdateLazyTextures(UINT frame);
+		void CreateCommandLists();
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC GetGraphicsPipelineStateDesc();
+		void BuildPipelineState();
+		void BuildImpostorPipelineState();
+		void BuildComputePipelineState();
 		void CreateRootSignatures();
 		void CreateCommandSignature();
 		std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 		void BuildFrameResources();
+		void WaitForSceneLoad(std::shared_future<void>& ready);
+		void ReportSceneLoadTimings();
 
 	private:
 		bool m_enableCulling;
 		bool m_justChangedCulling;
+		bool m_enableImpostors;
+		bool m_regenerateInstances;		// generate the instances even if the scene file has baked ones
+		bool m_compressScene;			// compress the streams of the baked scene file
+		bool m_enableStreaming;			// stream the instances of the small, instanced items in tiles around the camera
+		bool m_patchesRecorded = false;	// the compute command list copies instance patches this frame
+		bool m_enableHotReload;			// reimport the models and textures, which change while the application runs
+		bool m_lazyTextures;			// load a texture when an item using it is drawn for the first time
+		float m_impostorDistance;
 
 		// Graphics root signature parameter offsets.
 		enum GraphicsRootParameters
@@ -53,6 +92,9 @@ namespace ExecuteIndirect
 			Graphics_MaterialsSRV,
 			Graphics_InstanceData,
 			Graphics_TextureTable,
+			Graphics_ImpostorConstants,
+			Graphics_ItemsSRV,
+			Graphics_ItemConstants,
 			Graphics_RootParametersCount
 		};
 
@@ -68,6 +110,36 @@ namespace ExecuteIndirect
 		
 		static const UINT ComputeThreadBlockSize = 64;		// Should match the value in compute.hlsl.
 
+		enum TextureState : UINT
+		{
+			Texture_Unloaded = 0,		// the SRV points to the placeholder
+			Texture_Loading,			// the file is read on the I/O thread
+			Texture_Resident,
+			Texture_Failed,				// stays on the placeholder
+		};
+
+		// A texture, whose SRV was changed, but some frame copies of the texture table still have the old one
+		struct DirtyTextureDescriptor
+		{
+			UINT Slot;
+			UINT NumFramesDirty;
+		};
+
+		// A reimported render item, which replaces the geometry of the scene's item with the same name
+		struct HotReloadItem
+		{
+			std::string Name;
+			std::unique_ptr<RenderItem> Item;
+			std::string MaterialName;		// the item's material index is only valid in the loader, which imported it
+		};
+
+		// Everything, which changed since the last frame - filled on the service thread, applied at the start of a frame
+		struct HotReloadBatch
+		{
+			std::vector<HotReloadItem> Items;
+			std::vector<std::string> Textures;		// file names of the changed diffuse and normal maps
+		};
+
 		// Cached pointer to device resources.
 		std::shared_ptr<DX::DeviceResources> m_deviceResources;
 
@@ -78,37 +150,50 @@ namespace ExecuteIndirect
 		ComPtr<ID3D12GraphicsCommandList>	m_computeCommandList;
 		ComPtr<ID3D12CommandSignature>		m_commandSignature;
 		ComPtr<ID3D12CommandSignature>		m_computeCommandSignature;
+		ComPtr<ID3D12CommandSignature>		m_impostorCommandSignature;
 		ComPtr<ID3D12RootSignature>			m_rootSignature;
 		ComPtr<ID3D12RootSignature>			m_computeRootSignature;
 
 		ComPtr<ID3D12PipelineState>			m_pipelineState;
 		ComPtr<ID3D12PipelineState>			m_computePipelineState;
+		ComPtr<ID3D12PipelineState>			m_impostorPipelineState;
 		ComPtr<ID3D12DescriptorHeap>		m_InstanceDataHeap;
 		ComPtr<ID3D12DescriptorHeap>		m_srvTextureHeap;
 		ComPtr<ID3D12DescriptorHeap>		m_srvHiZMapHeap;
 		ComPtr<ID3D12Resource>				CommandBuffer;
 		ComPtr<ID3D12Resource>				CommandBufferUploader;
+		ComPtr<ID3D12Resource>				ImpostorCommandBuffer;
+		ComPtr<ID3D12Resource>				ImpostorCommandBufferUploader;
 		ComPtr<ID3D12Resource>				DrawnInstancesReadbackBuffer;
+		ComPtr<ID3D12Resource>				m_placeholderTextures[2];		// 1x1 diffuse and normal map
+		ComPtr<ID3D12Resource>				m_placeholderUploaders[2];
 		SceneConstantBuffer					m_SceneBufferData;
 		OBJLoader							m_Loader;
+		GeometryPool						m_GeometryPool;
+		ImpostorBaker						m_ImpostorBaker;
 
 		std::unordered_map<std::string, std::unique_ptr<RenderItem>>	m_renderItems;
 
-		std::unordered_map<std::string, std::unique_ptr<Texture>>	m_DiffuseMaps;
-		std::unordered_map<std::string, std::unique_ptr<Texture>>	m_NormalMaps;
-		std::unordered_map<std::string, std::unique_ptr<Material>>	m_Materials;
+		std::unordered_map<StringRef, std::unique_ptr<Texture>>	m_DiffuseMaps;
+		std::unordered_map<StringRef, std::unique_ptr<Texture>>	m_NormalMaps;
+		std::unordered_map<StringRef, std::unique_ptr<Material>>	m_Materials;
+		std::unordered_map<std::string, std::unique_ptr<ImpostorAtlas>>	m_Impostors;
 		std::vector<std::unique_ptr<FrameResources>>				mFrameResources;
 		FrameResources* mCurrFrameResource =						nullptr;
 		UploadBuffer<UINT>* m_processedInstancesCounterReset =		nullptr;
 		std::vector<RenderItem*> m_potentialOccluders;
 		std::vector<IndirectCommand> m_indirectCommandData;
-		std::vector<IndirectCommand> m_occluderIndirectCommandData;
+		std::vector<OccluderIndirectCommand> m_occluderIndirectCommandData;
+		std::vector<ImpostorIndirectCommand> m_impostorIndirectCommandData;
+		std::vector<RenderItem*> m_impostorItems;
 		Scene								m_Scene;
 
 		HiZBuffer							m_HizBuffer;
 		int									mCurrFrameResourceIndex = 0;
 		UINT								m_SrvCbvUavDescriptorSize;
+		UINT								m_textureDescriptorCount = 0;	// of one frame's copy of the texture table
 		UINT								m_renderItemsSize = 0;
+		UINT								m_itemsFramesDirty = DX::c_frameCount;	// the item tables, which need an update
 		UINT*								m_drawnInstancesCount;
 		UINT								m_totalDrawnInstancesCount;
 
@@ -117,6 +202,28 @@ namespace ExecuteIndirect
 		std::vector<byte>					m_vertexShader;
 		std::vector<byte>					m_pixelShader;
 		std::vector<byte>					m_computeShader;
+		std::vector<byte>					m_impostorVertexShader;
+		std::vector<byte>					m_impostorPixelShader;
+
+		// The scene is read on the worker pool, while the pipeline is built
+		SceneLoadRequest					m_SceneLoad;
+		double								m_SceneLoadWaitTime = 0.0;		// ms, the main thread waited for the load
+		WorldPartition						m_WorldPartition;				// its loads run on the worker pool
+		WorldPartitionSettings				m_WorldPartitionSettings;
+		std::vector<RenderItem*>			m_streamedItems;				// in the order of the partition's items
+		std::vector<InstancePatch>			m_instancePatches;
+		std::vector<Texture*>				m_textureSlots;					// the diffuse maps, followed by the normal maps
+		std::vector<UINT>					m_textureStates;				// TextureState of every slot
+		std::vector<std::vector<UINT>>		m_commandTextures;				// texture slots of every indirect command
+		std::vector<std::pair<UINT, std::future<std::vector<byte>>>>	m_textureLoads;		// slot and file data
+		std::vector<DirtyTextureDescriptor>	m_dirtyTextureDescriptors;
+		WorkerPool							m_TextureIO;					// a single thread, reads the texture files
+		std::unordered_map<std::string, std::string>	m_hotReloadModels;		// watched OBJ or MTL file -> OBJ file
+		std::unique_ptr<HotReloadBatch>		m_pendingReload;
+		std::mutex							m_hotReloadMutex;				// guards m_pendingReload
+		std::future<void>					m_sceneCompaction;				// of the journaled scene file, on the worker pool
+		HotReloadService					m_HotReload;					// stopped before the maps, which it reads, are destroyed
+		WorkerPool							m_WorkerPool;					// last member, it finishes its tasks before the maps are destroyed
 
 		// Variables used with the rendering loop.
 		bool	m_loadingComplete;
@@ -1,16 +1,26 @@
 #include "Scene.h"
 #include "DirectXHelper.h"
+#include "MemoryTracker.h"
+#include "StartupProfiler.h"
 
 using namespace ExecuteIndirect;
 
-Scene::Scene()
+Scene::Scene() :
+	m_SpawnTable(SpawnTable::CreateDefault())
 {
 	m_OccluderModelNames.push_back("terrain");
+	//vegetation makes up most of the instances, far away it is drawn as impostors
+	m_ImpostorModelNames.push_back("Branches");
+	m_ImpostorModelNames.push_back("Trunk");
+	m_ImpostorModelNames.push_back("leaf");
+	m_ImpostorModelNames.push_back("bark");
+	m_ImpostorModelNames.push_back("grass");
 }
 
 
 Scene::~Scene()
 {
+	MemoryTracker::Get().RemoveOwner(&m_Heightfield);
 }
 
 /// <summary>
@@ -24,160 +34,85 @@ void Scene::SetOccluders(std::unordered_map<std::string, std::unique_ptr<RenderI
 }
 
 
-void ExecuteIndirect::Scene::BuildInstanceData(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems)
+/// <summary>
+/// Generates the instances of the spawn table's models, placed at random points of the terrain's heightfield
+/// </summary>
+/// <param name="renderItems">The render items.</param>
+/// <param name="scaleTerrain">Make the hills higher (false if the terrain in the scene file is already scaled).</param>
+/// <param name="pool">Optional worker pool, the result doesn't depend on it.</param>
+void ExecuteIndirect::Scene::BuildInstanceData(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, bool scaleTerrain, WorkerPool* pool)
 {
-	InstanceData instanceData;
-	XMMATRIX scaleMatrix;
-	XMMATRIX translateMatrix;
-	XMMATRIX instanceWorldMatrix;
-	Vertex* terrainVertices = renderItems["terrain"]->GetVertexBufferData();
-	UINT terrainVerticesCount = renderItems["terrain"]->GetVertexCount();
-
-	std::random_device rd;  //Will be used to obtain a seed for the random number engine
-	std::mt19937 gen(rd()); //Standard mersenne_twister_engine seeded with rd()
-	std::uniform_int_distribution<> dis(0, terrainVerticesCount);	//distribution from range 0 to total vertex count for the terrain
-
-	//generate terrain instance data 
-	scaleMatrix = XMMatrixIdentity();
-	translateMatrix = XMMatrixIdentity();
-	instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-	XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-	XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose( XMLoadFloat4x4(&renderItems["terrain"]->GetTexTransformMatrix())));
-	instanceData.MaterialIndex = renderItems["terrain"]->GetMaterialIndex();
-	renderItems["terrain"]->GetInstances().push_back(instanceData);
-
-	//make hills higher
-	for (UINT i = 0; i < terrainVerticesCount; i++)
-		terrainVertices[i].pos.y *= 2.0;
-	
-	//generate fir tree instance data
-	scaleMatrix = XMMatrixScaling(0.05f, 0.05f, 0.05f);
-	for (UINT i = 0; i < firCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Branches"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Branches"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["Branches"]->GetInstances().push_back(instanceData);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Trunk"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Trunk"]->GetMaterialIndex();
-		renderItems["Trunk"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate complex tree instance data
-	scaleMatrix = XMMatrixScaling(2.0f, 2.0f, 2.0f);
-	for (UINT i = 0; i < complexTreeCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["leaf"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["leaf"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["leaf"]->GetInstances().push_back(instanceData);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["bark"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["bark"]->GetMaterialIndex();
-		renderItems["bark"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate grass instance data
-	scaleMatrix = XMMatrixScaling(2.0f, 2.0f, 2.0f);
-	for (UINT i = 0; i < grassCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["grass"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["grass"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["grass"]->GetInstances().push_back(instanceData);
+	InstanceData instanceData = {};
+	RenderItem* terrain = renderItems["terrain"].get();
+	UINT terrainVerticesCount = terrain->GetVertexCount();
+
+	//regeneration replaces the baked instances
+	for (auto& renderItem : renderItems)
+		renderItem.second->GetInstances().clear();
+
+	//generate terrain instance data - no rotation, scale or translation
+	instanceData.Scale = 1.0f;
+	instanceData.Rotation = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
+	terrain->GetInstances().push_back(instanceData);
+
+	//make hills higher (the vertices of a mapped scene file are read only, so they are copied first)
+	if (scaleTerrain) {
+		terrain->DetachCPUBuffers();
+		XMFLOAT3* vertices = terrain->GetPositionData();
+		for (UINT i = 0; i < terrainVerticesCount; i++)
+			vertices[i].y *= 2.0;
+		terrain->CreateBoundingVolumes();
 	}
-	//generate stone instance data
-	scaleMatrix = XMMatrixScaling(0.05f, 0.05f, 0.05f);
-	for (UINT i = 0; i < stoneCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Stone"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Stone"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["Stone"]->GetInstances().push_back(instanceData);
+	//the heightfield is sampled at uniform points, so the density doesn't follow the tessellation of the terrain
+	{
+		ProfileScope scope("Terrain heightfield");
+		if (!m_Heightfield.Build(&terrain->GetPositionData()->x, terrainVerticesCount, terrain->GetIndexBufferData(), terrain->GetIndexCount())) {
+			OutputDebugStringA("Spawn table: the terrain has no triangles to place the instances on\n");
+			return;
+		}
+		MemoryTracker::Get().SetOwnerName(&m_Heightfield, "Terrain heightfield");
+		MemoryTracker::Get().Set(Memory_Geometry, m_Heightfield.GetByteSize(), &m_Heightfield);
 	}
 
-	//generate deer instance data
-	scaleMatrix = XMMatrixScaling(3.0f, 3.0f, 3.0f);
-	for (UINT i = 0; i < deerCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Deer_body"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Deer_body"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["Deer_body"]->GetInstances().push_back(instanceData);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Deer_horns"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Deer_horns"]->GetMaterialIndex();
-		renderItems["Deer_horns"]->GetInstances().push_back(instanceData);
+	//the parts are looked up once per model, a model with a missing part is skipped. The instances of every part are
+	//allocated here, so the chunks of an entry can be placed on any thread.
+	std::vector<SpawnTarget> targets;
+	std::vector<std::pair<RenderItem*, size_t>> partRanges;		// a part and the first instance of the entry
+	std::vector<size_t> firstParts;								// in the part ranges, of every target
+	for (UINT e = 0; e < m_SpawnTable.GetEntries().size(); e++) {
+		const SpawnEntry& entry = m_SpawnTable.GetEntries()[e];
+		UINT count = m_SpawnTable.GetCount(entry);
+		size_t firstPart = partRanges.size();
+		for (auto& partName : entry.Parts) {
+			auto part = renderItems.find(partName);
+			if (part == renderItems.end()) {
+				OutputDebugStringA(("Spawn table: " + entry.Model + " has no render item " + partName + ", it isn't placed\n").c_str());
+				count = 0;
+				break;
+			}
+			partRanges.push_back(std::make_pair(part->second.get(), (size_t)0));
+		}
+		if (count == 0) {
+			partRanges.resize(firstPart);
+			continue;
+		}
+		for (size_t p = firstPart; p < partRanges.size(); p++) {
+			RenderItem* part = partRanges[p].first;
+			partRanges[p].second = part->GetInstances().size();
+			part->GetInstances().resize(part->GetInstances().size() + count);
+		}
+		SpawnTarget target;
+		target.Entry = e;
+		targets.push_back(target);
+		firstParts.push_back(firstPart);
 	}
-
-	//generate bison instance data
-	scaleMatrix = XMMatrixScaling(15.0f, 15.0f, 15.0f);
-	for (UINT i = 0; i < bisonCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y+5.0f, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Bison"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Bison"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["Bison"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate tiger instance data
-	scaleMatrix = XMMatrixScaling(0.005f, 0.005f, 0.005f);
-	for (UINT i = 0; i < tigerCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y+5.0f, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["Tiger"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["Tiger"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["Tiger"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate wolf instance data
-	scaleMatrix = XMMatrixScaling(5.0f, 5.0f, 5.0f);
-	for (UINT i = 0; i < wolfCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["WolfBody"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["WolfBody"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["WolfBody"]->GetInstances().push_back(instanceData);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["WolfFur"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["WolfFur"]->GetMaterialIndex();
-		renderItems["WolfFur"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate house instance data
-	scaleMatrix = XMMatrixScaling(5.0f, 5.0f, 5.0f);
-	for (UINT i = 0; i < houseCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["house"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["house"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["house"]->GetInstances().push_back(instanceData);
-	}
-
-	//generate farmhouse instance data
-	scaleMatrix = XMMatrixScaling(1.0f, 1.0f, 1.0f);
-	for (UINT i = 0; i < farmHouseCount; i++) {
-		INT32 inx = dis(gen);
-		translateMatrix = XMMatrixTranslation(terrainVertices[inx].pos.x, terrainVertices[inx].pos.y, terrainVertices[inx].pos.z);
-		instanceWorldMatrix = XMMatrixMultiply(scaleMatrix, translateMatrix);
-		XMStoreFloat4x4(&instanceData.TexTransform, XMMatrixTranspose(XMLoadFloat4x4(&renderItems["farmhouse"]->GetTexTransformMatrix())));
-		instanceData.MaterialIndex = renderItems["farmhouse"]->GetMaterialIndex();
-		XMStoreFloat4x4(&instanceData.World, XMMatrixTranspose(instanceWorldMatrix));
-		renderItems["farmhouse"]->GetInstances().push_back(instanceData);
+	//a part can be in several entries, so the pointers are taken after all of them are allocated
+	for (size_t t = 0; t < targets.size(); t++) {
+		size_t lastPart = t + 1 < targets.size() ? firstParts[t + 1] : partRanges.size();
+		for (size_t p = firstParts[t]; p < lastPart; p++) {
+			InstanceData* instances = partRanges[p].first->GetInstances().data() + partRanges[p].second;
+			targets[t].Parts.push_back(reinterpret_cast<SceneInstance*>(instances));
+		}
 	}
+	m_SpawnTable.Place(m_Heightfield, targets, pool);
 }
@@ -2,6 +2,9 @@
 #include "pch.h"
 #include "ShaderStructures.h"
 #include "RenderItem.h"
+#include "SpawnTable.h"
+#include "Heightfield.h"
+#include "WorkerPool.h"
 
 namespace ExecuteIndirect
 {
@@ -11,21 +14,16 @@ namespace ExecuteIndirect
 		Scene();
 		~Scene();
 		void SetOccluders(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems);
-		void BuildInstanceData(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems);
+		std::vector<std::string>& GetImpostorModelNames() { return m_ImpostorModelNames; }
+		void BuildInstanceData(std::unordered_map<std::string, std::unique_ptr<RenderItem>>& renderItems, bool scaleTerrain = true, WorkerPool* pool = nullptr);
+		void SetSpawnTable(const SpawnTable& spawnTable) { m_SpawnTable = spawnTable; }		// before BuildInstanceData
+		const SpawnTable& GetSpawnTable() const { return m_SpawnTable; }
+		const Heightfield& GetHeightfield() const { return m_Heightfield; }		// of the terrain, after BuildInstanceData
 	private:
-		
-		const UINT bisonCount = 900;
-		const UINT farmHouseCount = 150;
-		const UINT houseCount = 140;
-		const UINT tigerCount = 900;
-		const UINT firCount = 2400;
-		const UINT complexTreeCount = 10;
-		const UINT stoneCount = 2400;
-		const UINT grassCount = 2400;
-		const UINT deerCount = 900;
-		const UINT wolfCount = 900;
-		std::unordered_map<std::string, InstanceData> m_InstanceData;
+		SpawnTable m_SpawnTable;
+		Heightfield m_Heightfield;
 		std::vector<std::string> m_OccluderModelNames;
+		std::vector<std::string> m_ImpostorModelNames;
 	};
 
 }
\ No newline at end of file
@@ -0,0 +1,723 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "SceneFile.h"
+#include "LZCodec.h"
+#include "Hash.h"
+#include <cstddef>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace ExecuteIndirect;
+
+// An entry of the table of contents of v2 files, which have no hashes
+struct SceneSectionV2
+{
+	uint32_t Type;
+	uint32_t Compression;
+	uint64_t Offset;
+	uint64_t Size;
+};
+
+static uint64_t AlignOffset(uint64_t offset)
+{
+	return (offset + SceneFileAlignment - 1) & ~(SceneFileAlignment - 1);
+}
+
+static uint64_t CountLiveBytes(const std::vector<SceneSection>& toc)
+{
+	uint64_t bytes = AlignOffset(sizeof(SceneFileHeader) + toc.size() * sizeof(SceneSection));
+	for (auto& section : toc)
+		bytes += AlignOffset(section.Size);
+	return bytes;
+}
+
+/// <summary>
+/// Compresses data in independent blocks. Blocks, which don't get smaller, are stored as they are.
+/// </summary>
+/// <param name="blob">The SceneCompressedHeader, the block table and the blocks.</param>
+/// <returns>False if the blob isn't smaller than the data, the data should be stored uncompressed</returns>
+static bool CompressBlob(const void* source, uint64_t sourceSize, std::vector<uint8_t>& blob)
+{
+	uint32_t blockCount = (uint32_t)((sourceSize + SceneCompressionBlockSize - 1) / SceneCompressionBlockSize);
+	uint64_t tableSize = sizeof(SceneCompressedHeader) + blockCount * sizeof(SceneCompressedBlock);
+	blob.assign((size_t)tableSize, 0);
+	std::vector<uint8_t> block(LZCompressBound(SceneCompressionBlockSize));
+	SceneCompressedHeader header = { sourceSize, SceneCompressionBlockSize, blockCount };
+	memcpy(blob.data(), &header, sizeof(header));
+	const uint8_t* data = static_cast<const uint8_t*>(source);
+	for (uint32_t i = 0; i < blockCount; i++) {
+		uint64_t rawOffset = (uint64_t)i * SceneCompressionBlockSize;
+		size_t rawSize = (size_t)(sourceSize - rawOffset < SceneCompressionBlockSize ? sourceSize - rawOffset : SceneCompressionBlockSize);
+		size_t size = LZCompress(data + rawOffset, rawSize, block.data(), block.size());
+		SceneCompressedBlock entry = { (uint32_t)blob.size(), (uint32_t)rawSize };
+		if (size == 0 || size >= rawSize) {
+			blob.insert(blob.end(), data + rawOffset, data + rawOffset + rawSize);
+		}
+		else {
+			entry.Size = (uint32_t)size;
+			blob.insert(blob.end(), block.begin(), block.begin() + size);
+		}
+		memcpy(blob.data() + sizeof(SceneCompressedHeader) + i * sizeof(SceneCompressedBlock), &entry, sizeof(entry));
+	}
+	return blob.size() < sourceSize;
+}
+
+/// <summary>
+/// Maps the whole file for reading
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <returns>False if the file can't be opened or is empty</returns>
+bool MappedFile::Open(const char* fileName)
+{
+	Close();
+#ifdef _WIN32
+	//the journal is appended to a scene file, which is mapped by the renderer
+	HANDLE file = CreateFileA(fileName, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMapping(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	m_file = file;
+	m_mapping = mapping;
+	m_data = static_cast<const uint8_t*>(view);
+	m_size = (uint64_t)fileSize.QuadPart;
+#else
+	int file = open(fileName, O_RDONLY);
+	if (file < 0)
+		return false;
+	struct stat fileStat;
+	if (fstat(file, &fileStat) != 0 || fileStat.st_size == 0) {
+		close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, (size_t)fileStat.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	//the mapping keeps its own reference to the file
+	close(file);
+	if (view == MAP_FAILED)
+		return false;
+	m_data = static_cast<const uint8_t*>(view);
+	m_size = (uint64_t)fileStat.st_size;
+#endif
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (!m_data)
+		return;
+#ifdef _WIN32
+	UnmapViewOfFile(m_data);
+	CloseHandle(m_mapping);
+	CloseHandle(m_file);
+	m_file = nullptr;
+	m_mapping = nullptr;
+#else
+	munmap(const_cast<uint8_t*>(m_data), (size_t)m_size);
+#endif
+	m_data = nullptr;
+	m_size = 0;
+}
+
+/// <summary>
+/// Replaces a scene file with its pending version, if there is one
+/// </summary>
+/// <param name="fileName">Name of the scene file.</param>
+/// <returns>True if the file was replaced</returns>
+bool ExecuteIndirect::CommitPendingSceneFile(const char* fileName)
+{
+	std::string pendingName = std::string(fileName) + ScenePendingSuffix;
+	std::ifstream pending(pendingName, std::ios::binary);
+	if (!pending.is_open())
+		return false;
+	pending.close();
+#ifdef _WIN32
+	return MoveFileExA(pendingName.c_str(), fileName, MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	return rename(pendingName.c_str(), fileName) == 0;
+#endif
+}
+
+/// <summary>
+/// Rewrites the live sections of a scene file with a journal, the replaced blobs and the old tables of contents are
+/// dropped. The sections keep their indices and compressed blobs are copied as they are.
+/// </summary>
+/// <param name="fileName">Name of the scene file.</param>
+/// <param name="outputFileName">Name of the compacted file, e.g. the pending version of the scene file.</param>
+/// <returns>False if the file can't be read or the output can't be written</returns>
+bool ExecuteIndirect::CompactSceneFile(const char* fileName, const char* outputFileName)
+{
+	SceneFile file;
+	file.SetVerifyMode(SceneVerify_Lazy);
+	if (!file.Open(fileName))
+		return false;
+	SceneFileWriter writer;
+	for (uint32_t i = 0; i < file.GetSectionCount(); i++) {
+		const SceneSection& section = file.GetSection(i);
+		if (!file.VerifySection(i))
+			return false;
+		writer.AddEncodedSection(section.Type, section.Compression, file.GetSectionData(i), section.Size);
+	}
+	return writer.Write(outputFileName, file.GetRenderItemCount(), file.GetFlags());
+}
+
+/// <summary>
+/// Adds a section, which data is owned by the caller and must be alive until Write
+/// </summary>
+/// <returns>The index of the section in the table of contents</returns>
+uint32_t SceneFileWriter::AddSection(uint32_t type, const void* data, uint64_t size, uint32_t compression)
+{
+	m_sections.push_back({ type, compression, data, size, false });
+	return (uint32_t)m_sections.size() - 1;
+}
+
+/// <summary>
+/// Adds a section, which blob is already encoded with the compression, e.g. copied from another scene file
+/// </summary>
+/// <returns>The index of the section in the table of contents</returns>
+uint32_t SceneFileWriter::AddEncodedSection(uint32_t type, uint32_t compression, const void* blob, uint64_t size)
+{
+	m_sections.push_back({ type, compression, blob, size, true });
+	return (uint32_t)m_sections.size() - 1;
+}
+
+/// <summary>
+/// Adds a section, which data is kept by the writer
+/// </summary>
+/// <returns>The index of the section in the table of contents</returns>
+uint32_t SceneFileWriter::AddSection(uint32_t type, std::vector<uint8_t>&& data)
+{
+	m_ownedData.push_back(std::move(data));
+	return AddSection(type, m_ownedData.back().data(), m_ownedData.back().size());
+}
+
+/// <summary>
+/// Replaces the data of a section with the compressed blob, the section stays uncompressed if the blob isn't smaller
+/// than the data
+/// </summary>
+void SceneFileWriter::CompressSection(PendingSection& section)
+{
+	std::vector<uint8_t> blob;
+	m_rawSize += section.Size;
+	if (!CompressBlob(section.Data, section.Size, blob)) {
+		section.Compression = SceneCompression_None;
+		m_compressedSize += section.Size;
+		return;
+	}
+	m_compressedSize += blob.size();
+	m_ownedData.push_back(std::move(blob));
+	section.Data = m_ownedData.back().data();
+	section.Size = m_ownedData.back().size();
+}
+
+/// <summary>
+/// Writes the header, the table of contents and the aligned section blobs
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <param name="renderItemCount">The number of records in the render items section.</param>
+/// <param name="flags">The SceneFileFlags.</param>
+/// <returns>False if the file can't be written</returns>
+bool SceneFileWriter::Write(const char* fileName, uint32_t renderItemCount, uint32_t flags)
+{
+	m_rawSize = 0;
+	m_compressedSize = 0;
+	for (auto& section : m_sections) {
+		if (section.Encoded)
+			continue;
+		if (section.Compression == SceneCompression_LZ && section.Size > 0)
+			CompressSection(section);
+		else
+			section.Compression = SceneCompression_None;
+	}
+
+	std::vector<SceneSection> toc(m_sections.size());
+	uint64_t offset = AlignOffset(sizeof(SceneFileHeader) + toc.size() * sizeof(SceneSection));
+	for (size_t i = 0; i < m_sections.size(); i++) {
+		toc[i].Type = m_sections[i].Type;
+		toc[i].Compression = m_sections[i].Compression;
+		toc[i].Offset = offset;
+		toc[i].Size = m_sections[i].Size;
+		toc[i].Hash = HashBytes(m_sections[i].Data, (size_t)m_sections[i].Size);
+		offset = AlignOffset(offset + m_sections[i].Size);
+	}
+
+	SceneFileHeader header = {};
+	header.Magic = SceneFileMagic;
+	header.Version = SceneFileVersion;
+	header.SectionCount = (uint32_t)toc.size();
+	header.RenderItemCount = renderItemCount;
+	header.TocOffset = sizeof(SceneFileHeader);
+	header.FileSize = offset;
+	header.Flags = flags;
+	header.TocHash = HashBytes(toc.data(), toc.size() * sizeof(SceneSection));
+
+	std::ofstream stream;
+	stream.open(fileName, std::ios::trunc | std::ios::binary);
+	if (!stream.is_open())
+		return false;
+	const char padding[SceneFileAlignment] = {};
+	stream.write((const char*)&header, sizeof(SceneFileHeader));
+	stream.write((const char*)toc.data(), toc.size() * sizeof(SceneSection));
+	uint64_t written = sizeof(SceneFileHeader) + toc.size() * sizeof(SceneSection);
+	for (size_t i = 0; i < m_sections.size(); i++) {
+		stream.write(padding, toc[i].Offset - written);
+		stream.write((const char*)m_sections[i].Data, m_sections[i].Size);
+		written = toc[i].Offset + toc[i].Size;
+	}
+	stream.write(padding, header.FileSize - written);
+	bool result = stream.good();
+	stream.close();
+	m_sections.clear();
+	m_ownedData.clear();
+	return result;
+}
+
+/// <summary>
+/// Checks if a file starts with the magic of the scene files, so a corrupted scene file isn't read as the old format
+/// </summary>
+bool SceneFile::IsSceneFile(const char* fileName)
+{
+	std::ifstream stream(fileName, std::ios::binary);
+	uint32_t magic = 0;
+	stream.read((char*)&magic, sizeof(magic));
+	return stream.good() && magic == SceneFileMagic;
+}
+
+/// <summary>
+/// Maps a scene file and validates the header, the table of contents and the render item records. Unless the verify
+/// mode is SceneVerify_None, the table of contents and the tables, used here, are checked against their hashes.
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <returns>False if the file is missing, isn't a v2/v3 scene file, is truncated or corrupted</returns>
+bool SceneFile::Open(const char* fileName)
+{
+	Close();
+	if (!m_file.Open(fileName))
+		return false;
+	const uint8_t* data = m_file.GetData();
+	uint64_t fileSize = m_file.GetSize();
+	auto header = reinterpret_cast<const SceneFileHeader*>(data);
+	if (fileSize < sizeof(SceneFileHeader) || header->Magic != SceneFileMagic ||
+		(header->Version != SceneFileVersion && header->Version != 2) || header->FileSize > fileSize) {
+		m_file.Close();
+		return false;
+	}
+	bool hashed = header->Version >= SceneFileFirstHashedVersion;
+	uint64_t entrySize = hashed ? sizeof(SceneSection) : sizeof(SceneSectionV2);
+	uint64_t tocOffset = header->TocOffset;
+	uint32_t sectionCount = header->SectionCount;
+	m_renderItemCount = header->RenderItemCount;
+	m_flags = header->Flags;
+	//the newest journal entry replaces the table of contents of the header, its table is always checked, a torn entry
+	//is an interrupted save rather than a corruption
+	m_journalRecord = hashed ? FindJournalRecord(data, header->FileSize, fileSize) : 0;
+	if (m_journalRecord) {
+		auto record = reinterpret_cast<const SceneJournalRecord*>(data + m_journalRecord);
+		tocOffset = record->TocOffset;
+		sectionCount = record->SectionCount;
+		m_renderItemCount = record->RenderItemCount;
+		m_flags = record->Flags;
+		m_journalLength = (uint32_t)record->Sequence;
+	}
+	else if (header->TocOffset + (uint64_t)header->SectionCount * entrySize > fileSize ||
+		(m_verifyMode == SceneVerify_Strict && !hashed) ||
+		(m_verifyMode != SceneVerify_None && hashed &&
+			HashBytes(data + header->TocOffset, (size_t)(header->SectionCount * entrySize)) != header->TocHash)) {
+		m_file.Close();
+		return false;
+	}
+	m_sections.resize(sectionCount);
+	if (hashed) {
+		memcpy(m_sections.data(), data + tocOffset, sectionCount * sizeof(SceneSection));
+	}
+	else {
+		auto sections = reinterpret_cast<const SceneSectionV2*>(data + tocOffset);
+		for (uint32_t i = 0; i < sectionCount; i++)
+			m_sections[i] = { sections[i].Type, sections[i].Compression, sections[i].Offset, sections[i].Size, 0 };
+	}
+	for (uint32_t i = 0; i < sectionCount; i++) {
+		if (m_sections[i].Offset % SceneFileAlignment || m_sections[i].Offset + m_sections[i].Size > fileSize ||
+			(m_sections[i].Compression != SceneCompression_None && !ValidateCompressedSection(m_sections[i], data + m_sections[i].Offset))) {
+			Close();
+			return false;
+		}
+	}
+	m_header = header;
+	m_sectionStates.reset(new std::atomic<uint8_t>[sectionCount]);
+	for (uint32_t i = 0; i < sectionCount; i++)
+		m_sectionStates[i] = Section_Unverified;
+
+	uint32_t itemsSection = FindSection(SceneSection_RenderItems);
+	uint32_t namesSection = FindSection(SceneSection_Names);
+	bool valid = itemsSection != SceneInvalidSection && namesSection != SceneInvalidSection &&
+		m_sections[itemsSection].Size == (uint64_t)m_renderItemCount * sizeof(SceneItemRecord) &&
+		VerifySection(itemsSection) && VerifySection(namesSection);
+	if (valid) {
+		m_items = static_cast<const SceneItemRecord*>(GetSectionData(itemsSection));
+		m_names = static_cast<const char*>(GetSectionData(namesSection));
+	}
+	uint64_t namesSize = valid ? m_sections[namesSection].Size : 0;
+	for (uint32_t i = 0; valid && i < m_renderItemCount; i++) {
+		const SceneItemRecord& item = m_items[i];
+		valid = item.NameOffset < namesSize && memchr(m_names + item.NameOffset, '\0', namesSize - item.NameOffset) &&
+			item.PositionSection < sectionCount && item.AttributeSection < sectionCount && item.IndexSection < sectionCount &&
+			(item.InstanceSection == SceneInvalidSection || item.InstanceSection < sectionCount);
+	}
+	//the bounds are optional, the loader computes them if they are missing
+	uint32_t boundsSection = FindSection(SceneSection_Bounds);
+	if (valid && boundsSection != SceneInvalidSection &&
+		m_sections[boundsSection].Size == (uint64_t)m_renderItemCount * sizeof(SceneItemBounds)) {
+		if (VerifySection(boundsSection))
+			m_bounds = static_cast<const SceneItemBounds*>(GetSectionData(boundsSection));
+		else
+			valid = m_verifyMode != SceneVerify_Strict;
+	}
+	if (!valid)
+		Close();
+	return valid;
+}
+
+void SceneFile::Close()
+{
+	m_file.Close();
+	m_header = nullptr;
+	m_sections.clear();
+	m_renderItemCount = 0;
+	m_flags = 0;
+	m_journalLength = 0;
+	m_journalRecord = 0;
+	m_sectionStates.reset();
+	m_items = nullptr;
+	m_bounds = nullptr;
+	m_names = nullptr;
+}
+
+/// <summary>
+/// Checks a section against its hash, the first time it is called for the section. It can be called from several threads.
+/// </summary>
+/// <param name="section">The index of the section.</param>
+/// <returns>False if the section is corrupted, true if it matches its hash or isn't verified (SceneVerify_None, v2 files)</returns>
+bool SceneFile::VerifySection(uint32_t section) const
+{
+	if (m_verifyMode == SceneVerify_None || !HasHashes())
+		return true;
+	uint8_t state = m_sectionStates[section];
+	if (state == Section_Unverified) {
+		//two threads may hash the same section, they store the same result
+		bool valid = HashBytes(GetSectionData(section), (size_t)m_sections[section].Size) == m_sections[section].Hash;
+		state = valid ? Section_Valid : Section_Corrupted;
+		m_sectionStates[section] = state;
+	}
+	return state == Section_Valid;
+}
+
+/// <summary>
+/// Gets a pointer to the blob of a section in the mapping
+/// </summary>
+const void* SceneFile::GetSectionData(uint32_t section) const
+{
+	return m_file.GetData() + m_sections[section].Offset;
+}
+
+/// <summary>
+/// Gets the size of the section's data, after the decompression
+/// </summary>
+uint64_t SceneFile::GetRawSize(uint32_t section) const
+{
+	if (!IsCompressed(section))
+		return m_sections[section].Size;
+	return static_cast<const SceneCompressedHeader*>(GetSectionData(section))->RawSize;
+}
+
+/// <summary>
+/// Gets the number of independently compressed blocks of a section, 0 for uncompressed sections
+/// </summary>
+uint32_t SceneFile::GetBlockCount(uint32_t section) const
+{
+	if (!IsCompressed(section))
+		return 0;
+	return static_cast<const SceneCompressedHeader*>(GetSectionData(section))->BlockCount;
+}
+
+/// <summary>
+/// Decompresses a block of a section. The blocks are independent, so they can be decompressed in parallel.
+/// </summary>
+/// <param name="section">The index of the section.</param>
+/// <param name="block">The index of the block.</param>
+/// <param name="destination">The start of the section's decompressed data (GetRawSize bytes), the block is written at its offset.</param>
+/// <returns>False if the block is corrupted</returns>
+bool SceneFile::DecompressBlock(uint32_t section, uint32_t block, void* destination) const
+{
+	auto blob = static_cast<const uint8_t*>(GetSectionData(section));
+	auto header = reinterpret_cast<const SceneCompressedHeader*>(blob);
+	auto blocks = reinterpret_cast<const SceneCompressedBlock*>(blob + sizeof(SceneCompressedHeader));
+	uint64_t rawOffset = (uint64_t)block * header->BlockSize;
+	uint64_t rawSize = header->RawSize - rawOffset < header->BlockSize ? header->RawSize - rawOffset : header->BlockSize;
+	uint8_t* out = static_cast<uint8_t*>(destination) + rawOffset;
+	if (blocks[block].Size == rawSize) {
+		memcpy(out, blob + blocks[block].Offset, (size_t)rawSize);
+		return true;
+	}
+	return LZDecompress(blob + blocks[block].Offset, blocks[block].Size, out, (size_t)rawSize);
+}
+
+/// <summary>
+/// Checks if the block table of a compressed section matches its raw size and the blocks are in the section
+/// </summary>
+bool SceneFile::ValidateCompressedSection(const SceneSection& section, const uint8_t* data) const
+{
+	if (section.Compression != SceneCompression_LZ || section.Size < sizeof(SceneCompressedHeader))
+		return false;
+	auto header = reinterpret_cast<const SceneCompressedHeader*>(data);
+	if (header->BlockSize == 0 || header->BlockCount != (header->RawSize + header->BlockSize - 1) / header->BlockSize ||
+		sizeof(SceneCompressedHeader) + (uint64_t)header->BlockCount * sizeof(SceneCompressedBlock) > section.Size)
+		return false;
+	auto blocks = reinterpret_cast<const SceneCompressedBlock*>(data + sizeof(SceneCompressedHeader));
+	for (uint32_t i = 0; i < header->BlockCount; i++) {
+		if ((uint64_t)blocks[i].Offset + blocks[i].Size > section.Size)
+			return false;
+	}
+	return true;
+}
+
+/// <summary>
+/// Gets the bytes of the file, which are used by the current table of contents - the header, the table and the
+/// aligned blobs. The rest are replaced blobs and old tables, which a compaction drops.
+/// </summary>
+uint64_t SceneFile::GetLiveBytes() const
+{
+	return CountLiveBytes(m_sections);
+}
+
+/// <summary>
+/// Finds the newest valid journal record. The records are aligned and end the file, unless the last save was
+/// interrupted - then the record before the torn entry is searched for.
+/// </summary>
+/// <param name="data">The mapped file.</param>
+/// <param name="start">The end of the file, written with the header.</param>
+/// <param name="fileSize">The size of the file.</param>
+/// <returns>The offset of the record, 0 if the file has no journal</returns>
+uint64_t SceneFile::FindJournalRecord(const uint8_t* data, uint64_t start, uint64_t fileSize) const
+{
+	const size_t hashedSize = offsetof(SceneJournalRecord, Hash);
+	for (uint64_t offset = (fileSize & ~(SceneFileAlignment - 1)); offset >= start + sizeof(SceneJournalRecord);) {
+		offset -= sizeof(SceneJournalRecord);
+		auto record = reinterpret_cast<const SceneJournalRecord*>(data + offset);
+		if (record->Magic != SceneJournalMagic || record->Hash != HashBytes(record, hashedSize))
+			continue;
+		uint64_t tocSize = (uint64_t)record->SectionCount * sizeof(SceneSection);
+		if (record->TocOffset % SceneFileAlignment || record->TocOffset < start || record->TocOffset + tocSize > offset ||
+			HashBytes(data + record->TocOffset, (size_t)tocSize) != record->TocHash)
+			continue;
+		return offset;
+	}
+	return 0;
+}
+
+uint32_t SceneFile::FindSection(uint32_t type) const
+{
+	//the tables are used in place, so they are never compressed
+	for (uint32_t i = 0; i < m_sections.size(); i++) {
+		if (m_sections[i].Type == type && !IsCompressed(i))
+			return i;
+	}
+	return SceneInvalidSection;
+}
+
+/// <summary>
+/// Opens a v3 scene file for appending a journal entry. The current table of contents is the one of the newest entry.
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <returns>False if the file can't be read or is a v2 file, which has to be rewritten</returns>
+bool SceneJournalWriter::Open(const char* fileName)
+{
+	m_pending.clear();
+	m_ownedData.clear();
+	m_appendedBytes = 0;
+	m_file.SetVerifyMode(SceneVerify_None);
+	if (!m_file.Open(fileName) || !m_file.HasHashes()) {
+		m_file.Close();
+		return false;
+	}
+	m_fileName = fileName;
+	m_toc.resize(m_file.GetSectionCount());
+	for (uint32_t i = 0; i < m_file.GetSectionCount(); i++)
+		m_toc[i] = m_file.GetSection(i);
+	m_previousRecord = m_file.GetJournalRecordOffset();
+	m_journalLength = m_file.GetJournalLength();
+	m_fileSize = m_file.GetFileSize();
+	m_liveBytes = CountLiveBytes(m_toc);
+	return true;
+}
+
+/// <summary>
+/// Replaces the data of a section, the section keeps its index and type
+/// </summary>
+void SceneJournalWriter::ReplaceSection(uint32_t section, const void* data, uint64_t size, uint32_t compression)
+{
+	m_pending.push_back({ section, compression, data, size });
+}
+
+/// <summary>
+/// Replaces the data of a section with data, which is kept by the writer
+/// </summary>
+void SceneJournalWriter::ReplaceSection(uint32_t section, std::vector<uint8_t>&& data)
+{
+	m_ownedData.push_back(std::move(data));
+	ReplaceSection(section, m_ownedData.back().data(), m_ownedData.back().size());
+}
+
+/// <summary>
+/// Adds a section after the sections of the file
+/// </summary>
+/// <returns>The index of the section in the table of contents</returns>
+uint32_t SceneJournalWriter::AddSection(uint32_t type, const void* data, uint64_t size, uint32_t compression)
+{
+	m_toc.push_back({ type, SceneCompression_None, 0, 0, 0 });
+	ReplaceSection((uint32_t)m_toc.size() - 1, data, size, compression);
+	return (uint32_t)m_toc.size() - 1;
+}
+
+/// <summary>
+/// Helper function - writes the data of a file, which is in the cache of the system, to the disk. A stream must be
+/// flushed before, so its data is in the cache.
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <returns>False if the file can't be opened or synced</returns>
+static bool SyncFile(const std::string& fileName)
+{
+#ifdef _WIN32
+	//FlushFileBuffers needs a handle with write access, it flushes the data written through every handle of the file
+	HANDLE file = CreateFileA(fileName.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+	bool result = FlushFileBuffers(file) != 0;
+	CloseHandle(file);
+#else
+	//fsync writes the dirty pages of the file, not only the ones written through this descriptor
+	int file = open(fileName.c_str(), O_WRONLY);
+	if (file < 0)
+		return false;
+	bool result = fsync(file) == 0;
+	close(file);
+#endif
+	return result;
+}
+
+/// <summary>
+/// Appends the blobs, the table of contents and the journal record. The record is written last, after the data is on
+/// the disk, so an interrupted entry or a power loss before the record is complete leaves the previous entry.
+/// </summary>
+/// <param name="renderItemCount">The number of records in the render items section.</param>
+/// <param name="flags">The SceneFileFlags.</param>
+/// <returns>False if the file can't be written</returns>
+bool SceneJournalWriter::Commit(uint32_t renderItemCount, uint32_t flags)
+{
+	if (m_fileName.empty())
+		return false;
+	for (auto& section : m_pending) {
+		std::vector<uint8_t> blob;
+		if (section.Compression != SceneCompression_LZ || section.Size == 0 || !CompressBlob(section.Data, section.Size, blob)) {
+			section.Compression = SceneCompression_None;
+			continue;
+		}
+		m_ownedData.push_back(std::move(blob));
+		section.Data = m_ownedData.back().data();
+		section.Size = m_ownedData.back().size();
+	}
+	m_file.Close();
+
+	std::fstream stream(m_fileName, std::ios::in | std::ios::out | std::ios::binary);
+	if (!stream.is_open())
+		return false;
+	//a torn entry of an interrupted save is left in place, the new entry starts after it
+	stream.seekp(0, std::ios::end);
+	uint64_t fileEnd = (uint64_t)stream.tellp();
+	uint64_t start = AlignOffset(fileEnd);
+	uint64_t offset = start;
+	for (auto& section : m_pending) {
+		SceneSection& entry = m_toc[section.Index];
+		entry.Compression = section.Compression;
+		entry.Offset = offset;
+		entry.Size = section.Size;
+		entry.Hash = HashBytes(section.Data, (size_t)section.Size);
+		offset = AlignOffset(offset + section.Size);
+	}
+	SceneJournalRecord record = {};
+	record.Magic = SceneJournalMagic;
+	record.SectionCount = (uint32_t)m_toc.size();
+	record.RenderItemCount = renderItemCount;
+	record.Flags = flags;
+	record.TocOffset = offset;
+	record.TocHash = HashBytes(m_toc.data(), m_toc.size() * sizeof(SceneSection));
+	record.Previous = m_previousRecord;
+	record.Sequence = m_journalLength + 1;
+	uint64_t recordOffset = AlignOffset(offset + m_toc.size() * sizeof(SceneSection));
+	record.Hash = HashBytes(&record, offsetof(SceneJournalRecord, Hash));
+
+	const char padding[SceneFileAlignment] = {};
+	uint64_t written = fileEnd;
+	for (auto& section : m_pending) {
+		const SceneSection& entry = m_toc[section.Index];
+		stream.write(padding, entry.Offset - written);
+		stream.write((const char*)section.Data, section.Size);
+		written = entry.Offset + entry.Size;
+	}
+	stream.write(padding, record.TocOffset - written);
+	stream.write((const char*)m_toc.data(), m_toc.size() * sizeof(SceneSection));
+	stream.write(padding, recordOffset - (record.TocOffset + m_toc.size() * sizeof(SceneSection)));
+	//the record goes to the disk after the data it points to - the disk can reorder the writes of one flush
+	stream.flush();
+	bool result = stream.good() && SyncFile(m_fileName);
+	if (result) {
+		stream.write((const char*)&record, sizeof(record));
+		stream.flush();
+		result = stream.good() && SyncFile(m_fileName);
+	}
+	stream.close();
+
+	m_appendedBytes = recordOffset + sizeof(record) - fileEnd;
+	m_fileSize = recordOffset + sizeof(record);
+	m_liveBytes = CountLiveBytes(m_toc);
+	if (result) {
+		m_previousRecord = recordOffset;
+		m_journalLength++;
+	}
+	m_pending.clear();
+	m_ownedData.clear();
+	return result;
+}
+
+/// <summary>
+/// The file should be compacted, if the replaced blobs and tables take more than the live sections, or after many
+/// entries, since each entry has a full table of contents
+/// </summary>
+bool SceneJournalWriter::ShouldCompact() const
+{
+	const uint32_t MaxJournalLength = 64;
+	return m_fileSize > 2 * m_liveBytes || m_journalLength >= MaxJournalLength;
+}
@@ -0,0 +1,325 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// scene.bin v3 layout:
+	//   SceneFileHeader | SceneSection[SectionCount] | section blobs, each one 64 byte aligned
+	// Render item records reference their blobs by section index, so the loader maps the file once
+	// and the render items point straight into the mapping. The structures don't use DirectXMath,
+	// so the format can be read and written without the rest of the renderer.
+	// v3 adds the hashes of the table of contents and of every section, v2 files are still read.
+	//
+	// A v3 file can have a journal of edits appended to it:
+	//   ... | changed section blobs | SceneSection[SectionCount] | SceneJournalRecord
+	// The record points to the new table of contents, which has every section of the file - the changed ones at their
+	// new offsets. The header isn't rewritten, the reader takes the table of the last valid record at the end of the file.
+	const uint32_t SceneFileMagic = 0x43534945;		// "EISC"
+	const uint32_t SceneFileVersion = 3;
+	const uint32_t SceneFileFirstHashedVersion = 3;
+	const uint64_t SceneFileAlignment = 64;
+	const uint32_t SceneInvalidSection = ~0u;
+
+	enum SceneFileFlags : uint32_t
+	{
+		SceneFlag_BakedInstances = 1,	// the instance sections hold the generated instances, the terrain heights are already scaled
+		SceneFlag_CompactInstances = 4,	// the instances have the SceneInstance layout (2 marked an older, 48 byte one)
+	};
+
+	// How much of the file is checked against the hashes
+	enum SceneVerifyMode : uint32_t
+	{
+		SceneVerify_None = 0,			// trust the file, only the sizes and offsets are validated
+		SceneVerify_Lazy,				// a section is verified the first time it is touched, corrupted render items are skipped
+		SceneVerify_Strict,				// the file must have hashes and every section is verified, a mismatch fails the load (CI)
+	};
+
+	// The sections can be compressed with the LZ codec in independent blocks, which are decompressed in parallel
+	enum SceneCompression : uint32_t
+	{
+		SceneCompression_None = 0,
+		SceneCompression_LZ,
+	};
+	const uint32_t SceneCompressionBlockSize = 256 * 1024;
+
+	// A scene file can't be replaced while it is mapped, so a new one is written next to it with this suffix
+	// and replaces it at the next load
+	const char* const ScenePendingSuffix = ".pending";
+	bool CommitPendingSceneFile(const char* fileName);
+	// Rewrites the live sections of a file with a journal as a new file without one, the section indices stay
+	bool CompactSceneFile(const char* fileName, const char* outputFileName);
+
+	const uint32_t SceneJournalMagic = 0x4E4A4945;		// "EIJN"
+
+	enum SceneSectionType : uint32_t
+	{
+		SceneSection_Names = 0,			// render item names, each one terminated with '\0'
+		SceneSection_RenderItems,		// SceneItemRecord[RenderItemCount]
+		SceneSection_Positions,			// XMFLOAT3[VertexCount] of a render item
+		SceneSection_Attributes,		// VertexAttributes[VertexCount] of a render item
+		SceneSection_Indices,			// UINT[IndexCount] of a render item
+		SceneSection_Instances,			// InstanceData[InstanceCount] of a render item
+		SceneSection_Bounds,			// SceneItemBounds[RenderItemCount], in the order of the records
+	};
+
+	struct SceneFileHeader
+	{
+		uint32_t Magic;
+		uint32_t Version;
+		uint32_t SectionCount;
+		uint32_t RenderItemCount;
+		uint64_t TocOffset;
+		uint64_t FileSize;
+		uint32_t Flags;					// SceneFileFlags
+		uint32_t Reserved0;
+		uint64_t TocHash;				// of the table of contents (v3)
+		uint8_t Reserved[16];
+	};
+	static_assert(sizeof(SceneFileHeader) == SceneFileAlignment, "The header must keep the table of contents aligned");
+
+	// An entry of the table of contents
+	struct SceneSection
+	{
+		uint32_t Type;
+		uint32_t Compression;			// SceneCompression, 0 in files written before the compression
+		uint64_t Offset;
+		uint64_t Size;					// the size in the file
+		uint64_t Hash;					// of the blob in the file (v3)
+	};
+
+	// Ends a journal entry, it is written after the entry's blobs and table of contents
+	struct SceneJournalRecord
+	{
+		uint32_t Magic;
+		uint32_t SectionCount;
+		uint32_t RenderItemCount;
+		uint32_t Flags;
+		uint64_t TocOffset;
+		uint64_t TocHash;
+		uint64_t Previous;				// offset of the previous record, 0 for the first one
+		uint64_t Sequence;				// 1 for the first record
+		uint8_t Reserved[8];
+		uint64_t Hash;					// of the record up to this field
+	};
+	static_assert(sizeof(SceneJournalRecord) == SceneFileAlignment, "The journal records are aligned like the blobs");
+
+	// The blob of a compressed section: SceneCompressedHeader | SceneCompressedBlock[BlockCount] | block data
+	struct SceneCompressedHeader
+	{
+		uint64_t RawSize;
+		uint32_t BlockSize;				// every block but the last one decompresses to BlockSize bytes
+		uint32_t BlockCount;
+	};
+
+	struct SceneCompressedBlock
+	{
+		uint32_t Offset;				// from the start of the section blob
+		uint32_t Size;					// equal to the raw size if the block is stored uncompressed
+	};
+
+	struct SceneItemRecord
+	{
+		uint32_t NameOffset;			// in the names section
+		uint32_t VertexCount;
+		uint32_t IndexCount;
+		uint32_t MaterialIndex;
+		uint32_t PositionSection;
+		uint32_t AttributeSection;
+		uint32_t IndexSection;
+		uint32_t InstanceSection;		// SceneInvalidSection if the instances are generated at startup
+		float World[16];
+		float TexTransform[16];
+	};
+
+	// Layouts of the vertex streams - XMFLOAT3 and VertexAttributes in the renderer
+	struct ScenePosition
+	{
+		float x, y, z;
+	};
+
+	struct SceneVertexAttributes
+	{
+		float Normal[3];
+		float TextureCoordinates[2];
+		float Tangent[3];
+	};
+
+	// Layout of InstanceData - a translation, a uniform scale and a rotation instead of the world matrix (see
+	// InstancePacking.h), the texture transform and the material are in the record of the item. The scale of every
+	// instance is positive, a zeroed instance is an empty slot, which the culling shader skips.
+	struct SceneInstance
+	{
+		float Position[3];
+		float Scale;
+		float Rotation[4];				// unit quaternion x, y, z, w
+	};
+
+	// Bounding volumes of a render item in model space, computed when the scene file is written
+	struct SceneItemBounds
+	{
+		float BoxCenter[3];
+		float BoxExtents[3];
+		float SphereCenter[3];
+		float SphereRadius;
+		float OrientedBoxCenter[3];
+		float OrientedBoxExtents[3];
+		float OrientedBoxOrientation[4];	// quaternion
+	};
+
+	// Read only mapping of a whole file
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+		~MappedFile() { Close(); }
+
+		bool Open(const char* fileName);
+		void Close();
+
+		const uint8_t* GetData() const { return m_data; }
+		uint64_t GetSize() const { return m_size; }
+
+	private:
+		const uint8_t* m_data = nullptr;
+		uint64_t m_size = 0;
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
+
+	// Collects the section blobs and writes them with the header and the table of contents
+	class SceneFileWriter
+	{
+	public:
+		uint32_t AddSection(uint32_t type, const void* data, uint64_t size, uint32_t compression = SceneCompression_None);
+		uint32_t AddSection(uint32_t type, std::vector<uint8_t>&& data);
+		// A blob, which is already compressed (copied from another scene file)
+		uint32_t AddEncodedSection(uint32_t type, uint32_t compression, const void* blob, uint64_t size);
+		bool Write(const char* fileName, uint32_t renderItemCount, uint32_t flags = 0);
+
+		uint64_t GetRawSize() const { return m_rawSize; }				// of the compressed sections, after Write
+		uint64_t GetCompressedSize() const { return m_compressedSize; }
+
+	private:
+		struct PendingSection
+		{
+			uint32_t Type;
+			uint32_t Compression;
+			const void* Data;		// not owned, must be alive until Write
+			uint64_t Size;
+			bool Encoded;			// Data is the compressed blob
+		};
+		void CompressSection(PendingSection& section);
+		std::vector<PendingSection> m_sections;
+		std::vector<std::vector<uint8_t>> m_ownedData;
+		uint64_t m_rawSize = 0;
+		uint64_t m_compressedSize = 0;
+	};
+
+	// A validated, mapped scene file. The blobs stay valid while the object is alive.
+	class SceneFile
+	{
+	public:
+		static bool IsSceneFile(const char* fileName);
+		void SetVerifyMode(uint32_t mode) { m_verifyMode = mode; }		// before Open
+		uint32_t GetVerifyMode() const { return m_verifyMode; }
+		bool Open(const char* fileName);
+		void Close();
+		bool IsOpen() const { return m_header != nullptr; }
+		bool HasHashes() const { return m_header->Version >= SceneFileFirstHashedVersion; }
+		bool VerifySection(uint32_t section) const;
+
+		uint32_t GetRenderItemCount() const { return m_renderItemCount; }
+		uint32_t GetFlags() const { return m_flags; }
+		const SceneItemRecord* GetRenderItems() const { return m_items; }
+		const SceneItemBounds* GetBounds() const { return m_bounds; }		// nullptr for files without bounds
+		const char* GetName(const SceneItemRecord& item) const { return m_names + item.NameOffset; }
+		uint32_t GetSectionCount() const { return (uint32_t)m_sections.size(); }
+		const SceneSection& GetSection(uint32_t section) const { return m_sections[section]; }
+		const void* GetSectionData(uint32_t section) const;		// the compressed blob for compressed sections
+		bool IsCompressed(uint32_t section) const { return m_sections[section].Compression != SceneCompression_None; }
+		uint64_t GetRawSize(uint32_t section) const;
+		uint32_t GetBlockCount(uint32_t section) const;
+		bool DecompressBlock(uint32_t section, uint32_t block, void* destination) const;
+
+		// The journal - the records appended since the file was written, and the bytes of the file, which are still used
+		uint32_t GetJournalLength() const { return m_journalLength; }
+		uint64_t GetJournalRecordOffset() const { return m_journalRecord; }
+		uint64_t GetFileSize() const { return m_file.GetSize(); }
+		uint64_t GetLiveBytes() const;
+		// The first uncompressed section of the type, e.g. one of the tables
+		uint32_t FindSection(uint32_t type) const;
+
+	private:
+		uint64_t FindJournalRecord(const uint8_t* data, uint64_t start, uint64_t fileSize) const;
+		bool ValidateCompressedSection(const SceneSection& section, const uint8_t* data) const;
+
+		enum SectionState : uint8_t
+		{
+			Section_Unverified = 0,
+			Section_Valid,
+			Section_Corrupted,
+		};
+
+		MappedFile m_file;
+		const SceneFileHeader* m_header = nullptr;
+		std::vector<SceneSection> m_sections;				// copied, v2 entries are converted
+		uint32_t m_renderItemCount = 0;					// of the header or of the last journal record
+		uint32_t m_flags = 0;
+		uint32_t m_journalLength = 0;
+		uint64_t m_journalRecord = 0;						// offset of the last journal record, 0 without a journal
+		std::unique_ptr<std::atomic<uint8_t>[]> m_sectionStates;	// SectionState, set by VerifySection
+		uint32_t m_verifyMode = SceneVerify_None;
+		const SceneItemRecord* m_items = nullptr;
+		const SceneItemBounds* m_bounds = nullptr;
+		const char* m_names = nullptr;
+	};
+
+	// Appends the changed and the new sections of a scene file as a journal entry, so saving an edit writes the changed
+	// bytes and a table of contents instead of the whole file. The sections keep their indices, so the records of the
+	// render items, which didn't change, stay valid. A reader, which has the file mapped, sees the entry when it opens
+	// the file again.
+	class SceneJournalWriter
+	{
+	public:
+		bool Open(const char* fileName);
+		// The file before the entry, valid until Commit
+		const SceneFile& GetFile() const { return m_file; }
+		// The data must be alive until Commit
+		void ReplaceSection(uint32_t section, const void* data, uint64_t size, uint32_t compression = SceneCompression_None);
+		void ReplaceSection(uint32_t section, std::vector<uint8_t>&& data);
+		uint32_t AddSection(uint32_t type, const void* data, uint64_t size, uint32_t compression = SceneCompression_None);
+		bool Commit(uint32_t renderItemCount, uint32_t flags);
+
+		uint64_t GetAppendedBytes() const { return m_appendedBytes; }		// after Commit
+		// More than half of the file is replaced sections or the journal is long, the file should be compacted
+		bool ShouldCompact() const;
+
+	private:
+		struct PendingSection
+		{
+			uint32_t Index;
+			uint32_t Compression;
+			const void* Data;
+			uint64_t Size;
+		};
+
+		std::string m_fileName;
+		SceneFile m_file;
+		std::vector<SceneSection> m_toc;
+		std::vector<PendingSection> m_pending;
+		std::vector<std::vector<uint8_t>> m_ownedData;
+		uint64_t m_previousRecord = 0;
+		uint32_t m_journalLength = 0;
+		uint64_t m_appendedBytes = 0;
+		uint64_t m_fileSize = 0;
+		uint64_t m_liveBytes = 0;
+	};
+}
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "DeviceResources.h"
+#include "StringTable.h"
 namespace ExecuteIndirect
 {
 	using namespace DirectX;
@@ -31,8 +32,8 @@ namespace ExecuteIndirect
 
 	struct Material
 	{
-		// Unique material name for lookup.
-		std::string Name;
+		// Unique material name for lookup, in the string table of materials.bin or in the loader's string pool.
+		StringRef Name;
 
 		// Index into constant buffer corresponding to this material.
 		int MatCBIndex = -1;
@@ -42,9 +43,10 @@ namespace ExecuteIndirect
 
 	struct Texture
 	{
-		std::string Name;
-		std::string Filename;
+		StringRef Name;
+		StringRef Filename;
 		UINT index;
+		UINT64 ContentHash = 0;				// hash of the file, used to find copies of the same texture at import
 		Microsoft::WRL::ComPtr<ID3D12Resource> Resource = nullptr;
 		Microsoft::WRL::ComPtr<ID3D12Resource> UploadHeap = nullptr;
 	};
@@ -58,15 +60,35 @@ namespace ExecuteIndirect
 		UINT mCBpadding3;
 	};
 
+	// Only the transform, which is different for every instance, the shaders decode it in Instance.hlsli, the CPU with
+	// the functions of InstancePacking.h. The scale of an empty slot is 0.
 	struct InstanceData {
-		XMFLOAT4X4 World;
-		XMFLOAT4X4 TexTransform;
+		XMFLOAT3 Position;
+		float Scale;
+		XMFLOAT4 Rotation;				// unit quaternion
+	};
+
+	// Constants of a render item, which all of its instances share - a table in the order of the indirect commands,
+	// indexed by the item index of a command
+	struct ItemData {
+		XMFLOAT4X4 TexTransform;		// transposed
 		UINT MaterialIndex;
-		UINT InstancePad0;
-		UINT InstancePad1;
-		UINT InstancePad2;
+		UINT ItemPad0;
+		UINT ItemPad1;
+		UINT ItemPad2;
 	};
 
+	// The world matrix of an instance, the same as the one, which the shaders decode
+	inline XMMATRIX GetInstanceWorldMatrix(const InstanceData& instance)
+	{
+		XMMATRIX world = XMMatrixRotationQuaternion(XMLoadFloat4(&instance.Rotation));
+		world.r[0] = XMVectorScale(world.r[0], instance.Scale);
+		world.r[1] = XMVectorScale(world.r[1], instance.Scale);
+		world.r[2] = XMVectorScale(world.r[2], instance.Scale);
+		world.r[3] = XMVectorSetW(XMLoadFloat3(&instance.Position), 1.0f);
+		return world;
+	}
+
 	struct SceneConstantBuffer
 	{
 		XMFLOAT4X4 viewMatrix;
@@ -79,6 +101,7 @@ namespace ExecuteIndirect
 	};
 
 	// Used to send per-vertex data to the scene vertex shader.
+	// Interleaved vertex, used only while importing the OBJ files
 	struct Vertex
 	{
 		XMFLOAT3 pos;
@@ -88,18 +111,66 @@ namespace ExecuteIndirect
 		
 	};
 
+	// Shading attributes of a vertex - render items keep them in a stream, separate from the positions,
+	// so the position only passes (bounds, occluders, CPU culling) read 12 instead of 44 bytes per vertex
+	struct VertexAttributes
+	{
+		XMFLOAT3 normal;
+		XMFLOAT2 textureCoordinates;
+		XMFLOAT3 tangent;
+	};
+
 	struct ComputeShaderConstants {
 		UINT instanceCount;
 		XMFLOAT3 boundingBoxCenter;
 		XMFLOAT3 boundingBoxExtents;
+		float impostorDistance;			// instances farther than this are appended to the impostor buffer
+		XMFLOAT4 orientedBoxOrientation;
+		XMFLOAT3 orientedBoxCenter;
+		float boundingSphereRadius;
+		XMFLOAT3 orientedBoxExtents;
+		float ComputePad0;
+		XMFLOAT3 boundingSphereCenter;
+		float ComputePad1;
+	};
+
+	#define MaxImpostors 8
+
+	// Per impostor constants, set by the impostor indirect command
+	struct ImpostorConstants {
+		XMFLOAT3 center;
+		float radius;
+		UINT atlasIndex;
+		UINT viewCount;
+		UINT itemIndex;					// in the item table
+		UINT ImpostorPad0;
 	};
 
 	// Data structure to match the command signature used for ExecuteIndirect.
 	struct IndirectCommand
 	{
-		D3D12_VERTEX_BUFFER_VIEW vertexBufferView;
+		D3D12_VERTEX_BUFFER_VIEW positionBufferView;
+		D3D12_VERTEX_BUFFER_VIEW attributeBufferView;
+		D3D12_INDEX_BUFFER_VIEW indexBufferView;
+		D3D12_GPU_VIRTUAL_ADDRESS instancesShaderView;
+		UINT itemIndex;
+		D3D12_DRAW_INDEXED_ARGUMENTS drawArguments;
+	};
+
+	// Data structure to match the command signature used for drawing the occluders in the HiZ buffer - positions only.
+	struct OccluderIndirectCommand
+	{
+		D3D12_VERTEX_BUFFER_VIEW positionBufferView;
 		D3D12_INDEX_BUFFER_VIEW indexBufferView;
 		D3D12_GPU_VIRTUAL_ADDRESS instancesShaderView;
 		D3D12_DRAW_INDEXED_ARGUMENTS drawArguments;
 	};
+
+	// Data structure to match the command signature used for drawing the far instances as impostor quads.
+	struct ImpostorIndirectCommand
+	{
+		D3D12_GPU_VIRTUAL_ADDRESS instancesShaderView;
+		ImpostorConstants constants;
+		D3D12_DRAW_ARGUMENTS drawArguments;
+	};
 }
\ No newline at end of file
@@ -0,0 +1,197 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "SpawnTable.h"
+#include "CounterRandom.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+
+using namespace ExecuteIndirect;
+
+static SpawnEntry MakeEntry(const char* model, std::vector<std::string> parts, uint32_t count, float scale, float heightOffset)
+{
+	SpawnEntry entry;
+	entry.Model = model;
+	entry.Parts = parts;
+	entry.Count = count;
+	entry.MinScale = scale;
+	entry.MaxScale = scale;
+	entry.HeightOffset = heightOffset;
+	return entry;
+}
+
+/// <summary>
+/// Creates the table of the demo scene, used when there is no table file
+/// </summary>
+SpawnTable SpawnTable::CreateDefault()
+{
+	SpawnTable table;
+	table.Add(MakeEntry("fir", { "Branches", "Trunk" }, 2400, 0.05f, 0.0f));
+	table.Add(MakeEntry("complexTree", { "leaf", "bark" }, 10, 2.0f, 0.0f));
+	table.Add(MakeEntry("grass", { "grass" }, 2400, 2.0f, 0.0f));
+	table.Add(MakeEntry("stone", { "Stone" }, 2400, 0.05f, 0.0f));
+	table.Add(MakeEntry("deer", { "Deer_body", "Deer_horns" }, 900, 3.0f, 0.0f));
+	table.Add(MakeEntry("bison", { "Bison" }, 900, 15.0f, 5.0f));
+	table.Add(MakeEntry("tiger", { "Tiger" }, 900, 0.005f, 5.0f));
+	table.Add(MakeEntry("wolf", { "WolfBody", "WolfFur" }, 900, 5.0f, 0.0f));
+	table.Add(MakeEntry("house", { "house" }, 140, 5.0f, 0.0f));
+	table.Add(MakeEntry("farmhouse", { "farmhouse" }, 150, 1.0f, 0.0f));
+	return table;
+}
+
+/// <summary>
+/// Reads a table file, the entries are added to the table
+/// </summary>
+/// <param name="fileName">Name of the file.</param>
+/// <param name="error">The line, which can't be read, empty if the file is missing.</param>
+/// <returns>False if the file is missing or has an invalid line</returns>
+bool SpawnTable::Load(const char* fileName, std::string& error)
+{
+	std::ifstream file(fileName);
+	error.clear();
+	if (!file.is_open())
+		return false;
+	std::string line;
+	for (uint32_t lineNumber = 1; std::getline(file, line); lineNumber++) {
+		line = line.substr(0, line.find('#'));
+		std::istringstream stream(line);
+		std::string model;
+		if (!(stream >> model))
+			continue;
+		bool valid;
+		if (model == "countScale") {
+			valid = (stream >> m_countScale) && m_countScale >= 0.0f;
+		}
+		else if (model == "seed") {
+			valid = (bool)(stream >> m_seed);
+		}
+		else {
+			SpawnEntry entry;
+			entry.Model = model;
+			valid = (stream >> entry.Count >> entry.MinScale >> entry.MaxScale >> entry.HeightOffset) &&
+				entry.MinScale > 0.0f && entry.MinScale <= entry.MaxScale;
+			std::string part;
+			while (stream >> part)
+				entry.Parts.push_back(part);
+			valid = valid && !entry.Parts.empty();
+			if (valid)
+				m_entries.push_back(entry);
+		}
+		if (!valid) {
+			std::ostringstream message;
+			message << fileName << "(" << lineNumber << "): invalid spawn entry \"" << line << "\"";
+			error = message.str();
+			return false;
+		}
+	}
+	return true;
+}
+
+uint32_t SpawnTable::GetCount(const SpawnEntry& entry) const
+{
+	return (uint32_t)std::lround(entry.Count * (double)m_countScale);
+}
+
+uint64_t SpawnTable::GetTotalCount() const
+{
+	uint64_t count = 0;
+	for (auto& entry : m_entries)
+		count += GetCount(entry) * entry.Parts.size();
+	return count;
+}
+
+/// <summary>
+/// Splits the targets in chunks, which the pool's threads and the calling thread take until all are placed
+/// </summary>
+/// <param name="heightfield">The heightfield of the terrain.</param>
+/// <param name="targets">The entries and their instances, allocated by the caller.</param>
+/// <param name="pool">Optional worker pool, the result doesn't depend on it.</param>
+void SpawnTable::Place(const Heightfield& heightfield, const std::vector<SpawnTarget>& targets, WorkerPool* pool) const
+{
+	struct SpawnChunk
+	{
+		uint32_t Target;
+		uint32_t First;
+		uint32_t Count;
+	};
+	struct SpawnWork
+	{
+		std::vector<SpawnChunk> Chunks;
+		std::atomic<size_t> Next;
+		std::atomic<size_t> Done;
+		std::mutex Mutex;
+		std::condition_variable Finished;
+	};
+	const uint32_t ChunkSize = 4096;
+	auto work = std::make_shared<SpawnWork>();
+	work->Next = 0;
+	work->Done = 0;
+	for (uint32_t t = 0; t < targets.size(); t++) {
+		uint32_t count = GetCount(m_entries[targets[t].Entry]);
+		for (uint32_t first = 0; first < count; first += ChunkSize)
+			work->Chunks.push_back({ t, first, std::min(ChunkSize, count - first) });
+	}
+	if (work->Chunks.empty())
+		return;
+
+	//a helper, which starts after the last chunk, returns right away, so only the chunks are waited for
+	const Heightfield* terrain = &heightfield;
+	const std::vector<SpawnTarget>* spawnTargets = &targets;
+	auto runChunks = [this, work, terrain, spawnTargets]() {
+		for (size_t chunk = work->Next++; chunk < work->Chunks.size(); chunk = work->Next++) {
+			const SpawnChunk& spawnChunk = work->Chunks[chunk];
+			PlaceChunk(*terrain, (*spawnTargets)[spawnChunk.Target], spawnChunk.First, spawnChunk.Count);
+			if (++work->Done == work->Chunks.size()) {
+				std::lock_guard<std::mutex> lock(work->Mutex);
+				work->Finished.notify_all();
+			}
+		}
+	};
+	if (pool) {
+		size_t helpers = std::min<size_t>(pool->GetThreadCount(), work->Chunks.size() - 1);
+		for (size_t i = 0; i < helpers; i++)
+			pool->Submit(runChunks);
+	}
+	runChunks();
+	std::unique_lock<std::mutex> lock(work->Mutex);
+	work->Finished.wait(lock, [&work]() { return work->Done == work->Chunks.size(); });
+}
+
+/// <summary>
+/// Places a chunk of a target's instances on the terrain. All parts of the model (e.g. branches and trunk) share
+/// the position and the scale of every instance. A position off the terrain mesh (where the heightfield made the
+/// height up) is drawn again, an instance without a position on the mesh after a few draws is left an empty slot.
+/// </summary>
+/// <param name="heightfield">The heightfield of the terrain.</param>
+/// <param name="target">The entry and its instances.</param>
+/// <param name="first">The first instance of the chunk.</param>
+/// <param name="count">The number of instances.</param>
+void SpawnTable::PlaceChunk(const Heightfield& heightfield, const SpawnTarget& target, uint32_t first, uint32_t count) const
+{
+	const uint32_t MaxPlacementDraws = 32;
+	const SpawnEntry& entry = m_entries[target.Entry];
+	float scaleRange = entry.MaxScale - entry.MinScale;
+	for (uint32_t i = first; i < first + count; i++) {
+		//x and z from the low and the high half of the number, the scale and the next draw from the next numbers of the sequence
+		uint64_t random = CounterRandom(m_seed, target.Entry, i);
+		float scale = entry.MinScale + scaleRange * RandomUnitFloat(SplitMix64(random));
+		SceneInstance instance = {};
+		for (uint32_t draw = 0; draw < MaxPlacementDraws; draw++, random = SplitMix64(SplitMix64(random))) {
+			float x = heightfield.GetMinX() + heightfield.GetSizeX() * RandomUnitFloat(random);
+			float z = heightfield.GetMinZ() + heightfield.GetSizeZ() * RandomUnitFloat(random >> 32);
+			if (!heightfield.IsCovered(x, z))
+				continue;
+			instance.Position[0] = x;
+			instance.Position[1] = heightfield.GetHeight(x, z) + entry.HeightOffset;
+			instance.Position[2] = z;
+			instance.Scale = scale;
+			instance.Rotation[3] = 1.0f;
+			break;
+		}
+		for (SceneInstance* part : target.Parts)
+			part[i] = instance;
+	}
+}
@@ -0,0 +1,63 @@
+#pragma once
+#include "Heightfield.h"
+#include "SceneFile.h"
+#include "WorkerPool.h"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// A model, which the scene generator places on the terrain - all of its parts share the world matrix of an instance
+	struct SpawnEntry
+	{
+		std::string Model;					// for the reports
+		std::vector<std::string> Parts;		// names of the render items
+		uint32_t Count = 0;
+		float MinScale = 1.0f;				// the uniform scale of an instance is random in [MinScale, MaxScale]
+		float MaxScale = 1.0f;
+		float HeightOffset = 0.0f;			// above the terrain
+	};
+
+	// Where the instances of an entry are placed - the first of its instances in every part's instance buffer, each
+	// part has GetCount(entry) instances from there on
+	struct SpawnTarget
+	{
+		uint32_t Entry;						// the index in the entries, the random stream of its instances
+		std::vector<SceneInstance*> Parts;
+	};
+
+	// The models and the instance counts of the generated scene. A table file has one model per line:
+	//   <model> <count> <min scale> <max scale> <height offset> <part> [<part> ...]
+	// '#' starts a comment and a "countScale <factor>" line multiplies every count, e.g. for load tests. A "seed <value>"
+	// line changes the seed of the placement, the same seed places the same instances.
+	class SpawnTable
+	{
+	public:
+		// The models of the demo scene
+		static SpawnTable CreateDefault();
+
+		bool Load(const char* fileName, std::string& error);
+		void Add(const SpawnEntry& entry) { m_entries.push_back(entry); }
+		void SetCountScale(float scale) { m_countScale = scale; }
+		float GetCountScale() const { return m_countScale; }
+		void SetSeed(uint64_t seed) { m_seed = seed; }
+		uint64_t GetSeed() const { return m_seed; }
+
+		const std::vector<SpawnEntry>& GetEntries() const { return m_entries; }
+		// The count of the entry, multiplied by the count scale
+		uint32_t GetCount(const SpawnEntry& entry) const;
+		uint64_t GetTotalCount() const;
+
+		// Places the instances of the targets at random points of the heightfield, in chunks on the pool and the calling
+		// thread. An instance only depends on the seed, its entry and its index, not on the pool.
+		void Place(const Heightfield& heightfield, const std::vector<SpawnTarget>& targets, WorkerPool* pool = nullptr) const;
+
+	private:
+		void PlaceChunk(const Heightfield& heightfield, const SpawnTarget& target, uint32_t first, uint32_t count) const;
+
+		std::vector<SpawnEntry> m_entries;
+		float m_countScale = 1.0f;
+		uint64_t m_seed = 1;
+	};
+}
@@ -0,0 +1,245 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "StartupProfiler.h"
+#include <fstream>
+#include <iomanip>
+#include <map>
+#include <utility>
+
+using namespace ExecuteIndirect;
+
+namespace {
+	//trivial types, so they are usable from operator new before (and after) the thread's dynamic initialization
+	thread_local uint64_t t_allocatedBytes = 0;
+	thread_local uint64_t t_readBytes = 0;
+	thread_local StartupProfiler::ScopeId t_currentScope = StartupProfiler::InvalidScope;
+}
+
+void ExecuteIndirect::CountAllocatedBytes(size_t bytes)
+{
+	t_allocatedBytes += bytes;
+}
+
+void ExecuteIndirect::CountReadBytes(uint64_t bytes)
+{
+	t_readBytes += bytes;
+}
+
+StartupProfiler& StartupProfiler::Get()
+{
+	static StartupProfiler profiler;
+	return profiler;
+}
+
+double StartupProfiler::Elapsed() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+uint32_t StartupProfiler::GetThreadIndexLocked()
+{
+	std::thread::id thread = std::this_thread::get_id();
+	for (uint32_t i = 0; i < m_threads.size(); i++) {
+		if (m_threads[i] == thread)
+			return i;
+	}
+	m_threads.push_back(thread);
+	return (uint32_t)m_threads.size() - 1;
+}
+
+/// <summary>
+/// Starts a new profile, the scopes of the previous one are dropped
+/// </summary>
+/// <param name="rootName">Name of the root scope.</param>
+void StartupProfiler::Start(const char* rootName)
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_scopes.clear();
+		m_threads.clear();
+		m_start = std::chrono::steady_clock::now();
+		m_running = true;
+	}
+	t_currentScope = InvalidScope;
+	BeginScope(rootName);
+}
+
+/// <summary>
+/// Closes the root scope and stops recording. The scopes, which are still open, end here too.
+/// </summary>
+void StartupProfiler::Finish()
+{
+	if (!m_running)
+		return;
+	EndScope(0);
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto& scope : m_scopes) {
+		if (scope.End < 0.0)
+			scope.End = m_scopes[0].End;
+	}
+	m_running = false;
+}
+
+StartupProfiler::ScopeId StartupProfiler::GetCurrentScope()
+{
+	return t_currentScope;
+}
+
+/// <summary>
+/// Opens a scope on the calling thread
+/// </summary>
+/// <param name="name">The name of the phase.</param>
+/// <param name="parent">The parent, if the thread has no open scope.</param>
+/// <returns>The scope, InvalidScope if there is no profile running</returns>
+StartupProfiler::ScopeId StartupProfiler::BeginScope(const char* name, ScopeId parent)
+{
+	if (!m_running)
+		return InvalidScope;
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running)
+		return InvalidScope;
+	Scope scope;
+	scope.Name = name;
+	scope.Thread = GetThreadIndexLocked();
+	//a scope, left open by a previous profile, isn't a parent
+	bool nested = t_currentScope < m_scopes.size() && m_scopes[t_currentScope].Thread == scope.Thread && m_scopes[t_currentScope].End < 0.0;
+	if (nested)
+		scope.Parent = t_currentScope;
+	else if (parent < m_scopes.size())
+		scope.Parent = parent;
+	else
+		scope.Parent = m_scopes.empty() ? InvalidScope : 0;
+	scope.Start = Elapsed();
+	scope.End = -1.0;
+	scope.ReadAtStart = t_readBytes;
+	scope.AllocatedAtStart = t_allocatedBytes;
+	scope.BytesRead = 0;
+	scope.BytesAllocated = 0;
+	m_scopes.push_back(std::move(scope));
+	t_currentScope = (ScopeId)m_scopes.size() - 1;
+	return t_currentScope;
+}
+
+/// <summary>
+/// Closes a scope, it must be called on the thread, which opened it
+/// </summary>
+void StartupProfiler::EndScope(ScopeId id)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	if (!m_running || id >= m_scopes.size() || m_scopes[id].End >= 0.0)
+		return;
+	Scope& scope = m_scopes[id];
+	scope.End = Elapsed();
+	scope.BytesRead = t_readBytes - scope.ReadAtStart;
+	scope.BytesAllocated = t_allocatedBytes - scope.AllocatedAtStart;
+	bool parentOnThread = scope.Parent != InvalidScope && m_scopes[scope.Parent].Thread == scope.Thread;
+	t_currentScope = parentOnThread ? scope.Parent : InvalidScope;
+}
+
+/// <summary>
+/// Merges the scopes with the same name and parent. The rows are in the order of the first scope of each row.
+/// </summary>
+std::vector<StartupProfiler::Row> StartupProfiler::BuildRows() const
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	double now = Elapsed();
+	std::vector<Row> rows;
+	std::vector<int> scopeRows(m_scopes.size());
+	std::map<std::pair<int, std::string>, int> rowIndices;
+	for (size_t i = 0; i < m_scopes.size(); i++) {
+		const Scope& scope = m_scopes[i];
+		int parentRow = scope.Parent == InvalidScope ? -1 : scopeRows[scope.Parent];
+		auto key = std::make_pair(parentRow, scope.Name);
+		auto found = rowIndices.find(key);
+		double end = scope.End < 0.0 ? now : scope.End;
+		if (found == rowIndices.end()) {
+			Row row;
+			row.Name = scope.Name;
+			row.Parent = parentRow;
+			row.Depth = parentRow < 0 ? 0 : rows[parentRow].Depth + 1;
+			row.Count = 0;
+			row.Start = scope.Start;
+			row.End = end;
+			row.Time = 0.0;
+			row.BytesRead = 0;
+			row.BytesAllocated = 0;
+			found = rowIndices.emplace(key, (int)rows.size()).first;
+			rows.push_back(row);
+		}
+		Row& row = rows[found->second];
+		row.Count++;
+		row.End = row.End < end ? end : row.End;
+		row.Time += end - scope.Start;
+		row.BytesRead += scope.BytesRead;
+		row.BytesAllocated += scope.BytesAllocated;
+		scopeRows[i] = found->second;
+	}
+	return rows;
+}
+
+/// <summary>
+/// Writes the phases as a table - the merged scopes have their count after the name, their time is summed
+/// </summary>
+void StartupProfiler::WriteTable(std::ostream& stream) const
+{
+	std::vector<Row> rows = BuildRows();
+	const double MB = 1024.0 * 1024.0;
+	stream << std::fixed << std::setprecision(2);
+	stream << "Startup profile (" << m_threads.size() << " threads)\n";
+	stream << std::left << std::setw(48) << "Phase" << std::right << std::setw(10) << "Start ms" << std::setw(10) << "End ms"
+		<< std::setw(11) << "Time ms" << std::setw(11) << "Read MB" << std::setw(12) << "Alloc MB" << "\n";
+	for (auto& row : rows) {
+		std::string name = std::string(row.Depth * 2, ' ') + row.Name;
+		if (row.Count > 1)
+			name += " x" + std::to_string(row.Count);
+		stream << std::left << std::setw(48) << name << std::right << std::setw(10) << row.Start << std::setw(10) << row.End
+			<< std::setw(11) << row.Time << std::setw(11) << row.BytesRead / MB << std::setw(12) << row.BytesAllocated / MB << "\n";
+	}
+}
+
+/// <summary>
+/// Helper function - writes a JSON string
+/// </summary>
+static void WriteJSONString(std::ostream& stream, const std::string& text)
+{
+	stream << '"';
+	for (char c : text) {
+		if (c == '"' || c == '\\')
+			stream << '\\' << c;
+		else if ((unsigned char)c < 0x20)
+			stream << "\\u" << std::hex << std::setw(4) << std::setfill('0') << (int)c << std::dec << std::setfill(' ');
+		else
+			stream << c;
+	}
+	stream << '"';
+}
+
+/// <summary>
+/// Writes the phases as JSON - the rows of the table, a row's parent is an index in the phases array
+/// </summary>
+void StartupProfiler::WriteJSON(std::ostream& stream) const
+{
+	std::vector<Row> rows = BuildRows();
+	stream << std::fixed << std::setprecision(3);
+	stream << "{\n\t\"threads\": " << m_threads.size() << ",\n\t\"totalMs\": " << (rows.empty() ? 0.0 : rows[0].End) << ",\n\t\"phases\": [";
+	for (size_t i = 0; i < rows.size(); i++) {
+		const Row& row = rows[i];
+		stream << (i ? ",\n\t\t{ " : "\n\t\t{ ") << "\"name\": ";
+		WriteJSONString(stream, row.Name);
+		stream << ", \"parent\": " << row.Parent << ", \"depth\": " << row.Depth << ", \"count\": " << row.Count
+			<< ", \"startMs\": " << row.Start << ", \"endMs\": " << row.End << ", \"timeMs\": " << row.Time
+			<< ", \"bytesRead\": " << row.BytesRead << ", \"bytesAllocated\": " << row.BytesAllocated << " }";
+	}
+	stream << "\n\t]\n}\n";
+}
+
+/// <returns>False if the file can't be written</returns>
+bool StartupProfiler::WriteJSON(const char* fileName) const
+{
+	std::ofstream stream(fileName);
+	if (!stream.is_open())
+		return false;
+	WriteJSON(stream);
+	return stream.good();
+}
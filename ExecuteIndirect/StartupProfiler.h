@@ -0,0 +1,103 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Counted per thread. The allocations are counted by the global operator new (ltalloc.cc), the reads by the file readers.
+	void CountAllocatedBytes(size_t bytes);
+	void CountReadBytes(uint64_t bytes);
+
+	// Named, nested timing scopes of the startup phases. A scope's parent is the innermost open scope of its thread. Work
+	// handed to another thread (a worker) passes the scope it is nested in, otherwise it is nested in the root scope. Every scope records the bytes its thread read
+	// and allocated while it was open, its children on the same thread included. Nothing is recorded outside of a profile.
+	class StartupProfiler
+	{
+	public:
+		typedef uint32_t ScopeId;
+		static const ScopeId InvalidScope = ~0u;
+
+		static StartupProfiler& Get();
+
+		// Starts a profile with an open root scope, Finish closes it and stops recording
+		void Start(const char* rootName);
+		void Finish();
+		bool IsRunning() const { return m_running; }
+
+		ScopeId BeginScope(const char* name, ScopeId parent = InvalidScope);
+		void EndScope(ScopeId id);
+		// The innermost open scope of the calling thread
+		static ScopeId GetCurrentScope();
+
+		// The scopes with the same name and parent are merged in one row
+		void WriteTable(std::ostream& stream) const;
+		void WriteJSON(std::ostream& stream) const;
+		bool WriteJSON(const char* fileName) const;
+
+	private:
+		struct Scope
+		{
+			std::string Name;
+			ScopeId Parent;
+			uint32_t Thread;
+			double Start;					// ms from the start of the profile
+			double End;						// negative while the scope is open
+			uint64_t ReadAtStart;			// the thread's counters, when the scope was opened
+			uint64_t AllocatedAtStart;
+			uint64_t BytesRead;
+			uint64_t BytesAllocated;
+		};
+
+		struct Row
+		{
+			std::string Name;
+			int Parent;
+			uint32_t Depth;
+			uint32_t Count;
+			double Start;
+			double End;
+			double Time;					// summed over the merged scopes
+			uint64_t BytesRead;
+			uint64_t BytesAllocated;
+		};
+
+		StartupProfiler() = default;
+		double Elapsed() const;
+		uint32_t GetThreadIndexLocked();
+		std::vector<Row> BuildRows() const;
+
+		mutable std::mutex m_mutex;
+		std::vector<Scope> m_scopes;
+		std::vector<std::thread::id> m_threads;
+		std::chrono::steady_clock::time_point m_start;
+		std::atomic<bool> m_running{ false };
+	};
+
+	// Opens a scope of the startup profile for its lifetime
+	class ProfileScope
+	{
+	public:
+		explicit ProfileScope(const char* name, StartupProfiler::ScopeId parent = StartupProfiler::InvalidScope) :
+			m_id(StartupProfiler::Get().BeginScope(name, parent)) {}
+		ProfileScope(const ProfileScope&) = delete;
+		ProfileScope& operator=(const ProfileScope&) = delete;
+		~ProfileScope() { End(); }
+
+		void End()
+		{
+			if (m_id != StartupProfiler::InvalidScope)
+				StartupProfiler::Get().EndScope(m_id);
+			m_id = StartupProfiler::InvalidScope;
+		}
+
+	private:
+		StartupProfiler::ScopeId m_id;
+	};
+}
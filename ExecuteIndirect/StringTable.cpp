@@ -0,0 +1,40 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "StringTable.h"
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Stores a copy of the string, unless an equal one is already in the pool
+/// </summary>
+/// <param name="str">The string.</param>
+/// <returns>Reference to the pooled string, valid while the pool is alive</returns>
+StringRef StringPool::Intern(StringRef str)
+{
+	auto existing = m_lookup.find(str);
+	if (existing != m_lookup.end())
+		return *existing;
+	m_strings.emplace_back(str.begin(), str.end());
+	StringRef pooled(m_strings.back());
+	m_lookup.insert(pooled);
+	return pooled;
+}
+
+/// <summary>
+/// Adds a string to the table, unless an equal one is already in it
+/// </summary>
+/// <param name="str">The string.</param>
+/// <returns>The offset of the string in the table</returns>
+uint32_t StringTableBuilder::Add(StringRef str)
+{
+	std::string key = str.str();
+	auto existing = m_offsets.find(key);
+	if (existing != m_offsets.end())
+		return existing->second;
+	uint32_t offset = (uint32_t)m_data.size();
+	m_data.insert(m_data.end(), str.begin(), str.end());
+	m_data.push_back('\0');
+	m_offsets[key] = offset;
+	return offset;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Non owning reference to a '\0' terminated string, which lives in the string table of a mapped file
+	// or in a StringPool (the v140 toolset has no std::string_view)
+	class StringRef
+	{
+	public:
+		StringRef() : m_data(""), m_size(0) {}
+		StringRef(const char* data, uint32_t size) : m_data(data), m_size(size) {}
+		explicit StringRef(const std::string& str) : m_data(str.c_str()), m_size((uint32_t)str.size()) {}
+
+		const char* c_str() const { return m_data; }
+		uint32_t size() const { return m_size; }
+		bool empty() const { return m_size == 0; }
+		const char* begin() const { return m_data; }
+		const char* end() const { return m_data + m_size; }
+		std::string str() const { return std::string(m_data, m_size); }
+
+		bool operator==(const StringRef& other) const { return m_size == other.m_size && memcmp(m_data, other.m_data, m_size) == 0; }
+		bool operator!=(const StringRef& other) const { return !(*this == other); }
+
+	private:
+		const char* m_data;
+		uint32_t m_size;
+	};
+}
+
+namespace std {
+	template<>
+	struct hash<ExecuteIndirect::StringRef>
+	{
+		size_t operator()(const ExecuteIndirect::StringRef& str) const
+		{
+			//FNV-1a
+			uint64_t h = 14695981039346656037ull;
+			for (char c : str) {
+				h ^= (uint8_t)c;
+				h *= 1099511628211ull;
+			}
+			return (size_t)h;
+		}
+	};
+}
+
+namespace ExecuteIndirect {
+
+	// Owns the strings, created at runtime (OBJ import, old file formats). Equal strings are stored once.
+	class StringPool
+	{
+	public:
+		StringRef Intern(StringRef str);
+		StringRef Intern(const std::string& str) { return Intern(StringRef(str)); }
+
+	private:
+		std::deque<std::string>			m_strings;		// the deque doesn't move its elements, so the references stay valid
+		std::unordered_set<StringRef>	m_lookup;
+	};
+
+	// Collects deduplicated '\0' terminated strings for the string table of a binary file
+	class StringTableBuilder
+	{
+	public:
+		uint32_t Add(StringRef str);
+		const std::vector<char>& GetData() const { return m_data; }
+
+	private:
+		std::vector<char>							m_data;
+		std::unordered_map<std::string, uint32_t>	m_offsets;
+	};
+}
@@ -0,0 +1,205 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "TaskGraph.h"
+#include <algorithm>
+#include <cassert>
+#include <iomanip>
+#include <sstream>
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Adds a task
+/// </summary>
+/// <param name="name">The name in the report.</param>
+/// <param name="function">The work.</param>
+/// <param name="dependencies">Tasks, which must finish before this one starts.</param>
+/// <param name="affinity">TaskAffinity.</param>
+/// <returns>The id of the task</returns>
+TaskGraph::TaskId TaskGraph::AddTask(const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies, uint32_t affinity)
+{
+	TaskId id = (TaskId)m_tasks.size();
+	m_tasks.emplace_back();
+	Task& task = m_tasks.back();
+	task.Name = name;
+	task.Function = std::move(function);
+	task.Affinity = affinity;
+	for (TaskId dependency : dependencies)
+		AddDependency(id, dependency);
+	return id;
+}
+
+void TaskGraph::AddDependency(TaskId task, TaskId dependency)
+{
+	assert(dependency < task && "the dependencies must be added before the task");
+	m_tasks[task].Dependencies.push_back(dependency);
+	m_tasks[dependency].Dependents.push_back(task);
+}
+
+double TaskGraph::Elapsed() const
+{
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_start).count();
+}
+
+/// <summary>
+/// Runs the tasks and returns when all of them are done. The calling thread executes the main thread tasks and
+/// waits for the workers in between.
+/// </summary>
+/// <param name="pool">The workers for the free threaded tasks.</param>
+void TaskGraph::Run(WorkerPool& pool)
+{
+	m_start = std::chrono::steady_clock::now();
+	m_profileScope = StartupProfiler::GetCurrentScope();
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_remaining = m_tasks.size();
+	for (auto& task : m_tasks)
+		task.PendingDependencies = task.Dependencies.size();
+	for (TaskId id = 0; id < m_tasks.size(); id++) {
+		if (m_tasks[id].PendingDependencies == 0)
+			ScheduleLocked(id, pool);
+	}
+	while (m_remaining > 0) {
+		if (m_mainQueue.empty()) {
+			m_condition.wait(lock);
+			continue;
+		}
+		//the earliest added task first, so the command list is recorded in a predictable order
+		auto next = std::min_element(m_mainQueue.begin(), m_mainQueue.end());
+		TaskId id = *next;
+		m_mainQueue.erase(next);
+		lock.unlock();
+		Execute(id);
+		lock.lock();
+		CompleteLocked(id, pool);
+	}
+	m_totalTime = Elapsed();
+	if (m_error)
+		std::rethrow_exception(m_error);
+}
+
+/// <summary>
+/// Helper function - runs a task and keeps its first exception
+/// </summary>
+void TaskGraph::Execute(TaskId id)
+{
+	Task& task = m_tasks[id];
+	task.Start = Elapsed();
+	//after a failure the remaining tasks are only completed, so the run ends
+	if (m_failed) {
+		task.Skipped = true;
+	}
+	else {
+		try {
+			//the tasks are phases of the startup profile, nested in the scope, which ran the graph
+			ProfileScope scope(task.Name.c_str(), m_profileScope);
+			task.Function();
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (!m_error)
+				m_error = std::current_exception();
+			m_failed = true;
+		}
+	}
+	task.End = Elapsed();
+}
+
+/// <summary>
+/// Helper function - schedules the dependents, which have no other pending dependencies
+/// </summary>
+void TaskGraph::CompleteLocked(TaskId id, WorkerPool& pool)
+{
+	for (TaskId dependent : m_tasks[id].Dependents) {
+		if (--m_tasks[dependent].PendingDependencies == 0)
+			ScheduleLocked(dependent, pool);
+	}
+	m_remaining--;
+	m_condition.notify_all();
+}
+
+void TaskGraph::ScheduleLocked(TaskId id, WorkerPool& pool)
+{
+	if (m_tasks[id].Affinity == Task_MainThread) {
+		m_mainQueue.push_back(id);
+		m_condition.notify_all();
+		return;
+	}
+	//Run waits for every task, so the graph outlives the worker tasks
+	pool.Submit([this, id, &pool]() {
+		Execute(id);
+		std::lock_guard<std::mutex> lock(m_mutex);
+		CompleteLocked(id, pool);
+	});
+}
+
+/// <summary>
+/// The longest chain of dependent tasks by their durations. With enough threads the run can't be shorter,
+/// so these are the tasks to shorten or split.
+/// </summary>
+std::vector<TaskGraph::TaskId> TaskGraph::GetCriticalPath() const
+{
+	if (m_tasks.empty())
+		return std::vector<TaskId>();
+	//the ids are in a topological order
+	std::vector<double> pathLength(m_tasks.size(), 0.0);
+	std::vector<TaskId> previous(m_tasks.size(), (TaskId)m_tasks.size());
+	TaskId last = 0;
+	for (TaskId id = 0; id < m_tasks.size(); id++) {
+		for (TaskId dependency : m_tasks[id].Dependencies) {
+			if (pathLength[dependency] > pathLength[id] || previous[id] == m_tasks.size()) {
+				pathLength[id] = pathLength[dependency];
+				previous[id] = dependency;
+			}
+		}
+		pathLength[id] += m_tasks[id].End - m_tasks[id].Start;
+		if (pathLength[id] > pathLength[last])
+			last = id;
+	}
+	std::vector<TaskId> path;
+	for (TaskId id = last; id != m_tasks.size(); id = previous[id])
+		path.push_back(id);
+	std::reverse(path.begin(), path.end());
+	return path;
+}
+
+/// <summary>
+/// The wall time, the parallelism, the critical path and the timeline of the last run
+/// </summary>
+std::string TaskGraph::GetReport() const
+{
+	double work = 0.0;
+	size_t nameWidth = 4;
+	for (auto& task : m_tasks) {
+		work += task.End - task.Start;
+		nameWidth = std::max(nameWidth, task.Name.size());
+	}
+	std::vector<TaskId> path = GetCriticalPath();
+	double pathLength = 0.0;
+	for (TaskId id : path)
+		pathLength += m_tasks[id].End - m_tasks[id].Start;
+
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(2);
+	report << "Startup: " << m_tasks.size() << " tasks in " << m_totalTime << " ms, " << work << " ms of work ("
+		<< work / std::max(m_totalTime, 0.001) << "x parallel)\n";
+	report << "Startup critical path: " << pathLength << " ms (" << 100.0 * pathLength / std::max(m_totalTime, 0.001) << "% of the run)\n";
+	for (TaskId id : path) {
+		const Task& task = m_tasks[id];
+		report << "    " << std::left << std::setw(nameWidth) << task.Name << std::right
+			<< std::setw(10) << task.End - task.Start << " ms\n";
+	}
+	//the timeline in the order the tasks started
+	std::vector<TaskId> order(m_tasks.size());
+	for (TaskId id = 0; id < m_tasks.size(); id++)
+		order[id] = id;
+	std::sort(order.begin(), order.end(), [this](TaskId a, TaskId b) { return m_tasks[a].Start < m_tasks[b].Start; });
+	report << "Startup timeline (start, duration, thread):\n";
+	for (TaskId id : order) {
+		const Task& task = m_tasks[id];
+		report << "    " << std::left << std::setw(nameWidth) << task.Name << std::right
+			<< std::setw(10) << task.Start << std::setw(10) << task.End - task.Start << " ms  "
+			<< (task.Affinity == Task_MainThread ? "main" : "worker") << (task.Skipped ? " (skipped)" : "") << "\n";
+	}
+	return report.str();
+}
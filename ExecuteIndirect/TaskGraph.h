@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <initializer_list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "StartupProfiler.h"
+#include "WorkerPool.h"
+
+namespace ExecuteIndirect {
+
+	// Where a task runs. Tasks, which record the shared command list or wait for other work, run on the
+	// thread that runs the graph, one at a time and in the order they were added.
+	enum TaskAffinity : uint32_t
+	{
+		Task_AnyThread = 0,
+		Task_MainThread,
+	};
+
+	// Tasks with explicit dependencies. Run executes every task as soon as its dependencies are done - the free
+	// threaded ones on the worker pool, the rest on the calling thread - and records when each one ran, so the
+	// critical path of the run can be reported.
+	class TaskGraph
+	{
+	public:
+		typedef uint32_t TaskId;
+
+		// The dependencies must be added first, so the ids are in a topological order
+		TaskId AddTask(const char* name, std::function<void()> function, std::initializer_list<TaskId> dependencies = {}, uint32_t affinity = Task_AnyThread);
+		void AddDependency(TaskId task, TaskId dependency);
+		// Rethrows the first exception of a task, the tasks after it are skipped
+		void Run(WorkerPool& pool);
+
+		double GetTotalTime() const { return m_totalTime; }
+		std::vector<TaskId> GetCriticalPath() const;
+		std::string GetReport() const;
+
+	private:
+		struct Task
+		{
+			std::string Name;
+			std::function<void()> Function;
+			std::vector<TaskId> Dependencies;
+			std::vector<TaskId> Dependents;
+			uint32_t Affinity;
+			size_t PendingDependencies = 0;
+			double Start = 0.0;				// ms from the start of the run
+			double End = 0.0;
+			bool Skipped = false;
+		};
+
+		void Execute(TaskId id);
+		void CompleteLocked(TaskId id, WorkerPool& pool);
+		void ScheduleLocked(TaskId id, WorkerPool& pool);
+		double Elapsed() const;
+
+		std::vector<Task> m_tasks;
+		std::mutex m_mutex;
+		std::condition_variable m_condition;
+		std::deque<TaskId> m_mainQueue;
+		size_t m_remaining = 0;
+		std::atomic<bool> m_failed{ false };
+		std::exception_ptr m_error;
+		std::chrono::steady_clock::time_point m_start;
+		double m_totalTime = 0.0;
+		StartupProfiler::ScopeId m_profileScope = StartupProfiler::InvalidScope;
+	};
+}
@@ -1,4 +1,5 @@
 #include "Lighting.hlsli"
+#include "Instance.hlsli"
 
 cbuffer SceneConstantBuffer : register(b0)
 {
@@ -23,18 +24,15 @@ struct MaterialData
 	uint     MatPad2;
 };
 
-struct InstanceData
-{
-	float4x4 World;
-	float4x4 TexTransform;
-	uint materialIndex;
-	uint InstPad0;
-	uint InstPad1;
-	uint InstPad2;
-};
 	
 StructuredBuffer<MaterialData> materials : register(t0);			//Material SRV
 StructuredBuffer<InstanceData> instanceData : register(t1);			//Instance Data SRV
+StructuredBuffer<ItemData> items : register(t2);					//Render item table SRV
+
+cbuffer ItemConstants : register(b2)
+{
+	uint itemIndex;				//set by the indirect command
+};
 
 // Per-vertex data used as input to the vertex shader.
 struct VertexShaderInput
@@ -69,9 +67,10 @@ PixelShaderInput main(VertexShaderInput input, uint instanceID : SV_InstanceID)
 	float4 pos = float4(input.PosL, 1.0f);
 	//Load the current instance data
 	InstanceData instData = instanceData[instanceID];
-	float4x4 worldMatrix = instData.World;
-	float4x4 textureTranform = instData.TexTransform;
-	uint materialIndex = instData.materialIndex;
+	float4x4 worldMatrix = instanceWorld(instData);
+	//the texture transform and the material are the same for all instances of the item
+	ItemData item = items[itemIndex];
+	uint materialIndex = item.materialIndex;
 	//Load object's material data
 	MaterialData matData = materials[materialIndex];
 	output.MatIndex = materialIndex;
@@ -88,7 +87,7 @@ PixelShaderInput main(VertexShaderInput input, uint instanceID : SV_InstanceID)
 	output.PosH = mul(output.PosH, projectionMatrix);
 
 	// Transform texture coordinates 
-	float4 texC = mul(float4(input.TexC, 0.0f, 1.0f), textureTranform);
+	float4 texC = mul(float4(input.TexC, 0.0f, 1.0f), item.TexTransform);
 	output.TexC = mul(texC, matData.MatTransform).xy;
 
 	return output;
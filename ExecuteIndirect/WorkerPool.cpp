@@ -0,0 +1,48 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "WorkerPool.h"
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Starts the worker threads
+/// </summary>
+/// <param name="threadCount">The number of threads, 0 uses one thread per hardware thread.</param>
+WorkerPool::WorkerPool(unsigned threadCount)
+{
+	if (threadCount == 0)
+		threadCount = std::thread::hardware_concurrency() ? std::thread::hardware_concurrency() : 1;
+	for (unsigned i = 0; i < threadCount; i++)
+		m_threads.emplace_back(&WorkerPool::WorkerLoop, this);
+}
+
+/// <summary>
+/// Finishes the queued tasks and joins the threads
+/// </summary>
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+	for (auto& thread : m_threads)
+		thread.join();
+}
+
+void WorkerPool::WorkerLoop()
+{
+	for (;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if (m_tasks.empty())
+				return;
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ExecuteIndirect {
+
+	// Fixed set of worker threads, executing the submitted tasks in FIFO order
+	class WorkerPool
+	{
+	public:
+		explicit WorkerPool(unsigned threadCount = 0);
+		WorkerPool(const WorkerPool&) = delete;
+		WorkerPool& operator=(const WorkerPool&) = delete;
+		~WorkerPool();
+
+		// Queues a task, the future gets its result (or exception)
+		template<typename Function>
+		auto Submit(Function&& function) -> std::future<decltype(function())>
+		{
+			auto task = std::make_shared<std::packaged_task<decltype(function())()>>(std::forward<Function>(function));
+			auto future = task->get_future();
+			{
+				std::lock_guard<std::mutex> lock(m_mutex);
+				m_tasks.push_back([task]() { (*task)(); });
+			}
+			m_condition.notify_one();
+			return future;
+		}
+
+		unsigned GetThreadCount() const { return (unsigned)m_threads.size(); }
+
+	private:
+		void WorkerLoop();
+
+		std::vector<std::thread>			m_threads;
+		std::deque<std::function<void()>>	m_tasks;
+		std::mutex							m_mutex;
+		std::condition_variable				m_condition;
+		bool								m_stopping = false;
+	};
+}
@@ -0,0 +1,448 @@
+#ifdef _WIN32
+#include "pch.h"
+#endif
+#include "WorldPartition.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <unordered_map>
+#include "LZCodec.h"
+
+using namespace ExecuteIndirect;
+
+/// <summary>
+/// Helper function - the instance count of the tiles, which can be resident together, is the capacity of the mirror
+/// </summary>
+static uint32_t GetResidentTilesBound(const WorldPartitionSettings& settings)
+{
+	uint32_t radius = (uint32_t)std::ceil(settings.UnloadRadius / settings.TileSize);
+	return (2 * radius + 1) * (2 * radius + 1);
+}
+
+/// <summary>
+/// Splits the instances in the tiles and compresses every tile
+/// </summary>
+/// <param name="items">The streamed items, their instances are moved out.</param>
+/// <param name="textureBytes">The size of every texture.</param>
+/// <param name="settings">The settings.</param>
+void WorldPartition::Build(std::vector<PartitionItem>& items, const std::vector<uint64_t>& textureBytes, const WorldPartitionSettings& settings)
+{
+	m_settings = settings;
+	m_settings.TileSize = std::max(settings.TileSize, 1.0f);
+	m_settings.UnloadRadius = std::max(settings.UnloadRadius, settings.LoadRadius);
+	m_settings.MaxLoadsInFlight = std::max(settings.MaxLoadsInFlight, 1u);
+	m_textureBytes = textureBytes;
+	m_textureReferences.assign(textureBytes.size(), 0);
+	m_items.clear();
+	m_items.resize(items.size());
+	m_loading.clear();
+	m_resident.clear();
+	m_usedBytes = 0;
+	m_patchItem = 0;
+	m_counters = WorldPartitionStats();
+
+	float minX = 0.0f, minZ = 0.0f, maxX = 0.0f, maxZ = 0.0f;
+	bool first = true;
+	for (auto& item : items) {
+		for (auto& instance : item.Instances) {
+			//an empty slot has no position
+			if (instance.Scale == 0.0f)
+				continue;
+			float x = instance.Position[0], z = instance.Position[2];
+			minX = first ? x : std::min(minX, x);
+			minZ = first ? z : std::min(minZ, z);
+			maxX = first ? x : std::max(maxX, x);
+			maxZ = first ? z : std::max(maxZ, z);
+			first = false;
+		}
+	}
+	m_originX = minX;
+	m_originZ = minZ;
+	m_columns = (uint32_t)((maxX - minX) / m_settings.TileSize) + 1;
+	m_rows = (uint32_t)((maxZ - minZ) / m_settings.TileSize) + 1;
+	m_tiles.clear();
+	m_tiles.resize((size_t)m_columns * m_rows);
+
+	//bucket the instances, a tile has the instances of its items item after item
+	std::vector<std::vector<uint32_t>> tileCounts(items.size());
+	std::vector<std::vector<SceneInstance>> tileInstances(m_tiles.size());
+	for (uint32_t i = 0; i < items.size(); i++) {
+		tileCounts[i].assign(m_tiles.size(), 0);
+		for (auto& instance : items[i].Instances) {
+			if (instance.Scale == 0.0f)
+				continue;
+			uint32_t tile = GetTile(instance.Position[0], instance.Position[2]);
+			if (tileCounts[i][tile]++ == 0) {
+				m_tiles[tile].Items.push_back({ i, 0, (uint32_t)RangeAllocator::InvalidOffset });
+				for (uint32_t texture : items[i].Textures) {
+					if (std::find(m_tiles[tile].Textures.begin(), m_tiles[tile].Textures.end(), texture) == m_tiles[tile].Textures.end())
+						m_tiles[tile].Textures.push_back(texture);
+				}
+			}
+			m_tiles[tile].Items.back().Count++;
+			tileInstances[tile].push_back(instance);
+		}
+	}
+	for (uint32_t i = 0; i < items.size(); i++) {
+		Item& item = m_items[i];
+		item.GeometryBytes = items[i].GeometryBytes;
+		//the most instances the resident tiles can have - the largest tiles of the item, as many as fit in the unload radius
+		std::vector<uint32_t>& counts = tileCounts[i];
+		size_t bound = std::min<size_t>(GetResidentTilesBound(m_settings), counts.size());
+		std::partial_sort(counts.begin(), counts.begin() + bound, counts.end(), std::greater<uint32_t>());
+		uint64_t capacity = 0;
+		for (size_t t = 0; t < bound; t++)
+			capacity += counts[t];
+		capacity = std::min<uint64_t>(capacity, m_settings.MemoryBudget / sizeof(SceneInstance));
+		item.Capacity = (uint32_t)capacity;
+		item.Allocator.Reset(capacity);
+		items[i].Instances.clear();
+		items[i].Instances.shrink_to_fit();
+	}
+
+	//compress the tiles
+	for (size_t t = 0; t < m_tiles.size(); t++) {
+		Tile& tile = m_tiles[t];
+		if (tile.Items.empty())
+			continue;
+		std::vector<SceneInstance>& instances = tileInstances[t];
+		size_t rawSize = instances.size() * sizeof(SceneInstance);
+		const uint8_t* raw = (const uint8_t*)instances.data();
+		tile.RawSize = (uint32_t)rawSize;
+		tile.Blob.resize(LZCompressBound(rawSize));
+		size_t compressedSize = LZCompress(raw, rawSize, tile.Blob.data(), tile.Blob.size());
+		tile.Compressed = compressedSize && compressedSize < rawSize;
+		if (tile.Compressed)
+			tile.Blob.resize(compressedSize);
+		else
+			tile.Blob.assign(raw, raw + rawSize);
+		tile.Blob.shrink_to_fit();
+		std::vector<SceneInstance>().swap(instances);
+		m_counters.TileCount++;
+		m_counters.ColdBytes += tile.Blob.size();
+		m_counters.RawBytes += rawSize;
+	}
+}
+
+/// <returns>The tile, the positions outside of the grid are clamped to the border tiles</returns>
+uint32_t WorldPartition::GetTile(float x, float z) const
+{
+	if (m_tiles.empty())
+		return InvalidTile;
+	float column = std::floor((x - m_originX) / m_settings.TileSize);
+	float row = std::floor((z - m_originZ) / m_settings.TileSize);
+	column = std::min(std::max(column, 0.0f), (float)(m_columns - 1));
+	row = std::min(std::max(row, 0.0f), (float)(m_rows - 1));
+	return (uint32_t)row * m_columns + (uint32_t)column;
+}
+
+/// <returns>The distance on the XZ plane from the origin to the closest point of the tile</returns>
+float WorldPartition::GetTileDistance(uint32_t tile, const float origin[3]) const
+{
+	float x0 = m_originX + (tile % m_columns) * m_settings.TileSize;
+	float z0 = m_originZ + (tile / m_columns) * m_settings.TileSize;
+	float dx = std::max(std::max(x0 - origin[0], origin[0] - x0 - m_settings.TileSize), 0.0f);
+	float dz = std::max(std::max(z0 - origin[2], origin[2] - z0 - m_settings.TileSize), 0.0f);
+	return std::sqrt(dx * dx + dz * dz);
+}
+
+/// <summary>
+/// The memory a tile adds - its instances and the geometry and the textures, which no resident tile references yet
+/// </summary>
+uint64_t WorldPartition::GetCost(const Tile& tile) const
+{
+	uint64_t cost = tile.RawSize;
+	for (auto& tileItem : tile.Items) {
+		if (m_items[tileItem.Item].References == 0)
+			cost += m_items[tileItem.Item].GeometryBytes;
+	}
+	for (uint32_t texture : tile.Textures) {
+		if (m_textureReferences[texture] == 0)
+			cost += m_textureBytes[texture];
+	}
+	return cost;
+}
+
+void WorldPartition::Reference(Tile& tile)
+{
+	m_usedBytes += GetCost(tile);
+	for (auto& tileItem : tile.Items)
+		m_items[tileItem.Item].References++;
+	for (uint32_t texture : tile.Textures)
+		m_textureReferences[texture]++;
+}
+
+void WorldPartition::Release(Tile& tile)
+{
+	for (auto& tileItem : tile.Items)
+		m_items[tileItem.Item].References--;
+	for (uint32_t texture : tile.Textures)
+		m_textureReferences[texture]--;
+	m_usedBytes -= GetCost(tile);
+	tile.State = Tile_Unloaded;
+}
+
+/// <summary>
+/// Copies the loaded instances of a tile to the mirrors
+/// </summary>
+/// <returns>False if an item's mirror has no space for them</returns>
+bool WorldPartition::Commit(uint32_t tileIndex, const std::vector<SceneInstance>& instances)
+{
+	Tile& tile = m_tiles[tileIndex];
+	const SceneInstance* source = instances.data();
+	for (size_t i = 0; i < tile.Items.size(); i++) {
+		TileItem& tileItem = tile.Items[i];
+		Item& item = m_items[tileItem.Item];
+		uint64_t offset = item.Allocator.Allocate(tileItem.Count);
+		if (offset == RangeAllocator::InvalidOffset) {
+			Defragment(tileItem.Item);
+			offset = item.Allocator.Allocate(tileItem.Count);
+		}
+		if (offset == RangeAllocator::InvalidOffset) {
+			//the capacity is clamped by the budget, undo the items of the tile, which were copied already
+			for (size_t j = 0; j < i; j++) {
+				TileItem& copied = tile.Items[j];
+				Item& copiedItem = m_items[copied.Item];
+				std::memset(copiedItem.Mirror + copied.Offset, 0, copied.Count * sizeof(SceneInstance));
+				MarkDirty(copied.Item, copied.Offset, copied.Count);
+				copiedItem.Allocator.Free(copied.Offset);
+				copiedItem.ResidentInstances -= copied.Count;
+				copied.Offset = (uint32_t)RangeAllocator::InvalidOffset;
+			}
+			return false;
+		}
+		tileItem.Offset = (uint32_t)offset;
+		std::memcpy(item.Mirror + tileItem.Offset, source, tileItem.Count * sizeof(SceneInstance));
+		MarkDirty(tileItem.Item, tileItem.Offset, tileItem.Count);
+		item.ResidentInstances += tileItem.Count;
+		source += tileItem.Count;
+	}
+	tile.State = Tile_Resident;
+	m_resident.push_back(tileIndex);
+	m_counters.Loads++;
+	return true;
+}
+
+/// <summary>
+/// Empties the slots of a resident tile and frees its memory
+/// </summary>
+void WorldPartition::Unload(uint32_t tileIndex)
+{
+	Tile& tile = m_tiles[tileIndex];
+	for (auto& tileItem : tile.Items) {
+		Item& item = m_items[tileItem.Item];
+		std::memset(item.Mirror + tileItem.Offset, 0, tileItem.Count * sizeof(SceneInstance));
+		MarkDirty(tileItem.Item, tileItem.Offset, tileItem.Count);
+		item.Allocator.Free(tileItem.Offset);
+		item.ResidentInstances -= tileItem.Count;
+		tileItem.Offset = (uint32_t)RangeAllocator::InvalidOffset;
+	}
+	Release(tile);
+	m_resident.erase(std::find(m_resident.begin(), m_resident.end(), tileIndex));
+	m_counters.Unloads++;
+}
+
+/// <summary>
+/// Compacts an item's mirror, the moved ranges are uploaded again
+/// </summary>
+void WorldPartition::Defragment(uint32_t item)
+{
+	Item& data = m_items[item];
+	std::vector<RangeMove> moves = data.Allocator.Defragment();
+	if (moves.empty())
+		return;
+	//the ranges move towards the start in the order of their offsets, so a move never overwrites a range, which isn't moved yet
+	std::sort(moves.begin(), moves.end(), [](const RangeMove& a, const RangeMove& b) { return a.OldOffset < b.OldOffset; });
+	std::unordered_map<uint32_t, uint32_t> newOffsets;
+	for (auto& move : moves) {
+		std::memmove(data.Mirror + move.NewOffset, data.Mirror + move.OldOffset, (size_t)move.Size * sizeof(SceneInstance));
+		newOffsets[(uint32_t)move.OldOffset] = (uint32_t)move.NewOffset;
+	}
+	uint32_t used = (uint32_t)data.Allocator.GetStats().UsedSize;
+	std::memset(data.Mirror + used, 0, (size_t)(data.Capacity - used) * sizeof(SceneInstance));
+	uint32_t first = (uint32_t)moves.front().NewOffset;
+	MarkDirty(item, first, data.Capacity - first);
+	for (uint32_t tileIndex : m_resident) {
+		for (auto& tileItem : m_tiles[tileIndex].Items) {
+			if (tileItem.Item != item)
+				continue;
+			auto found = newOffsets.find(tileItem.Offset);
+			if (found != newOffsets.end())
+				tileItem.Offset = found->second;
+		}
+	}
+	m_counters.Defragmentations++;
+}
+
+void WorldPartition::MarkDirty(uint32_t item, uint32_t offset, uint32_t count)
+{
+	std::map<uint32_t, uint32_t>& dirty = m_items[item].Dirty;
+	uint32_t end = offset + count;
+	//merge with the ranges, which overlap or touch the new one
+	auto range = dirty.upper_bound(offset);
+	if (range != dirty.begin() && std::prev(range)->second >= offset)
+		range = std::prev(range);
+	while (range != dirty.end() && range->first <= end) {
+		offset = std::min(offset, range->first);
+		end = std::max(end, range->second);
+		range = dirty.erase(range);
+	}
+	dirty.emplace(offset, end);
+}
+
+/// <summary>
+/// Completes the finished loads, unloads the tiles out of range and starts loading the nearest tiles in range
+/// </summary>
+/// <param name="origin">The camera position.</param>
+/// <param name="pool">The pool, which decompresses the tiles.</param>
+void WorldPartition::Update(const float origin[3], WorkerPool& pool)
+{
+	if (m_tiles.empty())
+		return;
+	for (size_t i = 0; i < m_loading.size();) {
+		uint32_t tileIndex = m_loading[i];
+		Tile& tile = m_tiles[tileIndex];
+		if (tile.Load.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+			i++;
+			continue;
+		}
+		m_loading.erase(m_loading.begin() + i);
+		std::vector<SceneInstance> instances;
+		try {
+			instances = tile.Load.get();
+		}
+		catch (...) {
+			instances.clear();
+		}
+		bool inRange = GetTileDistance(tileIndex, origin) <= m_settings.UnloadRadius;
+		if (!inRange || instances.size() * sizeof(SceneInstance) != tile.RawSize || !Commit(tileIndex, instances)) {
+			Release(tile);
+			m_counters.Discarded++;
+		}
+	}
+	for (size_t i = 0; i < m_resident.size();) {
+		if (GetTileDistance(m_resident[i], origin) > m_settings.UnloadRadius)
+			Unload(m_resident[i]);
+		else
+			i++;
+	}
+
+	//the unloaded tiles in range, nearest first
+	std::vector<std::pair<float, uint32_t>> candidates;
+	uint32_t radius = (uint32_t)std::ceil(m_settings.LoadRadius / m_settings.TileSize);
+	uint32_t center = GetTile(origin[0], origin[2]);
+	int32_t centerColumn = (int32_t)(center % m_columns), centerRow = (int32_t)(center / m_columns);
+	int32_t firstColumn = std::max(centerColumn - (int32_t)radius, 0), lastColumn = std::min(centerColumn + (int32_t)radius, (int32_t)m_columns - 1);
+	int32_t firstRow = std::max(centerRow - (int32_t)radius, 0), lastRow = std::min(centerRow + (int32_t)radius, (int32_t)m_rows - 1);
+	for (int32_t row = firstRow; row <= lastRow; row++) {
+		for (int32_t column = firstColumn; column <= lastColumn; column++) {
+			uint32_t tileIndex = (uint32_t)row * m_columns + column;
+			if (m_tiles[tileIndex].State != Tile_Unloaded || m_tiles[tileIndex].Items.empty())
+				continue;
+			float distance = GetTileDistance(tileIndex, origin);
+			if (distance <= m_settings.LoadRadius)
+				candidates.emplace_back(distance, tileIndex);
+		}
+	}
+	std::sort(candidates.begin(), candidates.end());
+	for (auto& candidate : candidates) {
+		if (m_loading.size() >= m_settings.MaxLoadsInFlight)
+			break;
+		Tile& tile = m_tiles[candidate.second];
+		//make room by evicting the resident tiles, which are farther than the new one
+		while (m_usedBytes + GetCost(tile) > m_settings.MemoryBudget) {
+			auto farthest = m_resident.end();
+			float farthestDistance = candidate.first;
+			for (auto resident = m_resident.begin(); resident != m_resident.end(); ++resident) {
+				float distance = GetTileDistance(*resident, origin);
+				if (distance > farthestDistance) {
+					farthest = resident;
+					farthestDistance = distance;
+				}
+			}
+			if (farthest == m_resident.end())
+				break;
+			Unload(*farthest);
+		}
+		//the nearer tiles go first, so a farther tile doesn't take the memory, which a nearer one waits for
+		if (m_usedBytes + GetCost(tile) > m_settings.MemoryBudget)
+			break;
+		Reference(tile);
+		tile.State = Tile_Loading;
+		const Tile* source = &tile;
+		tile.Load = pool.Submit([source]() {
+			std::vector<SceneInstance> instances(source->RawSize / sizeof(SceneInstance));
+			if (!source->Compressed)
+				std::memcpy(instances.data(), source->Blob.data(), source->RawSize);
+			else if (!LZDecompress(source->Blob.data(), source->Blob.size(), (uint8_t*)instances.data(), source->RawSize))
+				instances.clear();
+			return instances;
+		});
+		m_loading.push_back(candidate.second);
+	}
+}
+
+/// <summary>
+/// Loads the tiles in range and waits for them, at startup or after a teleport
+/// </summary>
+void WorldPartition::LoadAll(const float origin[3], WorkerPool& pool)
+{
+	for (;;) {
+		Update(origin, pool);
+		if (m_loading.empty())
+			return;
+		for (uint32_t tileIndex : m_loading)
+			m_tiles[tileIndex].Load.wait();
+	}
+}
+
+/// <summary>
+/// Takes the dirty ranges, the items are visited round robin, so a big item doesn't starve the others
+/// </summary>
+/// <param name="maxInstances">The most instances of the patches.</param>
+/// <param name="patches">Gets the patches.</param>
+/// <returns>The instance count of the patches</returns>
+uint32_t WorldPartition::TakePatches(uint32_t maxInstances, std::vector<InstancePatch>& patches)
+{
+	uint32_t taken = 0;
+	for (uint32_t visited = 0; visited < m_items.size() && taken < maxInstances; visited++) {
+		uint32_t item = (m_patchItem + visited) % (uint32_t)m_items.size();
+		std::map<uint32_t, uint32_t>& dirty = m_items[item].Dirty;
+		while (!dirty.empty() && taken < maxInstances) {
+			auto range = dirty.begin();
+			uint32_t offset = range->first, end = range->second;
+			uint32_t count = std::min(end - offset, maxInstances - taken);
+			patches.push_back({ item, offset, count });
+			taken += count;
+			dirty.erase(range);
+			if (offset + count < end)
+				dirty.emplace(offset + count, end);
+		}
+		if (!dirty.empty())
+			m_patchItem = item;
+		else
+			m_patchItem = (item + 1) % (uint32_t)m_items.size();
+	}
+	return taken;
+}
+
+void WorldPartition::ClearPatches()
+{
+	for (auto& item : m_items)
+		item.Dirty.clear();
+}
+
+WorldPartitionStats WorldPartition::GetStats() const
+{
+	WorldPartitionStats stats = m_counters;
+	stats.ResidentTiles = (uint32_t)m_resident.size();
+	stats.LoadingTiles = (uint32_t)m_loading.size();
+	stats.UsedBytes = m_usedBytes;
+	for (auto& item : m_items) {
+		stats.ResidentInstances += item.ResidentInstances;
+		for (auto& range : item.Dirty)
+			stats.PendingPatchInstances += range.second - range.first;
+	}
+	return stats;
+}
@@ -0,0 +1,151 @@
+#pragma once
+#include <cstdint>
+#include <future>
+#include <map>
+#include <vector>
+#include "RangeAllocator.h"
+#include "SceneFile.h"
+#include "WorkerPool.h"
+
+namespace ExecuteIndirect {
+
+	struct WorldPartitionSettings
+	{
+		float TileSize = 200.0f;
+		float LoadRadius = 400.0f;			// the tiles closer than this are loaded
+		float UnloadRadius = 550.0f;		// and the ones farther than this are unloaded, the gap stops a tile from flickering at the border
+		uint64_t MemoryBudget = 64ull * 1024 * 1024;	// instances, geometry and textures of the resident and loading tiles
+		uint32_t MaxLoadsInFlight = 8;
+		uint32_t MaxPatchInstances = 16384;	// uploaded per frame, the rest waits for the next frames
+	};
+
+	// A streamed render item - its instances are split in the tiles, the geometry and the textures are shared
+	struct PartitionItem
+	{
+		std::vector<SceneInstance> Instances;		// the empty slots (scale 0) are skipped
+		uint64_t GeometryBytes = 0;
+		std::vector<uint32_t> Textures;		// indices in the texture sizes
+	};
+
+	// A range of an item's instance buffer, which changed since it was uploaded
+	struct InstancePatch
+	{
+		uint32_t Item;
+		uint32_t Offset;					// in instances
+		uint32_t Count;
+	};
+
+	struct WorldPartitionStats
+	{
+		uint32_t TileCount = 0;				// tiles with instances
+		uint32_t ResidentTiles = 0;
+		uint32_t LoadingTiles = 0;
+		uint64_t UsedBytes = 0;				// reserved by the resident and the loading tiles
+		uint64_t ColdBytes = 0;				// the compressed tiles
+		uint64_t RawBytes = 0;
+		uint64_t Loads = 0;
+		uint64_t Unloads = 0;
+		uint64_t Discarded = 0;				// finished loads of tiles, which were out of range already
+		uint64_t Defragmentations = 0;
+		uint32_t ResidentInstances = 0;
+		uint32_t PendingPatchInstances = 0;
+	};
+
+	// Splits the instances of the streamed items in square tiles on the XZ plane. A tile keeps its instances compressed
+	// and is decompressed on a worker when the camera gets close. The resident instances of an item live in a fixed size
+	// CPU mirror of its instance buffer, suballocated with a RangeAllocator, and every change of the mirror is recorded
+	// as a dirty range, so only the patches have to be copied to the GPU. Everything but the decompression runs on the
+	// thread, which calls Update.
+	class WorldPartition
+	{
+	public:
+		static const uint32_t InvalidTile = ~0u;
+
+		// Moves the instances out of the items, textureBytes has the size of every texture the items reference
+		void Build(std::vector<PartitionItem>& items, const std::vector<uint64_t>& textureBytes, const WorldPartitionSettings& settings);
+		// Mirror of an item's instance buffer with GetCapacity(item) instances, zeroed by the caller
+		uint32_t GetCapacity(uint32_t item) const { return m_items[item].Capacity; }
+		void SetMirror(uint32_t item, SceneInstance* mirror) { m_items[item].Mirror = mirror; }
+
+		// Completes the finished loads, unloads the far tiles and starts loading the near ones
+		void Update(const float origin[3], WorkerPool& pool);
+		// Updates until every tile in range, which fits in the budget, is resident
+		void LoadAll(const float origin[3], WorkerPool& pool);
+		// Takes up to maxInstances of the dirty ranges, the rest stays for the next call
+		uint32_t TakePatches(uint32_t maxInstances, std::vector<InstancePatch>& patches);
+		void ClearPatches();
+
+		uint32_t GetItemCount() const { return (uint32_t)m_items.size(); }
+		bool IsItemResident(uint32_t item) const { return m_items[item].References > 0; }
+		bool IsTextureResident(uint32_t texture) const { return m_textureReferences[texture] > 0; }
+		uint32_t GetResidentInstances(uint32_t item) const { return m_items[item].ResidentInstances; }
+
+		uint32_t GetTileCount() const { return (uint32_t)m_tiles.size(); }
+		uint32_t GetTile(float x, float z) const;
+		bool IsTileResident(uint32_t tile) const { return m_tiles[tile].State == Tile_Resident; }
+		bool IsTileEmpty(uint32_t tile) const { return m_tiles[tile].Items.empty(); }
+		float GetTileDistance(uint32_t tile, const float origin[3]) const;
+		const WorldPartitionSettings& GetSettings() const { return m_settings; }
+		WorldPartitionStats GetStats() const;
+
+	private:
+		enum TileState : uint32_t
+		{
+			Tile_Unloaded = 0,
+			Tile_Loading,
+			Tile_Resident,
+		};
+
+		struct TileItem
+		{
+			uint32_t Item;
+			uint32_t Count;
+			uint32_t Offset;				// in the item's mirror while the tile is resident
+		};
+
+		struct Tile
+		{
+			std::vector<TileItem> Items;
+			std::vector<uint32_t> Textures;
+			std::vector<uint8_t> Blob;		// the instances of the items in order, LZ compressed if it made them smaller
+			uint32_t RawSize = 0;
+			bool Compressed = false;
+			uint32_t State = Tile_Unloaded;
+			std::future<std::vector<SceneInstance>> Load;
+		};
+
+		struct Item
+		{
+			uint64_t GeometryBytes = 0;
+			uint32_t Capacity = 0;
+			uint32_t References = 0;		// resident and loading tiles, which have instances of the item
+			uint32_t ResidentInstances = 0;
+			SceneInstance* Mirror = nullptr;
+			RangeAllocator Allocator;
+			std::map<uint32_t, uint32_t> Dirty;		// offset -> end, merged
+		};
+
+		uint64_t GetCost(const Tile& tile) const;
+		void Reference(Tile& tile);
+		void Release(Tile& tile);
+		bool Commit(uint32_t tileIndex, const std::vector<SceneInstance>& instances);
+		void Unload(uint32_t tileIndex);
+		void Defragment(uint32_t item);
+		void MarkDirty(uint32_t item, uint32_t offset, uint32_t count);
+
+		WorldPartitionSettings m_settings;
+		float m_originX = 0.0f;
+		float m_originZ = 0.0f;
+		uint32_t m_columns = 0;
+		uint32_t m_rows = 0;
+		std::vector<Tile> m_tiles;			// m_columns * m_rows, row major
+		std::vector<Item> m_items;
+		std::vector<uint64_t> m_textureBytes;
+		std::vector<uint32_t> m_textureReferences;
+		std::vector<uint32_t> m_loading;
+		std::vector<uint32_t> m_resident;
+		uint64_t m_usedBytes = 0;
+		uint32_t m_patchItem = 0;			// TakePatches starts where the last call stopped
+		WorldPartitionStats m_counters;
+	};
+}
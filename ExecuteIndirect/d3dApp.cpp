@@ -2,6 +2,9 @@
 #include "d3dApp.h"
 #include "Camera.h"
 #include "Renderer.h"
+#include "MemoryTracker.h"
+#include "StartupProfiler.h"
+#include <sstream>
 
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -88,8 +91,33 @@ void D3DApp::Update(const GameTimer& gt) {
 
 void D3DApp::Draw(const GameTimer & gt)
 {
+	ProfileScope scope("First frame");
 	m_sceneRenderer->Render();
 	m_deviceResources->Present();
+	scope.End();
+	if (StartupProfiler::Get().IsRunning())
+		ReportStartupProfile();
+}
+
+/// <summary>
+/// Ends the startup profile and reports it, as a table in the debug output and in startup_profile.json. The memory
+/// after the first frame is reported the same way, in memory_report.json.
+/// </summary>
+void D3DApp::ReportStartupProfile()
+{
+	StartupProfiler& profiler = StartupProfiler::Get();
+	profiler.Finish();
+	std::ostringstream table;
+	profiler.WriteTable(table);
+	OutputDebugStringA(table.str().c_str());
+	if (!profiler.WriteJSON("startup_profile.json"))
+		OutputDebugStringA("Startup profile: startup_profile.json can't be written\n");
+	MemoryTracker& memory = MemoryTracker::Get();
+	std::ostringstream memoryTable;
+	memory.WriteTable(memoryTable);
+	OutputDebugStringA(memoryTable.str().c_str());
+	if (!memory.WriteJSON("memory_report.json"))
+		OutputDebugStringA("Memory: memory_report.json can't be written\n");
 }
 
 void D3DApp::OnResize()
@@ -233,12 +261,22 @@ LRESULT D3DApp::MsgProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam)
 
 bool D3DApp::Initialize()
 {
-	if (!InitMainWindow())
-		return false;
-
-	m_deviceResources = std::make_shared<DX::DeviceResources>(mhMainWnd, mClientWidth, mClientHeight);
+	//the profile ends with the first frame
+	StartupProfiler::Get().Start("Startup");
+	{
+		ProfileScope scope("Main window");
+		if (!InitMainWindow())
+			return false;
+	}
+	{
+		ProfileScope scope("Device resources");
+		m_deviceResources = std::make_shared<DX::DeviceResources>(mhMainWnd, mClientWidth, mClientHeight);
+	}
 	m_Camera = std::make_shared<Camera>();
-	m_sceneRenderer = std::unique_ptr<Renderer>(new Renderer(m_deviceResources, m_Camera));
+	{
+		ProfileScope scope("Renderer");
+		m_sceneRenderer = std::unique_ptr<Renderer>(new Renderer(m_deviceResources, m_Camera));
+	}
 	// Do the initial resize code.
 	OnResize();
 	return true;
@@ -306,11 +344,22 @@ void D3DApp::CalculateFrameStats()
 		std::wstring fpsStr = std::to_wstring(fps);
 		std::wstring mspfStr = std::to_wstring(mspf);
 		std::wstring totalInstancesStr = std::to_wstring(m_totalDrawnInstances);
+		//Triangle pre-culling counters of the last frame
+		OccluderCullingStats& occluderStats = m_sceneRenderer->GetOccluderCullingStats();
+		std::wstring occluderStr = std::to_wstring(occluderStats.AcceptedTriangles) + L"/" + std::to_wstring(occluderStats.TotalTriangles) +
+			L" (" + std::to_wstring((int)(occluderStats.GetRejectionRate() * 100.0f)) + L"% rejected, " + std::to_wstring(occluderStats.CullingTime) + L" ms)";
+
+		//Streamed world tiles
+		WorldPartitionStats streamingStats = m_sceneRenderer->GetStreamingStats();
+		std::wstring tilesStr = std::to_wstring(streamingStats.ResidentTiles) + L"/" + std::to_wstring(streamingStats.TileCount) +
+			L" (" + std::to_wstring(streamingStats.UsedBytes / (1024 * 1024)) + L" MB)";
 
 		std::wstring windowText = mMainWndCaption +
 			L"    fps: " + fpsStr +
 			L"   mspf: " + mspfStr +
-			L"   instances: " + totalInstancesStr;
+			L"   instances: " + totalInstancesStr +
+			L"   occluder triangles: " + occluderStr +
+			L"   tiles: " + tilesStr;
 
 		SetWindowText(mhMainWnd, windowText.c_str());
 
@@ -368,6 +417,12 @@ void D3DApp::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState(0x20) & 0x0001)
 		m_sceneRenderer->ChangeCulling();
 
+	if (GetAsyncKeyState('I') & 0x0001)
+		m_sceneRenderer->ChangeImpostors();
+
+	if (GetAsyncKeyState('O') & 0x0001)
+		m_sceneRenderer->ChangeTrianglePreCulling();
+
 }
 
 
@@ -56,6 +56,7 @@ namespace ExecuteIndirect {
 
 		bool InitMainWindow();
 		void CalculateFrameStats();
+		void ReportStartupProfile();
 
 		void OnKeyboardInput(const GameTimer & gt);
 
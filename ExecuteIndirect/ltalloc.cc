@@ -35,8 +35,11 @@ http://ltalloc.googlecode.com/hg/ltalloc.cc
 
 Project URL: http://code.google.com/p/ltalloc
 */
+#ifdef _WIN32
 #include "pch.h"
+#endif
 #include "ltalloc.h"
+#include "StartupProfiler.h"
 
 #define LTALLOC_VERSION "2.0.0" /* (2015/06/16) - ltcalloc(), ltmsize(), ltrealloc(), ltmemalign(), LTALLOC_AUTO_GC_INTERVAL 
 #define LTALLOC_VERSION "1.0.0" /* (2015/06/16) - standard STL allocator provided [see ltalloc.hpp file](ltalloc.hpp)
@@ -656,7 +659,7 @@ CPPCODE(template <bool throw_> static) void *ltmalloc(size_t size)
 	else
 		return fetch_from_central_cache CPPCODE(<throw_>)(size, tc, sizeClass);
 }
-CPPCODE(void *ltmalloc(size_t size) { return ltmalloc<false>(size); })//for possible external usage
+CPPCODE(void *ltmalloc(size_t size) { ExecuteIndirect::CountAllocatedBytes(size); return ltmalloc<false>(size); })//for possible external usage
 
 static void add_batch_to_central_cache(CentralCache *cc, unsigned int sizeClass, FreeBlock *batch)
 {
@@ -933,10 +936,11 @@ void ltsqueeze(size_t padsz)
 }
 
 #if defined(__cplusplus) && !defined(LTALLOC_DISABLE_OPERATOR_NEW_OVERRIDE)
-void *operator new  (size_t size) throw(std::bad_alloc){ return ltmalloc<true>(size); }
-void *operator new  (size_t size, const std::nothrow_t&) throw(){ return ltmalloc<false>(size); }
-void *operator new[](size_t size) throw(std::bad_alloc) {return ltmalloc<true>(size); }
-void *operator new[](size_t size, const std::nothrow_t&) throw() {return ltmalloc<false>(size); }
+//the allocations are counted for the startup profile
+void *operator new  (size_t size) throw(std::bad_alloc){ ExecuteIndirect::CountAllocatedBytes(size); return ltmalloc<true>(size); }
+void *operator new  (size_t size, const std::nothrow_t&) throw(){ ExecuteIndirect::CountAllocatedBytes(size); return ltmalloc<false>(size); }
+void *operator new[](size_t size) throw(std::bad_alloc) { ExecuteIndirect::CountAllocatedBytes(size); return ltmalloc<true>(size); }
+void *operator new[](size_t size, const std::nothrow_t&) throw() { ExecuteIndirect::CountAllocatedBytes(size); return ltmalloc<false>(size); }
 
 void operator delete  (void* p)                        throw() { ltfree(p); }
 void operator delete  (void* p, const std::nothrow_t&) throw() { ltfree(p); }